@@ -0,0 +1,253 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Microbenchmark for the containers in Array.hpp
+//
+// Compares draining a backlog through Array<T> (as Output, Commander and
+// Websocket use it for their queues) with the previous implementation of
+// Array<T>, that reallocated and copied the whole array for every element
+// added or removed, and removing clients from an ObjectArray<T> (by
+// searching it) with removing them from an IntrusiveList<T>. It also checks
+// that the containers keep their elements in order.
+//
+// The results are printed like opengalaxy-bench prints them, one JSON
+// object per line with the fastest and the median of the runs, and the old
+// and the new implementation as separate benchmarks:
+//
+//  {"benchmark":"array_drain_new_10000","ops":10000,"ns_per_op":25.4,"ns_per_op_median":26.0}
+//
+// Built and run by 'make bench'.
+//
+
+#include "atomic.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "Array.hpp"
+
+using namespace openGalaxy;
+
+// The previous implementation of Array<T>::append() and Array<T>::remove()
+template <typename T> class OldArray {
+  int m_nLength = 0;
+  T *m_ptData = nullptr;
+public:
+  ~OldArray() { delete[] m_ptData; }
+  int size() { return m_nLength; }
+  T& operator[]( int nIndex ) { return m_ptData[ nIndex ]; }
+  void append( T tValue ){
+    T *ptData = new T[ m_nLength + 1 ];
+    for( int n = 0; n < m_nLength; n++ ) ptData[ n ] = m_ptData[ n ];
+    ptData[ m_nLength ] = tValue;
+    delete[] m_ptData;
+    m_ptData = ptData;
+    m_nLength += 1;
+  }
+  void remove( int nIndex ){
+    T *ptData = new T[ m_nLength - 1 ];
+    for( int n = 0; n < nIndex; n++ ) ptData[ n ] = m_ptData[ n ];
+    for( int n = nIndex + 1; n < m_nLength; n++ ) ptData[ n - 1 ] = m_ptData[ n ];
+    delete[] m_ptData;
+    m_ptData = ptData;
+    m_nLength -= 1;
+  }
+};
+
+class Message {
+public:
+  int nr;
+  Message( int n ) : nr( n ) {}
+};
+
+class Client : public IntrusiveList<Client>::Node {
+public:
+  int nr;
+  Client( int n ) : nr( n ) {}
+};
+
+static void check( bool ok, const char *what )
+{
+  if( !ok ){
+    fprintf( stderr, "FAILED: %s\n", what );
+    exit( EXIT_FAILURE );
+  }
+}
+
+static const int runs = 5;
+
+static double ms_since( std::chrono::steady_clock::time_point start )
+{
+  return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Runs a benchmark 'runs' times (after a warm up) and prints the result.
+// 'body' does 'ops' operations and returns the time (in ms) they took.
+static void report( const char *name, int n, unsigned long ops, std::function<double()> body )
+{
+  body();
+  std::vector<double> ns;
+  for( int r = 0; r < runs; r++ ) ns.push_back( body() * 1e6 / ops );
+  std::sort( ns.begin(), ns.end() );
+  printf(
+    "{\"benchmark\":\"%s_%d\",\"ops\":%lu,\"ns_per_op\":%.1f,\"ns_per_op_median\":%.1f}\n",
+    name, n, ops, ns[ 0 ], ns[ ns.size() / 2 ]
+  );
+  fflush( stdout );
+}
+
+// Queue 'backlog' messages, then take them from the front until empty
+template <typename Q> static double drain( Q& queue, int backlog )
+{
+  auto start = std::chrono::steady_clock::now();
+  for( int n = 0; n < backlog; n++ ) queue.append( new Message( n ) );
+  for( int n = 0; n < backlog; n++ ){
+    Message *m = queue[ 0 ];
+    check( m->nr == n, "messages drained in order" );
+    delete m;
+    queue.remove( 0 );
+  }
+  check( queue.size() == 0, "queue is empty" );
+  return ms_since( start );
+}
+
+// Keep 'backlog' messages queued while passing 'count' more through the queue
+template <typename Q> static double steady( Q& queue, int backlog, int count )
+{
+  auto start = std::chrono::steady_clock::now();
+  for( int n = 0; n < backlog; n++ ) queue.append( new Message( n ) );
+  for( int n = backlog; n < backlog + count; n++ ){
+    queue.append( new Message( n ) );
+    Message *m = queue[ 0 ];
+    check( m->nr == n - backlog, "messages passed in order" );
+    delete m;
+    queue.remove( 0 );
+  }
+  while( queue.size() ){
+    delete queue[ 0 ];
+    queue.remove( 0 );
+  }
+  return ms_since( start );
+}
+
+// Remove every other client (from the back) by searching the array for it,
+// as Poll did when a client disconnected
+static double remove_from_array( int count )
+{
+  ObjectArray<Client*> array;
+  for( int n = 0; n < count; n++ ) array.append( new Client( n ) );
+  auto start = std::chrono::steady_clock::now();
+  for( int n = count - 1; n >= 0; n -= 2 ){
+    for( int i = 0; i < array.size(); i++ ){
+      if( array[ i ]->nr == n ){
+        array.remove( i );
+        break;
+      }
+    }
+  }
+  double t = ms_since( start );
+  check( array.size() == count / 2, "clients removed from the array" );
+  for( int i = 0; i < array.size(); i++ ) check( array[ i ]->nr == 2 * i, "clients kept in order in the array" );
+  return t;
+}
+
+// Remove the same clients from an intrusive list, as Poll does now
+static double remove_from_list( int count )
+{
+  IntrusiveList<Client> list;
+  std::vector<Client*> clients;
+  for( int n = 0; n < count; n++ ){
+    clients.push_back( new Client( n ) );
+    list.append( clients[ n ] );
+  }
+  auto start = std::chrono::steady_clock::now();
+  for( int n = count - 1; n >= 0; n -= 2 ) list.remove( clients[ n ] );
+  double t = ms_since( start );
+  check( list.size() == count / 2, "clients removed from the list" );
+  int i = 0;
+  for( Client *c = list.first(); c; c = list.next( c ) ) check( c->nr == 2 * i++, "clients kept in order in the list" );
+  return t;
+}
+
+int main()
+{
+  printf( "{\"suite\":\"array-bench\",\"runs\":%d}\n", runs );
+
+  // ops are messages
+  const int backlogs[] = { 1000, 10000, 50000 };
+  for( int backlog : backlogs ){
+    report( "array_drain_old", backlog, backlog, [&]{ OldArray<Message*> queue; return drain( queue, backlog ); } );
+    report( "array_drain_new", backlog, backlog, [&]{ Array<Message*> queue; return drain( queue, backlog ); } );
+  }
+
+  for( int backlog : backlogs ){
+    report( "array_steady_old", backlog, 10000, [&]{ OldArray<Message*> queue; return steady( queue, backlog, 10000 ); } );
+    report( "array_steady_new", backlog, 10000, [&]{ Array<Message*> queue; return steady( queue, backlog, 10000 ); } );
+  }
+
+  // Insert and remove in the middle, compared with a plain model
+  {
+    Array<int> a;
+    OldArray<int> model;
+    for( int n = 0; n < 2000; n++ ){
+      int i = ( n * 7919 ) % ( a.size() + 1 );
+      a.insert( n, i );
+      // (the model only appends, so rebuild it in the same order)
+      OldArray<int> copy;
+      for( int k = 0; k < model.size(); k++ ){
+        if( k == i ) copy.append( n );
+        copy.append( model[ k ] );
+      }
+      if( i == model.size() ) copy.append( n );
+      while( model.size() ) model.remove( 0 );
+      for( int k = 0; k < copy.size(); k++ ) model.append( copy[ k ] );
+      if( n % 3 == 0 ){
+        int r = ( n * 104729 ) % a.size();
+        a.remove( r );
+        model.remove( r );
+      }
+    }
+    check( a.size() == model.size(), "insert/remove keeps the size" );
+    for( int k = 0; k < a.size(); k++ ) check( a[ k ] == model[ k ], "insert/remove keeps the order" );
+  }
+
+  // ops are clients removed
+  for( int count : { 100, 1000, 10000 } ){
+    report( "clients_remove_array", count, count / 2, [&]{ return remove_from_array( count ); } );
+    report( "clients_remove_list", count, count / 2, [&]{ return remove_from_list( count ); } );
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// opengalaxy-bench - Microbenchmarks for the hot paths of the server
+//
+// Times the SIA decoder (on a clean stream and on a stream with parity
+// errors and line noise), the decoding of a single SIA data packet, the
+// JSON encoding and base64 encoding of events, parsing a JSON object, the
+// Array<T> queues, parsing commands for the Commander and re-arming the
+// timers of a TimingWheel. It is linked with
+// the objects of the server and uses an offline openGalaxy context (see
+// context_options::offline), so it needs no configuration file, serial
+// port or free TCP port.
+//
+// Every benchmark does a fixed amount of work on fixed input (the noise is
+// generated with a fixed seed), so the results of two releases or builds
+// can be compared. Each benchmark is run --runs times and the fastest run
+// is reported, as one JSON object per line on stdout:
+//
+//  {"benchmark":"sia_decode_clean","ops":30000,"ns_per_op":812.5,"ns_per_op_median":820.1,"mb_per_s":21.3}
+//
+// The first line describes the suite, the log of the server is discarded
+// unless --log is used. Build and run with 'make bench'.
+//
+
+#include "atomic.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "opengalaxy.hpp"
+#include "json.h"
+#include "ssl_evp.h"
+
+namespace openGalaxy {
+
+class Bench {
+public:
+  Bench(openGalaxy& opengalaxy, int runs, const char *filter);
+  ~Bench();
+  void run();
+
+private:
+  typedef SiaBlock::FunctionCode FunctionCode;
+
+  openGalaxy& m_openGalaxy;
+  int m_runs;
+  const char *m_filter;
+
+  // The bytes of the SIA streams and the blocks they are read in
+  std::vector<unsigned char> m_clean, m_noisy;
+  std::vector<size_t> m_clean_reads, m_noisy_reads;
+  unsigned int m_events;
+
+  // A decoded event, for the encoders
+  SiaEvent *m_event = nullptr;
+
+  // Keeps the compiler from optimizing the work away
+  volatile size_t m_sink = 0;
+
+  void add_block(std::vector<unsigned char>& stream, std::vector<size_t>& reads, FunctionCode fc, const char *message, bool bad_parity);
+  void make_streams();
+  size_t decode(std::vector<unsigned char>& stream, std::vector<size_t>& reads, size_t& events);
+  size_t parse_command(const char *line);
+  void report(const char *name, unsigned long ops, std::function<size_t()> body);
+};
+
+Bench::Bench(openGalaxy& opengalaxy, int runs, const char *filter)
+ : m_openGalaxy(opengalaxy), m_runs(runs), m_filter(filter)
+{
+  make_streams();
+}
+
+Bench::~Bench()
+{
+  if(m_event) delete m_event;
+}
+
+// Appends a SIA block (as the panel sends it) to a stream
+void Bench::add_block(std::vector<unsigned char>& stream, std::vector<size_t>& reads, FunctionCode fc, const char *message, bool bad_parity)
+{
+  SiaBlock sia;
+  size_t len = strlen(message);
+  if(len > (size_t)SiaBlock::datablock_max) len = SiaBlock::datablock_max;
+  sia.block.header.block_length = len;
+  sia.block.header.acknoledge_request = 1;
+  sia.block.function_code = fc;
+  memcpy(sia.block.message, message, len);
+  sia.GenerateParity();
+  if(bad_parity) sia.block.parity ^= 0x5A;
+
+  stream.push_back(sia.block.header.data);
+  stream.push_back((unsigned char)sia.block.function_code);
+  stream.insert(stream.end(), sia.block.message, sia.block.message + len);
+  stream.push_back(sia.block.parity);
+  reads.push_back(len + SiaBlock::block_overhead);
+}
+
+// Generates the events of a busy panel (account, new event and ascii
+// blocks), once as they should arrive and once with 3% of the blocks
+// having a bad parity and 2% of them preceded by a byte of line noise.
+void Bench::make_streams()
+{
+  static const struct {
+    const char *code;
+    const char *ascii;
+    bool zone;
+  } events[] = {
+    { "BA", "+Intruder", true },
+    { "BR", "-Intruder", true },
+    { "CL", "+Closing", false },
+    { "OP", "-Opening", false },
+    { "TA", "+Tamper", true },
+    { "TR", "-Tamper", true }
+  };
+  std::minstd_rand random(1);
+
+  m_events = 10000;
+  for(unsigned int n = 0; n < m_events; n++){
+    int e = n % (sizeof(events) / sizeof(events[0]));
+    int area = 1 + (n / 2) % 32;
+    unsigned int zone = 1001 + (n % 8) + 10 * ((n / 8) % 16);
+    char account[16], event[64], ascii[64];
+    snprintf(account, sizeof account, "%04u", 1234);
+    if(events[e].zone){
+      snprintf(event, sizeof event, "ti%02u:%02u/ri%d/%s%u", (n / 60) % 24, n % 60, area, events[e].code, zone);
+      snprintf(ascii, sizeof ascii, "%s zone %u", events[e].ascii, zone);
+    }
+    else {
+      snprintf(event, sizeof event, "ti%02u:%02u/id%03u/ri%d/%s%d", (n / 60) % 24, n % 60, 1 + n % 99, area, events[e].code, area);
+      snprintf(ascii, sizeof ascii, "%s area %d", events[e].ascii, area);
+    }
+    const struct { FunctionCode fc; const char *message; } blocks[] = {
+      { FunctionCode::account_id, account },
+      { FunctionCode::new_event, event },
+      { FunctionCode::ascii, ascii }
+    };
+    for(auto& b : blocks){
+      add_block(m_clean, m_clean_reads, b.fc, b.message, false);
+      if(random() % 100 < 2){
+        m_noisy.push_back((unsigned char)random());
+        m_noisy_reads.push_back(1);
+      }
+      add_block(m_noisy, m_noisy_reads, b.fc, b.message, random() % 100 < 3);
+    }
+  }
+}
+
+// Feeds a stream to a new SIA decoder, one read at a time (the receiver
+// reads a block at a time as the panel waits for the acknoledge)
+size_t Bench::decode(std::vector<unsigned char>& stream, std::vector<size_t>& reads, size_t& events)
+{
+  SIA sia(m_openGalaxy);
+  sia.SetLevel(3);
+  unsigned char *p = stream.data();
+  events = 0;
+  for(size_t r : reads){
+    SiaEvent *ev = sia.Decode(p, r);
+    if(ev){
+      events++;
+      if(m_event == nullptr) m_event = ev;
+      else delete ev;
+    }
+    p += r;
+  }
+  return stream.size();
+}
+
+// Parses a command line the way Commander::ExecCmd() does,
+// up to the lookup of its action
+size_t Bench::parse_command(const char *line)
+{
+  char buf[256];
+  char *words[6], *rest;
+  size_t length = strlen(line);
+  memcpy(buf, line, length + 1);
+  if(Commander::Tokenize(buf, words, 6, &rest) == 0) return 0;
+  Commander::command_t *c = Commander::commands_table.find(words[0]);
+  const void *action = nullptr;
+  switch(c->index){
+    case Commander::cmd::area:
+      action = Commander::area_actions_table.find(words[2]);
+      break;
+    case Commander::cmd::zone:
+      action = Commander::zone_actions_table.find(words[2]);
+      break;
+    case Commander::cmd::zones:
+      action = Commander::zones_actions_table.find(words[1]);
+      break;
+    case Commander::cmd::output:
+      action = Commander::output_actions_table.find(words[2]);
+      break;
+    case Commander::cmd::poll:
+      action = Commander::poll_actions_table.find(words[1]);
+      if(words[2]) action = Commander::poll_items_table.find(words[2]);
+      break;
+    case Commander::cmd::code_alarm:
+      action = Commander::code_alarm_modules_table.find(words[1]);
+      break;
+    default:
+      break;
+  }
+  return (size_t)c + (size_t)action;
+}
+
+// Runs a benchmark 'm_runs' times (after a warm up) and prints the result.
+// 'body' does 'ops' operations and returns the number of bytes processed.
+void Bench::report(const char *name, unsigned long ops, std::function<size_t()> body)
+{
+  using namespace std::chrono;
+  if(m_filter && strstr(name, m_filter) == nullptr) return;
+
+  size_t bytes = body();
+  std::vector<double> ns;
+  for(int r = 0; r < m_runs; r++){
+    steady_clock::time_point start = steady_clock::now();
+    bytes = body();
+    ns.push_back(duration<double,std::nano>(steady_clock::now() - start).count() / ops);
+  }
+  std::sort(ns.begin(), ns.end());
+
+  printf(
+    "{\"benchmark\":\"%s\",\"ops\":%lu,\"ns_per_op\":%.1f,\"ns_per_op_median\":%.1f",
+    name, ops, ns[0], ns[ns.size() / 2]
+  );
+  if(bytes) printf(",\"mb_per_s\":%.2f", (bytes / (double)ops) * 1000.0 / ns[0]);
+  printf("}\n");
+  fflush(stdout);
+}
+
+void Bench::run()
+{
+  size_t events;
+
+  printf(
+    "{\"suite\":\"opengalaxy-bench\",\"version\":\"%s\",\"runs\":%d,\"events\":%u,\"noisy_bytes\":%lu}\n",
+    VERSION, m_runs, m_events, (unsigned long)m_noisy.size()
+  );
+
+  // SIA::Decode(), ops are events
+  report("sia_decode_clean", m_events, [&]{
+    size_t bytes = decode(m_clean, m_clean_reads, events);
+    if(events != m_events) throw new std::runtime_error("sia_decode_clean: events were lost");
+    return bytes;
+  });
+  report("sia_decode_noisy", m_events, [&]{ return decode(m_noisy, m_noisy_reads, events); });
+  if(m_event == nullptr) decode(m_clean, m_clean_reads, events);
+
+  // SIA::DecodePacket(), ops are packets
+  {
+    const char *list[] = { "ti12:34", "da10-19-26", "ri12", "id007", "BA1001", "CL12", "OP3", "TA1112*2ZN" };
+    std::vector<std::string> packets(list, list + sizeof(list) / sizeof(list[0]));
+    SIA sia(m_openGalaxy);
+    report("sia_decode_packet", 100000, [&]{
+      size_t n = 0;
+      for(int i = 0; i < 100000; i++){
+        std::string& packet = packets[i % packets.size()];
+        n += sia.DecodePacket(packet) ? packet.size() : 0;
+      }
+      return n;
+    });
+  }
+
+  // Output::json_encode() and ssl_base64_encode() of a decoded event
+  report("output_json_encode", 50000, [&]{
+    size_t n = 0;
+    for(int i = 0; i < 50000; i++){
+      std::stringstream json;
+      m_openGalaxy.output().json_encode(json, *m_event);
+      n += json.tellp();
+    }
+    return n;
+  });
+  report("ssl_base64_encode", 100000, [&]{
+    size_t n = 0;
+    for(int i = 0; i < 100000; i++){
+      char *b64;
+      size_t len;
+      if(ssl_base64_encode(m_event->raw.block.data, SiaBlock::block_max, &b64, &len)){
+        ssl_free(b64);
+        n += SiaBlock::block_max;
+      }
+    }
+    return n;
+  });
+
+  // json_parse_objects() on a certificates package (as uploaded by opengalaxy-ca)
+  {
+    std::string b64;
+    std::minstd_rand random(2);
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for(int i = 0; i < 1024; i++) b64.push_back(alphabet[random() % 64]);
+    std::string package =
+      "{\"sig\":\"" + b64.substr(0, 344) + "\",\"rsa\":\"" + b64.substr(344, 344) + "\","
+      "\"aes\":\"" + b64 + "\",\"mode\":1,\"keysize\":256,\"mdsize\":32,"
+      "\"options\":{\"list\":[1,2,3,true,false,null],\"name\":\"opengalaxy\"}}";
+    report("json_parse_objects", 20000, [&]{
+      size_t n = 0;
+      for(int i = 0; i < 20000; i++){
+        json_object *o = json_parse_objects(package.c_str());
+        if(o){
+          json_free_objects(o);
+          n += package.size();
+        }
+      }
+      return n;
+    });
+  }
+
+  // Array<T> as a FIFO (the queues of Output, Commander and Websocket),
+  // ops are messages passed through a queue that holds a backlog
+  for(int backlog : { 10, 10000 }){
+    char name[64];
+    snprintf(name, sizeof name, "array_fifo_backlog_%d", backlog);
+    report(name, 1000000, [&]{
+      Array<size_t> queue;
+      size_t n = 0;
+      for(int i = 0; i < backlog; i++) queue.append(i);
+      for(int i = 0; i < 1000000; i++){
+        queue.append(backlog + i);
+        n += queue[0];
+        queue.remove(0);
+      }
+      m_sink = n;
+      return 0;
+    });
+  }
+
+  // Commander command parsing, ops are command lines
+  {
+    const char *lines[] = {
+      "AREA 1 SET", "area 12 unset", "AREA 0 STATE", "ZONE 1001 OMIT", "zone 1112 state",
+      "ZONES READY", "OUTPUT 1 ON", "output 0 off", "POLL ON AREAS", "poll once all",
+      "CODE-ALARM TELECOM", "STATS RESET", "HELP", "BOGUS COMMAND"
+    };
+    const int count = sizeof(lines) / sizeof(lines[0]);
+    report("commander_parse", 200000, [&]{
+      size_t n = 0;
+      for(int i = 0; i < 200000; i++) n += parse_command(lines[i % count]);
+      m_sink = n;
+      return 0;
+    });
+  }
+
+  // TimingWheel::arm() of a timer that is already armed (as for each
+  // request of a session), with 10000 other timers (sessions) armed,
+  // ops are timers re-armed
+  {
+    const int count = 10000;
+    std::vector<TimingWheel::Timer> timers(count);
+    TimingWheel wheel;
+    for(int i = 0; i < count; i++) wheel.arm(timers[i], 1000 + i * 60);
+    report("timingwheel_rearm_10000", 1000000, [&]{
+      for(int i = 0; i < 1000000; i++) wheel.arm(timers[(unsigned)i * 7919u % count], 300000 + i % 60000);
+      m_sink = wheel.size();
+      return 0;
+    });
+  }
+}
+
+} // ends namespace openGalaxy
+
+
+static struct option cmd_line_options[] = {
+  { "help",      no_argument,       nullptr, 'h' },
+  { "runs",      required_argument, nullptr, 'r' },
+  { "benchmark", required_argument, nullptr, 'b' },
+  { "log",       required_argument, nullptr, 'l' },
+  { NULL, 0, 0, 0 }
+};
+
+static const char* synopsis =
+  "\n"
+  "Synopsis: opengalaxy-bench [options]\n"
+  "\n"
+  " -h or --help\t\t\tPrints this help text and exit.\n"
+  " -r or --runs <n>\t\tRun every benchmark n times (default 5).\n"
+  " -b or --benchmark <name>\tOnly run the benchmarks with name in their name.\n"
+  " -l or --log <file>\t\tWrite the log of the server to this file.\n"
+  "\n";
+
+int main(int argc, char *argv[])
+{
+  using namespace openGalaxy;
+
+  int runs = 5;
+  const char *filter = nullptr;
+  const char *log = nullptr;
+  int n, opt_index;
+  while((n = getopt_long(argc, argv, "hr:b:l:", cmd_line_options, &opt_index)) >= 0){
+    switch(n){
+      case 'r': runs = atoi(optarg); break;
+      case 'b': filter = optarg; break;
+      case 'l': log = optarg; break;
+      default:
+        printf("%s", synopsis);
+        return (n == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if(runs < 1) runs = 1;
+
+  // The server logs to std::cout, keep it out of the results
+  std::ofstream logfile;
+  std::streambuf *cout_buf = std::cout.rdbuf();
+  if(log){
+    logfile.open(log);
+    std::cout.rdbuf(logfile.rdbuf());
+  }
+  else {
+    std::cout.rdbuf(nullptr);
+  }
+
+  int retv = EXIT_SUCCESS;
+  context_options options;
+  options.offline = 1;
+  options.no_ssl = 1;
+  class openGalaxy *opengalaxy = nullptr;
+  try {
+    opengalaxy = new class openGalaxy(options);
+    opengalaxy->syslog().set_level(Syslog::Level::Error);
+    Bench bench(*opengalaxy, runs, filter);
+    bench.run();
+  }
+  catch(std::runtime_error* ex){
+    fprintf(stderr, "opengalaxy-bench: %s\n", ex->what());
+    retv = EXIT_FAILURE;
+  }
+  delete opengalaxy;
+
+  std::cout.rdbuf(cout_buf);
+  std::cout.clear();
+  return retv;
+}
@@ -81,6 +81,10 @@ static int TimeoutGetAlarmStatus_AllreadyWaiting = 0;  // allready waiting for a
 
 static int TimeoutGetArmedStatus_AllreadyWaiting = 0;  // allready waiting for armed status when nonzero
 
+// Used by cbArea_Grid_JSON_POLL_REPLY() to apply POLL DELTA replies
+static int area_have_state = 0;              // nonzero when we have the full ready state
+static unsigned int area_state_version = 0;  // stateVersion of the last applied reply
+
 
 //
 // Called in response to 'area 0 alarm' executed by:
@@ -161,8 +165,10 @@ static void cbArea_Grid_OnlineNotify( void )
   Websocket_SendCommand( "AREA 0 STATE" ); // get armed state
   Websocket_SendCommand( "AREA 0 ALARM" ); // get ready or alarm state (depending on firmware version)
 
-  // Start polling the areas 'ready' states
+  // Start polling the areas 'ready' states, receiving only the changes
+  area_have_state = 0;
   Websocket_SendCommand( "POLL ADD AREAS" );
+  Websocket_SendCommand( "POLL DELTA" );
   Websocket_SendCommand( "POLL ON 20" );
 }
 
@@ -173,6 +179,8 @@ static void cbArea_Grid_OnlineNotify( void )
 //
 static void cbArea_Grid_OfflineNotify( void )
 {
+  area_have_state = 0;
+
   // Set all areas status to UNKNOWN
   for( int t = 0; t < 32; t++ ){
     areas[t].armed = area_armed_state_unknown;
@@ -184,55 +192,83 @@ static void cbArea_Grid_OfflineNotify( void )
 }
 
 
+//
+// Sets the ready state of area t (0-31) as received with a JSON_POLL_REPLY
+//
+static void Area_Grid_SetReadyState( int t, unsigned char state )
+{
+  areas[t].ready = state;
+  switch( state ){
+    case area_ready_state_set:
+      areas[t].ready = area_ready_state_set;                  // Set the new current ready state.
+      if( areas[t].armed != area_armed_state_set ){           // Does it match with what we know about armed status?
+        areas[t].armed = area_armed_state_set;                // If not update it.
+        Area_Grid_UiSetArmedStatus( t + 1, AREA_ARMED_YES );  // And for the UI
+      }
+      if( areas[t].alarm == area_alarm_state_normal ){
+        Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_NORMAL );
+      }
+      break;
+    case area_ready_state_partial:
+      areas[t].ready = area_ready_state_partial;                  // Set the new current ready state.
+      if( areas[t].armed != area_armed_state_partial ){           // Does it match with what we know about armed status?
+        areas[t].armed = area_armed_state_partial;                // If not update it.
+        Area_Grid_UiSetArmedStatus( t + 1, AREA_ARMED_PARTIAL );  // And for the UI
+      }
+      if( areas[t].alarm == area_alarm_state_normal ){
+        Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_NORMAL );
+      }
+      break;
+    case area_ready_state_ready:
+      areas[t].ready = area_ready_state_ready;
+      if( areas[t].alarm == area_alarm_state_normal ){
+        Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_READY );
+      }
+      break;
+    case area_ready_state_locked:
+      areas[t].ready = area_ready_state_locked;
+      // fixme: Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_LOCKED );
+      break;
+    case area_ready_state_unset:
+    default:
+      areas[t].ready = state;
+      if( areas[t].alarm == area_alarm_state_normal ){
+        Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_NOT_READY );
+      }
+      break;
+  }
+}
+
+
 //
 // Registered as commander_callback for JSON_POLL_REPLY
 // Called whenever a JSON data block with typeId JSON_POLL_REPLY was received
 //
+// With POLL DELTA the server sends the ready state of all areas once
+// (and every now and then), after that only the areas that changed.
+// When a change was missed the full state is requested again.
+//
 static void cbArea_Grid_JSON_POLL_REPLY( struct commander_reply_t *ev )
 {
   if( ev->haveAreaState ){
     for( int t = 0; t < 32; t++ ){
-      areas[t].ready = ev->areaStates[t];
-      switch( ev->areaStates[t] ){
-        case area_ready_state_set:
-          areas[t].ready = area_ready_state_set;                  // Set the new current ready state.
-          if( areas[t].armed != area_armed_state_set ){           // Does it match with what we know about armed status?
-            areas[t].armed = area_armed_state_set;                // If not update it.
-            Area_Grid_UiSetArmedStatus( t + 1, AREA_ARMED_YES );  // And for the UI
-          }
-          if( areas[t].alarm == area_alarm_state_normal ){
-            Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_NORMAL );
-          }
-          break;
-        case area_ready_state_partial:
-          areas[t].ready = area_ready_state_partial;                  // Set the new current ready state.
-          if( areas[t].armed != area_armed_state_partial ){           // Does it match with what we know about armed status?
-            areas[t].armed = area_armed_state_partial;                // If not update it.
-            Area_Grid_UiSetArmedStatus( t + 1, AREA_ARMED_PARTIAL );  // And for the UI
-          }
-          if( areas[t].alarm == area_alarm_state_normal ){
-            Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_NORMAL );
-          }
-          break;
-        case area_ready_state_ready:
-          areas[t].ready = area_ready_state_ready;
-          if( areas[t].alarm == area_alarm_state_normal ){
-            Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_READY );
-          }
-          break;
-        case area_ready_state_locked:
-          areas[t].ready = area_ready_state_locked;
-          // fixme: Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_LOCKED );
-          break;
-        case area_ready_state_unset:
-        default:
-          areas[t].ready = ev->areaStates[t];
-          if( areas[t].alarm == area_alarm_state_normal ){
-            Area_Grid_UiSetAlarmStatus( t + 1, AREA_STATUS_NOT_READY );
-          }
-          break;
+      Area_Grid_SetReadyState( t, ev->areaStates[t] );
+    }
+    area_state_version = ev->stateVersion;
+    area_have_state = 1;
+  }
+  else if( ev->areaDeltaCount > 0 ){
+    if( area_have_state == 0 || ev->stateVersion != area_state_version + 1 ){
+      area_have_state = 0;
+      Websocket_SendCommand( "POLL DELTA" );
+      return;
+    }
+    for( int t = 0; t + 1 < ev->areaDeltaCount; t += 2 ){
+      if( ev->areaDelta[t] < 32 ){
+        Area_Grid_SetReadyState( ev->areaDelta[t], ev->areaDelta[t + 1] );
       }
-    }    
+    }
+    area_state_version = ev->stateVersion;
   }
 }
 
@@ -0,0 +1,217 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Functions to decode the frames received from the
+ *   server when using the openGalaxy-binary-protocol.
+ */
+
+#include "atomic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "commander.h"
+#include "broadcast.h"
+#include "binary-decode.h"
+
+//
+// Returns a '\0' terminated copy of a string field
+//
+static char *bin_strdup( const unsigned char *s, size_t len )
+{
+  char *retv = malloc( len + 1 );
+  if( retv != NULL ){
+    memcpy( retv, s, len );
+    retv[len] = '\0';
+  }
+  return retv;
+}
+
+//
+// Returns a base64 encoded copy of a string field (the raw SIA block)
+//
+static char *bin_base64( const unsigned char *s, size_t len )
+{
+  gchar *b64 = g_base64_encode( s, len );
+  char *retv = ( b64 ) ? strdup( b64 ) : NULL;
+  g_free( b64 );
+  return retv;
+}
+
+// returns 0 for success, -1 on error
+// sets sref and cref to new struct or NULL
+int BIN_ParseOpenGalaxyWebsocketFrame( struct sia_event_t **sref, struct commander_reply_t **cref, const unsigned char *frame, size_t len )
+{
+  size_t pos = 1, flen, t;
+  int tag, id, have_sia = 0;
+  unsigned int value = 0;
+  const unsigned char *data = NULL;
+  char **str = NULL;
+  struct sia_event_t *s = NULL;
+  struct commander_reply_t *c = NULL;
+
+  if( ( sref == NULL ) || ( cref == NULL ) || ( frame == NULL ) || ( len < 1 ) ) return -1;
+  *sref = NULL;
+  *cref = NULL;
+
+  if( frame[0] >= BIN_TYPE_BATCH ) return -1;
+
+  c = malloc( sizeof( struct commander_reply_t ) );
+  if( c == NULL ){
+    return -1;
+  }
+  memset( c, 0, sizeof( struct commander_reply_t ) );
+
+  s = malloc( sizeof( struct sia_event_t ) );
+  if( s == NULL ){
+    free( c );
+    return -1;
+  }
+  memset( s, 0, sizeof( struct sia_event_t ) );
+
+  c->typeId = frame[0];
+
+  while( pos < len ){
+    tag = frame[pos++];
+    id = BIN_TAG_ID( tag );
+
+    // Get the value or the location and length of the data
+    switch( BIN_TAG_KIND( tag ) ){
+      case BIN_KIND_BYTE:
+        if( pos + 1 > len ) goto error;
+        value = frame[pos];
+        flen = 1;
+        break;
+      case BIN_KIND_UINT:
+        if( pos + 4 > len ) goto error;
+        value = bin_get_u32( &frame[pos] );
+        flen = 4;
+        break;
+      case BIN_KIND_STRING:
+        if( pos + 2 > len ) goto error;
+        value = bin_get_u16( &frame[pos] );
+        data = &frame[pos + 2];
+        flen = 2 + value;
+        break;
+      default: // BIN_KIND_ARRAY
+        if( pos + 1 > len ) goto error;
+        value = frame[pos];
+        data = &frame[pos + 1];
+        flen = 1 + value;
+        break;
+    }
+    if( pos + flen > len ) goto error;
+    pos += flen;
+
+    if( BIN_TAG_KIND( tag ) == BIN_KIND_ARRAY ){
+      unsigned char *dest;
+      size_t max;
+      int *count = NULL;
+      switch( id ){
+        case BIN_FIELD_AREASTATE:   dest = c->areaStates;   max = sizeof( c->areaStates );   break;
+        case BIN_FIELD_ZONESTATE:   dest = c->zoneStates;   max = sizeof( c->zoneStates );   break;
+        case BIN_FIELD_OUTPUTSTATE: dest = c->outputStates; max = sizeof( c->outputStates ); break;
+        case BIN_FIELD_AREADELTA:   dest = c->areaDelta;    max = sizeof( c->areaDelta );    count = &c->areaDeltaCount;   break;
+        case BIN_FIELD_ZONEDELTA:   dest = c->zoneDelta;    max = sizeof( c->zoneDelta );    count = &c->zoneDeltaCount;   break;
+        case BIN_FIELD_OUTPUTDELTA: dest = c->outputDelta;  max = sizeof( c->outputDelta );  count = &c->outputDeltaCount; break;
+        default: goto error;
+      }
+      for( t = 0; t < value && t < max; t++ ) dest[t] = data[t];
+      if( count ) *count = t;
+      continue;
+    }
+
+    if( BIN_TAG_KIND( tag ) == BIN_KIND_STRING ){
+      switch( id ){
+        case BIN_FIELD_TYPEDESC:         str = &c->typeDesc; break;
+        case BIN_FIELD_COMMAND:          str = &c->command; break;
+        case BIN_FIELD_REPLYTEXT:
+        case BIN_FIELD_HELPTEXT:         str = &c->text; break;
+        case BIN_FIELD_EVENTCODE:        str = &s->EventCode; break;
+        case BIN_FIELD_EVENTNAME:        str = &s->EventName; break;
+        case BIN_FIELD_EVENTDESC:        str = &s->EventDesc; break;
+        case BIN_FIELD_EVENTADDRESSTYPE: str = &s->EventAddressType; break;
+        case BIN_FIELD_DATE:             str = &s->Date; break;
+        case BIN_FIELD_TIME:             str = &s->Time; break;
+        case BIN_FIELD_ASCII:            str = &s->ASCII; s->have_ASCII = 1; break;
+        case BIN_FIELD_RAW:              str = &s->Raw; break;
+        default: goto error;
+      }
+      if( *str ) free( *str );
+      *str = ( id == BIN_FIELD_RAW ) ? bin_base64( data, value ) : bin_strdup( data, value );
+      if( id >= BIN_FIELD_ACCOUNTID ) have_sia = 1;
+      continue;
+    }
+
+    // Numerical values (BIN_KIND_BYTE or BIN_KIND_UINT)
+    if( id >= BIN_FIELD_ACCOUNTID ) have_sia = 1;
+    switch( id ){
+      case BIN_FIELD_SUCCESS:            c->success = value; break;
+      case BIN_FIELD_AREASTATE:          c->areaState = value; break;
+      case BIN_FIELD_ZONENUMBER:         c->zoneNumber = value; break;
+      case BIN_FIELD_OMITSTATE:          c->omitState = value; break;
+      case BIN_FIELD_ZONESTATE:          c->zoneState = value; break;
+      case BIN_FIELD_PANELISONLINE:      c->panelIsOnline = value; break;
+      case BIN_FIELD_HAVEAREASTATE:      c->haveAreaState = value; break;
+      case BIN_FIELD_HAVEZONESTATE:      c->haveZoneState = value; break;
+      case BIN_FIELD_HAVEOUTPUTSTATE:    c->haveOutputState = value; break;
+      case BIN_FIELD_SEQ:                s->seq = value; break;
+      case BIN_FIELD_STATEVERSION:       c->stateVersion = value; break;
+      case BIN_FIELD_KEYFRAME:           c->keyframe = value; break;
+      case BIN_FIELD_ACCOUNTID:          s->AccountID = value; break;
+      case BIN_FIELD_EVENTADDRESSNUMBER: s->EventAddressNumber = value; s->have_EventAddressNumber = 1; break;
+      case BIN_FIELD_SUBSCRIBERID:       s->SubscriberID = value; s->have_SubscriberID = 1; break;
+      case BIN_FIELD_AREAID:             s->AreaID = value; s->have_AreaID = 1; break;
+      case BIN_FIELD_PERIPHERALID:       s->PeripheralID = value; s->have_PeripheralID = 1; break;
+      case BIN_FIELD_AUTOMATEDID:        s->AutomatedID = value; s->have_AutomatedID = 1; break;
+      case BIN_FIELD_TELEPHONEID:        s->TelephoneID = value; s->have_TelephoneID = 1; break;
+      case BIN_FIELD_LEVEL:              s->Level = value; s->have_Level = 1; break;
+      case BIN_FIELD_VALUE:              s->Value = value; s->have_Value = 1; break;
+      case BIN_FIELD_PATH:               s->Path = value; s->have_Path = 1; break;
+      case BIN_FIELD_ROUTEGROUP:         s->RouteGroup = value; s->have_RouteGroup = 1; break;
+      case BIN_FIELD_SUBSUBSCRIBER:      s->SubSubscriber = value; s->have_SubSubscriber = 1; break;
+      default: goto error;
+    }
+  }
+
+  if( have_sia ){
+    *sref = s;
+  }
+  else {
+    SIA_FreeEvent( s );
+  }
+  *cref = c;
+  return 0;
+
+error:
+  Commander_FreeReply( c );
+  SIA_FreeEvent( s );
+  return -1;
+}
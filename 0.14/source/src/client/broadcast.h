@@ -81,6 +81,7 @@ typedef struct sia_event_t {
   int have_RouteGroup;
   unsigned int SubSubscriber;
   int have_SubSubscriber;
+  unsigned long seq; // sequence number given by the server (0 = none)
   struct sia_event_t *next;
 } sia_event;
 
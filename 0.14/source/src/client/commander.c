@@ -49,6 +49,7 @@
 #include "websocket.h"
 #include "log.h"
 #include "json-decode.h"
+#include "binary-decode.h"
 #include "commander.h"
 #include "connect.h"
 #include "opengalaxy-client.h"
@@ -615,6 +616,10 @@ void Websocket_AddMessage( const char *fmt, ... )
     return;
   }
 
+  if( s && !Websocket_NewSequence( s->seq ) ){
+    SIA_FreeEvent( s ); // already received before we reconnected
+    s = NULL;
+  }
   if( s ) xSIA_AddMessage( s );
 
   if( !cl->decoded ){
@@ -638,3 +643,57 @@ void Websocket_AddMessage( const char *fmt, ... )
 
 }
 
+
+// Same as Websocket_AddMessage() but for a frame received with the
+// openGalaxy-binary-protocol (a batch frame must be split by the caller).
+void Websocket_AddBinaryMessage( const unsigned char *frame, size_t len )
+{
+  if( commander_quit ) return;
+  struct sia_event_t *s = NULL;
+
+  commander_reply_list *cl = malloc( sizeof( commander_reply_list ) );
+  char *dup = g_strdup_printf(
+    "(binary frame: typeId %u, %u bytes)\n",
+    ( len > 0 ) ? frame[0] : 0, (unsigned int)len
+  );
+  if( !cl || !dup ){
+    if( cl ) free( cl );
+    if( dup ) free( dup );
+    return;
+  }
+  cl->msg = dup;
+  cl->next = NULL;
+
+  if( BIN_ParseOpenGalaxyWebsocketFrame( &s, &cl->decoded, frame, len ) < 0 ){
+    if( s ) xSIA_AddMessage( s );
+    if( cl ) free( cl );
+    if( dup ) free( dup );
+    return;
+  }
+
+  if( s && !Websocket_NewSequence( s->seq ) ){
+    SIA_FreeEvent( s ); // already received before we reconnected
+    s = NULL;
+  }
+  if( s ) xSIA_AddMessage( s );
+
+  if( !cl->decoded ){
+    if( cl ) free( cl );
+    if( dup ) free( dup );
+    return;
+  }
+
+  cl->decoded->raw = cl->msg; // point back to the (description of the) raw msg
+
+  g_mutex_lock( &commander_mutex );
+  if( commander_messages == NULL ){
+    commander_messages = cl;
+  }
+  else {
+    commander_reply_list *clist = commander_messages;
+    while( clist->next ) clist = clist->next;
+    clist->next = cl;
+  }
+  g_mutex_unlock( &commander_mutex );
+
+}
@@ -94,6 +94,14 @@ typedef struct commander_reply_t {
   int           haveAreaState;
   int           haveZoneState;
   int           haveOutputState;
+  unsigned int  stateVersion;       // POLL DELTA: version of the polled state
+  int           keyframe;           // POLL DELTA: non-zero when the reply holds the full state
+  unsigned char areaDelta[64];      // POLL DELTA: index/value pairs of changed areas
+  int           areaDeltaCount;     // number of values in areaDelta
+  unsigned char zoneDelta[130];     // POLL DELTA: index/value pairs of changed zones
+  int           zoneDeltaCount;     // number of values in zoneDelta
+  unsigned char outputDelta[64];    // POLL DELTA: index/value pairs of changed outputs
+  int           outputDeltaCount;   // number of values in outputDelta
   char          *raw; // points back to commander_reply_list->msg ( set by Commander_AddJSON(), not json_parse_opengalaxy_commander() )
 } commander_reply;
 
@@ -116,6 +124,7 @@ void Commander_Exit( void );
 // Add a JSON object to be processed (called from websocket.c)
 void Commander_AddMessage( const char *fmt, ... );
 void Websocket_AddMessage( const char *fmt, ... );
+void Websocket_AddBinaryMessage( const unsigned char *frame, size_t len );
 
 // Free a struct commander_reply_t
 void Commander_FreeReply( struct commander_reply_t *r );
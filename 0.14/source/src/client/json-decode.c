@@ -42,6 +42,21 @@
 #include "json.h"
 #include "json-decode.h"
 
+//
+// Copies the index/value pairs of a POLL DELTA reply array into dest
+// Returns the number of values copied
+//
+static int json_decode_delta( json_value_array *a, unsigned char *dest, size_t max )
+{
+  int t = 0;
+  while( ( (size_t)t < max ) && ( a != NULL ) && ( a->value != NULL ) ){
+    if( a->value->type != json_number_value ) break;
+    dest[t++] = a->value->content.number->value;
+    a = a->next;
+  }
+  return t;
+}
+
 //
 // Decodes a JSON object as returned by the broadcast protocol
 // and stores the data in a new struct sia_events_list_t
@@ -254,6 +269,12 @@ struct commander_reply_t *JSON_ParseOpenGalaxyCommanderObject( char *object )
             else if( strcmp( i->name->value, "haveOutputState" ) == 0 ){
               retv->haveOutputState = i->data->content.number->value;
             }
+            else if( strcmp( i->name->value, "stateVersion" ) == 0 ){
+              retv->stateVersion = i->data->content.number->value;
+            }
+            else if( strcmp( i->name->value, "keyframe" ) == 0 ){
+              retv->keyframe = i->data->content.number->value;
+            }
             else {
               Commander_FreeReply( retv );
               json_free_objects( o );
@@ -302,6 +323,15 @@ struct commander_reply_t *JSON_ParseOpenGalaxyCommanderObject( char *object )
                 }
               }
             }
+            else if( strcmp( i->name->value, "areaDelta" ) == 0 ){
+              retv->areaDeltaCount = json_decode_delta( i->data->content.array, retv->areaDelta, sizeof( retv->areaDelta ) );
+            }
+            else if( strcmp( i->name->value, "zoneDelta" ) == 0 ){
+              retv->zoneDeltaCount = json_decode_delta( i->data->content.array, retv->zoneDelta, sizeof( retv->zoneDelta ) );
+            }
+            else if( strcmp( i->name->value, "outputDelta" ) == 0 ){
+              retv->outputDeltaCount = json_decode_delta( i->data->content.array, retv->outputDelta, sizeof( retv->outputDelta ) );
+            }
             else if( strcmp( i->name->value, "outputState" ) == 0 ){
               a = i->data->content.array;
               t = 0;
@@ -416,6 +446,9 @@ int JSON_ParseOpenGalaxyWebsocketObject(struct sia_event_t **sref, struct comman
             else if( strcmp( i->name->value, "success" ) == 0 ){
               c->success = i->data->content.number->value;
             }
+            else if( strcmp( i->name->value, "seq" ) == 0 ){
+              s->seq = i->data->content.number->value;
+            }
             else if( strcmp( i->name->value, "areaState" ) == 0 ){
               c->areaState = i->data->content.number->value;
             }
@@ -440,6 +473,12 @@ int JSON_ParseOpenGalaxyWebsocketObject(struct sia_event_t **sref, struct comman
             else if( strcmp( i->name->value, "haveOutputState" ) == 0 ){
               c->haveOutputState = i->data->content.number->value;
             }
+            else if( strcmp( i->name->value, "stateVersion" ) == 0 ){
+              c->stateVersion = i->data->content.number->value;
+            }
+            else if( strcmp( i->name->value, "keyframe" ) == 0 ){
+              c->keyframe = i->data->content.number->value;
+            }
             else {
               Commander_FreeReply( c );
               SIA_FreeEvent( s );
@@ -489,6 +528,15 @@ int JSON_ParseOpenGalaxyWebsocketObject(struct sia_event_t **sref, struct comman
                 }
               }
             }
+            else if( strcmp( i->name->value, "areaDelta" ) == 0 ){
+              c->areaDeltaCount = json_decode_delta( i->data->content.array, c->areaDelta, sizeof( c->areaDelta ) );
+            }
+            else if( strcmp( i->name->value, "zoneDelta" ) == 0 ){
+              c->zoneDeltaCount = json_decode_delta( i->data->content.array, c->zoneDelta, sizeof( c->zoneDelta ) );
+            }
+            else if( strcmp( i->name->value, "outputDelta" ) == 0 ){
+              c->outputDeltaCount = json_decode_delta( i->data->content.array, c->outputDelta, sizeof( c->outputDelta ) );
+            }
             else if( strcmp( i->name->value, "outputState" ) == 0 ){
               a = i->data->content.array;
               t = 0;
@@ -89,6 +89,7 @@
 #include "websocket.h"
 #include "broadcast.h"
 #include "commander.h"
+#include "binary.h"
 #include "log.h"
 
 // Buffer sizes for in- and outgoing data
@@ -174,6 +175,7 @@ static GMutex WebsocketMutex;      // Mutex to safeguard thread data
 enum websocket_protocols {
   PROTOCOL_HTTP = 0,
   PROTOCOL_OPENGALAXY,
+  PROTOCOL_BINARY,
   PROTOCOL_COUNT
 };
 
@@ -204,6 +206,12 @@ static struct lws_protocols protocols[] = {
     sizeof( struct websocket_per_session_data_opengalaxy_protocol ),
     OUTPUT_BUFFER_SIZE,
   },
+  {
+    BIN_PROTOCOL_NAME,
+    callback_commander,
+    sizeof( struct websocket_per_session_data_opengalaxy_protocol ),
+    OUTPUT_BUFFER_SIZE,
+  },
   { NULL, NULL, 0, 0 } // end of list
 };
 
@@ -341,6 +349,95 @@ static const char* ws_command_fifo_pop( void )
 }
 
 
+// Sequence number of the last SIA message received (0 = none yet)
+static unsigned long last_sia_seq = 0;
+
+// Returns false if a SIA message with this sequence number was already
+// received (the server resends messages in response to RESUME).
+bool Websocket_NewSequence( unsigned long seq )
+{
+  if( seq == 0 ) return true; // not numbered by the server
+  if( seq <= last_sia_seq ) return false;
+  last_sia_seq = seq;
+  return true;
+}
+
+// Asks the server for the SIA messages broadcasted while we were disconnected
+static void ws_request_resume( void )
+{
+  char cmd[32];
+  if( !last_sia_seq ) return;
+  snprintf( cmd, sizeof( cmd ), "RESUME %lu", last_sia_seq );
+  if( ws_command_fifo_push( cmd ) == 0 ){
+    websocket_commander_do_send = 1;
+  }
+}
+
+
+//
+// Passes each object of a received message to Websocket_AddMessage().
+// The server may coalesce several SIA messages into one JSON array.
+//
+static void ws_add_received_message( char *msg )
+{
+  char *p = msg, *start = NULL;
+  int depth = 0, in_string = 0;
+
+  while( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) p++;
+  if( *p != '[' ){
+    Websocket_AddMessage( "%s\n", msg );
+    return;
+  }
+
+  for( p++; *p; p++ ){
+    if( in_string ){
+      if( *p == '\\' && p[1] ) p++;
+      else if( *p == '"' ) in_string = 0;
+      continue;
+    }
+    if( *p == '"' ){
+      in_string = 1;
+    }
+    else if( *p == '{' ){
+      if( depth++ == 0 ) start = p;
+    }
+    else if( *p == '}' && depth > 0 ){
+      if( --depth == 0 && start ){
+        char c = p[1];
+        p[1] = '\0';
+        Websocket_AddMessage( "%s\n", start );
+        p[1] = c;
+        start = NULL;
+      }
+    }
+  }
+}
+
+
+//
+// Passes each frame of a received binary message to Websocket_AddBinaryMessage().
+// The server may coalesce several SIA messages into one batch frame.
+//
+static void ws_add_received_binary( const unsigned char *msg, size_t len )
+{
+  size_t pos = 1, flen;
+
+  if( len < 1 ) return;
+  if( msg[0] != BIN_TYPE_BATCH ){
+    Websocket_AddBinaryMessage( msg, len );
+    return;
+  }
+
+  while( pos + 2 <= len ){
+    flen = bin_get_u16( &msg[pos] );
+    pos += 2;
+    if( pos + flen > len ) break;
+    Websocket_AddBinaryMessage( &msg[pos], flen );
+    pos += flen;
+  }
+}
+
+
 //
 //  Callback for the http protocol
 //
@@ -401,6 +498,8 @@ static int callback_commander(
       g_mutex_unlock( &WebsocketMutex );
       Connect_setStatusOnline();
       g_mutex_lock( &WebsocketMutex );
+      // (the server waits for us to login before answering)
+      ws_request_resume();
       // start the ball rolling,
       // LWS_CALLBACK_CLIENT_WRITEABLE will come next service
       lws_callback_on_writable( wsi );
@@ -457,8 +556,13 @@ static int callback_commander(
       break;
 
     case LWS_CALLBACK_CLIENT_RECEIVE:
+      // The server may still send JSON (text) to a client that uses the binary protocol
+      if( lws_frame_is_binary( wsi ) ){
+        ws_add_received_binary( (const unsigned char *)in, len );
+        break;
+      }
       ((char *)in)[len] = '\0';
-      Websocket_AddMessage( "%s\n", (char *)in );
+      ws_add_received_message( (char *)in );
       break;
 
     case LWS_CALLBACK_CLIENT_WRITEABLE:
@@ -618,7 +722,8 @@ static gpointer Websocket_ThreadMain( gpointer data )
         info_ws.origin = address;
         info_ws.ietf_version_or_minus_one = -1;
         info_ws.client_exts = exts;
-        info_ws.protocol = protocols[PROTOCOL_OPENGALAXY].name;
+        // Prefer the binary protocol, older servers only know the JSON protocol
+        info_ws.protocol = BIN_PROTOCOL_NAME "," "openGalaxy-websocket-protocol";
 
         // connect first protocol (http)
         // (Not actually http, the connection is upgraded to a websocket...)
@@ -45,6 +45,7 @@ void Websocket_AsyncConnect         ( void );
 void Websocket_AsyncDisconnect      ( void );
 bool Websocket_SendCommand          ( const char *cmd, ... );
 int  Websocket_SendCredentials      ( const char *session_id, const char *username, const char *password );
+bool Websocket_NewSequence          ( unsigned long seq );
 
 #endif
 
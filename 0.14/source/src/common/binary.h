@@ -0,0 +1,140 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Definitions shared by the server and client for the
+ * "openGalaxy-binary-protocol" websocket subprotocol.
+ *
+ * Every frame starts with the same typeId as the JSON formatted replies
+ * (see API.TXT), followed by a list of tagged fields:
+ *
+ *  frame := typeId(u8) field*
+ *  field := tag(u8) payload
+ *  tag   := (kind << 6) | field id
+ *
+ * Payload by kind:
+ *  BIN_KIND_BYTE   : u8 value
+ *  BIN_KIND_UINT   : u32 value (little endian)
+ *  BIN_KIND_STRING : u16 length (little endian) followed by the bytes (no '\0')
+ *  BIN_KIND_ARRAY  : u8 count followed by count u8 values
+ *
+ * Several frames may be send as one batch frame:
+ *
+ *  batch := BIN_TYPE_BATCH(u8) ( length(u16, little endian) frame )*
+ *
+ * Fields that have no value (null in JSON) are left out.
+ */
+
+#ifndef __OPENGALAXY_BINARY_PROTOCOL_H__
+#define __OPENGALAXY_BINARY_PROTOCOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define BIN_PROTOCOL_NAME "openGalaxy-binary-protocol"
+
+// typeId of a frame that holds several frames
+#define BIN_TYPE_BATCH 0x80
+
+// Field kinds
+#define BIN_KIND_BYTE   0
+#define BIN_KIND_UINT   1
+#define BIN_KIND_STRING 2
+#define BIN_KIND_ARRAY  3
+
+#define BIN_TAG( kind, id ) ( (unsigned char)( ( (kind) << 6 ) | ( (id) & 0x3F ) ) )
+#define BIN_TAG_KIND( tag ) ( ( (tag) >> 6 ) & 0x03 )
+#define BIN_TAG_ID( tag )   ( (tag) & 0x3F )
+
+// Field id's for command replies
+typedef enum {
+  BIN_FIELD_TYPEDESC = 1,
+  BIN_FIELD_SUCCESS,
+  BIN_FIELD_COMMAND,
+  BIN_FIELD_REPLYTEXT,
+  BIN_FIELD_HELPTEXT,
+  BIN_FIELD_AREASTATE,       // byte for a single area, array for all areas
+  BIN_FIELD_ZONENUMBER,
+  BIN_FIELD_OMITSTATE,
+  BIN_FIELD_ZONESTATE,       // byte for a single zone, array for all zones
+  BIN_FIELD_OUTPUTSTATE,
+  BIN_FIELD_PANELISONLINE,
+  BIN_FIELD_HAVEAREASTATE,
+  BIN_FIELD_HAVEZONESTATE,
+  BIN_FIELD_HAVEOUTPUTSTATE,
+  BIN_FIELD_SEQ,             // sequence number of a broadcasted SIA message
+  BIN_FIELD_STATEVERSION,    // version of the polled state (POLL DELTA)
+  BIN_FIELD_KEYFRAME,
+  BIN_FIELD_AREADELTA,       // array of index/value pairs of changed areas
+  BIN_FIELD_ZONEDELTA,       // array of index/value pairs of changed zones
+  BIN_FIELD_OUTPUTDELTA,     // array of index/value pairs of changed outputs
+
+  // Field id's for SIA messages (typeId 0)
+  BIN_FIELD_ACCOUNTID = 32,
+  BIN_FIELD_EVENTCODE,
+  BIN_FIELD_EVENTNAME,
+  BIN_FIELD_EVENTDESC,
+  BIN_FIELD_EVENTADDRESSTYPE,
+  BIN_FIELD_EVENTADDRESSNUMBER,
+  BIN_FIELD_DATE,
+  BIN_FIELD_TIME,
+  BIN_FIELD_ASCII,
+  BIN_FIELD_SUBSCRIBERID,
+  BIN_FIELD_AREAID,
+  BIN_FIELD_PERIPHERALID,
+  BIN_FIELD_AUTOMATEDID,
+  BIN_FIELD_TELEPHONEID,
+  BIN_FIELD_LEVEL,
+  BIN_FIELD_VALUE,
+  BIN_FIELD_PATH,
+  BIN_FIELD_ROUTEGROUP,
+  BIN_FIELD_SUBSUBSCRIBER,
+  BIN_FIELD_RAW              // string holding the raw (not base64 encoded) SIA block
+} bin_field_id;
+
+static inline unsigned int bin_get_u16( const unsigned char *p )
+{
+  return (unsigned int)p[0] | ( (unsigned int)p[1] << 8 );
+}
+
+static inline unsigned int bin_get_u32( const unsigned char *p )
+{
+  return (unsigned int)p[0] | ( (unsigned int)p[1] << 8 ) |
+    ( (unsigned int)p[2] << 16 ) | ( (unsigned int)p[3] << 24 );
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,50 +29,218 @@
  */
 
 // Make sure that we have thread & reentrant safe memory allocation functions
+//
+// Allocations of up to 4096 bytes are served from pools of fixed size
+// blocks, one pool for each power of 2 (the size classes). The blocks are
+// carved from larger slabs that are never returned to the system, so a
+// long running server does not fragment the heap with the many small,
+// short lived blocks it allocates for every SIA message and reply.
+//
+// Each thread keeps a cache of free blocks for every size class and
+// normally allocates and frees without touching any shared state.
+// When a thread frees more blocks than it keeps (ie. the websocket thread
+// freeing the messages allocated by the receiver thread), the surplus is
+// pushed onto a lock-free list of returned blocks for that size class.
+// A thread that runs out of cached blocks takes that entire list in a
+// single atomic exchange before it allocates a new slab.
+//
+// The allocation counters are also kept by each thread, they are summed
+// by thread_safe_alloc_stats().
+//
+// Larger allocations go directly to the system allocator.
+//
 
 #include "atomic.h"
 #include <malloc.h>
 #include <string.h>
+#include <new>
+#include <atomic>
 #include <mutex>
+#include "tmalloc.hpp"
 
 namespace openGalaxy {
 
-static std::mutex m;
+// Every block starts with a header that holds its size class
+union BlockHeader {
+  int size_class;          // index in size_classes[] or large_class
+  long double align1;      // (keep the users data aligned)
+  long long align2;
+  void *align3;
+};
+
+// A free block (the link overlays the users data)
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+static const int large_class = thread_safe_alloc_classes - 1;
+static const int slab_bytes = 65536;        // size of the slabs blocks are carved from
+static const int cache_bytes = 65536;       // (max.) size of the free blocks each thread keeps per size class
+
+static inline size_t class_size(int c) { return (size_t)32 << c; } // 32 ... 4096 bytes
+static inline size_t block_bytes(int c) { return sizeof(BlockHeader) + class_size(c); }
+
+// Shared state for each size class, on cache lines of their own
+struct alignas(64) SizeClass {
+  std::atomic<FreeBlock*> returned;         // blocks returned by other threads
+  std::atomic<unsigned long long> blocks;   // blocks carved from slabs
+};
+static SizeClass size_classes[thread_safe_alloc_classes];
+
+// Increments a counter that is only written by the thread that owns it
+// (and read by thread_safe_alloc_stats())
+static inline void count(std::atomic<unsigned long long>& n)
+{
+  n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+class ThreadCache;
+static std::mutex caches_mutex;
+static ThreadCache *caches = nullptr;       // the caches of all running threads
+static unsigned long long exited_allocs[thread_safe_alloc_classes]; // the counters of the threads that exited
+static unsigned long long exited_frees[thread_safe_alloc_classes];
+
+static void push_returned(int c, FreeBlock *first, FreeBlock *last)
+{
+  FreeBlock *head = size_classes[c].returned.load(std::memory_order_relaxed);
+  do {
+    last->next = head;
+  } while(!size_classes[c].returned.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// The free blocks kept by one thread
+class ThreadCache {
+public:
+  FreeBlock *head[large_class];
+  int count[large_class];
+  std::atomic<unsigned long long> allocs[thread_safe_alloc_classes];
+  std::atomic<unsigned long long> frees[thread_safe_alloc_classes];
+  ThreadCache *prev, *next;                 // (in the list of caches)
+
+  ThreadCache() {
+    for(int c = 0; c < large_class; c++){
+      head[c] = nullptr;
+      count[c] = 0;
+    }
+    for(int c = 0; c < thread_safe_alloc_classes; c++){
+      allocs[c].store(0, std::memory_order_relaxed);
+      frees[c].store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(caches_mutex);
+    prev = nullptr;
+    next = caches;
+    if(next) next->prev = this;
+    caches = this;
+  }
+
+  // Return all cached blocks and keep the counters when the thread exits
+  ~ThreadCache() {
+    for(int c = 0; c < large_class; c++){
+      if(head[c]) spill(c, count[c]);
+    }
+    std::lock_guard<std::mutex> lock(caches_mutex);
+    for(int c = 0; c < thread_safe_alloc_classes; c++){
+      exited_allocs[c] += allocs[c].load(std::memory_order_relaxed);
+      exited_frees[c] += frees[c].load(std::memory_order_relaxed);
+    }
+    if(prev) prev->next = next;
+    else caches = next;
+    if(next) next->prev = prev;
+  }
+
+  // Moves n cached blocks to the list of returned blocks
+  void spill(int c, int n) {
+    FreeBlock *first = head[c], *last = first;
+    for(int i = 1; i < n; i++) last = last->next;
+    head[c] = last->next;
+    count[c] -= n;
+    push_returned(c, first, last);
+  }
+
+  // Fills the cache with the returned blocks, or a new slab
+  void refill(int c) {
+    FreeBlock *list = size_classes[c].returned.exchange(nullptr, std::memory_order_acquire);
+    if(list){
+      while(list){
+        FreeBlock *next = list->next;
+        list->next = head[c];
+        head[c] = list;
+        count[c]++;
+        list = next;
+      }
+      return;
+    }
+    size_t n = slab_bytes / block_bytes(c);
+    if(n < 4) n = 4;
+    char *slab = (char*)malloc(n * block_bytes(c));
+    if(slab == nullptr) throw new std::bad_alloc();
+    for(size_t i = 0; i < n; i++){
+      BlockHeader *h = (BlockHeader*)(slab + i * block_bytes(c));
+      h->size_class = c;
+      FreeBlock *b = (FreeBlock*)(h + 1);
+      b->next = head[c];
+      head[c] = b;
+      count[c]++;
+    }
+    size_classes[c].blocks.fetch_add(n, std::memory_order_relaxed);
+  }
+};
+
+static thread_local ThreadCache cache;
+
+static inline int size_class_of(size_t len)
+{
+  int c = 0;
+  while(c < large_class && class_size(c) < len) c++;
+  return c;
+}
 
 void *thread_safe_malloc(size_t len)
 {
-  m.lock();
-  void *retv = malloc(len);
-  m.unlock();
-  if(retv == nullptr) throw new std::bad_alloc();
-  return retv;
+  int c = size_class_of(len);
+  count(cache.allocs[c]);
+  if(c == large_class){
+    BlockHeader *h = (BlockHeader*)malloc(sizeof(BlockHeader) + len);
+    if(h == nullptr) throw new std::bad_alloc();
+    h->size_class = large_class;
+    return h + 1;
+  }
+  if(cache.head[c] == nullptr) cache.refill(c);
+  FreeBlock *b = cache.head[c];
+  cache.head[c] = b->next;
+  cache.count[c]--;
+  return b;
 }
 
 void *thread_safe_zalloc(size_t len)
 {
-  m.lock();
-  void *retv = malloc(len);
-  m.unlock();
-  if(retv == nullptr) throw new std::bad_alloc();
+  void *retv = thread_safe_malloc(len);
   memset(retv, 0, len);
   return retv;
 }
 
 void *thread_safe_realloc(void *p, size_t len)
 {
-  m.lock();
-  void *retv = realloc(p, len);
-  m.unlock();
-  if(retv == nullptr) throw new std::bad_alloc();
+  if(p == nullptr) return thread_safe_malloc(len);
+  BlockHeader *h = (BlockHeader*)p - 1;
+  if(h->size_class == large_class && size_class_of(len) == large_class){
+    h = (BlockHeader*)realloc(h, sizeof(BlockHeader) + len);
+    if(h == nullptr) throw new std::bad_alloc();
+    return h + 1;
+  }
+  if(h->size_class != large_class && len <= class_size(h->size_class)) return p; // still fits
+  void *retv = thread_safe_malloc(len);
+  if(h->size_class != large_class) memcpy(retv, p, class_size(h->size_class));
+  else memcpy(retv, p, len); // (shrinking a large block into a pooled one)
+  thread_safe_free(p);
   return retv;
 }
 
 char *thread_safe_strdup(const char *s1)
 {
-  m.lock();
-  char* retv = strdup(s1);
-  m.unlock();
-  if(retv == nullptr) throw new std::bad_alloc();
+  size_t len = strlen(s1) + 1;
+  char* retv = (char*)thread_safe_malloc(len);
+  memcpy(retv, s1, len);
   return retv;
 }
 
@@ -89,12 +257,42 @@ char *thread_safe_strndup(const char *str, size_t s)
 
 void thread_safe_free(void *ptr)
 {
-  m.lock();
-  free(ptr);
-  m.unlock();
+  if(ptr == nullptr) return;
+  BlockHeader *h = (BlockHeader*)ptr - 1;
+  int c = h->size_class;
+  count(cache.frees[c]);
+  if(c == large_class){
+    free(h);
+    return;
+  }
+  FreeBlock *b = (FreeBlock*)ptr;
+  b->next = cache.head[c];
+  cache.head[c] = b;
+  cache.count[c]++;
+  // Keep at most cache_bytes per size class, return half of it when full
+  int max = cache_bytes / class_size(c);
+  if(cache.count[c] > max) cache.spill(c, max / 2);
   return;
 }
 
+void thread_safe_alloc_stats(thread_safe_alloc_stat stats[thread_safe_alloc_classes])
+{
+  std::lock_guard<std::mutex> lock(caches_mutex);
+  for(int c = 0; c < thread_safe_alloc_classes; c++){
+    stats[c].size = (c == large_class) ? 0 : class_size(c);
+    stats[c].allocs = exited_allocs[c];
+    stats[c].frees = exited_frees[c];
+    for(ThreadCache *t = caches; t; t = t->next){
+      stats[c].allocs += t->allocs[c].load(std::memory_order_relaxed);
+      stats[c].frees += t->frees[c].load(std::memory_order_relaxed);
+    }
+    // (every large block is allocated from the system)
+    stats[c].blocks = (c == large_class) ? stats[c].allocs : size_classes[c].blocks.load(std::memory_order_relaxed);
+    // (a block may be freed by another thread than the one that allocated it)
+    stats[c].in_use = (stats[c].allocs > stats[c].frees) ? stats[c].allocs - stats[c].frees : 0;
+  }
+}
+
 } // ends namespace openGalaxy
 
 
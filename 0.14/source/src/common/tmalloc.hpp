@@ -32,6 +32,7 @@
 #define __OPENGALAXY_SERVER_TMALLOC_HPP__
 
 #include "atomic.h"
+#include <cstddef>
 
 namespace openGalaxy {
 
@@ -43,6 +44,19 @@ void  thread_safe_free(void *ptr);
 char *thread_safe_strdup(const char *s1);
 //char *thread_safe_strndup(const char *str, size_t s);
 
+// Allocation counters for each size class of thread_safe_malloc()
+class thread_safe_alloc_stat {
+public:
+  size_t size;                 // the (max.) size of a block, 0 for the blocks larger than 4096 bytes
+  unsigned long long allocs;   // number of blocks allocated
+  unsigned long long frees;    // number of blocks freed
+  unsigned long long blocks;   // number of blocks obtained from the system
+  unsigned long long in_use;   // number of blocks presently allocated
+};
+constexpr int thread_safe_alloc_classes = 9; // (8 size classes, 32 to 4096 bytes, and the larger blocks)
+
+void thread_safe_alloc_stats(thread_safe_alloc_stat stats[thread_safe_alloc_classes]);
+
 } // ends namespace openGalaxy
 
 #endif
@@ -35,12 +35,24 @@
 
 namespace openGalaxy {
 
+// An array of elements of type T.
+//
+// The elements are kept in a ring buffer whose capacity grows (and
+// shrinks) by powers of two, so appending, prepending and removing the
+// first or last element take amortised constant time. Inserting or
+// removing anywhere else moves the elements on the shorter side.
+// This makes the array usable both as a list and as a FIFO queue.
 template <typename T> class Array {
 
 protected:
   volatile int m_nLength; // Array length
+  int m_nCapacity; // Number of allocated elements (0 or a power of 2)
+  int m_nHead; // Index in m_ptData of element 0
   T *m_ptData; // Array data
 
+  T& at( int nIndex ) { return m_ptData[ ( m_nHead + nIndex ) & ( m_nCapacity - 1 ) ]; }
+  void reserve( int nCapacity );
+
 public:
 
   // Constructors
@@ -54,6 +66,7 @@ public:
   void erase();
   T& operator[]( int nIndex );
   volatile int size();
+  int capacity() { return m_nCapacity; }
   void reallocate( int nNewLength );
   void resize( int nNewLength );
   void insert( T tValue, int nIndex );
@@ -63,6 +76,8 @@ public:
 };
 
 
+// An Array of pointers to objects that are owned by the array,
+// the objects are deleted when they are removed from the array.
 template<typename T> class ObjectArray: public Array<T> {
 
 public:
@@ -79,6 +94,53 @@ public:
   void remove( int nIndex );
 };
 
+
+// A doubly linked list of objects of type T that are owned by the list.
+//
+// The links are kept in the objects themselves (T must derive from
+// IntrusiveList<T>::Node), so adding or removing an object never allocates
+// and removing a known object takes constant time. An object can only be
+// in one list at a time.
+template<typename T> class IntrusiveList {
+
+public:
+  class Node {
+    friend class IntrusiveList<T>;
+    T *m_prev = nullptr;
+    T *m_next = nullptr;
+  };
+
+private:
+  T *m_first = nullptr;
+  T *m_last = nullptr;
+  int m_nLength = 0;
+
+  static Node* node( T *t ) { return static_cast<Node*>( t ); }
+
+public:
+  IntrusiveList() {}
+  ~IntrusiveList() { erase(); }
+
+  // Iterate with: for( T *t = list.first(); t; t = list.next( t ) )
+  T* first() { return m_first; }
+  T* last() { return m_last; }
+  T* next( T *t ) { return node( t )->m_next; }
+  T* prev( T *t ) { return node( t )->m_prev; }
+  int size() { return m_nLength; }
+
+  void append( T *t );
+  void prepend( T *t );
+
+  // Removes an object from the list without deleting it
+  void unlink( T *t );
+
+  // Removes an object from the list and deletes it
+  void remove( T *t ) { unlink( t ); delete t; }
+
+  // Deletes all objects in the list
+  void erase();
+};
+
 // Implementation
 //
 // Because this is a template class the definition and
@@ -87,13 +149,18 @@ public:
 template <typename T> Array<T>::Array()
 {
   m_nLength = 0;
+  m_nCapacity = 0;
+  m_nHead = 0;
   m_ptData = 0;
 }
 
 template <typename T> Array<T>::Array( int nLength )
 {
-  m_ptData = new T[nLength];
-  m_nLength = nLength;
+  m_nLength = 0;
+  m_nCapacity = 0;
+  m_nHead = 0;
+  m_ptData = 0;
+  resize( nLength );
 }
 
 template <typename T> Array<T>::~Array()
@@ -101,11 +168,28 @@ template <typename T> Array<T>::~Array()
   delete[] m_ptData;
 }
 
+// Moves the elements to a new buffer with room for (at least) nCapacity elements
+template <typename T> void Array<T>::reserve( int nCapacity )
+{
+  int nNewCapacity = 8;
+  while( nNewCapacity < nCapacity ) nNewCapacity *= 2;
+  T *ptData = new T[ nNewCapacity ];
+  for( int nIndex = 0; nIndex < m_nLength; nIndex++ ){
+    ptData[ nIndex ] = at( nIndex );
+  }
+  delete[] m_ptData;
+  m_ptData = ptData;
+  m_nCapacity = nNewCapacity;
+  m_nHead = 0;
+}
+
 template <typename T> void Array<T>::erase()
 {
   delete[] m_ptData;
   m_ptData = 0;
   m_nLength = 0;
+  m_nCapacity = 0;
+  m_nHead = 0;
 }
 
 template <typename T> T& Array<T>::operator[]( int nIndex )
@@ -113,7 +197,7 @@ template <typename T> T& Array<T>::operator[]( int nIndex )
   if( !(nIndex >= 0 && nIndex < m_nLength ) ){
     throw new std::runtime_error("Array<T>::operator[]: nIndex out of bounds.");
   }
-  return m_ptData[ nIndex ];
+  return at( nIndex );
 }
 
 template <typename T> volatile int Array<T>::size()
@@ -124,9 +208,7 @@ template <typename T> volatile int Array<T>::size()
 template <typename T> void Array<T>::reallocate( int nNewLength )
 {
   erase();
-  if( nNewLength <= 0 ) return;
-  m_ptData = new T[ nNewLength ];
-  m_nLength = nNewLength;
+  resize( nNewLength );
 }
 
 template <typename T> void Array<T>::resize( int nNewLength )
@@ -135,15 +217,10 @@ template <typename T> void Array<T>::resize( int nNewLength )
     erase();
   }
   else {
-    T *ptData = new T[ nNewLength ];
-    if(m_nLength > 0) {
-      int nElementsToCopy = (nNewLength > m_nLength) ? m_nLength : nNewLength;
-      for( int nIndex=0; nIndex < nElementsToCopy; nIndex++ ){
-        ptData[nIndex] = m_ptData[nIndex];
-      }
+    if( nNewLength > m_nCapacity ) reserve( nNewLength );
+    for( int nIndex = m_nLength; nIndex < nNewLength; nIndex++ ){
+      at( nIndex ) = T();
     }
-    delete[] m_ptData;
-    m_ptData = ptData;
     m_nLength = nNewLength;
   }
 }
@@ -154,20 +231,23 @@ template <typename T> void Array<T>::insert( T tValue, int nIndex )
     throw new std::runtime_error("Array<T>::insert(): nIndex out of bounds.");
   }
 
-  T *ptData = new T[ m_nLength + 1 ];
+  if( m_nLength == m_nCapacity ) reserve( m_nLength + 1 );
 
-  for( int nBefore=0; nBefore < nIndex; nBefore++ ){
-    ptData[ nBefore ] = m_ptData[ nBefore ];
+  if( nIndex < m_nLength / 2 ){
+    // Move the elements before nIndex one place to the front
+    m_nHead = ( m_nHead - 1 ) & ( m_nCapacity - 1 );
+    for( int nBefore = 0; nBefore < nIndex; nBefore++ ){
+      at( nBefore ) = at( nBefore + 1 );
+    }
   }
-
-  ptData[ nIndex ] = tValue;
-
-  for( int nAfter=nIndex; nAfter < m_nLength; nAfter++ ){
-    ptData[ nAfter + 1 ] = m_ptData[ nAfter ];
+  else {
+    // Move the elements after nIndex one place to the back
+    for( int nAfter = m_nLength; nAfter > nIndex; nAfter-- ){
+      at( nAfter ) = at( nAfter - 1 );
+    }
   }
 
-  delete[] m_ptData;
-  m_ptData = ptData;
+  at( nIndex ) = tValue;
   m_nLength += 1;
 }
 
@@ -187,19 +267,32 @@ template <typename T> void Array<T>::remove( int nIndex )
     throw new std::runtime_error("Array<T>::remove(): nIndex out of bounds.");
   }
 
-  T *ptData = new T[ m_nLength - 1 ];
-
-  for( int nBefore = 0; nBefore < nIndex; nBefore++ ){
-    ptData[ nBefore ] = m_ptData[ nBefore ];
+  if( nIndex < m_nLength / 2 ){
+    // Move the elements before nIndex one place to the back
+    for( int nBefore = nIndex; nBefore > 0; nBefore-- ){
+      at( nBefore ) = at( nBefore - 1 );
+    }
+    at( 0 ) = T();
+    m_nHead = ( m_nHead + 1 ) & ( m_nCapacity - 1 );
   }
-
-  for( int nAfter = nIndex + 1; nAfter < m_nLength; nAfter++ ){
-    ptData[ nAfter - 1 ] = m_ptData[ nAfter ];
+  else {
+    // Move the elements after nIndex one place to the front
+    for( int nAfter = nIndex + 1; nAfter < m_nLength; nAfter++ ){
+      at( nAfter - 1 ) = at( nAfter );
+    }
+    at( m_nLength - 1 ) = T();
   }
 
-  delete[] m_ptData;
-  m_ptData = ptData;
   m_nLength -= 1;
+
+  // Give back the memory of a queue that has drained after a burst
+  if( m_nLength == 0 ){
+    m_nHead = 0;
+    if( m_nCapacity > 64 ) erase();
+  }
+  else if( m_nCapacity > 64 && m_nLength < m_nCapacity / 4 ){
+    reserve( m_nCapacity / 2 );
+  }
 }
 
 ////////////////////////////////////////////////////////////
@@ -214,7 +307,7 @@ template <typename T> ObjectArray<T>::~ObjectArray()
 template <typename T> void ObjectArray<T>::erase()
 {
   for( int nIndex = 0; nIndex < Array<T>::m_nLength; nIndex++ ){
-    delete Array<T>::m_ptData[nIndex];
+    delete Array<T>::at( nIndex );
   }
   Array<T>::erase();
 }
@@ -231,16 +324,10 @@ template <typename T> void ObjectArray<T>::resize( int nNewLength )
     ObjectArray<T>::erase();
   }
   else {
-    T *ptData = new T[ nNewLength ];
-    if(Array<T>::m_nLength > 0) {
-      for( int nIndex = 0; nIndex < Array<T>::m_nLength; nIndex++ ){
-        if( nIndex < nNewLength ) ptData[ nIndex ] = Array<T>::m_ptData[ nIndex ];
-        else delete Array<T>::m_ptData[ nIndex ];
-      }
+    for( int nIndex = nNewLength; nIndex < Array<T>::m_nLength; nIndex++ ){
+      delete Array<T>::at( nIndex );
     }
-    delete[] Array<T>::m_ptData;
-    Array<T>::m_ptData = ptData;
-    Array<T>::m_nLength = nNewLength;
+    Array<T>::resize( nNewLength );
   }
 }
 
@@ -249,10 +336,50 @@ template <typename T> void ObjectArray<T>::remove( int nIndex )
   if( !(nIndex >=0 && nIndex < Array<T>::m_nLength ) ){
     throw new std::runtime_error("ObjectArray<T>::remove(): nIndex out of bounds.");
   }
-  delete Array<T>::m_ptData[ nIndex ];
+  delete Array<T>::at( nIndex );
   Array<T>::remove( nIndex );
 }
 
+////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////
+
+template <typename T> void IntrusiveList<T>::append( T *t )
+{
+  node( t )->m_prev = m_last;
+  node( t )->m_next = nullptr;
+  if( m_last ) node( m_last )->m_next = t;
+  else m_first = t;
+  m_last = t;
+  m_nLength++;
+}
+
+template <typename T> void IntrusiveList<T>::prepend( T *t )
+{
+  node( t )->m_prev = nullptr;
+  node( t )->m_next = m_first;
+  if( m_first ) node( m_first )->m_prev = t;
+  else m_last = t;
+  m_first = t;
+  m_nLength++;
+}
+
+template <typename T> void IntrusiveList<T>::unlink( T *t )
+{
+  if( node( t )->m_prev ) node( node( t )->m_prev )->m_next = node( t )->m_next;
+  else m_first = node( t )->m_next;
+  if( node( t )->m_next ) node( node( t )->m_next )->m_prev = node( t )->m_prev;
+  else m_last = node( t )->m_prev;
+  node( t )->m_prev = nullptr;
+  node( t )->m_next = nullptr;
+  m_nLength--;
+}
+
+template <typename T> void IntrusiveList<T>::erase()
+{
+  while( m_first ) remove( m_first );
+}
+
 } // ends namespace openGalaxy
 
 #endif
@@ -65,6 +65,7 @@ int save_certificates(const char* json, class openGalaxy& opengalaxy)
   size_t plaintext_size;
   unsigned char* tmp;
   struct packed_certs_t certs;
+  bool decoded = false; // true once 'certs' holds the (OpenSSL allocated) decoded certificates
   int retv = 0; // 0 = error
 
   FILE* fp;
@@ -308,6 +309,8 @@ decrypted:
   thread_safe_free(certs.decrypt_key);
   certs.decrypt_key = (char*)tmp;
 
+  decoded = true;
+
   // Store the certificates in the proper locations
 
 //opengalaxy.syslog().error(certs.ca_cert);
@@ -413,12 +416,22 @@ decrypted:
   retv = 1; // success
 
 exit:
-  if(certs.ca_cert) thread_safe_free(certs.ca_cert);
-  if(certs.server_cert) thread_safe_free(certs.server_cert);
-  if(certs.server_key) thread_safe_free(certs.server_key);
-  if(certs.crl_cert) thread_safe_free(certs.crl_cert);
-  if(certs.verify_key) thread_safe_free(certs.verify_key);
-  if(certs.decrypt_key) thread_safe_free(certs.decrypt_key);
+  if(decoded){
+    ssl_free(certs.ca_cert);
+    ssl_free(certs.server_cert);
+    ssl_free(certs.server_key);
+    ssl_free(certs.crl_cert);
+    ssl_free(certs.verify_key);
+    ssl_free(certs.decrypt_key);
+  }
+  else {
+    if(certs.ca_cert) thread_safe_free(certs.ca_cert);
+    if(certs.server_cert) thread_safe_free(certs.server_cert);
+    if(certs.server_key) thread_safe_free(certs.server_key);
+    if(certs.crl_cert) thread_safe_free(certs.crl_cert);
+    if(certs.verify_key) thread_safe_free(certs.verify_key);
+    if(certs.decrypt_key) thread_safe_free(certs.decrypt_key);
+  }
   return retv;
 }
 
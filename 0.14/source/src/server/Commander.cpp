@@ -49,6 +49,7 @@ Commander::command_t Commander::commands_list[] = {
   { Commander::cmd::output,     "OUTPUT"     },
   { Commander::cmd::poll,       "POLL"       },
   { Commander::cmd::code_alarm, "CODE-ALARM" },
+  { Commander::cmd::stats,      "STATS"      },
   { Commander::cmd::count,      nullptr      }
 };
 
@@ -150,6 +151,7 @@ struct Commander::poll_action_t Commander::poll_actions_list[] = {
   { Commander::poll_action::add,      "ADD" },
   { Commander::poll_action::remove,   "REMOVE" },
   { Commander::poll_action::one_shot, "ONCE" },
+  { Commander::poll_action::delta,    "DELTA" },
   { Commander::poll_action::count, nullptr }
 };
 
@@ -170,6 +172,19 @@ struct Commander::code_alarm_module_t Commander::code_alarm_modules_list[] = {
   { Commander::code_alarm_module::count, nullptr }
 };
 
+Commander::KeywordTable<Commander::command_t> Commander::commands_table(commands_list, &command_t::command);
+Commander::KeywordTable<Commander::zone_typename_t> Commander::zone_typenames_table(zone_typenames, &zone_typename_t::string);
+Commander::KeywordTable<Commander::area_action_t> Commander::area_actions_table(area_actions_list, &area_action_t::action);
+Commander::KeywordTable<Commander::zone_action_t> Commander::zone_actions_table(zone_actions_list, &zone_action_t::action);
+Commander::KeywordTable<Commander::zone_parameter_option_t> Commander::zone_parameter_options_table(zone_parameter_options_list, &zone_parameter_option_t::action);
+Commander::KeywordTable<Commander::zone_parameter_flag_t> Commander::zone_parameter_flags_table(zone_parameter_flags_list, &zone_parameter_flag_t::action);
+Commander::KeywordTable<Commander::zone_set_state_t> Commander::zone_set_states_table(zone_set_states_list, &zone_set_state_t::action);
+Commander::KeywordTable<Commander::zones_action_t> Commander::zones_actions_table(zones_actions_list, &zones_action_t::action);
+Commander::KeywordTable<Commander::output_action_t> Commander::output_actions_table(output_actions_list, &output_action_t::action);
+Commander::KeywordTable<Commander::poll_action_t> Commander::poll_actions_table(poll_actions_list, &poll_action_t::action);
+Commander::KeywordTable<Commander::poll_item_t> Commander::poll_items_table(poll_items_list, &poll_item_t::item);
+Commander::KeywordTable<Commander::code_alarm_module_t> Commander::code_alarm_modules_table(code_alarm_modules_list, &code_alarm_module_t::module);
+
 const char Commander::json_standard_reply_fmt[]  = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"success\":%u,\"command\":\"%s\",\"replyText\":\"\"}";
 const char Commander::json_command_error_fmt[]   = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"success\":%u,\"command\":\"%s\",\"replyText\":\"%s\"}";
 const char Commander::json_command_help_fmt[]    = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"success\":%u,\"command\":\"%s\",\"helpText\":\"%s\"}";
@@ -180,10 +195,7 @@ const char Commander::json_zone_omit_state_fmt[] = "{\"typeId\":%u,\"typeDesc\":
 const char Commander::json_zone_state_fmt[]      = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"zoneNumber\":%u,\"zoneState\":%u}";
 const char Commander::json_all_zone_state_fmt[]  = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"zoneState\":[%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u]}";
 const char Commander::json_output_state_fmt[]    = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"outputState\":[%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u]}";
-
-const char Commander::poll_all_area_fmt[]        = "[%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u]";
-const char Commander::poll_all_zone_state_fmt[]  = "[%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u]";
-const char Commander::poll_output_state_fmt[]    = "[%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u]";
+const char Commander::json_statistics_fmt[]      = "{\"typeId\":%u,\"typeDesc\":\"%s\",\"success\":%u,\"command\":\"%s\",\"stats\":%s}";
 
 const char Commander::json_authorization_required_fmt[] = "{\"typeId\":%u,\"typeDesc\":\"%llX\",\"replyText\":\"%s\"}"; // hack: typeDesc == session_id && replyText = user full name
 const char Commander::json_authentication_accepted_fmt[] = "{\"typeId\":%u,\"typeDesc\":\"%s\"}";
@@ -209,24 +221,22 @@ const char* Commander::CommanderTypeDesc[] = {
   "output states",
   "polling loop",
   "authorization required",
-  "authentication accepted"
+  "authentication accepted",
+  "statistics"
 };
 
 Commander::Commander(openGalaxy& openGalaxy)
- : m_openGalaxy(openGalaxy)
+ : m_openGalaxy(openGalaxy), m_task(openGalaxy.executor(), [this]{ run(); })
 {
-  m_thread = new std::thread(Commander::Thread, this);
 }
 
 Commander::~Commander()
 {
-  delete m_thread;
 }
 
 void Commander::notify()
 {
-  m_cv_notified = true;
-  m_request_cv.notify_one();
+  m_task.schedule();
 }
 
 // Helper function for the default JSON formatted reply to a command
@@ -284,12 +294,8 @@ int Commander::isZoneType(const char *s)
   int retv = -1;
   int number;
 
-  for(int t=0; zone_typenames[t].number != 0; t++){
-    if(strcmp(zone_typenames[t].string, s) == 0){
-      retv = zone_typenames[t].number;
-      break;
-    }
-  }
+  struct zone_typename_t *z = zone_typenames_table.find(s);
+  if(z->string) retv = z->number;
   if(retv < 0){
     // not found in the list, is the 1st char a digit?
     if(s[0]>='0' && s[0]<='9'){
@@ -300,14 +306,248 @@ int Commander::isZoneType(const char *s)
   return retv;
 }
 
+// Splits the text in 'buf' into at most 'max' words separated by spaces
+// or tabs, in place, and converts the words to uppercase.
+// Unused entries in 'words' are set to nullptr and 'rest' is set to
+// the (unconverted) text after the last word, or nullptr if there is none.
+// Returns the number of words.
+int Commander::Tokenize(char *buf, char *words[], int max, char **rest)
+{
+  int n = 0;
+  char *p = buf;
+  *rest = nullptr;
+  while(n < max){
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p == '\0') break;
+    words[n++] = p;
+    while(*p && *p != ' ' && *p != '\t'){
+      *p = toupper(*p);
+      p++;
+    }
+    if(*p == '\0') break;
+    *p++ = '\0';
+  }
+  if(n == max && *p) *rest = p;
+  for(int i = n; i < max; i++) words[i] = nullptr;
+  return n;
+}
+
+// Returns true if the 'length' characters at 'line' are a MACRO command
+static bool IsMacro(const char *line, size_t length)
+{
+  while(length > 0 && (*line == ' ' || *line == '\t')){
+    line++;
+    length--;
+  }
+  return length >= 5 && strncasecmp(line, "MACRO", 5) == 0 &&
+    (length == 5 || line[5] == ' ' || line[5] == '\t');
+}
+
+// Sends the output of the last executed command back to the client,
+// or adds it to the combined reply of a batch.
+void Commander::AddReply(PendingCommand& cmd, bool batch)
+{
+  std::string& replies = cmd.replies;
+  int& count = cmd.count;
+  size_t n = strlen((char*)commander_output_buffer);
+  if(n == 0) return;
+  if(batch == false){
+    cmd.callback(*cmd.opengalaxy, &cmd.session, cmd.user, (char*)commander_output_buffer);
+    return;
+  }
+  // Send what we have when this reply does not fit in the same message
+  if(count > 0 && replies.size() + n + 2 >= Websocket::WS_BUFFER_SIZE){
+    replies += ']';
+    cmd.callback(*cmd.opengalaxy, &cmd.session, cmd.user, (char*)replies.c_str());
+    replies.clear();
+    count = 0;
+  }
+  replies += (count++ == 0) ? '[' : ',';
+  replies.append((char*)commander_output_buffer, n);
+}
+
+// Executes every line of a pending command as a separate command.
+//
+// A client may send many commands in one message (one command per line)
+// to have them executed as a single batch. The replies to a batch are
+// combined into JSON arrays, each no larger than the websocket buffer,
+// so the client gets a few messages back instead of one per command.
+//
+// Returns false when a line waits for the panel to answer, the line is
+// executed again (and the batch continued) once it did. (see run())
+bool Commander::ExecBatch(PendingCommand& cmd)
+{
+  const char *begin = cmd.command.data();
+  const char *end = begin + cmd.command.size();
+
+  // Find the non-empty lines, only a message with more than one of them
+  // (or a macro) is a batch
+  const char *line = begin;
+  size_t line_length = cmd.command.size();
+  int lines = 0;
+  for(const char *q = begin; q <= end; ){
+    const char *eol = (const char*)memchr(q, '\n', end - q);
+    if(eol == nullptr) eol = end;
+    size_t length = eol - q;
+    if(length > 0 && q[length - 1] == '\r') length--;
+    size_t i = 0;
+    while(i < length && isspace(q[i])) i++;
+    if(i < length && lines++ == 0){
+      line = q;
+      line_length = length;
+    }
+    q = eol + 1;
+  }
+  bool batch = cmd.user == nullptr && (lines > 1 || (lines == 1 && IsMacro(line, line_length)));
+
+  if(batch == false){
+    commander_output_buffer[0] = '\0';
+    ExecCmd(cmd, line, line_length);
+    if(cmd.await.pending) return false;
+    AddReply(cmd, false);
+    return true;
+  }
+
+  while(cmd.offset <= cmd.command.size()){
+    const char *p = begin + cmd.offset;
+    const char *eol = (const char*)memchr(p, '\n', end - p);
+    if(eol == nullptr) eol = end;
+    size_t length = eol - p;
+    if(length > 0 && p[length - 1] == '\r') length--;
+
+    // Skip empty lines in a batch
+    size_t i = 0;
+    while(i < length && isspace(p[i])) i++;
+    if(i < length){
+      if(IsMacro(p, length)){
+        if(ExecMacro(cmd, p, length) == false) return false;
+      }
+      else {
+        commander_output_buffer[0] = '\0';
+        ExecCmd(cmd, p, length);
+        if(cmd.await.pending) return false;
+        AddReply(cmd, true);
+        cmd.await.reset();
+      }
+    }
+    cmd.offset = eol - begin + 1;
+  }
+
+  if(cmd.count > 0){
+    cmd.replies += ']';
+    cmd.callback(*cmd.opengalaxy, &cmd.session, cmd.user, (char*)cmd.replies.c_str());
+  }
+  return true;
+}
+
+// MACRO <name> [arg1 .. arg9]
+//
+// Executes the commands of a macro from the configuration file as one
+// transaction: the remote login to the panel is kept open from the first
+// to the last command. The reply to each command is added to the batch,
+// followed by a standard reply that is successfull only when all
+// commands were.
+//
+// Returns false when a command waits for the panel to answer,
+// the macro continues with that command once it did.
+bool Commander::ExecMacro(PendingCommand& cmd, const char *line, size_t length)
+{
+  char _command[length + 1];
+  memcpy(_command, line, length);
+  _command[length] = '\0';
+
+  if(cmd.macro == false){
+    char buf[length + 1];
+    memcpy(buf, _command, length + 1);
+
+    // MACRO, the name and the arguments for %1 to %9
+    char *words[11], *rest;
+    int n = Tokenize(buf, words, 11, &rest);
+
+    std::map<std::string, std::string>& macros = opengalaxy().settings().macros;
+    std::map<std::string, std::string>::iterator m = macros.end();
+    const char *error = nullptr;
+    if(n < 2) error = "requires an (other) argument!";
+    else if((m = macros.find(words[1])) == macros.end()) error = "No such macro!";
+    if(error){
+      snprintf(
+        (char*)commander_output_buffer,
+        sizeof(commander_output_buffer),
+        json_command_error_fmt,
+        static_cast<unsigned int>(json_reply_id::standard),
+        CommanderTypeDesc[static_cast<int>(json_reply_id::standard)],
+        false,
+        _command,
+        error
+      );
+      AddReply(cmd, true);
+      return true;
+    }
+
+    // Substitute the arguments
+    cmd.steps.clear();
+    for(const char *s = m->second.c_str(); *s; s++){
+      if(s[0] == '%' && s[1] >= '1' && s[1] <= '9'){
+        int arg = s[1] - '0' + 1;
+        if(arg < n) cmd.steps += words[arg];
+        s++;
+      }
+      else cmd.steps += *s;
+    }
+
+    opengalaxy().syslog().debug("Commander: Executing macro %s", words[1]);
+
+    // Execute the commands under one remote login
+    cmd.macro = true;
+    cmd.step = 0;
+    cmd.success = true;
+    opengalaxy().receiver().holdSession();
+  }
+
+  const char *begin = cmd.steps.data();
+  const char *end = begin + cmd.steps.size();
+  while(cmd.step < cmd.steps.size()){
+    const char *p = begin + cmd.step;
+    const char *eol = (const char*)memchr(p, '\n', end - p);
+    if(eol == nullptr) eol = end;
+    commander_output_buffer[0] = '\0';
+    if(IsMacro(p, eol - p)){
+      snprintf(
+        (char*)commander_output_buffer,
+        sizeof(commander_output_buffer),
+        json_command_error_fmt,
+        static_cast<unsigned int>(json_reply_id::standard),
+        CommanderTypeDesc[static_cast<int>(json_reply_id::standard)],
+        false,
+        "MACRO",
+        "A macro cannot execute another macro!"
+      );
+      cmd.success = false;
+    }
+    else {
+      bool retv = ExecCmd(cmd, p, eol - p);
+      if(cmd.await.pending) return false;
+      if(retv == false) cmd.success = false;
+    }
+    AddReply(cmd, true);
+    cmd.await.reset();
+    cmd.step = eol - begin + 1;
+  }
+  cmd.macro = false;
+  opengalaxy().receiver().releaseSession();
+
+  ReportCommandExec(cmd.success, _command);
+  AddReply(cmd, true);
+  return true;
+}
+
 // TODO: Split this up into nice little sub-functions (one 'command' per function)
-bool Commander::ExecCmd(PendingCommand& cmd)
+bool Commander::ExecCmd(PendingCommand& cmd, const char *cmdline, size_t length)
 {
   // \ \t<command>\ \t[arg1]\ \t[argn]\ \t
 
   unsigned int t, len;
-  const char delim[] = " \t";
-  char *saveptr, *command, *arg1, *arg2, *arg3, *arg4, *arg5, *argn;
+  char *words[6], *command, *arg1, *arg2, *arg3, *arg4, *arg5, *argn;
   bool retv = false;
 
   // Put (some of) these in unions to save a little memory because
@@ -335,45 +575,28 @@ bool Commander::ExecCmd(PendingCommand& cmd)
 
   // Compose the command string to echo back together with a standard JSON reply
   // (Hopefully, this filters any ASCII characters that will choke the javascript JSON.parse() command)
-  const char *_command = cmd.command.c_str();
+  char _command[length + 1];
+  memcpy(_command, cmdline, length);
+  _command[length] = '\0';
 
-  // Copy the command to a local buffer so strtok_r() can safely modify it
-  char cmdbuf[cmd.command.size()+1];
-  strcpy(cmdbuf, cmd.command.data());
-  if(cmdbuf == nullptr){
-    retv = false;
-    goto exit;
-  }
+  // Copy the command to a local buffer so Tokenize() can safely modify it
+  char cmdbuf[length + 1];
+  memcpy(cmdbuf, _command, length + 1);
 
-  // Get the name of the command to execute and its arguments
-  command = strtok_r(cmdbuf, delim, &saveptr);
-  if(command == nullptr){
+  // Get the name of the command to execute and its arguments (in uppercase)
+  if(Tokenize(cmdbuf, words, 6, &argn) == 0){
     retv = false;
     goto exit;
   }
-  arg1 = strtok_r(nullptr, delim, &saveptr);
-  arg2 = strtok_r(nullptr, delim, &saveptr);
-  arg3 = strtok_r(nullptr, delim, &saveptr);
-  arg4 = strtok_r(nullptr, delim, &saveptr);
-  arg5 = strtok_r(nullptr, delim, &saveptr);
-  argn = saveptr;
-  if(argn && strlen(argn) == 0) argn = nullptr;
-
-  // convert command and arg1 .. arg5 to uppercase 
-  if(command) for(t=0; t<strlen(command); t++) command[t] = toupper( command[t] );
-  if(arg1) for(t=0; t<strlen(arg1); t++) arg1[t] = toupper( arg1[t] );
-  if(arg2) for(t=0; t<strlen(arg2); t++) arg2[t] = toupper( arg2[t] );
-  if(arg3) for(t=0; t<strlen(arg3); t++) arg3[t] = toupper( arg3[t] );
-  if(arg4) for(t=0; t<strlen(arg4); t++) arg4[t] = toupper( arg4[t] );
-  if(arg5) for(t=0; t<strlen(arg5); t++) arg5[t] = toupper( arg5[t] );
-
-  // Locate the index for the command in the list of commands
-  for(t=0; commands_list[t].index != Commander::cmd::count; t++){
-    if(strcmp(commands_list[t].command, command) == 0) break;
-  }
+  command = words[0];
+  arg1 = words[1];
+  arg2 = words[2];
+  arg3 = words[3];
+  arg4 = words[4];
+  arg5 = words[5];
 
   // Parse the rest of the command
-  switch(commands_list[t].index) {
+  switch(commands_table.find(command)->index) {
 
     case Commander::cmd::help: // HELP
       len = snprintf(
@@ -413,11 +636,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
       }
 
       // Find the index of the action in the list actions for this command
-      for(t=0; area_actions_list[t].index != Commander::area_action::count; t++){
-        if(strcmp(area_actions_list[t].action, arg2) == 0) break;
-      }
-
-      action.area = &area_actions_list[t];
+      action.area = area_actions_table.find(arg2);
       t = isArea(arg1);
 
       switch(action.area->index){
@@ -444,39 +663,19 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           if( t == 0 ) {
             retv = opengalaxy().galaxy().GetAllAreasArmedState(state.armed);
             if(retv == true){
-              // Command called from the polling thread?
-              if(cmd.user != nullptr){
-                // Yes, format the output so poll_callback() can use it without having to decode a JSON object
-                struct Poll::poll_userdata *user = (struct Poll::poll_userdata*)cmd.user;
-                user->item = Poll::possible_items::areas; // signal to poll_callback() that these are area states
-                len = snprintf(
-                  (char*)commander_output_buffer,
-                  sizeof(commander_output_buffer),
-                  poll_all_area_fmt,
-                  static_cast<unsigned int>(state.armed[0]), static_cast<unsigned int>(state.armed[1]), static_cast<unsigned int>(state.armed[2]), static_cast<unsigned int>(state.armed[3]), static_cast<unsigned int>(state.armed[4]), static_cast<unsigned int>(state.armed[5]),
-                  static_cast<unsigned int>(state.armed[6]), static_cast<unsigned int>(state.armed[7]), static_cast<unsigned int>(state.armed[8]), static_cast<unsigned int>(state.armed[9]), static_cast<unsigned int>(state.armed[10]), static_cast<unsigned int>(state.armed[11]),
-                  static_cast<unsigned int>(state.armed[12]), static_cast<unsigned int>(state.armed[13]), static_cast<unsigned int>(state.armed[14]), static_cast<unsigned int>(state.armed[15]), static_cast<unsigned int>(state.armed[16]), static_cast<unsigned int>(state.armed[17]),
-                  static_cast<unsigned int>(state.armed[18]), static_cast<unsigned int>(state.armed[19]), static_cast<unsigned int>(state.armed[20]), static_cast<unsigned int>(state.armed[21]), static_cast<unsigned int>(state.armed[22]), static_cast<unsigned int>(state.armed[23]),
-                  static_cast<unsigned int>(state.armed[24]), static_cast<unsigned int>(state.armed[25]), static_cast<unsigned int>(state.armed[26]), static_cast<unsigned int>(state.armed[27]), static_cast<unsigned int>(state.armed[28]), static_cast<unsigned int>(state.armed[29]),
-                  static_cast<unsigned int>(state.armed[30]), static_cast<unsigned int>(state.armed[31])
-                );
-              }
-              else {
-                // No, send a JSON object to the client
-                len = snprintf(
-                  (char*)commander_output_buffer,
-                  sizeof(commander_output_buffer),
-                  json_all_area_fmt,
-                  static_cast<unsigned int>(json_reply_id::all_areas_armed_states),
-                  CommanderTypeDesc[static_cast<int>(json_reply_id::all_areas_armed_states)],
-                  static_cast<unsigned int>(state.armed[0]), static_cast<unsigned int>(state.armed[1]), static_cast<unsigned int>(state.armed[2]), static_cast<unsigned int>(state.armed[3]), static_cast<unsigned int>(state.armed[4]), static_cast<unsigned int>(state.armed[5]),
-                  static_cast<unsigned int>(state.armed[6]), static_cast<unsigned int>(state.armed[7]), static_cast<unsigned int>(state.armed[8]), static_cast<unsigned int>(state.armed[9]), static_cast<unsigned int>(state.armed[10]), static_cast<unsigned int>(state.armed[11]),
-                  static_cast<unsigned int>(state.armed[12]), static_cast<unsigned int>(state.armed[13]), static_cast<unsigned int>(state.armed[14]), static_cast<unsigned int>(state.armed[15]), static_cast<unsigned int>(state.armed[16]), static_cast<unsigned int>(state.armed[17]),
-                  static_cast<unsigned int>(state.armed[18]), static_cast<unsigned int>(state.armed[19]), static_cast<unsigned int>(state.armed[20]), static_cast<unsigned int>(state.armed[21]), static_cast<unsigned int>(state.armed[22]), static_cast<unsigned int>(state.armed[23]),
-                  static_cast<unsigned int>(state.armed[24]), static_cast<unsigned int>(state.armed[25]), static_cast<unsigned int>(state.armed[26]), static_cast<unsigned int>(state.armed[27]), static_cast<unsigned int>(state.armed[28]), static_cast<unsigned int>(state.armed[29]),
-                  static_cast<unsigned int>(state.armed[30]), static_cast<unsigned int>(state.armed[31])
-                );
-              }
+              len = snprintf(
+                (char*)commander_output_buffer,
+                sizeof(commander_output_buffer),
+                json_all_area_fmt,
+                static_cast<unsigned int>(json_reply_id::all_areas_armed_states),
+                CommanderTypeDesc[static_cast<int>(json_reply_id::all_areas_armed_states)],
+                static_cast<unsigned int>(state.armed[0]), static_cast<unsigned int>(state.armed[1]), static_cast<unsigned int>(state.armed[2]), static_cast<unsigned int>(state.armed[3]), static_cast<unsigned int>(state.armed[4]), static_cast<unsigned int>(state.armed[5]),
+                static_cast<unsigned int>(state.armed[6]), static_cast<unsigned int>(state.armed[7]), static_cast<unsigned int>(state.armed[8]), static_cast<unsigned int>(state.armed[9]), static_cast<unsigned int>(state.armed[10]), static_cast<unsigned int>(state.armed[11]),
+                static_cast<unsigned int>(state.armed[12]), static_cast<unsigned int>(state.armed[13]), static_cast<unsigned int>(state.armed[14]), static_cast<unsigned int>(state.armed[15]), static_cast<unsigned int>(state.armed[16]), static_cast<unsigned int>(state.armed[17]),
+                static_cast<unsigned int>(state.armed[18]), static_cast<unsigned int>(state.armed[19]), static_cast<unsigned int>(state.armed[20]), static_cast<unsigned int>(state.armed[21]), static_cast<unsigned int>(state.armed[22]), static_cast<unsigned int>(state.armed[23]),
+                static_cast<unsigned int>(state.armed[24]), static_cast<unsigned int>(state.armed[25]), static_cast<unsigned int>(state.armed[26]), static_cast<unsigned int>(state.armed[27]), static_cast<unsigned int>(state.armed[28]), static_cast<unsigned int>(state.armed[29]),
+                static_cast<unsigned int>(state.armed[30]), static_cast<unsigned int>(state.armed[31])
+              );
             }
             else ReportCommandExec(retv, _command);
           }
@@ -499,39 +698,19 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           retv = opengalaxy().galaxy().GetAllAreasAlarmState(state.alarm);
           if(retv == true){
             if(t == 0){
-              // Command called from the polling thread?
-              if(cmd.user != nullptr){
-                // Yes, format the output so poll_callback() can use it without having to decode a JSON object
-                struct Poll::poll_userdata *user = (struct Poll::poll_userdata*)cmd.user;
-                user->item = Poll::possible_items::areas; // signal to poll_callback() that these are area states
-                len = snprintf(
-                  (char*)commander_output_buffer,
-                  sizeof(commander_output_buffer),
-                  poll_all_area_fmt,
-                  static_cast<unsigned int>(state.alarm[0]), static_cast<unsigned int>(state.alarm[1]), static_cast<unsigned int>(state.alarm[2]), static_cast<unsigned int>(state.alarm[3]), static_cast<unsigned int>(state.alarm[4]), static_cast<unsigned int>(state.alarm[5]),
-                  static_cast<unsigned int>(state.alarm[6]), static_cast<unsigned int>(state.alarm[7]), static_cast<unsigned int>(state.alarm[8]), static_cast<unsigned int>(state.alarm[9]), static_cast<unsigned int>(state.alarm[10]), static_cast<unsigned int>(state.alarm[11]),
-                  static_cast<unsigned int>(state.alarm[12]), static_cast<unsigned int>(state.alarm[13]), static_cast<unsigned int>(state.alarm[14]), static_cast<unsigned int>(state.alarm[15]), static_cast<unsigned int>(state.alarm[16]), static_cast<unsigned int>(state.alarm[17]),
-                  static_cast<unsigned int>(state.alarm[18]), static_cast<unsigned int>(state.alarm[19]), static_cast<unsigned int>(state.alarm[20]), static_cast<unsigned int>(state.alarm[21]), static_cast<unsigned int>(state.alarm[22]), static_cast<unsigned int>(state.alarm[23]),
-                  static_cast<unsigned int>(state.alarm[24]), static_cast<unsigned int>(state.alarm[25]), static_cast<unsigned int>(state.alarm[26]), static_cast<unsigned int>(state.alarm[27]), static_cast<unsigned int>(state.alarm[28]), static_cast<unsigned int>(state.alarm[29]),
-                  static_cast<unsigned int>(state.alarm[30]), static_cast<unsigned int>(state.alarm[31])
-                );
-              }
-              else {
-                // No, send a JSON object to the client
-                len = snprintf(
-                  (char*)&commander_output_buffer[0],
-                  sizeof(commander_output_buffer),
-                  json_all_area_fmt,
-                  static_cast<unsigned int>(json_reply_id::all_areas_alarm_states),
-                  CommanderTypeDesc[static_cast<int>(json_reply_id::all_areas_alarm_states)],
-                  static_cast<unsigned int>(state.alarm[0]), static_cast<unsigned int>(state.alarm[1]), static_cast<unsigned int>(state.alarm[2]), static_cast<unsigned int>(state.alarm[3]), static_cast<unsigned int>(state.alarm[4]), static_cast<unsigned int>(state.alarm[5]),
-                  static_cast<unsigned int>(state.alarm[6]), static_cast<unsigned int>(state.alarm[7]), static_cast<unsigned int>(state.alarm[8]), static_cast<unsigned int>(state.alarm[9]), static_cast<unsigned int>(state.alarm[10]), static_cast<unsigned int>(state.alarm[11]),
-                  static_cast<unsigned int>(state.alarm[12]), static_cast<unsigned int>(state.alarm[13]), static_cast<unsigned int>(state.alarm[14]), static_cast<unsigned int>(state.alarm[15]), static_cast<unsigned int>(state.alarm[16]), static_cast<unsigned int>(state.alarm[17]),
-                  static_cast<unsigned int>(state.alarm[18]), static_cast<unsigned int>(state.alarm[19]), static_cast<unsigned int>(state.alarm[20]), static_cast<unsigned int>(state.alarm[21]), static_cast<unsigned int>(state.alarm[22]), static_cast<unsigned int>(state.alarm[23]),
-                  static_cast<unsigned int>(state.alarm[24]), static_cast<unsigned int>(state.alarm[25]), static_cast<unsigned int>(state.alarm[26]), static_cast<unsigned int>(state.alarm[27]), static_cast<unsigned int>(state.alarm[28]), static_cast<unsigned int>(state.alarm[29]),
-                  static_cast<unsigned int>(state.alarm[30]), static_cast<unsigned int>(state.alarm[31])
-                );
-              }
+              len = snprintf(
+                (char*)&commander_output_buffer[0],
+                sizeof(commander_output_buffer),
+                json_all_area_fmt,
+                static_cast<unsigned int>(json_reply_id::all_areas_alarm_states),
+                CommanderTypeDesc[static_cast<int>(json_reply_id::all_areas_alarm_states)],
+                static_cast<unsigned int>(state.alarm[0]), static_cast<unsigned int>(state.alarm[1]), static_cast<unsigned int>(state.alarm[2]), static_cast<unsigned int>(state.alarm[3]), static_cast<unsigned int>(state.alarm[4]), static_cast<unsigned int>(state.alarm[5]),
+                static_cast<unsigned int>(state.alarm[6]), static_cast<unsigned int>(state.alarm[7]), static_cast<unsigned int>(state.alarm[8]), static_cast<unsigned int>(state.alarm[9]), static_cast<unsigned int>(state.alarm[10]), static_cast<unsigned int>(state.alarm[11]),
+                static_cast<unsigned int>(state.alarm[12]), static_cast<unsigned int>(state.alarm[13]), static_cast<unsigned int>(state.alarm[14]), static_cast<unsigned int>(state.alarm[15]), static_cast<unsigned int>(state.alarm[16]), static_cast<unsigned int>(state.alarm[17]),
+                static_cast<unsigned int>(state.alarm[18]), static_cast<unsigned int>(state.alarm[19]), static_cast<unsigned int>(state.alarm[20]), static_cast<unsigned int>(state.alarm[21]), static_cast<unsigned int>(state.alarm[22]), static_cast<unsigned int>(state.alarm[23]),
+                static_cast<unsigned int>(state.alarm[24]), static_cast<unsigned int>(state.alarm[25]), static_cast<unsigned int>(state.alarm[26]), static_cast<unsigned int>(state.alarm[27]), static_cast<unsigned int>(state.alarm[28]), static_cast<unsigned int>(state.alarm[29]),
+                static_cast<unsigned int>(state.alarm[30]), static_cast<unsigned int>(state.alarm[31])
+              );
             }
             else {
               if(t > 32) retv = false;
@@ -551,39 +730,19 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           retv = opengalaxy().galaxy().GetAllAreasReadyState(state.ready);
           if(retv == true){
             if(t == 0){
-              // Command called from the polling thread?
-              if(cmd.user != nullptr){
-                // Yes, format the output so poll_callback() can use it without having to decode a JSON object
-                struct Poll::poll_userdata *user = (struct Poll::poll_userdata*)cmd.user;
-                user->item = Poll::possible_items::areas; // signal to poll_callback() that these are area states
-                len = snprintf(
-                  (char*)commander_output_buffer,
-                  sizeof(commander_output_buffer),
-                  poll_all_area_fmt,
-                  static_cast<unsigned int>(state.ready[0]), static_cast<unsigned int>(state.ready[1]), static_cast<unsigned int>(state.ready[2]), static_cast<unsigned int>(state.ready[3]), static_cast<unsigned int>(state.ready[4]), static_cast<unsigned int>(state.ready[5]),
-                  static_cast<unsigned int>(state.ready[6]), static_cast<unsigned int>(state.ready[7]), static_cast<unsigned int>(state.ready[8]), static_cast<unsigned int>(state.ready[9]), static_cast<unsigned int>(state.ready[10]), static_cast<unsigned int>(state.ready[11]),
-                  static_cast<unsigned int>(state.ready[12]), static_cast<unsigned int>(state.ready[13]), static_cast<unsigned int>(state.ready[14]), static_cast<unsigned int>(state.ready[15]), static_cast<unsigned int>(state.ready[16]), static_cast<unsigned int>(state.ready[17]),
-                  static_cast<unsigned int>(state.ready[18]), static_cast<unsigned int>(state.ready[19]), static_cast<unsigned int>(state.ready[20]), static_cast<unsigned int>(state.ready[21]), static_cast<unsigned int>(state.ready[22]), static_cast<unsigned int>(state.ready[23]),
-                  static_cast<unsigned int>(state.ready[24]), static_cast<unsigned int>(state.ready[25]), static_cast<unsigned int>(state.ready[26]), static_cast<unsigned int>(state.ready[27]), static_cast<unsigned int>(state.ready[28]), static_cast<unsigned int>(state.ready[29]),
-                  static_cast<unsigned int>(state.ready[30]), static_cast<unsigned int>(state.ready[31])
-                );
-              }
-              else {
-                // No, send a JSON object to the client
-                len = snprintf(
-                  (char*)commander_output_buffer,
-                  sizeof(commander_output_buffer),
-                  json_all_area_fmt,
-                  static_cast<unsigned int>(json_reply_id::all_areas_ready_states),
-                  CommanderTypeDesc[static_cast<int>(json_reply_id::all_areas_ready_states)],
-                  static_cast<unsigned int>(state.ready[0]), static_cast<unsigned int>(state.ready[1]), static_cast<unsigned int>(state.ready[2]), static_cast<unsigned int>(state.ready[3]), static_cast<unsigned int>(state.ready[4]), static_cast<unsigned int>(state.ready[5]),
-                  static_cast<unsigned int>(state.ready[6]), static_cast<unsigned int>(state.ready[7]), static_cast<unsigned int>(state.ready[8]), static_cast<unsigned int>(state.ready[9]), static_cast<unsigned int>(state.ready[10]), static_cast<unsigned int>(state.ready[11]),
-                  static_cast<unsigned int>(state.ready[12]), static_cast<unsigned int>(state.ready[13]), static_cast<unsigned int>(state.ready[14]), static_cast<unsigned int>(state.ready[15]), static_cast<unsigned int>(state.ready[16]), static_cast<unsigned int>(state.ready[17]),
-                  static_cast<unsigned int>(state.ready[18]), static_cast<unsigned int>(state.ready[19]), static_cast<unsigned int>(state.ready[20]), static_cast<unsigned int>(state.ready[21]), static_cast<unsigned int>(state.ready[22]), static_cast<unsigned int>(state.ready[23]),
-                  static_cast<unsigned int>(state.ready[24]), static_cast<unsigned int>(state.ready[25]), static_cast<unsigned int>(state.ready[26]), static_cast<unsigned int>(state.ready[27]), static_cast<unsigned int>(state.ready[28]), static_cast<unsigned int>(state.ready[29]),
-                  static_cast<unsigned int>(state.ready[30]), static_cast<unsigned int>(state.ready[31])
-                );
-              }
+              len = snprintf(
+                (char*)commander_output_buffer,
+                sizeof(commander_output_buffer),
+                json_all_area_fmt,
+                static_cast<unsigned int>(json_reply_id::all_areas_ready_states),
+                CommanderTypeDesc[static_cast<int>(json_reply_id::all_areas_ready_states)],
+                static_cast<unsigned int>(state.ready[0]), static_cast<unsigned int>(state.ready[1]), static_cast<unsigned int>(state.ready[2]), static_cast<unsigned int>(state.ready[3]), static_cast<unsigned int>(state.ready[4]), static_cast<unsigned int>(state.ready[5]),
+                static_cast<unsigned int>(state.ready[6]), static_cast<unsigned int>(state.ready[7]), static_cast<unsigned int>(state.ready[8]), static_cast<unsigned int>(state.ready[9]), static_cast<unsigned int>(state.ready[10]), static_cast<unsigned int>(state.ready[11]),
+                static_cast<unsigned int>(state.ready[12]), static_cast<unsigned int>(state.ready[13]), static_cast<unsigned int>(state.ready[14]), static_cast<unsigned int>(state.ready[15]), static_cast<unsigned int>(state.ready[16]), static_cast<unsigned int>(state.ready[17]),
+                static_cast<unsigned int>(state.ready[18]), static_cast<unsigned int>(state.ready[19]), static_cast<unsigned int>(state.ready[20]), static_cast<unsigned int>(state.ready[21]), static_cast<unsigned int>(state.ready[22]), static_cast<unsigned int>(state.ready[23]),
+                static_cast<unsigned int>(state.ready[24]), static_cast<unsigned int>(state.ready[25]), static_cast<unsigned int>(state.ready[26]), static_cast<unsigned int>(state.ready[27]), static_cast<unsigned int>(state.ready[28]), static_cast<unsigned int>(state.ready[29]),
+                static_cast<unsigned int>(state.ready[30]), static_cast<unsigned int>(state.ready[31])
+              );
             }
             else {
               if(t > 32) retv = false;
@@ -635,11 +794,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
       }
 
       // Find the index of the action in the list actions for this command
-      for(t=0; zone_actions_list[t].index != Commander::zone_action::count; t++ ) {
-        if(strcmp(zone_actions_list[t].action, arg2) == 0) break;
-      }
-
-      action.zone = &zone_actions_list[t];
+      action.zone = zone_actions_table.find(arg2);
       t = isZoneType(arg1); // translate arg1 into zone number or zone type number
 
       switch(action.zone->index){
@@ -681,20 +836,14 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           break;
         case Commander::zone_action::parameter: // ZONE <nr> PARAMETER <option> <flag>
           {
-            int i, j;
+            int j;
             Galaxy::zone_program prg;
             //
             // Find the index of the zone parameter option in the list options for this command
-            for(i=0; zone_parameter_options_list[i].index != Commander::zone_parameter_option::count; i++ ) {
-              if(strcmp(zone_parameter_options_list[i].action, arg3) == 0) break;
-            }
-            zone_parameter_options = &zone_parameter_options_list[i];
+            zone_parameter_options = zone_parameter_options_table.find(arg3);
             //
             // Find the index of the zone parameter flag in the list of flags for the zone parameter command
-            for(j=0; zone_parameter_flags_list[j].index != Commander::zone_parameter_flag::count; j++ ) {
-              if(strcmp(zone_parameter_flags_list[j].action, arg4) == 0) break;
-            }
-            zone_parameter_flags = &zone_parameter_flags_list[j];
+            zone_parameter_flags = zone_parameter_flags_table.find(arg4);
             //
             switch( zone_parameter_flags->index ){
               case Commander::zone_parameter_flag::on:
@@ -760,15 +909,12 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           break;
         case Commander::zone_action::set: // ZONE <nr> SET <state> [<blknum> <type> [desc]]
           {
-            int i, blknum = 0, type = 0;
+            int blknum = 0, type = 0;
             char *desc = argn;
             Galaxy::zone_program prg;
             //
             // Find the index of the zone set state in the list of zone set states
-            for(i=0; zone_set_states_list[i].index != Commander::zone_set_state::count; i++ ) {
-              if(strcmp(zone_set_states_list[i].action, arg3) == 0) break;
-            }
-            zone_set_states = &zone_set_states_list[i];
+            zone_set_states = zone_set_states_table.find(arg3);
 
             if(arg4 != nullptr){
               blknum = isArea(arg4);
@@ -874,38 +1020,26 @@ bool Commander::ExecCmd(PendingCommand& cmd)
         }
 
         // Find the index of the action in the list actions for this command
-        for(t=0; zones_actions_list[t].index != Commander::zs_action::count; t++) {
-          if(strcmp(zones_actions_list[t].action, arg1) == 0) break;
-        }
-
-        action.zones = &zones_actions_list[t];
-
-        Poll::possible_items item;
+        action.zones = zones_actions_table.find(arg1);
 
         // Get the requested states
         switch( action.zones->index ) {
           case Commander::zs_action::ready:
-            item = Poll::possible_items::zones;
             retv = opengalaxy().galaxy().GetAllZonesReadyState(state.zones);
             break;
           case Commander::zs_action::alarm:
-            item = Poll::possible_items::zones;
             retv = opengalaxy().galaxy().GetAllZonesAlarmState(state.zones);
             break;
           case Commander::zs_action::open:
-            item = Poll::possible_items::zones;
             retv = opengalaxy().galaxy().GetAllZonesOpenState(state.zones);
             break;
           case Commander::zs_action::tamper:
-            item = Poll::possible_items::zones;
             retv = opengalaxy().galaxy().GetAllZonesTamperState(state.zones);
             break;
           case Commander::zs_action::rstate:
-            item = Poll::possible_items::zones;
             retv = opengalaxy().galaxy().GetAllZonesRState(state.zones);
             break;
           case Commander::zs_action::omitted:
-            item = Poll::possible_items::zones;
             retv = opengalaxy().galaxy().GetAllZonesOmittedState(state.zones);
             break;
           default:
@@ -924,45 +1058,22 @@ bool Commander::ExecCmd(PendingCommand& cmd)
         }
         // Print them if successfull
         if(retv == true){
-          // Command called from the polling thread?
-          if(cmd.user != nullptr){
-            // Yes, format the output so poll_callback() can use it without having to decode a JSON object
-            struct Poll::poll_userdata *user = (struct Poll::poll_userdata*)cmd.user;
-            user->item = item; // signal to poll_callback() that these are zone states
-            len = snprintf(
-              (char*)commander_output_buffer,
-              sizeof(commander_output_buffer),
-              poll_all_zone_state_fmt,
-              state.zones[0],  state.zones[1],  state.zones[2],  state.zones[3],  state.zones[4],  state.zones[5],  state.zones[6],  state.zones[7],
-              state.zones[8],  state.zones[9],  state.zones[10], state.zones[11], state.zones[12], state.zones[13], state.zones[14], state.zones[15],
-              state.zones[16], state.zones[17], state.zones[18], state.zones[19], state.zones[20], state.zones[21], state.zones[22], state.zones[23],
-              state.zones[24], state.zones[25], state.zones[26], state.zones[27], state.zones[28], state.zones[29], state.zones[30], state.zones[31],
-              state.zones[32], state.zones[33], state.zones[34], state.zones[35], state.zones[36], state.zones[37], state.zones[38], state.zones[39],
-              state.zones[40], state.zones[41], state.zones[42], state.zones[43], state.zones[44], state.zones[45], state.zones[46], state.zones[47],
-              state.zones[48], state.zones[49], state.zones[50], state.zones[51], state.zones[52], state.zones[53], state.zones[54], state.zones[55],
-              state.zones[56], state.zones[57], state.zones[58], state.zones[59], state.zones[60], state.zones[61], state.zones[62], state.zones[63],
-              state.zones[64]
-            );
-          }
-          else {
-            // No, send a JSON object to the client
-            len = snprintf(
-              (char*)commander_output_buffer,
-              sizeof(commander_output_buffer),
-              json_all_zone_state_fmt,
-              static_cast<int>(json_reply_id::all_zones_state_base) + static_cast<int>(action.zones->index),
-              CommanderTypeDesc[static_cast<int>(json_reply_id::all_zones_state_base) + static_cast<int>(action.zones->index)],
-              state.zones[0],  state.zones[1],  state.zones[2],  state.zones[3],  state.zones[4],  state.zones[5],  state.zones[6],  state.zones[7],
-              state.zones[8],  state.zones[9],  state.zones[10], state.zones[11], state.zones[12], state.zones[13], state.zones[14], state.zones[15],
-              state.zones[16], state.zones[17], state.zones[18], state.zones[19], state.zones[20], state.zones[21], state.zones[22], state.zones[23],
-              state.zones[24], state.zones[25], state.zones[26], state.zones[27], state.zones[28], state.zones[29], state.zones[30], state.zones[31],
-              state.zones[32], state.zones[33], state.zones[34], state.zones[35], state.zones[36], state.zones[37], state.zones[38], state.zones[39],
-              state.zones[40], state.zones[41], state.zones[42], state.zones[43], state.zones[44], state.zones[45], state.zones[46], state.zones[47],
-              state.zones[48], state.zones[49], state.zones[50], state.zones[51], state.zones[52], state.zones[53], state.zones[54], state.zones[55],
-              state.zones[56], state.zones[57], state.zones[58], state.zones[59], state.zones[60], state.zones[61], state.zones[62], state.zones[63],
-              state.zones[64]
-            );
-          }
+          len = snprintf(
+            (char*)commander_output_buffer,
+            sizeof(commander_output_buffer),
+            json_all_zone_state_fmt,
+            static_cast<int>(json_reply_id::all_zones_state_base) + static_cast<int>(action.zones->index),
+            CommanderTypeDesc[static_cast<int>(json_reply_id::all_zones_state_base) + static_cast<int>(action.zones->index)],
+            state.zones[0],  state.zones[1],  state.zones[2],  state.zones[3],  state.zones[4],  state.zones[5],  state.zones[6],  state.zones[7],
+            state.zones[8],  state.zones[9],  state.zones[10], state.zones[11], state.zones[12], state.zones[13], state.zones[14], state.zones[15],
+            state.zones[16], state.zones[17], state.zones[18], state.zones[19], state.zones[20], state.zones[21], state.zones[22], state.zones[23],
+            state.zones[24], state.zones[25], state.zones[26], state.zones[27], state.zones[28], state.zones[29], state.zones[30], state.zones[31],
+            state.zones[32], state.zones[33], state.zones[34], state.zones[35], state.zones[36], state.zones[37], state.zones[38], state.zones[39],
+            state.zones[40], state.zones[41], state.zones[42], state.zones[43], state.zones[44], state.zones[45], state.zones[46], state.zones[47],
+            state.zones[48], state.zones[49], state.zones[50], state.zones[51], state.zones[52], state.zones[53], state.zones[54], state.zones[55],
+            state.zones[56], state.zones[57], state.zones[58], state.zones[59], state.zones[60], state.zones[61], state.zones[62], state.zones[63],
+            state.zones[64]
+          );
         }
         else ReportCommandExec(retv, _command);
       }
@@ -973,35 +1084,17 @@ bool Commander::ExecCmd(PendingCommand& cmd)
         if(arg1 != nullptr) if(strcmp(arg1, "GETALL") == 0){ // get output state
           retv = opengalaxy().galaxy().GetAllOutputs(state.outputs);
           if(retv == true){
-            // Command called from the polling thread?
-            if(cmd.user != nullptr){
-              // Yes, format the output so poll_callback() can use it without having to decode a JSON object
-              struct Poll::poll_userdata *user = (struct Poll::poll_userdata*)cmd.user;
-              user->item = Poll::possible_items::outputs; // signal to poll_callback() that these are output states
-              len = snprintf(
-                (char*)commander_output_buffer,
-                sizeof(commander_output_buffer),
-                poll_output_state_fmt,
-                state.outputs[0],  state.outputs[1],  state.outputs[2],  state.outputs[3],  state.outputs[4],  state.outputs[5],  state.outputs[6],  state.outputs[7],
-                state.outputs[8],  state.outputs[9],  state.outputs[10], state.outputs[11], state.outputs[12], state.outputs[13], state.outputs[14], state.outputs[15],
-                state.outputs[16], state.outputs[17], state.outputs[18], state.outputs[19], state.outputs[20], state.outputs[21], state.outputs[22], state.outputs[23],
-                state.outputs[24], state.outputs[25], state.outputs[26], state.outputs[27], state.outputs[28], state.outputs[29], state.outputs[30], state.outputs[31]
-              );
-            }
-            else {
-              // No, send a JSON object to the client
-              len = snprintf(
-                (char*)commander_output_buffer,
-                sizeof(commander_output_buffer),
-                json_output_state_fmt,
-                static_cast<unsigned int>(json_reply_id::all_output_states),
-                CommanderTypeDesc[static_cast<int>(json_reply_id::all_output_states)],
-                state.outputs[0],  state.outputs[1],  state.outputs[2],  state.outputs[3],  state.outputs[4],  state.outputs[5],  state.outputs[6],  state.outputs[7],
-                state.outputs[8],  state.outputs[9],  state.outputs[10], state.outputs[11], state.outputs[12], state.outputs[13], state.outputs[14], state.outputs[15],
-                state.outputs[16], state.outputs[17], state.outputs[18], state.outputs[19], state.outputs[20], state.outputs[21], state.outputs[22], state.outputs[23],
-                state.outputs[24], state.outputs[25], state.outputs[26], state.outputs[27], state.outputs[28], state.outputs[29], state.outputs[30], state.outputs[31]
-              );
-            }
+            len = snprintf(
+              (char*)commander_output_buffer,
+              sizeof(commander_output_buffer),
+              json_output_state_fmt,
+              static_cast<unsigned int>(json_reply_id::all_output_states),
+              CommanderTypeDesc[static_cast<int>(json_reply_id::all_output_states)],
+              state.outputs[0],  state.outputs[1],  state.outputs[2],  state.outputs[3],  state.outputs[4],  state.outputs[5],  state.outputs[6],  state.outputs[7],
+              state.outputs[8],  state.outputs[9],  state.outputs[10], state.outputs[11], state.outputs[12], state.outputs[13], state.outputs[14], state.outputs[15],
+              state.outputs[16], state.outputs[17], state.outputs[18], state.outputs[19], state.outputs[20], state.outputs[21], state.outputs[22], state.outputs[23],
+              state.outputs[24], state.outputs[25], state.outputs[26], state.outputs[27], state.outputs[28], state.outputs[29], state.outputs[30], state.outputs[31]
+            );
           }
           else ReportCommandExec(retv, _command);
           break;
@@ -1027,11 +1120,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
         if(arg3 == nullptr) arg3 = (char*)"0";
 
         // Find the index of the action in the list actions for this command
-        for(t=0; output_actions_list[t].index != Commander::output_action::count; t++){
-          if(strcmp(output_actions_list[t].action, arg2) == 0) break;
-        }
-
-        action.output = &output_actions_list[t];
+        action.output = output_actions_table.find(arg2);
         t = strtoul(arg1, nullptr, 10);
 
         int a = isArea(arg3);
@@ -1099,10 +1188,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
         }
 
         // Find the index of the action in the list actions for this command
-        for(t=0; poll_actions_list[t].index != Commander::poll_action::count; t++){
-          if(strcmp(poll_actions_list[t].action, arg1) == 0) break;
-        }
-        action.poll = &poll_actions_list[t];
+        action.poll = poll_actions_table.find(arg1);
 
         // Do we explicitly need another argument?
         if( action.poll->index == Commander::poll_action::add || action.poll->index == Commander::poll_action::remove ){
@@ -1128,10 +1214,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
         }
 
         // Find the index of the item in the list items for this command
-        for(t=0; poll_items_list[t].index != Commander::poll_item::count; t++){
-          if(strcmp(poll_items_list[t].item, arg2) == 0) break;
-        }
-        item = &poll_items_list[t];
+        item = poll_items_table.find(arg2);
         if(item->index == Commander::poll_item::count){
           // if it was not an item, get the interval for the command
           interval = strtoul(arg2, nullptr, 10);
@@ -1174,6 +1257,9 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           case Commander::poll_action::one_shot:
             retv = ReportCommandExec(opengalaxy().poll().oneShot(&socket), _command);
             break;
+          case Commander::poll_action::delta:
+            retv = ReportCommandExec(opengalaxy().poll().setDelta(&socket), _command);
+            break;
           default:
             len = snprintf(
               (char*)commander_output_buffer,
@@ -1209,10 +1295,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
           break;
         }
         // Find the index of the module in the list modules for this command
-        for(t=0; code_alarm_modules_list[t].index != Commander::code_alarm_module::count; t++){
-          if(strcmp(code_alarm_modules_list[t].module, arg1) == 0) break;
-        }
-        action.code_alarm = &code_alarm_modules_list[t];
+        action.code_alarm = code_alarm_modules_table.find(arg1);
         // Generate the alarm
         switch( action.code_alarm->index ){
           case code_alarm_module::telecom:
@@ -1244,6 +1327,54 @@ bool Commander::ExecCmd(PendingCommand& cmd)
       }
       break;
 
+    case Commander::cmd::stats: // STATS [RESET]
+      if(arg1 != nullptr && strcmp(arg1, "RESET") == 0){
+        opengalaxy().stats().reset();
+        retv = ReportCommandExec(true, _command);
+      }
+      else if(arg1 != nullptr){
+        len = snprintf(
+          (char*)commander_output_buffer,
+          sizeof(commander_output_buffer),
+          json_command_error_fmt,
+          static_cast<unsigned int>(json_reply_id::standard),
+          CommanderTypeDesc[static_cast<int>(json_reply_id::standard)],
+          false,
+          _command,
+          "Invalid argument!"
+        );
+        retv = false;
+      }
+      else {
+        std::string stats;
+        opengalaxy().stats().json(stats);
+        len = snprintf(
+          (char*)commander_output_buffer,
+          sizeof(commander_output_buffer),
+          json_statistics_fmt,
+          static_cast<unsigned int>(json_reply_id::statistics),
+          CommanderTypeDesc[static_cast<int>(json_reply_id::statistics)],
+          true,
+          _command,
+          stats.c_str()
+        );
+        retv = true;
+        if(len >= sizeof(commander_output_buffer)){
+          len = snprintf(
+            (char*)commander_output_buffer,
+            sizeof(commander_output_buffer),
+            json_command_error_fmt,
+            static_cast<unsigned int>(json_reply_id::standard),
+            CommanderTypeDesc[static_cast<int>(json_reply_id::standard)],
+            false,
+            _command,
+            "Statistics too large, use /stats.json instead!"
+          );
+          retv = false;
+        }
+      }
+      break;
+
     default:
       len = snprintf(
         (char*)commander_output_buffer,
@@ -1258,7 +1389,7 @@ bool Commander::ExecCmd(PendingCommand& cmd)
       retv = false;
       break;
 
-  } // ends switch(commands_list[t].index)
+  } // ends switch(commands_table.find(command)->index)
 
 exit:
   // When user is not a nullptr we know the
@@ -1280,13 +1411,39 @@ void Commander::execute(class openGalaxy *opengalaxy, session_id *session, void
   if(session) c->session = *session;
   c->user = user;
   c->callback = callback;
+  c->queued = std::chrono::steady_clock::now();
 
   m_mutex.lock();
-  pending_commands.append(c);
+  if(user == nullptr){
+    // Commands from a client go before any commands from the polling thread
+    int i;
+    for(i = 0; i < pending_commands.size(); i++){
+      if(pending_commands[i]->user != nullptr) break;
+    }
+    pending_commands.insert(c, i);
+  }
+  else pending_commands.append(c);
   m_mutex.unlock();
   notify();
 }
 
+// Drops all pending commands for a (disconnected) session
+// (a command that was already started is dropped by run() once
+//  the panel answered the requests it is waiting for)
+void Commander::cancel(session_id& session)
+{
+  if(session.id == 0) return;
+  m_mutex.lock();
+  for(int i = pending_commands.size() - 1; i >= 0; i--){
+    PendingCommand *c = pending_commands[i];
+    if(c->user == nullptr && c->session.id == session.id){
+      if(c->started) c->cancelled = true;
+      else pending_commands.remove(i);
+    }
+  }
+  m_mutex.unlock();
+}
+
 // return true when command_list is not empty (ie. we are sending commands)
 //
 bool Commander::isBusy()
@@ -1297,56 +1454,109 @@ bool Commander::isBusy()
   return retv;
 }
 
-void Commander::Thread(Commander* commander)
+// Returns the first pending command that can be executed, skipping the
+// commands waiting for the panel and the commands queued after a command
+// from the same client (or the polling thread) that was not finished yet.
+// (Must be called with m_mutex locked)
+Commander::PendingCommand* Commander::next()
+{
+  for(int i = 0; i < pending_commands.size(); i++){
+    PendingCommand *c = pending_commands[i];
+    if(c->waiting) continue;
+    int j;
+    for(j = 0; j < i; j++){
+      PendingCommand *p = pending_commands[j];
+      if((p->user == nullptr) == (c->user == nullptr) && p->session.id == c->session.id) break;
+    }
+    if(j == i) return c;
+  }
+  return nullptr;
+}
+
+// Called from the receiver thread when the panel answered all requests
+// a command was waiting for (see Galaxy::SetAwait())
+void Commander::Resume(openGalaxy& opengalaxy, unsigned long id, const Galaxy::Reply& reply, void *user)
+{
+  Commander& commander = opengalaxy.commander();
+  PendingCommand *c = (PendingCommand*)user;
+  commander.m_mutex.lock();
+  c->waiting = false;
+  commander.m_mutex.unlock();
+  commander.notify();
+}
+
+// Executes the pending commands
+// (runs on the executor's worker pool each time notify() was called)
+//
+// A command is executed until it needs an answer from the panel that was
+// not received yet. The command then waits in the list (without blocking
+// the task) and the task continues with the commands from other clients.
+// Once the answer arrives Resume() schedules the task again and the
+// command continues where it left off.
+void Commander::run()
 {
-  using namespace std::chrono;
   try {
-    int loop_delay = 1;
-    std::unique_lock<std::mutex> lck(commander->m_request_mutex);
-
-    // The outer loop only exits if the openGalaxy object is being destroyed.
-    // The inner loop iterates once every 'loop_delay' seconds, 
-    // or sooner when Commander::NotifyWorkerThread() is called.
-
-    // Outer loop: test if it is time to exit
-    while(commander->opengalaxy().isQuit()==false){
-      // Inner loop: test if we were notified (or otherwise sleep untill we timeout) and do a loop iteration if we were/did
-      while(commander->m_cv_notified || commander->m_request_cv.wait_for(lck,seconds(loop_delay))==std::cv_status::timeout){
-        // reset our notification variable
-        commander->m_cv_notified = false;
-        // Test if we need to exit the thread.
-        if(commander->opengalaxy().isQuit()==true) break;
-
-        // while there are pending commands
-        // (safe to access without locking since the value can
-        // only increase outside of this thread)
-        while(commander->pending_commands.size()>0 && !commander->opengalaxy().isQuit()){
-          // 'pop' the next command from the list,
-          commander->m_mutex.lock();
-          PendingCommand *c = new PendingCommand(*commander->pending_commands[0]);
-          commander->pending_commands.remove(0);
-          commander->m_mutex.unlock();
-          // and execute it.
-          commander->ExecCmd(*c);
-          // Send any output back using the callback function
-          if(strlen((char*)commander->commander_output_buffer)){
-            c->callback(*c->opengalaxy, &c->session, c->user, (char*)commander->commander_output_buffer);
+    while(!opengalaxy().isQuit()){
+      // find the next command to execute
+      m_mutex.lock();
+      PendingCommand *c = next();
+      bool cancelled = false, first = false;
+      if(c){
+        cancelled = c->cancelled;
+        first = !c->started;
+        c->started = true;
+      }
+      m_mutex.unlock();
+      if(c == nullptr) break;
+
+      // (only the commands from clients are timed, the polling thread queues
+      //  its commands behind them)
+      if(first && c->user == nullptr){
+        opengalaxy().stats().histogram(Stats::stage::command_queue).record_since(c->queued);
+      }
+
+      // and execute it, sending any output back using the callback function.
+      // (Panel requests are queued on behalf of the polling thread or the session)
+      bool done = true;
+      if(cancelled == false){
+        Galaxy::SetOrigin(c->user != nullptr, (c->user != nullptr) ? 0 : c->session.id);
+        Galaxy::SetAwait(&c->await);
+        done = ExecBatch(*c);
+        Galaxy::SetAwait(nullptr);
+        Galaxy::SetOrigin(false, 0);
+      }
+      else if(c->macro){
+        opengalaxy().receiver().releaseSession();
+      }
+
+      m_mutex.lock();
+      if(done == false){
+        // wait for Resume() unless the panel already answered
+        c->waiting = Galaxy::Suspend(c->await);
+      }
+      else {
+        // 'pop' the finished command from the list (without deleting it)
+        for(int i = 0; i < pending_commands.size(); i++){
+          if(pending_commands[i] == c){
+            pending_commands.Array<PendingCommand*>::remove(i);
+            break;
           }
-          // delete the original command data
-          // this includes the reference to the auth of the now possibly disconnected client
-          // (that would make its wsi an invalid pointer)
-          delete c;
-          std::this_thread::yield();
         }
+      }
+      m_mutex.unlock();
 
-      } // ends inner loop
-    } // ends outer loop
-    commander->opengalaxy().syslog().debug("Commander::Thread exited normally");
+      // delete the command data
+      // this includes the reference to the auth of the now possibly disconnected client
+      // (that would make its wsi an invalid pointer)
+      if(done) delete c;
+    }
   }
   catch(...){
+    Galaxy::SetAwait(nullptr);
+    Galaxy::SetOrigin(false, 0);
     // pass the exception on to the main() thread
-    commander->opengalaxy().m_Commander_exptr = std::current_exception();
-    commander->opengalaxy().exit();
+    opengalaxy().m_Commander_exptr = std::current_exception();
+    opengalaxy().exit();
   }
 }
 
@@ -34,13 +34,20 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+#include <chrono>
 
 #include "Array.hpp"
 #include "opengalaxy.hpp"
+#include "Galaxy.hpp"
 
 namespace openGalaxy {
 
 class Commander {
+friend class Bench; // src/bench/opengalaxy-bench.cpp
 
 public:
   typedef void(*callback_ptr)(class openGalaxy&, session_id*, void*, char*);
@@ -54,12 +61,66 @@ private:
     session_id session;            // the session that executes the command
     void *user;                    // poll data
     callback_ptr callback;         // function to call in response to any reply to the command
-    PendingCommand(class context_options& options) : session(options) {}
+    std::chrono::steady_clock::time_point queued; // when the command was received
+    Galaxy::Await await;           // the replies of the panel to the line being executed
+    size_t offset = 0;             // the next line of 'command' to execute
+    std::string replies;           // the combined replies of a batch
+    int count = 0;                 // the number of replies in 'replies'
+    std::string steps;             // the lines of the macro being executed
+    size_t step = 0;               // the next line of 'steps' to execute
+    bool macro = false;            // true while executing a macro (it holds the remote login)
+    bool success = true;           // false when a line of the macro failed
+    bool started = false;          // true once the command was executed (in part)
+    bool waiting = false;          // true while the command waits for the panel (see Resume())
+    bool cancelled = false;        // true when the session disconnected after the command was started
+    PendingCommand(class context_options& options) : session(options), await(Resume, this) {}
   };
 
   // Array of pending commands
   ObjectArray<PendingCommand*> pending_commands;
 
+  // A perfect hash table for the keywords in one of the lists below.
+  //
+  // The size of the table and the seed of the hash are searched once (at
+  // startup) so that every keyword gets a slot of its own. Looking up a
+  // (uppercase) word then costs one hash and one strcmp(), no matter how
+  // many keywords the list has. find() returns the terminating entry of
+  // the list (the one with a nullptr keyword) for unknown words.
+  template<typename T> class KeywordTable {
+    T *m_end;                  // the terminating entry of the list
+    const char *T::*m_key;     // the member that holds the keyword
+    std::vector<T*> m_slots;
+    unsigned int m_seed;
+    static unsigned int hash(const char *s, unsigned int seed){
+      unsigned int h = seed;
+      while(*s) h = (h ^ (unsigned char)*s++) * 16777619u; // FNV-1a
+      return h;
+    }
+  public:
+    KeywordTable(T *list, const char *T::*key) : m_key(key) {
+      int n = 0;
+      while(list[n].*key) n++;
+      m_end = &list[n];
+      for(size_t size = (n > 0) ? n : 1; ; size++){
+        for(m_seed = 2166136261u; m_seed < 2166136261u + 64; m_seed++){
+          m_slots.assign(size, nullptr);
+          int i;
+          for(i = 0; i < n; i++){
+            T*& slot = m_slots[hash(list[i].*key, m_seed) % size];
+            if(slot == nullptr) slot = &list[i];
+            else if(strcmp(slot->*key, list[i].*key) != 0) break; // collision
+          }
+          if(i == n) return;
+        }
+      }
+    }
+    T* find(const char *s) const {
+      if(s == nullptr) return m_end;
+      T *t = m_slots[hash(s, m_seed) % m_slots.size()];
+      return (t && strcmp(t->*m_key, s) == 0) ? t : m_end;
+    }
+  };
+
   // Enum to refer to a command through an index value
   enum class cmd : unsigned int {
    help = 0,
@@ -69,6 +130,7 @@ private:
    output,
    poll,
    code_alarm,
+   stats,
    count // last one, to count the number of indexes
   };
 
@@ -159,6 +221,7 @@ private:
     add,
     remove,
     one_shot,
+    delta,
     count
   };
 
@@ -250,20 +313,38 @@ private:
   };
   static struct code_alarm_module_t code_alarm_modules_list[];
 
+  // Lookup tables for the lists above
+  static KeywordTable<command_t> commands_table;
+  static KeywordTable<zone_typename_t> zone_typenames_table;
+  static KeywordTable<area_action_t> area_actions_table;
+  static KeywordTable<zone_action_t> zone_actions_table;
+  static KeywordTable<zone_parameter_option_t> zone_parameter_options_table;
+  static KeywordTable<zone_parameter_flag_t> zone_parameter_flags_table;
+  static KeywordTable<zone_set_state_t> zone_set_states_table;
+  static KeywordTable<zones_action_t> zones_actions_table;
+  static KeywordTable<output_action_t> output_actions_table;
+  static KeywordTable<poll_action_t> poll_actions_table;
+  static KeywordTable<poll_item_t> poll_items_table;
+  static KeywordTable<code_alarm_module_t> code_alarm_modules_table;
+
   openGalaxy& m_openGalaxy;
-  std::thread *m_thread;             // the worker thread for this receiver instance
+  Executor::Task m_task;             // executes the pending commands (on the executor's worker pool)
   std::mutex m_mutex;                // data mutex
-  std::mutex m_request_mutex;        // mutex and condition variable used to timeout and wakeup the worker thread
-  std::condition_variable m_request_cv;
-  volatile bool m_cv_notified = false; // Set to true when Commander::NotifyWorkerThread() is called
 
   // Temporary storage for command output text
   unsigned char commander_output_buffer[Websocket::WS_BUFFER_SIZE];
 
   bool ReportCommandExec(bool retv, const char* cmd);
 
-  static void Thread(class Commander*);
-  bool ExecCmd(PendingCommand& cmd);
+  static int Tokenize(char *buf, char *words[], int max, char **rest);
+
+  void run();
+  PendingCommand* next();
+  static void Resume(class openGalaxy&, unsigned long id, const Galaxy::Reply& reply, void *user);
+  bool ExecBatch(PendingCommand& cmd);
+  bool ExecMacro(PendingCommand& cmd, const char *line, size_t length);
+  void AddReply(PendingCommand& cmd, bool batch);
+  bool ExecCmd(PendingCommand& cmd, const char *command, size_t length);
 
 public:
 
@@ -278,11 +359,7 @@ public:
   static const char json_zone_state_fmt[];
   static const char json_all_zone_state_fmt[];
   static const char json_output_state_fmt[];
-
-  // Strings used to format the output of a command when the polling thread executed it
-  static const char poll_all_area_fmt[];
-  static const char poll_all_zone_state_fmt[];
-  static const char poll_output_state_fmt[];
+  static const char json_statistics_fmt[];
 
   // This json reply is send by class Websocket when a client needs authorization before using the commander.
   static const char json_authorization_required_fmt[];
@@ -317,18 +394,16 @@ public:
     poll_reply,
     authorization_required,
     authentication_accepted,
+    statistics,
     count
   };
 
   // Descriptive strings for JSON formatted reply typeId's
   static const char* CommanderTypeDesc[];
 
-  // Notifies the worker thread to end the current sleeping period and immediately starts it's next mainloop iteration
+  // Schedules the task that executes the pending commands
   void notify();
 
-  // joins the thread (used by openGalaxy::exit)
-  void join() { m_thread->join(); }
-
   Commander(openGalaxy& openGalaxy);
   ~Commander();
 
@@ -345,6 +420,9 @@ public:
 
   bool isBusy();
 
+  // Drops all pending commands for a (disconnected) session
+  void cancel(session_id& session);
+
   // Provide a method that refers to the top openGalaxy class
   inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
 
@@ -0,0 +1,448 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic.h"
+#include "opengalaxy.hpp"
+#include "Executor.hpp"
+
+#if __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace openGalaxy {
+
+constexpr int Executor::workers_min;
+constexpr int Executor::workers_max;
+
+// The pool and worker (index) the current thread belongs to
+static thread_local Executor *tls_pool = nullptr;
+static thread_local int tls_worker = -1;
+
+Executor::Task::Task(Executor& executor, Executor::task fn, bool on_loop)
+ : m_executor(executor), m_fn(fn), m_on_loop(on_loop), m_timer([this]{ fire(); })
+{
+}
+
+Executor::Task::~Task()
+{
+  cancel();
+}
+
+void Executor::Task::schedule()
+{
+  m_mutex.lock();
+  if(m_running){
+    m_again = true;
+    m_mutex.unlock();
+    return;
+  }
+  if(m_queued){
+    m_mutex.unlock();
+    return;
+  }
+  m_queued = true;
+  m_mutex.unlock();
+  if(m_on_loop) m_executor.dispatch([this]{ run(); });
+  else m_executor.post([this]{ run(); });
+}
+
+void Executor::Task::schedule_after(long long ms)
+{
+  m_executor.arm(m_timer, ms);
+}
+
+void Executor::Task::cancel()
+{
+  m_executor.disarm(m_timer);
+}
+
+void Executor::Task::run()
+{
+  m_mutex.lock();
+  m_queued = false;
+  if(m_running){
+    m_again = true;
+    m_mutex.unlock();
+    return;
+  }
+  m_running = true;
+  do {
+    m_again = false;
+    m_mutex.unlock();
+    m_fn();
+    m_mutex.lock();
+  } while(m_again);
+  m_running = false;
+  m_mutex.unlock();
+}
+
+// Called on the I/O loop when the timer expires
+void Executor::Task::fire()
+{
+  if(m_on_loop) run();
+  else schedule();
+}
+
+Executor::Executor(openGalaxy& opengalaxy)
+ : m_openGalaxy(opengalaxy)
+{
+  m_loop_quit = false;
+  m_pool_quit = false;
+  m_pool_queued = 0;
+  m_pool_next = 0;
+
+  int n = std::thread::hardware_concurrency();
+  if(n < workers_min) n = workers_min;
+  if(n > workers_max) n = workers_max;
+  for(int i = 0; i < n; i++) m_workers.push_back(new Worker);
+
+#if __linux__
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if(m_epoll < 0){
+    throw new std::runtime_error("Executor: Could not create an epoll instance.");
+  }
+  m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(m_wakeup < 0){
+    throw new std::runtime_error("Executor: Could not create an eventfd.");
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = m_wakeup;
+  if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev) < 0){
+    throw new std::runtime_error("Executor: Could not add the eventfd to the epoll instance.");
+  }
+#endif
+}
+
+Executor::~Executor()
+{
+  stop();
+  join();
+  delete m_loop;
+  for(Worker *w : m_workers){
+    delete w->thread;
+    delete w;
+  }
+#if __linux__
+  if(m_wakeup >= 0) ::close(m_wakeup);
+  if(m_epoll >= 0) ::close(m_epoll);
+#endif
+}
+
+void Executor::start()
+{
+  if(m_started) return;
+  m_started = true;
+  opengalaxy().syslog().debug("Executor: Starting the I/O loop and %d worker thread(s)", (int)m_workers.size());
+  // (the loop does not run anything before it got hold of m_loop_mutex)
+  m_loop_mutex.lock();
+  m_loop = new std::thread(Executor::Loop, this);
+  m_loop_id = m_loop->get_id();
+  m_loop_mutex.unlock();
+  for(int i = 0; i < (int)m_workers.size(); i++){
+    m_workers[i]->thread = new std::thread(Executor::Work, this, i);
+  }
+}
+
+void Executor::stop_loop()
+{
+  m_loop_quit = true;
+  wakeup();
+  if(m_loop && m_loop->joinable() && isLoopThread() == false) m_loop->join();
+  m_loop_mutex.lock();
+  m_loop_tasks.clear();
+  m_timers.clear();
+  m_loop_mutex.unlock();
+}
+
+void Executor::stop()
+{
+  stop_loop();
+  m_pool_mutex.lock();
+  m_pool_quit = true;
+  m_pool_mutex.unlock();
+  m_pool_cv.notify_all();
+  for(Worker *w : m_workers){
+    if(w->thread && w->thread->joinable() && w->thread->get_id() != std::this_thread::get_id()){
+      w->thread->join();
+    }
+  }
+  for(Worker *w : m_workers){
+    w->mutex.lock();
+    w->tasks.clear();
+    w->mutex.unlock();
+  }
+}
+
+void Executor::join()
+{
+  if(m_loop && m_loop->joinable()) m_loop->join();
+  for(Worker *w : m_workers){
+    if(w->thread && w->thread->joinable()) w->thread->join();
+  }
+}
+
+void Executor::post(Executor::task fn)
+{
+  if(m_pool_quit) return;
+  int i = (tls_pool == this) ? tls_worker : (int)(m_pool_next++ % m_workers.size());
+  m_workers[i]->mutex.lock();
+  m_workers[i]->tasks.push_back(fn);
+  m_workers[i]->mutex.unlock();
+  m_pool_mutex.lock();
+  m_pool_queued++;
+  m_pool_mutex.unlock();
+  m_pool_cv.notify_one();
+}
+
+void Executor::dispatch(Executor::task fn)
+{
+  m_loop_mutex.lock();
+  if(m_loop_quit){
+    m_loop_mutex.unlock();
+    return;
+  }
+  m_loop_tasks.push_back(fn);
+  m_loop_mutex.unlock();
+  if(isLoopThread() == false) wakeup();
+}
+
+void Executor::arm(Executor::Timer& timer, long long ms)
+{
+  m_loop_mutex.lock();
+  m_timers.arm(timer, ms);
+  m_loop_mutex.unlock();
+  if(isLoopThread() == false) wakeup();
+}
+
+void Executor::disarm(Executor::Timer& timer)
+{
+  // (the I/O loop may wake up for nothing, it does not matter)
+  m_loop_mutex.lock();
+  m_timers.cancel(timer);
+  m_loop_mutex.unlock();
+}
+
+bool Executor::watch(int fd, Executor::io_callback cb)
+{
+#if __linux__
+  std::lock_guard<std::mutex> lock(m_loop_mutex);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0){
+    opengalaxy().syslog().error("Executor: Could not watch file descriptor %d (%s)", fd, strerror(errno));
+    return false;
+  }
+  m_watched[fd] = cb;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Executor::unwatch(int fd)
+{
+#if __linux__
+  std::lock_guard<std::mutex> lock(m_loop_mutex);
+  if(m_watched.erase(fd)) epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+}
+
+// Wakes up the I/O loop (to look at its tasks and timers)
+void Executor::wakeup()
+{
+#if __linux__
+  uint64_t one = 1;
+  ssize_t n = ::write(m_wakeup, &one, sizeof(one));
+  (void)n; // (a full counter is just as good)
+#else
+  m_loop_mutex.lock();
+  m_loop_notified = true;
+  m_loop_mutex.unlock();
+  m_loop_cv.notify_one();
+#endif
+}
+
+// Returns the time (in milliseconds, rounded up) until the next timer
+// expires, 0 when there are tasks waiting or -1 when there is nothing to
+// wait for. (Must be called with m_loop_mutex locked)
+int Executor::next_timeout_ms()
+{
+  if(m_loop_tasks.size() > 0) return 0;
+  return m_timers.next_timeout_ms();
+}
+
+// Runs the callbacks of the timers that expired, a timer that is
+// disarm()ed (or armed again) while the callbacks before it run is skipped
+void Executor::run_timers()
+{
+  task fn;
+  m_loop_mutex.lock();
+  m_timers.collect();
+  while(m_loop_quit == false && m_timers.take(fn)){
+    m_loop_mutex.unlock();
+    execute(fn);
+    m_loop_mutex.lock();
+  }
+  m_loop_mutex.unlock();
+}
+
+// Runs the tasks that were dispatch()ed to the I/O loop
+void Executor::run_loop_tasks()
+{
+  std::deque<task> tasks;
+  m_loop_mutex.lock();
+  tasks.swap(m_loop_tasks);
+  m_loop_mutex.unlock();
+  for(task& fn : tasks){
+    if(m_loop_quit) break;
+    execute(fn);
+  }
+}
+
+// Takes a task from the queue of worker 'index' (newest first),
+// or steals one from another worker (oldest first)
+bool Executor::take(int index, Executor::task& fn)
+{
+  int n = m_workers.size();
+  for(int k = 0; k < n; k++){
+    Worker *w = m_workers[(index + k) % n];
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if(w->tasks.size() == 0) continue;
+    if(k == 0){
+      fn = w->tasks.back();
+      w->tasks.pop_back();
+    }
+    else {
+      fn = w->tasks.front();
+      w->tasks.pop_front();
+    }
+    m_pool_queued--;
+    return true;
+  }
+  return false;
+}
+
+// Runs a task, passing any exception on to the main() thread
+void Executor::execute(Executor::task& fn)
+{
+  try {
+    fn();
+  }
+  catch(...){
+    opengalaxy().m_Executor_exptr = std::current_exception();
+    opengalaxy().exit();
+  }
+}
+
+// static function:
+// The I/O loop
+void Executor::Loop(Executor *_this)
+{
+  try {
+#if __linux__
+    struct epoll_event events[16];
+#endif
+    while(_this->m_loop_quit == false){
+      _this->m_loop_mutex.lock();
+      int timeout = _this->next_timeout_ms();
+#if __linux__
+      _this->m_loop_mutex.unlock();
+      int n = epoll_wait(_this->m_epoll, events, 16, timeout);
+      if(n < 0){
+        if(errno == EINTR) continue;
+        throw new std::runtime_error("Executor: epoll_wait() failed.");
+      }
+      for(int i = 0; i < n && _this->m_loop_quit == false; i++){
+        int fd = events[i].data.fd;
+        if(fd == _this->m_wakeup){
+          uint64_t count;
+          ssize_t r = ::read(fd, &count, sizeof(count));
+          (void)r;
+          continue;
+        }
+        io_callback cb;
+        _this->m_loop_mutex.lock();
+        auto it = _this->m_watched.find(fd);
+        if(it != _this->m_watched.end()) cb = it->second;
+        _this->m_loop_mutex.unlock();
+        if(!cb) continue;
+        int flags = 0;
+        if(events[i].events & EPOLLIN) flags |= readable;
+        if(events[i].events & (EPOLLHUP | EPOLLERR)) flags |= hangup;
+        task run = [cb, flags]{ cb(flags); };
+        _this->execute(run);
+      }
+#else
+      std::unique_lock<std::mutex> lck(_this->m_loop_mutex, std::adopt_lock);
+      if(_this->m_loop_notified == false){
+        if(timeout < 0) _this->m_loop_cv.wait(lck);
+        else _this->m_loop_cv.wait_for(lck, std::chrono::milliseconds(timeout));
+      }
+      _this->m_loop_notified = false;
+      lck.unlock();
+#endif
+      if(_this->m_loop_quit) break;
+      _this->run_timers();
+      _this->run_loop_tasks();
+    }
+    _this->opengalaxy().syslog().debug("Executor::Loop exited normally");
+  }
+  catch(...){
+    // pass the exception on to the main() thread
+    _this->opengalaxy().m_Executor_exptr = std::current_exception();
+    _this->opengalaxy().exit();
+  }
+}
+
+// static function:
+// A thread of the worker pool
+void Executor::Work(Executor *_this, int index)
+{
+  tls_pool = _this;
+  tls_worker = index;
+  task fn;
+  while(_this->m_pool_quit == false){
+    if(_this->take(index, fn)){
+      _this->execute(fn);
+      fn = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lck(_this->m_pool_mutex);
+    _this->m_pool_cv.wait(lck, [_this]{ return _this->m_pool_quit || _this->m_pool_queued > 0; });
+  }
+}
+
+} // ends namespace openGalaxy
+
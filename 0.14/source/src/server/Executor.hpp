@@ -0,0 +1,206 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OPENGALAXY_SERVER_EXECUTOR_HPP__
+#define __OPENGALAXY_SERVER_EXECUTOR_HPP__
+
+#include "atomic.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TimingWheel.hpp"
+
+// (does not include opengalaxy.hpp, the worker classes declared
+//  there use Executor::Task by value)
+
+namespace openGalaxy {
+
+//
+// Runs the work of the Receiver, Output, Commander and Poll classes.
+//
+// There is one I/O loop thread that waits (with epoll on Linux) for file
+// descriptors to become readable, for timers (on a TimingWheel) to expire
+// and for tasks that were dispatch()ed to it. Work that may block for a
+// while (waiting for the panel to answer a command, writing to an output
+// plugin) is post()ed to a small pool of worker threads. Each worker takes
+// tasks from its own queue first and steals from the other queues when it
+// runs out.
+//
+// Nothing wakes up unless there is something to do, and stop() does not
+// have to wait for any thread to finish a sleep.
+//
+class Executor {
+public:
+  typedef std::function<void()> task;
+  typedef std::function<void(int)> io_callback;
+
+  // A timer, its callback runs on the I/O loop (and must not block)
+  typedef TimingWheel::Timer Timer;
+
+  // The events passed to an io_callback
+  enum : int {
+    readable = 1, // there is data to read
+    hangup = 2    // the other end closed, or an error occured
+  };
+
+  // The size of the worker pool (the number of CPU's, within these limits)
+  constexpr static int workers_min = 2;
+  constexpr static int workers_max = 4;
+
+  //
+  // A unit of work that is scheduled repeatedly, but never runs
+  // concurrently with itself. Scheduling it while it is already queued
+  // does nothing, scheduling it while it runs runs it once more afterwards.
+  //
+  class Task {
+  public:
+    // on_loop = run on the I/O loop thread instead of the worker pool
+    Task(Executor& executor, task fn, bool on_loop = false);
+    ~Task();
+
+    // Run as soon as possible
+    void schedule();
+
+    // Run after 'ms' milliseconds (replaces the previous timer)
+    void schedule_after(long long ms);
+
+    // Cancel the timer set with schedule_after()
+    void cancel();
+
+  private:
+    Executor& m_executor;
+    task m_fn;
+    bool m_on_loop;
+    std::mutex m_mutex;
+    bool m_queued = false;  // waiting in a task queue
+    bool m_running = false; // m_fn is executing
+    bool m_again = false;   // schedule()d while m_fn was executing
+    Timer m_timer;          // the timer set by schedule_after()
+
+    void run();
+    void fire();
+  };
+
+  Executor(class openGalaxy& opengalaxy);
+  ~Executor();
+
+  // Starts the I/O loop and the worker pool
+  void start();
+
+  // Stops the I/O loop (it no longer runs timers, tasks or io_callbacks)
+  void stop_loop();
+
+  // Stops the I/O loop and the worker pool, tasks that have not started yet
+  // are dropped, tasks that are running are waited for (unless called from
+  // one of them)
+  void stop();
+
+  // Waits for any thread that was still running a task when stop() was called
+  void join();
+
+  // Runs a task on the worker pool
+  void post(task fn);
+
+  // Runs a task on the I/O loop
+  void dispatch(task fn);
+
+  // (Re)arms a timer to expire after 'ms' milliseconds
+  void arm(Timer& timer, long long ms);
+
+  // Disarms a timer
+  void disarm(Timer& timer);
+
+  // Calls 'cb' on the I/O loop when 'fd' can be read from,
+  // returns false when this is not supported (ie. on Windows)
+  bool watch(int fd, io_callback cb);
+  void unwatch(int fd);
+
+  // Returns true when called from the I/O loop
+  bool isLoopThread() { return std::this_thread::get_id() == m_loop_id; }
+
+  // Provide a method that refers to the top openGalaxy class
+  inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<task> tasks;
+    std::thread *thread = nullptr;
+  };
+
+  class openGalaxy& m_openGalaxy;
+
+  // The I/O loop
+  std::thread *m_loop = nullptr;
+  std::thread::id m_loop_id;
+  std::mutex m_loop_mutex;               // protects the members below
+  std::deque<task> m_loop_tasks;         // tasks dispatch()ed to the I/O loop
+  TimingWheel m_timers;                  // armed timers
+  std::map<int, io_callback> m_watched;  // watched file descriptors
+  std::atomic<bool> m_loop_quit;
+#if __linux__
+  int m_epoll = -1;                      // the epoll instance
+  int m_wakeup = -1;                     // an eventfd that wakes up the epoll_wait()
+#else
+  std::condition_variable m_loop_cv;     // wakes up the I/O loop
+  bool m_loop_notified = false;
+#endif
+
+  // The worker pool
+  std::vector<Worker*> m_workers;
+  std::mutex m_pool_mutex;
+  std::condition_variable m_pool_cv;
+  std::atomic<int> m_pool_queued;        // number of tasks in all worker queues
+  std::atomic<unsigned int> m_pool_next; // round robin for tasks posted from outside the pool
+  std::atomic<bool> m_pool_quit;
+
+  bool m_started = false;
+
+  void wakeup();
+  int next_timeout_ms();
+  void run_timers();
+  void run_loop_tasks();
+  bool take(int index, task& fn);
+  void execute(task& fn);
+
+  static void Loop(class Executor *_this);
+  static void Work(class Executor *_this, int index);
+};
+
+} // ends namespace openGalaxy
+
+#endif
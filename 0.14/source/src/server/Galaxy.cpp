@@ -33,6 +33,7 @@
 #include "Syslog.hpp"
 #include "Settings.hpp"
 #include "Galaxy.hpp"
+#include "PanelState.hpp"
 
 #include "opengalaxy.hpp"
 
@@ -42,81 +43,269 @@
 
 namespace openGalaxy {
 
+// The origin of the requests submitted by the current thread (see SetOrigin())
+static thread_local bool origin_background = false;
+static thread_local unsigned long long origin_session = 0;
+
+// The Await of the current thread (see SetAwait())
+static thread_local Galaxy::Await *origin_await = nullptr;
+
 Galaxy::Galaxy(openGalaxy& opengalaxy)
  : m_openGalaxy(opengalaxy)
 {
-  // create the locks for our condition variables
-  m_areaAction_lock = new std::unique_lock<std::mutex>(m_areaAction_mutex);
-  m_getAreaArmedState_lock = new std::unique_lock<std::mutex>(m_getAreaArmedState_mutex);
-  m_getAllAreasArmedState_lock = new std::unique_lock<std::mutex>(m_getAllAreasArmedState_mutex);
-  m_getAllAreasAlarmState_lock = new std::unique_lock<std::mutex>(m_getAllAreasAlarmState_mutex);
-  m_getAllAreasReadyState_lock = new std::unique_lock<std::mutex>(m_getAllAreasReadyState_mutex);
-  m_zoneAction_lock = new std::unique_lock<std::mutex>(m_zoneAction_mutex);
-  m_zoneIsOmit_lock = new std::unique_lock<std::mutex>(m_zoneIsOmit_mutex);
-  m_outputAction_lock = new std::unique_lock<std::mutex>(m_outputAction_mutex);
-  m_getAllOutputs_lock = new std::unique_lock<std::mutex>(m_getAllOutputs_mutex);
-  m_getZoneState_lock = new std::unique_lock<std::mutex>(m_getZoneState_mutex);
-  m_getAllZonesReadyState_lock = new std::unique_lock<std::mutex>(m_getAllZonesReadyState_mutex);
-  m_getAllZonesAlarmState_lock = new std::unique_lock<std::mutex>(m_getAllZonesAlarmState_mutex);
-  m_getAllZonesOpenState_lock = new std::unique_lock<std::mutex>(m_getAllZonesOpenState_mutex);
-  m_getAllZonesTamperState_lock = new std::unique_lock<std::mutex>(m_getAllZonesTamperState_mutex);
-  m_getAllZonesRState_lock = new std::unique_lock<std::mutex>(m_getAllZonesRState_mutex);
-  m_getAllZonesOmittedState_lock = new std::unique_lock<std::mutex>(m_getAllZonesOmittedState_mutex);
-  m_getAllZonesMaskedState_lock = new std::unique_lock<std::mutex>(m_getAllZonesMaskedState_mutex);
-  m_getAllZonesFaultState_lock = new std::unique_lock<std::mutex>(m_getAllZonesFaultState_mutex);
-  m_reprocessEvents_lock = new std::unique_lock<std::mutex>(m_reprocessEvents_mutex);
-  m_flushEvents_lock = new std::unique_lock<std::mutex>(m_flushEvents_mutex);
-  m_generateWrongCodeAlarm_lock = new std::unique_lock<std::mutex>(m_generateWrongCodeAlarm_mutex);
-  m_setZoneState_lock = new std::unique_lock<std::mutex>(m_setZoneState_mutex);
+  m_state = new PanelState(opengalaxy);
 }
 
 Galaxy::~Galaxy()
 {
-  // Make sure we're not (by chance) waiting for a callback to finish
-  m_areaActionCallbackRetv = false;
-  m_areaAction_cv.notify_one();
-  m_getAreaArmedStateRetv = false;
-  m_getAreaArmedState_cv.notify_one();
-  m_getAllAreasArmedStateRetv = false;
-  m_getAllAreasArmedState_cv.notify_one();
-  m_getAllAreasAlarmStateRetv = false;
-  m_getAllAreasAlarmState_cv.notify_one();
-  m_getAllAreasReadyStateRetv = false;
-  m_getAllAreasReadyState_cv.notify_one();
-  m_zoneActionRetv = false;
-  m_zoneAction_cv.notify_one();
-  m_zoneIsOmitRetv = false;
-  m_zoneIsOmit_cv.notify_one();
-  m_outputActionRetv = false;
-  m_outputAction_cv.notify_one();
-  m_getAllOutputsRetv = false;
-  m_getAllOutputs_cv.notify_one();
-  m_getZoneStateRetv = false;
-  m_getZoneState_cv.notify_one();
-  m_getAllZonesReadyStateRetv = false;
-  m_getAllZonesReadyState_cv.notify_one();
-  m_getAllZonesAlarmStateRetv = false;
-  m_getAllZonesAlarmState_cv.notify_one();
-  m_getAllZonesOpenStateRetv = false;
-  m_getAllZonesOpenState_cv.notify_one();
-  m_getAllZonesTamperStateRetv = false;
-  m_getAllZonesTamperState_cv.notify_one();
-  m_getAllZonesRStateRetv = false;
-  m_getAllZonesRState_cv.notify_one();
-  m_getAllZonesOmittedStateRetv = false;
-  m_getAllZonesOmittedState_cv.notify_one();
-  m_getAllZonesMaskedStateRetv = false;
-  m_getAllZonesMaskedState_cv.notify_one();
-  m_getAllZonesFaultStateRetv = false;
-  m_getAllZonesFaultState_cv.notify_one();
-  m_reprocessEventsCallbackRetv = false;
-  m_reprocessEvents_cv.notify_one();
-  m_flushEventsCallbackRetv = false;
-  m_flushEvents_cv.notify_one();
-  m_generateWrongCodeAlarmCallbackRetv = false;
-  m_generateWrongCodeAlarm_cv.notify_one();
-  m_setZoneStateCallbackRetv = false;
-  m_setZoneState_cv.notify_one();
+  // Make sure nobody is (by chance) still waiting for a request to complete
+  m_requests_mutex.lock();
+  while(m_requests.size() > 0){
+    PendingRequest *request = m_requests[0];
+    m_requests.remove(0);
+    request->promise.set_value(Reply());
+    delete request;
+  }
+  m_requests_mutex.unlock();
+  delete m_state;
+}
+
+// Looks up an identical shared request in the completion table,
+// or adds a new request to it.
+//
+// 'queue' is set to true when the returned request is new and
+// still needs to be queued with QueueRequest().
+// (Must be called with m_requests_mutex locked)
+Galaxy::PendingRequest* Galaxy::FindOrAddRequest(SiaBlock::FunctionCode fc, const char *command, bool share, bool& queue)
+{
+  if(share == true){
+    for(int i = 0; i < m_requests.size(); i++){
+      PendingRequest *request = m_requests[i];
+      if(request->share == true && request->fc == fc && request->command.compare(command) == 0){
+        queue = false;
+        return request;
+      }
+    }
+  }
+
+  PendingRequest *request = new PendingRequest;
+  request->id = m_next_request_id++;
+  if(m_next_request_id == 0) m_next_request_id = 1; // 0 is never a valid request id
+  request->fc = fc;
+  request->command.assign(command);
+  request->share = share;
+  request->future = request->promise.get_future().share();
+  m_requests.append(request);
+  queue = true;
+  return request;
+}
+
+void Galaxy::SetOrigin(bool background, unsigned long long session)
+{
+  origin_background = background;
+  origin_session = session;
+}
+
+// Returns the transmit queue to use for a request from the current thread
+Receiver::priority Galaxy::OriginPriority(bool share)
+{
+  if(origin_background == true) return Receiver::priority::poll;
+  if(share == true) return Receiver::priority::query;
+  return Receiver::priority::action;
+}
+
+// Lets the receiver thread send a new request
+// (Must be called without m_requests_mutex locked)
+void Galaxy::QueueRequest(Galaxy::PendingRequest *request)
+{
+  if(opengalaxy().receiver().send(
+    request->fc,
+    (char*)request->command.data(),
+    request->command.length(),
+    CompleteRequest,
+    request->id,
+    OriginPriority(request->share),
+    origin_session
+  )==false){
+    CompleteRequest(opengalaxy(), request->id, nullptr, 0);
+  }
+}
+
+// Called by the receiver thread with the reply to a request
+void Galaxy::CompleteRequest(openGalaxy& opengalaxy, unsigned long id, char* buf, int len)
+{
+  Galaxy& galaxy = opengalaxy.galaxy();
+  PendingRequest *request = nullptr;
+
+  // Take the request out of the completion table
+  galaxy.m_requests_mutex.lock();
+  for(int i = 0; i < galaxy.m_requests.size(); i++){
+    if(galaxy.m_requests[i]->id == id){
+      request = galaxy.m_requests[i];
+      galaxy.m_requests.remove(i);
+      break;
+    }
+  }
+  galaxy.m_requests_mutex.unlock();
+
+  if(request == nullptr){
+    opengalaxy.syslog().error("Galaxy: Reply for unknown request %lu!", id);
+    return;
+  }
+
+  CompleteRequest(opengalaxy, request, (buf != nullptr), buf, len);
+  delete request;
+}
+
+// Passes the reply to everyone waiting for the request
+void Galaxy::CompleteRequest(openGalaxy& opengalaxy, Galaxy::PendingRequest *request, bool success, char* buf, int len)
+{
+  Reply reply;
+  reply.success = success;
+  if(success == true && len > 0) reply.data.assign(buf, len);
+
+  // Call the continuations first, the future may have
+  // been the only thing keeping the caller of Submit() waiting
+  for(int i = 0; i < request->continuations.size(); i++){
+    request->continuations[i]->callback(opengalaxy, request->id, reply, request->continuations[i]->user);
+  }
+  request->promise.set_value(reply);
+}
+
+Galaxy::Future Galaxy::Submit(SiaBlock::FunctionCode fc, const char *command, bool share, unsigned long *id)
+{
+  bool queue;
+  m_requests_mutex.lock();
+  PendingRequest *request = FindOrAddRequest(fc, command, share, queue);
+  Future future = request->future;
+  unsigned long request_id = request->id;
+  if(id) *id = request_id;
+  m_requests_mutex.unlock();
+
+  if(queue == true) QueueRequest(request);
+  else opengalaxy().receiver().share(request_id, OriginPriority(share), origin_session);
+  return future;
+}
+
+unsigned long Galaxy::Submit(SiaBlock::FunctionCode fc, const char *command, bool share, Galaxy::completion_callback callback, void *user)
+{
+  if(callback == nullptr) return 0;
+
+  bool queue;
+  PendingRequest::Continuation *continuation = new PendingRequest::Continuation;
+  continuation->callback = callback;
+  continuation->user = user;
+
+  m_requests_mutex.lock();
+  PendingRequest *request = FindOrAddRequest(fc, command, share, queue);
+  request->continuations.append(continuation);
+  unsigned long id = request->id;
+  m_requests_mutex.unlock();
+
+  if(queue == true) QueueRequest(request);
+  else opengalaxy().receiver().share(id, OriginPriority(share), origin_session);
+  return id;
+}
+
+// Waits for the reply to a request. The receiver completes every request
+// well within reply_timeout_seconds, a request that takes longer fails.
+Galaxy::Reply Galaxy::Wait(const Galaxy::Future& future)
+{
+  if(future.valid() == false) return Reply();
+  if(future.wait_for(std::chrono::seconds(reply_timeout_seconds)) != std::future_status::ready){
+    opengalaxy().syslog().error("Galaxy: Timeout while waiting for the reply to a request!");
+    return Reply();
+  }
+  return future.get();
+}
+
+void Galaxy::SetAwait(Galaxy::Await *await)
+{
+  origin_await = await;
+  if(await){
+    await->next = 0;
+    await->pending = false;
+  }
+}
+
+bool Galaxy::Suspend(Galaxy::Await& await)
+{
+  await.mutex.lock();
+  await.suspended = (await.outstanding > 0);
+  bool retv = await.suspended;
+  await.mutex.unlock();
+  return retv;
+}
+
+void Galaxy::Await::reset()
+{
+  mutex.lock();
+  slots.erase();
+  next = 0;
+  pending = false;
+  mutex.unlock();
+}
+
+// Continuation for a request made through an Await,
+// calls the callback of the Await when it was the last one it waits for
+void Galaxy::AwaitComplete(openGalaxy& opengalaxy, unsigned long id, const Galaxy::Reply& reply, void *user)
+{
+  Await::Slot *slot = (Await::Slot*)user;
+  Await *await = slot->await;
+
+  await->mutex.lock();
+  slot->reply = reply;
+  slot->ready = true;
+  await->outstanding--;
+  bool resume = (await->suspended == true && await->outstanding == 0);
+  if(resume) await->suspended = false;
+  completion_callback callback = await->callback;
+  void *callback_user = await->user;
+  await->mutex.unlock();
+
+  // (the Await may be deleted as soon as the callback was called)
+  if(resume) callback(opengalaxy, id, reply, callback_user);
+}
+
+// Makes a request and returns the reply, through the Await of the calling
+// thread when it has one. Otherwise blocks until the reply is received.
+Galaxy::Reply Galaxy::Call(SiaBlock::FunctionCode fc, const char *command, bool share)
+{
+  Await *await = origin_await;
+  if(await == nullptr) return Wait(Submit(fc, command, share));
+
+  // Use the reply from an earlier pass
+  await->mutex.lock();
+  int n = await->next++;
+  if(n < await->slots.size()){
+    Await::Slot *slot = await->slots[n];
+    if(slot->fc == fc && slot->command.compare(command) == 0){
+      Reply reply = slot->reply;
+      if(slot->ready == false) await->pending = true;
+      await->mutex.unlock();
+      return reply;
+    }
+    // This pass makes other requests than the last one, forget the rest
+    await->slots.resize(n);
+  }
+
+  // Or make a new request
+  Await::Slot *slot = new Await::Slot;
+  slot->await = await;
+  slot->fc = fc;
+  slot->command.assign(command);
+  await->slots.append(slot);
+  await->outstanding++;
+  await->mutex.unlock();
+
+  // (This completes the request right away when it could not be queued)
+  Submit(fc, command, share, AwaitComplete, slot);
+
+  await->mutex.lock();
+  Reply reply = slot->reply;
+  if(slot->ready == false) await->pending = true;
+  await->mutex.unlock();
+  return reply;
 }
 
 // Returns true only when nr is a valid (4 digit) zone number
@@ -194,15 +383,6 @@ bool Galaxy::IsOutput(int nr)
 // blknum: area 1...32 or all areas (0)
 // Action: unset, set, part set, reset, abort set, force set
 
-void Galaxy::AreaActionCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  // Was the command successfull?
-  if(buf == nullptr) opengalaxy.galaxy().m_areaActionCallbackRetv = false;
-  else opengalaxy.galaxy().m_areaActionCallbackRetv = true;
-  // Unblock
-  opengalaxy.galaxy().m_areaAction_cv.notify_one();
-}
-
 bool Galaxy::AreaAction(unsigned int blknum, Galaxy::area_action action)
 {
   if(blknum > 32) return false;
@@ -210,194 +390,124 @@ bool Galaxy::AreaAction(unsigned int blknum, Galaxy::area_action action)
   if(blknum == 0) snprintf(buf, 16, "SA*%u", (unsigned int)action); // all partitions
   else snprintf(buf, 16, "SA%u*%u", blknum, (unsigned int)action); // selected partition
 
-  // Let the receiver thread send the command
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    AreaActionCallback
-  )==false) return false;
-
-  // and wait for the callback to finish
-  m_areaAction_cv.wait(*m_areaAction_lock);
-  return m_areaActionCallbackRetv;
+  // Let the receiver thread send the command and wait for the reply
+  bool retv = Call(SiaBlock::FunctionCode::control, buf).success;
+  if(retv) m_state->InvalidateAreas();
+  return retv;
 }
 
 // Get the armed status of an area
 
-void Galaxy::GetAreaArmedStateCallback(openGalaxy& opengalaxy, char* buf, int len)
+bool Galaxy::DecodeAreaArmedState(const Galaxy::Reply& reply, unsigned int blknum, Galaxy::area_armed_state* state)
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAreaArmedStateRetv = false;
-  }
-  else {
-    opengalaxy.galaxy().m_getAreaArmedStateRetv = true;
-    // 'SAx*y'
-    *opengalaxy.galaxy().m_getAreaArmedStateState = (Galaxy::area_armed_state)atoi(
-        (char*)&buf[ (opengalaxy.galaxy().m_getAreaArmedStateBlknum < 10) ? 4 : 5 ]
-    );
-  }
-
-  opengalaxy.galaxy().m_getAreaArmedState_cv.notify_one();
+  // 'SAx*y'
+  size_t offset = (blknum < 10) ? 4 : 5;
+  if(reply.success == false || reply.data.length() <= offset) return false;
+  *state = (Galaxy::area_armed_state)atoi(&reply.data[offset]);
+  m_state->UpdateAreaArmedState(blknum, *state);
+  return true;
 }
 
 bool Galaxy::GetAreaArmedState(unsigned int blknum, Galaxy::area_armed_state* state)
 {
   if(blknum==0 || blknum>32) return false;
+  if(origin_background == false && m_state->GetAreaArmedState(blknum, state)) return true;
   char buf[16];
   snprintf(buf, 16, "SA%u", blknum);
-
-  // Let the receiver thread send the command and wait until the callback has been called
-  m_getAreaArmedStateState = state;
-  m_getAreaArmedStateBlknum = blknum;
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    GetAreaArmedStateCallback
-  )==false) return false;
-  m_getAreaArmedState_cv.wait(*m_getAreaArmedState_lock);
-  return m_getAreaArmedStateRetv;
+  return DecodeAreaArmedState(Call(SiaBlock::FunctionCode::control, buf, true), blknum, state);
 }
 
 /// Get the armed status of all 32 areas
 
-void Galaxy::GetAllAreasArmedStateCallback(openGalaxy& opengalaxy,char* buf, int len)
+bool Galaxy::DecodeAllAreasArmedState(const Galaxy::Reply& reply, Galaxy::area_armed_state state[32])
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllAreasArmedStateRetv = false;
-  }
-  else {
-    // 'SA*yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy'
-    for(int i=0; i<32; i++){
-      switch(buf[3+i]){
-        case '1':
-          opengalaxy.galaxy().m_getAllAreasArmedState[i] = Galaxy::area_armed_state::set;
-          break;
-        case '2':
-          opengalaxy.galaxy().m_getAllAreasArmedState[i] = Galaxy::area_armed_state::part_set;
-          break;
-        default:
-          opengalaxy.galaxy().m_getAllAreasArmedState[i] = Galaxy::area_armed_state::unset;
-          break;
-      }
+  if(reply.success == false || reply.data.length() < 3+32) return false;
+  // 'SA*yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy'
+  for(int i=0; i<32; i++){
+    switch(reply.data[3+i]){
+      case '1':
+        state[i] = Galaxy::area_armed_state::set;
+        break;
+      case '2':
+        state[i] = Galaxy::area_armed_state::part_set;
+        break;
+      default:
+        state[i] = Galaxy::area_armed_state::unset;
+        break;
     }
-    opengalaxy.galaxy().m_getAllAreasArmedStateRetv = true;
   }
-  opengalaxy.galaxy().m_getAllAreasArmedState_cv.notify_one();
+  m_state->UpdateAllAreasArmedState(state);
+  return true;
 }
 
 bool Galaxy::GetAllAreasArmedState(Galaxy::area_armed_state state[32])
 {
-  char buf[16];
-  snprintf(buf, 16, "SA");
-
-  // Let the receiver thread send the command and wait until the callback has been called
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    GetAllAreasArmedStateCallback
-  )==false) return false;
-  m_getAllAreasArmedState_cv.wait(*m_getAllAreasArmedState_lock);
-  if(m_getAllAreasArmedStateRetv){
-    for( int i = 0; i < 32; i++ ) state[i] = m_getAllAreasArmedState[i];
-  }
-  return m_getAllAreasArmedStateRetv;
+  if(origin_background == false && m_state->GetAllAreasArmedState(state)) return true;
+  return DecodeAllAreasArmedState(Call(SiaBlock::FunctionCode::control, "SA", true), state);
 }
 
 // Get the alarm status of all areas
-void Galaxy::GetAllAreasAlarmStateCallback(openGalaxy& opengalaxy, char* buf, int len)
+
+bool Galaxy::DecodeAllAreasAlarmState(const Galaxy::Reply& reply, Galaxy::area_alarm_state state[32])
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllAreasAlarmStateRetv = false;
-  }
-  else {
-    // 'SA91*yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy'
-    for(int i=0; i<32; i++){
-      switch(buf[5+i]){
-        case '1':
-          opengalaxy.galaxy().m_getAllAreasAlarmState[i] = Galaxy::area_alarm_state::alarm;
-          break;
-        case '2':
-          opengalaxy.galaxy().m_getAllAreasAlarmState[i] = Galaxy::area_alarm_state::reset_required;
-          break;
-        default:
-          opengalaxy.galaxy().m_getAllAreasAlarmState[i] = Galaxy::area_alarm_state::normal;
-          break;
-      }
+  if(reply.success == false || reply.data.length() < 5+32) return false;
+  // 'SA91*yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy'
+  for(int i=0; i<32; i++){
+    switch(reply.data[5+i]){
+      case '1':
+        state[i] = Galaxy::area_alarm_state::alarm;
+        break;
+      case '2':
+        state[i] = Galaxy::area_alarm_state::reset_required;
+        break;
+      default:
+        state[i] = Galaxy::area_alarm_state::normal;
+        break;
     }
-    opengalaxy.galaxy().m_getAllAreasAlarmStateRetv = true;
   }
-  opengalaxy.galaxy().m_getAllAreasAlarmState_cv.notify_one();
+  m_state->UpdateAllAreasAlarmState(state);
+  return true;
 }
 
 bool Galaxy::GetAllAreasAlarmState(Galaxy::area_alarm_state state[32])
 {
-  char buf[16];
-  snprintf(buf, 16, "SA91");
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    GetAllAreasAlarmStateCallback 
-  )==false) return false;
-  m_getAllAreasAlarmState_cv.wait(*m_getAllAreasAlarmState_lock);
-  if(m_getAllAreasAlarmStateRetv){
-    for(int i=0; i<32; i++) state[i] = m_getAllAreasAlarmState[i];
-  }
-  return m_getAllAreasAlarmStateRetv;
+  if(origin_background == false && m_state->GetAllAreasAlarmState(state)) return true;
+  return DecodeAllAreasAlarmState(Call(SiaBlock::FunctionCode::control, "SA91", true), state);
 }
 
-
 // Get the ready status of all areas (Galaxy V4.00)
 
-void Galaxy::GetAllAreasReadyStateCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllAreasReadyStateRetv = false;
-  }
-  else {
-    // 'SA92*yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy'
-    for(int i=0; i<32; i++){
-      switch(buf[5+i]){
-        case '1':
-          opengalaxy.galaxy().m_getAllAreasReadyState[i] = Galaxy::area_ready_state::set;
-          break;
-        case '2':
-          opengalaxy.galaxy().m_getAllAreasReadyState[i] = Galaxy::area_ready_state::part_set;
-          break;
-        case '3':
-          opengalaxy.galaxy().m_getAllAreasReadyState[i] = Galaxy::area_ready_state::ready_to_set;
-          break;
-        case '4':
-          opengalaxy.galaxy().m_getAllAreasReadyState[i] = Galaxy::area_ready_state::time_locked;
-          break;
-        default:
-          opengalaxy.galaxy().m_getAllAreasReadyState[i] = Galaxy::area_ready_state::unset;
-          break;
-      }
-    }
-    opengalaxy.galaxy().m_getAllAreasReadyStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllAreasReadyState_cv.notify_one();
+bool Galaxy::DecodeAllAreasReadyState(const Galaxy::Reply& reply, Galaxy::area_ready_state state[32])
+{
+  if(reply.success == false || reply.data.length() < 5+32) return false;
+  // 'SA92*yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy'
+  for(int i=0; i<32; i++){
+    switch(reply.data[5+i]){
+      case '1':
+        state[i] = Galaxy::area_ready_state::set;
+        break;
+      case '2':
+        state[i] = Galaxy::area_ready_state::part_set;
+        break;
+      case '3':
+        state[i] = Galaxy::area_ready_state::ready_to_set;
+        break;
+      case '4':
+        state[i] = Galaxy::area_ready_state::time_locked;
+        break;
+      default:
+        state[i] = Galaxy::area_ready_state::unset;
+        break;
+    }
+  }
+  m_state->UpdateAllAreasReadyState(state);
+  return true;
 }
 
 bool Galaxy::GetAllAreasReadyState(Galaxy::area_ready_state state[32])
 {
-  char buf[16];
-  snprintf(buf, 16, "SA92");
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    GetAllAreasReadyStateCallback
-  )==false) return false;
-  m_getAllAreasReadyState_cv.wait(*m_getAllAreasReadyState_lock);
-  if(m_getAllAreasReadyStateRetv){
-    for(int i=0; i<32; i++) state[i] = m_getAllAreasReadyState[i];
-  }
-  return m_getAllAreasReadyStateRetv;
+  if(origin_background == false && m_state->GetAllAreasReadyState(state)) return true;
+  return DecodeAllAreasReadyState(Call(SiaBlock::FunctionCode::control, "SA92", true), state);
 }
 
 // Perform a zone action by zone number or zone type
@@ -405,56 +515,37 @@ bool Galaxy::GetAllAreasReadyState(Galaxy::area_ready_state state[32])
 // nr    : 4 digit zone number or zone type 1...100
 // action: omit or un-omit
 
-void Galaxy::ZoneActionCallback(openGalaxy& opengalaxy,char* buf, int len)
-{
-  if(buf==nullptr) opengalaxy.galaxy().m_zoneActionRetv = false;
-  else opengalaxy.galaxy().m_zoneActionRetv = true;
-  opengalaxy.galaxy().m_zoneAction_cv.notify_one();
-}
-
 bool Galaxy::ZoneAction(unsigned int nr, Galaxy::zone_action action)
 {
   if(IsZone(nr)!=true) if(!(nr>=1 && nr<=100)) return false;
   char buf[16];
   snprintf(buf, 16, "SB%u*%u", nr, (unsigned int)action);
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    ZoneActionCallback
-  )==false) return false;
-  m_zoneAction_cv.wait(*m_zoneAction_lock);
-  return m_zoneActionRetv;
+  bool retv = Call(SiaBlock::FunctionCode::control, buf).success;
+  if(retv){
+    if(IsZone(nr)) m_state->UpdateZoneIsOmit(nr, action);
+    else m_state->InvalidateZones(); // by zone type
+  }
+  return retv;
 }
 
 // Get the omit status of a zone
 
-void Galaxy::ZoneIsOmitCallback(openGalaxy& opengalaxy,char* buf, int len)
+bool Galaxy::DecodeZoneIsOmit(const Galaxy::Reply& reply, Galaxy::zone_action *state)
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_zoneIsOmitRetv = false;
-  }
-  else {
-    // 'SBxxxx*y'
-    *opengalaxy.galaxy().m_zoneIsOmitState = (Galaxy::zone_action)atoi((char*)&buf[7]);
-    opengalaxy.galaxy().m_zoneIsOmitRetv = true;
-  }
-  opengalaxy.galaxy().m_zoneIsOmit_cv.notify_one();
+  // 'SBxxxx*y'
+  if(reply.success == false || reply.data.length() < 8) return false;
+  *state = (Galaxy::zone_action)atoi(&reply.data[7]);
+  m_state->UpdateZoneIsOmit(atoi(&reply.data[2]), *state);
+  return true;
 }
 
 bool Galaxy::ZoneIsOmit(unsigned int nr, Galaxy::zone_action *state)
 {
   if(IsZone(nr)!= true) return false;
+  if(origin_background == false && m_state->ZoneIsOmit(nr, state)) return true;
   char buf[16];
   snprintf(buf, 16, "SB%u", nr);
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    ZoneIsOmitCallback
-  )==false) return false;
-  m_zoneIsOmit_cv.wait(*m_zoneIsOmit_lock);
-  return m_zoneIsOmitRetv;
+  return DecodeZoneIsOmit(Call(SiaBlock::FunctionCode::control, buf, true), state);
 }
 
 // Perform an output action by 4 digit output number, type (1...100) or all outputs (0)
@@ -464,17 +555,6 @@ bool Galaxy::ZoneIsOmit(unsigned int nr, Galaxy::zone_action *state)
 // blknum: the area the output must belong to (1...32 or 0 for all areas) 
 //         this value is ignored for zone numbers and only has effect when setting outputs by type
 
-void Galaxy::OutputActionCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_outputActionRetv = false;
-  }
-  else {
-    opengalaxy.galaxy().m_outputActionRetv = true;
-  }
-  opengalaxy.galaxy().m_outputAction_cv.notify_one();
-}
-
 bool Galaxy::OutputAction(unsigned int nr, bool state, unsigned int blknum)
 {
   char buf[48];
@@ -523,61 +603,37 @@ bool Galaxy::OutputAction(unsigned int nr, bool state, unsigned int blknum)
     else snprintf(buf, sizeof(buf), "OR*%uG%u", state, blknum);
   }
 
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    OutputActionCallback
-  )==false) return false;
-  m_outputAction_cv.wait(*m_outputAction_lock);
-
-  return m_outputActionRetv;
+  bool retv = Call(SiaBlock::FunctionCode::control, buf).success;
+  if(retv) m_state->InvalidateOutputs();
+  return retv;
 }
 
 // bool GalaxyGetAllOutputs( unsigned char outputs[32] )
 //
 
-void Galaxy::GetAllOutputsCallback(openGalaxy& opengalaxy,char* buf, int len)
+bool Galaxy::DecodeAllOutputs(const Galaxy::Reply& reply, unsigned char outputs[32])
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllOutputsRetv = false;
-  }
-  else {
-    // 'OR1000*[32bytes]'
-    memcpy((void*)opengalaxy.galaxy().m_getAllOutputsState, &buf[7], 32);
-    opengalaxy.galaxy().m_getAllOutputsRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllOutputs_cv.notify_one();
+  // 'OR1000*[32bytes]'
+  if(reply.success == false || reply.data.length() < 7+32) return false;
+  memcpy(outputs, &reply.data[7], 32);
+  m_state->UpdateAllOutputs(outputs);
+  return true;
 }
 
 bool Galaxy::GetAllOutputs(unsigned char outputs[32])
 {
-  char buf[48];
-  snprintf(buf, 48, "OR1000");
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::control,
-    buf,
-    strlen(buf),
-    GetAllOutputsCallback
-  )==false) return false;
-  m_getAllOutputs_cv.wait(*m_getAllOutputs_lock);
-  memcpy(outputs, (void*)m_getAllOutputsState, 32);
-  return m_getAllOutputsRetv;
+  if(origin_background == false && m_state->GetAllOutputs(outputs)) return true;
+  return DecodeAllOutputs(Call(SiaBlock::FunctionCode::control, "OR1000", true), outputs);
 }
 
 // bool GalaxyGetZoneState( unsigned int nr, galaxy_zone_state *state )
 
-void Galaxy::GetZoneStateCallback(openGalaxy& opengalaxy, char* buf, int len)
+bool Galaxy::DecodeZoneState(const Galaxy::Reply& reply, Galaxy::zone_state *state)
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getZoneStateRetv = false;
-  }
-  else {
-    // 'ZSxxxx*[state]'
-    *opengalaxy.galaxy().m_getZoneStateState = (Galaxy::zone_state)atoi((char*)&buf[7]);
-    opengalaxy.galaxy().m_getZoneStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getZoneState_cv.notify_one();
+  // 'ZSxxxx*[state]'
+  if(reply.success == false || reply.data.length() < 8) return false;
+  *state = (Galaxy::zone_state)atoi(&reply.data[7]);
+  return true;
 }
 
 bool Galaxy::GetZoneState(unsigned int nr, Galaxy::zone_state *state)
@@ -585,778 +641,126 @@ bool Galaxy::GetZoneState(unsigned int nr, Galaxy::zone_state *state)
   if(IsZone(nr)==false) return false;
   char buf[16];
   snprintf(buf, 16, "ZS%u", nr);
-  m_getZoneStateState = state;
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    GetZoneStateCallback
-  )==false) return false;
-  m_getZoneState_cv.wait(*m_getZoneState_lock);
-  return m_getZoneStateRetv;
+  return DecodeZoneState(Call(SiaBlock::FunctionCode::extended, buf, true), state);
 }
 
-// bool GalaxyGetAllZonesReadyState( unsigned char zones_state[65] )
+// Get the Ready/Alarm/Open/Tamper/Resistance/Omitted/Masked/Fault state for all zones
+//
+// ZSx
+// 1, 101, ... 701: Zones 1 - 256
+// 2, 102, ... 702: Zones 257 - 512
+//
+// Through an Await both blocks are queued at once so they are send back to back.
 
-void Galaxy::GetAllZonesReadyStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
+bool Galaxy::GetAllZonesState(Galaxy::zones_query query, unsigned char zones_state[65])
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesReadyStateRetv = false;
-  }
-  else {
-    // buf = 'ZS1*[35bytes]'
-    // 0 = low, high, closed (ready) / 1 = os, sc, open, mask, fault (not ready)
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +4
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +4
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesReadyState[0] = buf[5];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesReadyState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesReadyState[1] = buf[4]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesReadyState[2] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesReadyState[2] = buf[5]; // RIO 101
-    }
-    for(int i=3; i<33; i++){
-      opengalaxy.galaxy().m_getAllZonesReadyState[i] = buf[i+5]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesReadyStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesReadyState_cv.notify_one();
-}
+  if(origin_background == false && m_state->GetAllZonesState(query, zones_state)) return true;
 
-void Galaxy::GetAllZonesReadyStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesReadyStateRetv = false;
+  char buf1[16], buf2[16];
+  if(query == zones_query::ready){
+    snprintf(buf1, 16, "ZS1");
+    snprintf(buf2, 16, "ZS2");
   }
   else {
-    // buf = 'ZS2*[33bytes]'
-    // 0 = low, high, closed (ready) / 1 = os, sc, open, mask, fault (not ready)
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +4
-    // 2001-4158    not-used
-    //
-    for(int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesReadyState[i] = buf[i-33+4]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesReadyStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesReadyState_cv.notify_one();
-}
-
-bool Galaxy::GetAllZonesReadyState(unsigned char zones_state[65])
-{
-  // ZSx
-  // 1: Zones 1 - 256
-  // 2: Zones 257 - 512
-  char buf[48];
-
-  // Get the first block
-  snprintf(buf, 48, "ZS1");
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    GetAllZonesReadyStateCallbackOne
-  )==false) return false;
-  m_getAllZonesReadyState_cv.wait(*m_getAllZonesReadyState_lock);
-  if(m_getAllZonesReadyStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS2");
-    if(opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesReadyStateCallbackTwo
-    )==false) return false;
-    m_getAllZonesReadyState_cv.wait(*m_getAllZonesReadyState_lock);
-    if(m_getAllZonesReadyStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesReadyState, 65);
-    }
-  }
-  return m_getAllZonesReadyStateRetv;
-}
-
-// bool GalaxyGetAllZonesAlarmState( unsigned char zones_state[65] )
-
-void Galaxy::GetAllZonesAlarmStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesAlarmStateRetv = false;
+    snprintf(buf1, 16, "ZS%u01", (unsigned int)query);
+    snprintf(buf2, 16, "ZS%u02", (unsigned int)query);
+  }
+  Reply one = Call(SiaBlock::FunctionCode::extended, buf1, true);
+  Reply two = Call(SiaBlock::FunctionCode::extended, buf2, true);
+  if(one.success == false || two.success == false) return false;
+
+  // Offset of the first data byte (after the '*')
+  size_t o1 = one.data.find('*');
+  size_t o2 = two.data.find('*');
+  if(o1 == std::string::npos || o2 == std::string::npos) return false;
+  o1++;
+  o2++;
+  if(one.data.length() < o1+34 || two.data.length() < o2+32) return false;
+
+  // first block = 'ZS1*[35bytes]' or 'ZSx01*[35bytes]'
+  //
+  // dip8 = 0
+  //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34
+  // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
+  //
+  // dip8 = 1
+  //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34
+  // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
+  //
+  if(opengalaxy().settings().galaxy_dip8 != 0){
+    zones_state[0] = one.data[o1+1];
   }
   else {
-    // buf = 'ZS101*[35bytes]'
-    // 0 = not used / 1 = alarm 
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesAlarmState[0] = buf[6+1];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesAlarmState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesAlarmState[1] = buf[6+0]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesAlarmState[2] = buf[6+3];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesAlarmState[2] = buf[6+1]; // RIO 101
-    }
-    for(int i=3; i<33; i++){
-      opengalaxy.galaxy().m_getAllZonesAlarmState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesAlarmStateRetv = true;
+    zones_state[0] = 0; // RIO 001
   }
-  opengalaxy.galaxy().m_getAllZonesAlarmState_cv.notify_one();
-}
-
-void Galaxy::GetAllZonesAlarmStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesAlarmStateRetv = false;
+  zones_state[1] = one.data[o1]; // RIO 100
+  if(opengalaxy().settings().galaxy_dip8 != 0){
+    zones_state[2] = one.data[o1+3];
   }
   else {
-    // 'ZS102*[33bytes]'
-    // 0 = not used / 1 = alarm 
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for(int i=33; i < 65; i++) opengalaxy.galaxy().m_getAllZonesAlarmState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesAlarmStateRetv = true;
+    zones_state[2] = one.data[o1+1]; // RIO 101
   }
-  opengalaxy.galaxy().m_getAllZonesAlarmState_cv.notify_one();
-}
-
-bool Galaxy::GetAllZonesAlarmState( unsigned char zones_state[65] )
-{
-  // ZSx
-  // 101: Zones 1 - 256
-  // 102: Zones 257 - 512
-  char buf[48];
-  
-  // Get the first block
-  snprintf(buf, 48, "ZS101");
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    GetAllZonesAlarmStateCallbackOne
-  )==false) return false;
-  m_getAllZonesAlarmState_cv.wait(*m_getAllZonesAlarmState_lock);
-  if(m_getAllZonesAlarmStateRetv==true){
-    // Get the second block
-      snprintf(buf, 48, "ZS102");
-    if( opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesAlarmStateCallbackTwo
-    )==false) return false;
-    m_getAllZonesAlarmState_cv.wait(*m_getAllZonesAlarmState_lock);
-    if(m_getAllZonesAlarmStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesAlarmState, 65);
-    }
+  for(int i=3; i<33; i++){
+    zones_state[i] = one.data[i+o1+1]; // RIOs 102 ... 215
   }
-  return m_getAllZonesAlarmStateRetv;
-}
 
-// bool GalaxyGetAllZonesOpenState( unsigned char zones_state[65] )
+  // second block = 'ZS2*[33bytes]' or 'ZSx02*[33bytes]'
+  //
+  // dip8 = 0/1
+  //  byte 0-31   byte 32
+  // 2001-4158    not-used
+  //
+  for(int i=33; i<65; i++) zones_state[i] = two.data[i-33+o2]; // RIOs 300 ... 415
 
-void Galaxy::GetAllZonesOpenStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesOpenStateRetv = false;
-  }
-  else {
-    // buf = 'ZS201*[35bytes]'
-    // 0 = not used / 1 = open 
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesOpenState[0] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesOpenState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesOpenState[1] = buf[6]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesOpenState[2] = buf[9];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesOpenState[2] = buf[7]; // RIO 101
-    }
-    for(int i=3; i<33; i++){
-      opengalaxy.galaxy().m_getAllZonesOpenState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesOpenStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesOpenState_cv.notify_one();
-}
+  m_state->UpdateAllZonesState(query, zones_state);
 
-void Galaxy::GetAllZonesOpenStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesOpenStateRetv = false;
-  }
-  else {
-    // 'ZS202*[33bytes]'
-    // 0 = not used / 1 = open 
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for(int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesOpenState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesOpenStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesOpenState_cv.notify_one();
+  return true;
 }
 
-bool Galaxy::GetAllZonesOpenState(unsigned char zones_state[65])
+// 0 = low, high, closed (ready) / 1 = os, sc, open, mask, fault (not ready)
+bool Galaxy::GetAllZonesReadyState(unsigned char zones_state[65])
 {
-  // ZSx
-  // 201: Zones 1 - 256
-  // 202: Zones 257 - 512
-  char buf[48];
-  // Get the first block
-  snprintf(buf, 48, "ZS201");
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    GetAllZonesOpenStateCallbackOne
-  )==false) return false;
-  m_getAllZonesOpenState_cv.wait(*m_getAllZonesOpenState_lock);
-  if(m_getAllZonesOpenStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS202");
-    if(opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesOpenStateCallbackTwo
-    )==false) return false;
-    m_getAllZonesOpenState_cv.wait(*m_getAllZonesOpenState_lock);
-    if(m_getAllZonesOpenStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesOpenState, 65);
-    }
-  }
-  return m_getAllZonesOpenStateRetv;
+  return GetAllZonesState(zones_query::ready, zones_state);
 }
 
-// bool GalaxyGetAllZonesTamperState( unsigned char zones_state[65] )
-
-void Galaxy::GetAllZonesTamperStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
+// 0 = not used / 1 = alarm 
+bool Galaxy::GetAllZonesAlarmState(unsigned char zones_state[65])
 {
-  if( buf == nullptr ){
-    opengalaxy.galaxy().m_getAllZonesTamperStateRetv = false;
-  }
-  else {
-    // buf = 'ZS301*[35bytes]'
-    // 0 = not used / 1 = oc or sc 
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesTamperState[0] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesTamperState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesTamperState[1] = buf[6]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesTamperState[2] = buf[9];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesTamperState[2] = buf[7]; // RIO 101
-    }
-    for(int i=3; i<33; i++){
-      opengalaxy.galaxy().m_getAllZonesTamperState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesTamperStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesTamperState_cv.notify_one();
+  return GetAllZonesState(zones_query::alarm, zones_state);
 }
 
-void Galaxy::GetAllZonesTamperStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
+bool Galaxy::GetAllZonesOpenState(unsigned char zones_state[65])
 {
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesTamperStateRetv = false;
-  }
-  else {
-    // buf = 'ZS302*[33bytes]'
-    // 0 = not used / 1 = oc or sc 
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for( int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesTamperState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesTamperStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesTamperState_cv.notify_one();
+  return GetAllZonesState(zones_query::open, zones_state);
 }
 
 bool Galaxy::GetAllZonesTamperState(unsigned char zones_state[65])
 {
-  // ZSx
-  // 301: Zones 1 - 256
-  // 302: Zones 257 - 512
-  char buf[48];
-
-  // Get the first block
-  snprintf(buf, 48, "ZS301");
-  if(
-    opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesTamperStateCallbackOne
-    ) == false
-  ) return false;
-  m_getAllZonesTamperState_cv.wait(*m_getAllZonesTamperState_lock);
-  if(m_getAllZonesTamperStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS302");
-    if(
-      opengalaxy().receiver().send(
-        SiaBlock::FunctionCode::extended,
-        buf,
-        strlen(buf),
-        GetAllZonesTamperStateCallbackTwo
-      ) == false
-    ) return false;
-    m_getAllZonesTamperState_cv.wait(*m_getAllZonesTamperState_lock);
-    if(m_getAllZonesTamperStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesTamperState, 65);
-    }
-  }
-  return m_getAllZonesTamperStateRetv;
-}
-
-// bool GalaxyGetAllZonesRState( unsigned char zones_state[65] )
-
-void Galaxy::GetAllZonesRStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesRStateRetv = false;
-  }
-  else {
-    // buf = 'ZS401*[35bytes]'
-    // 0 = not used / 1 = low or high R 
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesRState[0] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesRState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesRState[1] = buf[6]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesRState[2] = buf[9];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesRState[2] = buf[7]; // RIO 101
-    }
-    for(int i=3; i<33; i++){
-      opengalaxy.galaxy().m_getAllZonesRState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesRStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesRState_cv.notify_one();
-}
-
-void Galaxy::GetAllZonesRStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf == nullptr){
-    opengalaxy.galaxy().m_getAllZonesRStateRetv = false;
-  }
-  else {
-    // buf = 'ZS402*[33bytes]'
-    // 0 = not used / 1 = low or high R 
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for(int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesRState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesRStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesRState_cv.notify_one();
+  return GetAllZonesState(zones_query::tamper, zones_state);
 }
 
 bool Galaxy::GetAllZonesRState(unsigned char zones_state[65])
 {
-  // ZSx
-  // 401: Zones 1 - 256
-  // 402: Zones 257 - 512
-  char buf[48];
-
-  // Get the first block
-  snprintf(buf, 48, "ZS401");
-  if(
-    opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesRStateCallbackOne
-    ) == false
-  ) return false;
-  m_getAllZonesRState_cv.wait(*m_getAllZonesRState_lock);
-  if(m_getAllZonesRStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS402");
-    if(
-      opengalaxy().receiver().send(
-        SiaBlock::FunctionCode::extended,
-        buf,
-        strlen(buf),
-        GetAllZonesRStateCallbackTwo
-      ) == false
-    ) return false;
-    m_getAllZonesRState_cv.wait(*m_getAllZonesRState_lock);
-    if(m_getAllZonesRStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesRState, 65);
-    }
-  }
-  return m_getAllZonesRStateRetv;
-}
-
-// bool GalaxyGetAllZonesOmittedState( unsigned char zones_state[65] )
-
-void Galaxy::GetAllZonesOmittedStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesOmittedStateRetv = false;
-  }
-  else {
-    // buf = 'ZS501*[35bytes]'
-    // 0 = not omitted / 1 = omitted
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesOmittedState[0] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesOmittedState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesOmittedState[1] = buf[6]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesOmittedState[2] = buf[9];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesOmittedState[2] = buf[7]; // RIO 101
-    }
-    for(int i=3; i < 33; i++){
-      opengalaxy.galaxy().m_getAllZonesOmittedState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesOmittedStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesOmittedState_cv.notify_one();
-}
-
-void Galaxy::GetAllZonesOmittedStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if( buf == nullptr ){
-    opengalaxy.galaxy().m_getAllZonesOmittedStateRetv = false;
-  }
-  else {
-    // buf = 'ZS502*[33bytes]'
-    // 0 = not omitted / 1 = omitted
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for(int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesOmittedState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesOmittedStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesOmittedState_cv.notify_one();
+  return GetAllZonesState(zones_query::rstate, zones_state);
 }
 
 bool Galaxy::GetAllZonesOmittedState(unsigned char zones_state[65])
 {
-  // ZSx
-  // 501: Zones 1 - 256
-  // 502: Zones 257 - 512
-  char buf[48];
-
-  // Get the first block
-  snprintf(buf, 48, "ZS501");
-  if(
-    opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesOmittedStateCallbackOne
-    ) == false
-  ) return false;
-  m_getAllZonesOmittedState_cv.wait(*m_getAllZonesOmittedState_lock);
-  if(m_getAllZonesOmittedStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS502");
-    if(
-      opengalaxy().receiver().send(
-        SiaBlock::FunctionCode::extended,
-        buf,
-        strlen(buf),
-        GetAllZonesOmittedStateCallbackTwo
-      ) == false
-    ) return false;
-    m_getAllZonesOmittedState_cv.wait(*m_getAllZonesOmittedState_lock);
-    if(m_getAllZonesOmittedStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesOmittedState, 65);
-    }
-  }
-  return m_getAllZonesOmittedStateRetv;
-}
-
-void Galaxy::GetAllZonesMaskedStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesMaskedStateRetv = false;
-  }
-  else {
-    // buf = 'ZS601*[35bytes]'
-    // 0 = not masked / 1 = masked
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesMaskedState[0] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesMaskedState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesMaskedState[1] = buf[6]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesMaskedState[2] = buf[9];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesMaskedState[2] = buf[7]; // RIO 101
-    }
-    for(int i=3; i < 33; i++){
-      opengalaxy.galaxy().m_getAllZonesMaskedState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesMaskedStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesMaskedState_cv.notify_one();
-}
-
-void Galaxy::GetAllZonesMaskedStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if( buf == nullptr ){
-    opengalaxy.galaxy().m_getAllZonesMaskedStateRetv = false;
-  }
-  else {
-    // buf = 'ZS602*[33bytes]'
-    // 0 = not masked / 1 = masked
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for(int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesMaskedState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesMaskedStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesMaskedState_cv.notify_one();
+  return GetAllZonesState(zones_query::omitted, zones_state);
 }
 
 bool Galaxy::GetAllZonesMaskedState(unsigned char zones_state[65])
 {
-  // ZSx
-  // 601: Zones 1 - 256
-  // 602: Zones 257 - 512
-  char buf[48];
-
-  // Get the first block
-  snprintf(buf, 48, "ZS601");
-  if(
-    opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesMaskedStateCallbackOne
-    ) == false
-  ) return false;
-  m_getAllZonesMaskedState_cv.wait(*m_getAllZonesMaskedState_lock);
-  if(m_getAllZonesMaskedStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS602");
-    if(
-      opengalaxy().receiver().send(
-        SiaBlock::FunctionCode::extended,
-        buf,
-        strlen(buf),
-        GetAllZonesMaskedStateCallbackTwo
-      ) == false
-    ) return false;
-    m_getAllZonesMaskedState_cv.wait(*m_getAllZonesMaskedState_lock);
-    if(m_getAllZonesMaskedStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesMaskedState, 65);
-    }
-  }
-  return m_getAllZonesMaskedStateRetv;
-}
-
-void Galaxy::GetAllZonesFaultStateCallbackOne(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_getAllZonesFaultStateRetv = false;
-  }
-  else {
-    // buf = 'ZS701*[35bytes]'
-    // 0 = no fault / 1 = fault
-    //
-    // dip8 = 0
-    //  byte 0     byte 1     byte 2    byte 3   byte 4-33   byte 34    +6
-    // 1001-1008  1011-1018  not-used  not-used  1021-2158  not-used
-    //
-    // dip8 = 1
-    //  byte 0     byte 1     byte 2    byte 3    byte 4-33   byte 34   +6
-    // 1001-1008  0011-0018  not-used  1011-1018  1021-2158  not-used
-    //
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesFaultState[0] = buf[7];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesFaultState[0] = 0; // RIO 001
-    }
-    opengalaxy.galaxy().m_getAllZonesFaultState[1] = buf[6]; // RIO 100
-    if(opengalaxy.settings().galaxy_dip8 != 0){
-      opengalaxy.galaxy().m_getAllZonesFaultState[2] = buf[9];
-    }
-    else {
-      opengalaxy.galaxy().m_getAllZonesFaultState[2] = buf[7]; // RIO 101
-    }
-    for(int i=3; i < 33; i++){
-      opengalaxy.galaxy().m_getAllZonesFaultState[i] = buf[i+7]; // RIOs 102 ... 215
-    }
-    opengalaxy.galaxy().m_getAllZonesFaultStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesFaultState_cv.notify_one();
-}
-
-void Galaxy::GetAllZonesFaultStateCallbackTwo(openGalaxy& opengalaxy, char* buf, int len)
-{
-  if( buf == nullptr ){
-    opengalaxy.galaxy().m_getAllZonesFaultStateRetv = false;
-  }
-  else {
-    // buf = 'ZS702*[33bytes]'
-    // 0 = no fault / 1 = fault
-    //
-    // dip8 = 0/1
-    //  byte 0-31   byte 32     +6
-    // 2001-4158    not-used
-    //
-    for(int i=33; i<65; i++) opengalaxy.galaxy().m_getAllZonesFaultState[i] = buf[i-33+6]; // RIOs 300 ... 415
-    opengalaxy.galaxy().m_getAllZonesFaultStateRetv = true;
-  }
-  opengalaxy.galaxy().m_getAllZonesFaultState_cv.notify_one();
+  return GetAllZonesState(zones_query::masked, zones_state);
 }
 
+// 0 = no fault / 1 = fault
 bool Galaxy::GetAllZonesFaultState(unsigned char zones_state[65])
 {
-  // ZSx
-  // 701: Zones 1 - 256
-  // 702: Zones 257 - 512
-  char buf[48];
-
-  // Get the first block
-  snprintf(buf, 48, "ZS701");
-  if(
-    opengalaxy().receiver().send(
-      SiaBlock::FunctionCode::extended,
-      buf,
-      strlen(buf),
-      GetAllZonesFaultStateCallbackOne
-    ) == false
-  ) return false;
-  m_getAllZonesFaultState_cv.wait(*m_getAllZonesFaultState_lock);
-  if(m_getAllZonesFaultStateRetv==true){
-    // Get the second block
-    snprintf(buf, 48, "ZS702");
-    if(
-      opengalaxy().receiver().send(
-        SiaBlock::FunctionCode::extended,
-        buf,
-        strlen(buf),
-        GetAllZonesFaultStateCallbackTwo
-      ) == false
-    ) return false;
-    m_getAllZonesFaultState_cv.wait(*m_getAllZonesFaultState_lock);
-    if(m_getAllZonesFaultStateRetv==true){
-      memcpy(zones_state, (void*)m_getAllZonesFaultState, 65);
-    }
-  }
-  return m_getAllZonesFaultStateRetv;
+  return GetAllZonesState(zones_query::fault, zones_state);
 }
 
 
-void Galaxy::ReprocessEventsCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  // Was the command successfull?
-  if(buf == nullptr) opengalaxy.galaxy().m_reprocessEventsCallbackRetv = false;
-  else opengalaxy.galaxy().m_reprocessEventsCallbackRetv = true;
-  // Unblock
-  opengalaxy.galaxy().m_reprocessEvents_cv.notify_one();
-}
-
 bool Galaxy::ReprocessEvents(unsigned int nr, Galaxy::sia_module module)
 {
   // Reprocess nr (1-1000 or 0 for all) events for the given SIA module
@@ -1373,29 +777,11 @@ bool Galaxy::ReprocessEvents(unsigned int nr, Galaxy::sia_module module)
     snprintf(buf, 16, "EV%u*%u", nr, (unsigned int)module); // selected module
   }
 
-  // Let the receiver thread send the command
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    ReprocessEventsCallback
-  )==false) return false;
-
-  // and wait for the callback to finish
-  m_reprocessEvents_cv.wait(*m_reprocessEvents_lock);
-  return m_reprocessEventsCallbackRetv;
+  // Let the receiver thread send the command and wait for the reply
+  return Call(SiaBlock::FunctionCode::extended, buf).success;
 }
 
 
-void Galaxy::FlushEventsCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  // Was the command successfull?
-  if(buf == nullptr) opengalaxy.galaxy().m_flushEventsCallbackRetv = false;
-  else opengalaxy.galaxy().m_flushEventsCallbackRetv = true;
-  // Unblock
-  opengalaxy.galaxy().m_flushEvents_cv.notify_one();
-}
-
 bool Galaxy::FlushEvents(Galaxy::sia_module module)
 {
   // Flush all events for the given SIA module
@@ -1410,31 +796,8 @@ bool Galaxy::FlushEvents(Galaxy::sia_module module)
     snprintf(buf, 16, "EV*%u", (unsigned int)module); // selected module
   }
 
-  // Let the receiver thread send the command
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    FlushEventsCallback
-  )==false) return false;
-
-  // and wait for the callback to finish
-  m_flushEvents_cv.wait(*m_flushEvents_lock);
-  return m_flushEventsCallbackRetv;
-}
-
-void Galaxy::CheckEventsCallback(openGalaxy& opengalaxy,char* buf, int len)
-{
-  if(buf==nullptr){
-    opengalaxy.galaxy().m_checkEventsCallbackResult = 0;
-    opengalaxy.galaxy().m_checkEventsCallbackRetv = false;
-  }
-  else {
-    // 'EVx*y'
-    opengalaxy.galaxy().m_checkEventsCallbackResult = strtol(&buf[2], nullptr, 10);
-    opengalaxy.galaxy().m_checkEventsCallbackRetv = true;
-  }
-  opengalaxy.galaxy().m_checkEvents_cv.notify_one();
+  // Let the receiver thread send the command and wait for the reply
+  return Call(SiaBlock::FunctionCode::extended, buf).success;
 }
 
 bool Galaxy::CheckEvents(unsigned int& nr, Galaxy::sia_module module)
@@ -1451,52 +814,45 @@ bool Galaxy::CheckEvents(unsigned int& nr, Galaxy::sia_module module)
     snprintf(buf, 16, "EV%u", (unsigned int)module); // selected module
   }
 
-  // Let the receiver thread send the command
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    CheckEventsCallback
-  )==false) return false;
-
-  // and wait for the callback to finish
-  m_checkEvents_cv.wait(*m_checkEvents_lock);
-
-  nr = (unsigned int)m_checkEventsCallbackResult;
+  // Let the receiver thread send the command and wait for the reply
+  Reply reply = Call(SiaBlock::FunctionCode::extended, buf, true);
+  if(reply.success == false){
+    nr = 0;
+    return false;
+  }
 
-  return m_checkEventsCallbackRetv;
+  // 'EVx*y'
+  nr = (unsigned int)strtol(reply.data.c_str() + 2, nullptr, 10);
+  return true;
 }
 
 
-void Galaxy::GenerateWrongCodeAlarmCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  // Was the command successfull?
-  if(buf == nullptr) opengalaxy.galaxy().m_generateWrongCodeAlarmCallbackRetv = false;
-  else opengalaxy.galaxy().m_generateWrongCodeAlarmCallbackRetv = true;
-  // Unblock
-  opengalaxy.galaxy().m_generateWrongCodeAlarm_cv.notify_one();
-}
-
-bool Galaxy::GenerateWrongCodeAlarm_nb(Galaxy::sia_module module, Receiver::transmit_callback callback)
+void Galaxy::FormatWrongCodeAlarm(char buf[16], Galaxy::sia_module module)
 {
   // Generate a wrong code alarm for the given SIA module
   // EV20000*y
   // 1: ack
 
-  char buf[16];
   if(module == Galaxy::sia_module::all){
     snprintf(buf, 16, "EV20000*"); // all modules
   }
   else {
     snprintf(buf, 16, "EV20000*%u", (unsigned int)module); // selected module
   }
+}
+
+bool Galaxy::GenerateWrongCodeAlarm_nb(Galaxy::sia_module module, Receiver::transmit_callback callback)
+{
+  char buf[16];
+  FormatWrongCodeAlarm(buf, module);
 
   // Let the receiver thread send the command
   if(opengalaxy().receiver().send(
     SiaBlock::FunctionCode::extended,
     buf,
     strlen(buf),
-    callback
+    callback,
+    Receiver::priority::action
   )==false) return false;
 
   return true;
@@ -1504,24 +860,14 @@ bool Galaxy::GenerateWrongCodeAlarm_nb(Galaxy::sia_module module, Receiver::tran
 
 bool Galaxy::GenerateWrongCodeAlarm(Galaxy::sia_module module)
 {
-  // Let the receiver thread send the command
-  if(GenerateWrongCodeAlarm_nb(module, GenerateWrongCodeAlarmCallback) == false) return false;
+  char buf[16];
+  FormatWrongCodeAlarm(buf, module);
 
-  // and wait for the callback to finish
-  m_generateWrongCodeAlarm_cv.wait(*m_generateWrongCodeAlarm_lock);
-  return m_generateWrongCodeAlarmCallbackRetv;
+  // Let the receiver thread send the command and wait for the reply
+  return Call(SiaBlock::FunctionCode::extended, buf).success;
 }
 
 
-void Galaxy::SetZoneStateCallback(openGalaxy& opengalaxy, char* buf, int len)
-{
-  // Was the command successfull?
-  if(buf == nullptr) opengalaxy.galaxy().m_setZoneStateCallbackRetv = false;
-  else opengalaxy.galaxy().m_setZoneStateCallbackRetv = true;
-  // Unblock
-  opengalaxy.galaxy().m_setZoneState_cv.notify_one();
-}
-
 // Set the state of a zone or zone type.
 //
 // Argument 'zone' may only be a zone type when
@@ -1590,19 +936,11 @@ bool Galaxy::SetZoneState(
       return false;
   }
 
-  // Let the receiver thread send the command
-  if(opengalaxy().receiver().send(
-    SiaBlock::FunctionCode::extended,
-    buf,
-    strlen(buf),
-    SetZoneStateCallback
-  )==false) return false;
-
-  // and wait for the callback to finish
-  m_setZoneState_cv.wait(*m_setZoneState_lock);
-  return m_setZoneStateCallbackRetv;
+  // Let the receiver thread send the command and wait for the reply
+  bool retv = Call(SiaBlock::FunctionCode::extended, buf).success;
+  if(retv) m_state->InvalidateZones();
+  return retv;
 }
 
 
 } // ends namespace openGalaxy
-
@@ -35,11 +35,16 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <future>
+#include <string>
 
+#include "Array.hpp"
 #include "opengalaxy.hpp"
 
 namespace openGalaxy {
 
+class PanelState;
+
 class Galaxy {
 public:
 
@@ -245,15 +250,112 @@ public:
     GalaxyByte RIO415;   // byte 64
   };
 
+  // Galaxy zone state queries, each one is answered in two blocks
+  // with a bit for every zone (see GetAllZonesState())
+  enum class zones_query : unsigned int {
+    ready = 0, // ZS1/ZS2
+    alarm,     // ZS101/ZS102
+    open,      // ZS201/ZS202
+    tamper,    // ZS301/ZS302
+    rstate,    // ZS401/ZS402
+    omitted,   // ZS501/ZS502
+    masked,    // ZS601/ZS602
+    fault      // ZS701/ZS702
+  };
+
+  // The answer of the panel to a single request
+  class Reply {
+  public:
+    bool success = false; // false when the panel rejected the request or did not answer
+    std::string data;     // the datablock returned by the panel (may include \0 bytes)
+  };
+
+  // A Reply that becomes available once the receiver thread completed the
+  // request. Any number of threads may wait on (copies of) the same future.
+  typedef std::shared_future<Reply> Future;
+
+  // Function to call when a request completes. It is called from the
+  // receiver thread and must not block or Submit() a new request.
+  typedef void(*completion_callback)(class openGalaxy&, unsigned long id, const Reply&, void *user);
+
   Galaxy(openGalaxy&);
   ~Galaxy();
 
+  // Queue a request for the panel without blocking the calling thread.
+  //
+  // When 'share' is true and an identical shared request is still pending,
+  // no new request is queued: the caller is attached to the pending one
+  // and both are completed by the same round trip to the panel.
+  // Only read-only requests should be shared.
+  //
+  // The first form returns a future for the reply (and optionally the
+  // request id), the second form returns the request id and calls
+  // 'callback' from the receiver thread when the request completes.
+  // Both return an invalid future or request id 0 when the request could
+  // not be queued.
+  Future Submit(SiaBlock::FunctionCode fc, const char *command, bool share = false, unsigned long *id = nullptr);
+  unsigned long Submit(SiaBlock::FunctionCode fc, const char *command, bool share, completion_callback callback, void *user);
+
+  // Sets the origin of the requests submitted by the calling thread.
+  //
+  // Requests for background polling are queued with the lowest priority,
+  // other shared requests as operator queries and all other requests as
+  // operator actions. Requests still queued for a session are dropped
+  // when it disconnects (see Receiver::cancel()).
+  static void SetOrigin(bool background, unsigned long long session);
+
+  // The replies to the requests of a caller that may not block while the
+  // panel answers them (see SetAwait()).
+  class Await {
+  public:
+    class Slot {
+    public:
+      Await *await;               // the Await this slot belongs to
+      SiaBlock::FunctionCode fc;  // function code of the request
+      std::string command;        // data of the request
+      bool ready = false;         // true once 'reply' is valid
+      Reply reply;
+    };
+    completion_callback callback; // called when the caller may repeat its pass
+    void *user;                   // passed to 'callback'
+    bool pending = false;         // true when the last pass did not get all of its replies
+
+    Await(completion_callback callback, void *user) : callback(callback), user(user) {}
+
+    // Forgets all replies, before starting on something else
+    // (Must not be called while the Await is suspended)
+    void reset();
+
+  private:
+    friend class Galaxy;
+    std::mutex mutex;
+    ObjectArray<Slot*> slots;     // the requests of the pass, in the order they were made
+    int next = 0;                 // the slot for the next request of the pass
+    int outstanding = 0;          // the number of requests without a reply
+    bool suspended = false;       // true while the caller waits for 'callback'
+  };
+
+  // Sets (or clears with a nullptr) the Await of the calling thread and
+  // starts a new pass over it.
+  //
+  // While an Await is set, the functions below do not block: each request
+  // they make is answered with the reply stored in the next slot of the
+  // Await. When that reply is not there yet, the request is submitted with
+  // a continuation and fails with 'pending' set. The caller then calls
+  // Suspend() and repeats the same pass (with the same requests in the same
+  // order) once the callback of the Await was called.
+  static void SetAwait(Await *await);
+
+  // Returns true when the caller must wait for the callback of the Await
+  // before repeating its pass, or false when all replies are already in.
+  static bool Suspend(Await& await);
+
   // The functions below:
   //
-  //  - Sends one or more SiaBlock's to the transmitter and
-  //    set a callback function to call when the receiver class has received a reply.
-  //  - The functions then block by use of a condition variable, until that reply has been received.
-  //  - Finally any received data is transferred to the calling function.
+  //  - Queue one or more requests for the panel (see Submit()),
+  //  - block until the receiver thread has completed them (or fail after
+  //    reply_timeout_seconds), unless an Await is set (see SetAwait()),
+  //  - and transfer any received data to the calling function.
 
   // Perform a(n) area/zone/output action
   bool AreaAction              ( unsigned int blknum, area_action action );
@@ -323,201 +425,67 @@ public:
     const char *desc = nullptr   // zone description (optional, max. 16 chars)
   );
 
+  // The model of the panel state, the (blocking) state queries above
+  // are answered from it when it is fresh enough (see PanelState)
+  inline class PanelState& state(){ return *m_state; }
+
   // Provide a method that refers to the top openGalaxy class
   inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
 
 private:
 
   class openGalaxy& m_openGalaxy;
+  class PanelState *m_state;
+
+  // Longest time to wait for the reply to a request (seconds), longer than
+  // a block may wait in the transmit queues plus all retries to send it
+  constexpr static const int reply_timeout_seconds = 120;
+
+  Reply Wait(const Future& future);
+  Reply Call(SiaBlock::FunctionCode fc, const char *command, bool share = false);
+  static void AwaitComplete(class openGalaxy&, unsigned long id, const Reply& reply, void *user);
+
+  bool DecodeAreaArmedState     ( const Reply& reply, unsigned int blknum, area_armed_state* state );
+  bool DecodeAllAreasArmedState ( const Reply& reply, area_armed_state state[32] );
+  bool DecodeAllAreasAlarmState ( const Reply& reply, area_alarm_state state[32] );
+  bool DecodeAllAreasReadyState ( const Reply& reply, area_ready_state state[32] );
+  bool DecodeZoneIsOmit         ( const Reply& reply, zone_action* state );
+  bool DecodeZoneState          ( const Reply& reply, zone_state* state );
+  bool DecodeAllOutputs         ( const Reply& reply, unsigned char outputs[32] );
+  bool GetAllZonesState         ( zones_query query, unsigned char zones_state[65] );
 
   bool IsZone(int nr);
   bool IsOutput(int nr);
 
-  // for AreaAction()
-  static void AreaActionCallback(class openGalaxy&,char*,int len);
-  volatile bool m_areaActionCallbackRetv;
-  std::condition_variable m_areaAction_cv;
-  std::unique_lock<std::mutex> *m_areaAction_lock;
-  std::mutex m_areaAction_mutex;
-
-  // for GetAreaArmedState()
-  static void GetAreaArmedStateCallback(class openGalaxy&,char*,int);
-  volatile bool m_getAreaArmedStateRetv;
-  volatile area_armed_state* m_getAreaArmedStateState;
-  volatile unsigned int m_getAreaArmedStateBlknum;
-  std::condition_variable m_getAreaArmedState_cv;
-  std::unique_lock<std::mutex> *m_getAreaArmedState_lock;
-  std::mutex m_getAreaArmedState_mutex;
-
-  // for GetAllAreasArmedState()
-  static void GetAllAreasArmedStateCallback(class openGalaxy&,char*,int);
-  volatile bool m_getAllAreasArmedStateRetv;
-  volatile area_armed_state m_getAllAreasArmedState[32];
-  std::condition_variable m_getAllAreasArmedState_cv;
-  std::unique_lock<std::mutex> *m_getAllAreasArmedState_lock;
-  std::mutex m_getAllAreasArmedState_mutex;
-
-  // for GetAllAreasAlarmState()
-  static void GetAllAreasAlarmStateCallback(class openGalaxy&,char* buf,int);
-  volatile bool m_getAllAreasAlarmStateRetv;
-  volatile area_alarm_state m_getAllAreasAlarmState[32];
-  std::condition_variable m_getAllAreasAlarmState_cv;
-  std::unique_lock<std::mutex> *m_getAllAreasAlarmState_lock;
-  std::mutex m_getAllAreasAlarmState_mutex;
-
-  // for GetAllAreasReadyState()
-  static void GetAllAreasReadyStateCallback(class openGalaxy&,char* buf,int);
-  volatile bool m_getAllAreasReadyStateRetv;
-  volatile area_ready_state m_getAllAreasReadyState[32];
-  std::condition_variable m_getAllAreasReadyState_cv;
-  std::unique_lock<std::mutex> *m_getAllAreasReadyState_lock;
-  std::mutex m_getAllAreasReadyState_mutex;
-
-  // for ZoneAction()
-  static void ZoneActionCallback(class openGalaxy&,char*,int);
-  volatile bool m_zoneActionRetv;
-  std::condition_variable m_zoneAction_cv;
-  std::unique_lock<std::mutex> *m_zoneAction_lock;
-  std::mutex m_zoneAction_mutex;
-
-  // for ZoneIsOmit()
-  static void ZoneIsOmitCallback(class openGalaxy&,char*,int);
-  volatile bool m_zoneIsOmitRetv;
-  volatile zone_action* m_zoneIsOmitState;
-  std::condition_variable m_zoneIsOmit_cv;
-  std::unique_lock<std::mutex> *m_zoneIsOmit_lock;
-  std::mutex m_zoneIsOmit_mutex;
-
-  // for OutputAction()
-  static void OutputActionCallback(class openGalaxy&,char*, int);
-  volatile bool m_outputActionRetv;
-  std::condition_variable m_outputAction_cv;
-  std::unique_lock<std::mutex> *m_outputAction_lock;
-  std::mutex m_outputAction_mutex;
-
-  // for GetAllOutputs()
-  static void GetAllOutputsCallback(class openGalaxy&,char*, int);
-  volatile bool m_getAllOutputsRetv;
-  volatile unsigned char m_getAllOutputsState[32];
-  std::condition_variable m_getAllOutputs_cv;
-  std::unique_lock<std::mutex> *m_getAllOutputs_lock;
-  std::mutex m_getAllOutputs_mutex;
-
-  // for GetZoneState()
-  static void GetZoneStateCallback(class openGalaxy&,char*,int);
-  volatile bool m_getZoneStateRetv;
-  volatile zone_state* m_getZoneStateState;
-  std::condition_variable m_getZoneState_cv;
-  std::unique_lock<std::mutex> *m_getZoneState_lock;
-  std::mutex m_getZoneState_mutex;
-
-  // for GetAllZonesReadyState()
-  static void GetAllZonesReadyStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesReadyStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesReadyStateRetv;
-  volatile unsigned char m_getAllZonesReadyState[65];
-  std::condition_variable m_getAllZonesReadyState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesReadyState_lock;
-  std::mutex m_getAllZonesReadyState_mutex;
-
-  // for GetAllZonesAlarmState()
-  static void GetAllZonesAlarmStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesAlarmStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesAlarmStateRetv;
-  volatile unsigned char m_getAllZonesAlarmState[65];
-  std::condition_variable m_getAllZonesAlarmState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesAlarmState_lock;
-  std::mutex m_getAllZonesAlarmState_mutex;
-
-  // for GetAllZonesOpenState()
-  static void GetAllZonesOpenStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesOpenStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesOpenStateRetv;
-  volatile unsigned char m_getAllZonesOpenState[65];
-  std::condition_variable m_getAllZonesOpenState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesOpenState_lock;
-  std::mutex m_getAllZonesOpenState_mutex;
-
-  // for GetAllZonesTamperState()
-  static void GetAllZonesTamperStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesTamperStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesTamperStateRetv;
-  volatile unsigned char m_getAllZonesTamperState[65];
-  std::condition_variable m_getAllZonesTamperState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesTamperState_lock;
-  std::mutex m_getAllZonesTamperState_mutex;
-
-  // for GetAllZonesRState()
-  static void GetAllZonesRStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesRStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesRStateRetv;
-  volatile unsigned char m_getAllZonesRState[65];
-  std::condition_variable m_getAllZonesRState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesRState_lock;
-  std::mutex m_getAllZonesRState_mutex;
-
-  // for GetAllZonesOmittedState()
-  static void GetAllZonesOmittedStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesOmittedStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesOmittedStateRetv;
-  volatile unsigned char m_getAllZonesOmittedState[65];
-  std::condition_variable m_getAllZonesOmittedState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesOmittedState_lock;
-  std::mutex m_getAllZonesOmittedState_mutex;
-
-  // for GetAllZonesMaskedState()
-  static void GetAllZonesMaskedStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesMaskedStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesMaskedStateRetv;
-  volatile unsigned char m_getAllZonesMaskedState[65];
-  std::condition_variable m_getAllZonesMaskedState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesMaskedState_lock;
-  std::mutex m_getAllZonesMaskedState_mutex;
-
-  // for GetAllZonesFaultState()
-  static void GetAllZonesFaultStateCallbackOne(class openGalaxy&,char*,int);
-  static void GetAllZonesFaultStateCallbackTwo(class openGalaxy&,char*,int);
-  volatile bool m_getAllZonesFaultStateRetv;
-  volatile unsigned char m_getAllZonesFaultState[65];
-  std::condition_variable m_getAllZonesFaultState_cv;
-  std::unique_lock<std::mutex> *m_getAllZonesFaultState_lock;
-  std::mutex m_getAllZonesFaultState_mutex;
-
-  // for ReprocessEvents()
-  static void ReprocessEventsCallback(class openGalaxy&,char*,int);
-  volatile bool m_reprocessEventsCallbackRetv;
-  std::condition_variable m_reprocessEvents_cv;
-  std::unique_lock<std::mutex> *m_reprocessEvents_lock;
-  std::mutex m_reprocessEvents_mutex;
-
-  // for FlushEvents()
-  static void FlushEventsCallback(class openGalaxy&,char*,int);
-  volatile bool m_flushEventsCallbackRetv;
-  std::condition_variable m_flushEvents_cv;
-  std::unique_lock<std::mutex> *m_flushEvents_lock;
-  std::mutex m_flushEvents_mutex;
-
-  // for CheckEvents()
-  static void CheckEventsCallback(class openGalaxy&,char*,int);
-  volatile bool m_checkEventsCallbackRetv;
-  volatile long m_checkEventsCallbackResult;
-  std::condition_variable m_checkEvents_cv;
-  std::unique_lock<std::mutex> *m_checkEvents_lock;
-  std::mutex m_checkEvents_mutex;
-
-  // for GenerateWrongCodeAlarm()
-  static void GenerateWrongCodeAlarmCallback(class openGalaxy&,char*,int);
-  volatile bool m_generateWrongCodeAlarmCallbackRetv;
-  std::condition_variable m_generateWrongCodeAlarm_cv;
-  std::unique_lock<std::mutex> *m_generateWrongCodeAlarm_lock;
-  std::mutex m_generateWrongCodeAlarm_mutex;
-
-  // for SetZoneState()
-  static void SetZoneStateCallback(class openGalaxy&,char*,int);
-  volatile bool m_setZoneStateCallbackRetv;
-  std::condition_variable m_setZoneState_cv;
-  std::unique_lock<std::mutex> *m_setZoneState_lock;
-  std::mutex m_setZoneState_mutex;
+  // A request that is waiting for the receiver thread to complete it
+  class PendingRequest {
+  public:
+    class Continuation {
+    public:
+      completion_callback callback;
+      void *user;
+    };
+    unsigned long id;                   // request id
+    SiaBlock::FunctionCode fc;          // function code of the send block
+    std::string command;                // data of the send block
+    bool share;                         // true if identical requests may be attached to this one
+    std::promise<Reply> promise;        // completed with the reply
+    Future future;                      // (shared) future of 'promise'
+    ObjectArray<Continuation*> continuations; // functions to call with the reply
+  };
+
+  // The completion table with all pending requests, keyed by request id
+  Array<PendingRequest*> m_requests;
+  std::mutex m_requests_mutex;
+  unsigned long m_next_request_id = 1;
+
+  PendingRequest* FindOrAddRequest(SiaBlock::FunctionCode fc, const char *command, bool share, bool& queue);
+  void QueueRequest(PendingRequest *request);
+  static Receiver::priority OriginPriority(bool share);
+  static void CompleteRequest(class openGalaxy&, unsigned long id, char* buf, int len);
+  static void CompleteRequest(class openGalaxy&, PendingRequest *request, bool success, char* buf, int len);
+
+  static void FormatWrongCodeAlarm(char buf[16], sia_module module);
 };
 
 } // ends namespace openGalaxy
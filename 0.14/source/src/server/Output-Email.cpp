@@ -61,7 +61,7 @@ const char *EmailOutput::description()
 }
 
 EmailOutput::EmailOutput(class openGalaxy& opengalaxy)
- : OutputPlugin(opengalaxy)
+ : OutputPlugin(opengalaxy), m_task(opengalaxy.executor(), [this]{ run(); })
 {
 }
 
@@ -130,61 +130,91 @@ void EmailOutput::email_encode(std::stringstream& subject, std::stringstream& bo
   if(msg.haveAscii)         body << "Text\t\t: " << msg.ascii << std::endl;
 }
 
-void EmailOutput::email_send_thread(class openGalaxy* opengalaxy, std::stringstream *psubject, std::stringstream *pbody)
+// Sends an email with ssmtp, returns false when that failed
+bool EmailOutput::email_send(EmailOutput::Email& email)
 {
-  std::string subject = psubject->str();
-  std::string body = pbody->str();
-
   const char *cmd_fmt = "echo \'%s%s\n\' | /usr/sbin/ssmtp -C%s %s";
   const char *header_fmt = "From: \"%s\" <%s>\nSubject: %s\n\n";
 
   size_t sizeof_header =
     strlen(header_fmt) +
-    opengalaxy->settings().email_from_name.size() +
-    opengalaxy->settings().email_from_address.size() +
-    subject.size();
+    opengalaxy().settings().email_from_name.size() +
+    opengalaxy().settings().email_from_address.size() +
+    email.subject.size();
 
   size_t sizeof_cmd =
     strlen(cmd_fmt) +
     sizeof_header +
-    body.size() +
-    opengalaxy->settings().ssmtp_configfile.size() +
-    opengalaxy->settings().email_recipients.size() +
+    email.body.size() +
+    opengalaxy().settings().ssmtp_configfile.size() +
+    opengalaxy().settings().email_recipients.size() +
     32;
 
   char *header = (char*) thread_safe_malloc( sizeof_header );
   char *cmd = (char*) thread_safe_malloc(sizeof_cmd);
 
   snprintf( header, sizeof_header, header_fmt,
-    opengalaxy->settings().email_from_name.c_str(),
-    opengalaxy->settings().email_from_address.c_str(),
-    subject.c_str()
+    opengalaxy().settings().email_from_name.c_str(),
+    opengalaxy().settings().email_from_address.c_str(),
+    email.subject.c_str()
   );
 
   snprintf( cmd, sizeof_cmd, cmd_fmt,
     header,
-    body.c_str(),
-    opengalaxy->settings().ssmtp_configfile.c_str(),
-    opengalaxy->settings().email_recipients.c_str()
+    email.body.c_str(),
+    opengalaxy().settings().ssmtp_configfile.c_str(),
+    opengalaxy().settings().email_recipients.c_str()
   );
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-result"
-  system( cmd ); // execute ssmtp
-#pragma GCC diagnostic pop
+  int status = system( cmd ); // execute ssmtp
 
   thread_safe_free(cmd);
   thread_safe_free(header);
-  delete psubject;
-  delete pbody;
+
+  return ( status == 0 );
+}
+
+// Sends the queued emails, runs (on one worker at a time) when write() was
+// called so a burst of events does not tie up more than one worker
+void EmailOutput::run()
+{
+  try {
+    for(;;){
+      m_mutex.lock();
+      if(m_emails.size() == 0 || opengalaxy().isQuit()){
+        m_mutex.unlock();
+        break;
+      }
+      Email email = m_emails.front();
+      m_emails.pop_front();
+      m_mutex.unlock();
+
+      bool sent = email_send(email);
+
+      if(m_stats){
+        if(!sent) failed();
+        else if(email.received != std::chrono::steady_clock::time_point()) m_stats->latency.record_since(email.received);
+        m_stats->queue_depth--;
+      }
+    }
+  }
+  catch(...){
+    // pass the exception on to the main output thread
+    opengalaxy().output().m_Plugin_exptr = std::current_exception();
+    opengalaxy().exit();
+  }
 }
 
 bool EmailOutput::write(class SiaEvent& msg)
 {
-  std::stringstream *psubject = new std::stringstream();
-  std::stringstream *pbody = new std::stringstream();
-  email_encode(*psubject, *pbody, msg);
-  new std::thread(email_send_thread, &opengalaxy(), psubject, pbody);
+  std::stringstream subject;
+  std::stringstream body;
+  email_encode(subject, body, msg);
+  m_mutex.lock();
+  m_emails.push_back( { subject.str(), body.str(), msg.tpReceived } );
+  m_mutex.unlock();
+  if(m_stats) m_stats->queue_depth++;
+  m_task.schedule();
   return true;
 }
 
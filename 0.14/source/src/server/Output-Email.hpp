@@ -34,6 +34,7 @@
 #if !defined(HAVE_WINDOWS) && defined(HAVE_EMAIL_PLUGIN)
 
 #include "atomic.h"
+#include <deque>
 
 #include "opengalaxy.hpp"
 #include "Output.hpp"
@@ -42,8 +43,22 @@ namespace openGalaxy {
 
 class EmailOutput : public virtual OutputPlugin {
 private:
+  // An email waiting to be send
+  struct Email {
+    std::string subject;
+    std::string body;
+    std::chrono::steady_clock::time_point received;
+  };
+
+  // Sends the queued emails, one at a time (on the executor's worker pool)
+  Executor::Task m_task;
+  void run();
+
+  std::mutex m_mutex;          // protects m_emails
+  std::deque<Email> m_emails;  // the emails to send
+
   void email_encode(std::stringstream& subject, std::stringstream& body, SiaEvent& msg);
-  static void email_send_thread(class openGalaxy* opengalaxy, std::stringstream* psubject, std::stringstream* pbody);
+  bool email_send(Email& email);
 public:
   EmailOutput(class openGalaxy& opengalaxy);
   ~EmailOutput();
@@ -57,16 +57,19 @@ const char *MySqlOutput::description()
 }
 
 MySqlOutput::MySqlOutput(class openGalaxy& opengalaxy)
- : OutputPlugin(opengalaxy)
+ : OutputPlugin(opengalaxy), m_task(opengalaxy.executor(), [this]{ run(); })
 {
-  m_thread = new std::thread(MySqlOutput::Thread, this);
+  mysql_library_init(-1, nullptr, nullptr);
 }
 
+// (the executor has been stopped, m_task does not run anymore)
 MySqlOutput::~MySqlOutput()
 {
-  notify();
-  m_thread->join();
-  delete m_thread;
+  if(connector){
+    mysql_close(connector); // close connection to db
+    opengalaxy().syslog().debug("Output MySQL: Closed the connection to the database");
+  }
+  mysql_library_end(); // cleanup
 }
 
 bool MySqlOutput::write_db(class SiaEvent& msg)
@@ -264,140 +267,105 @@ bool MySqlOutput::write_db(class SiaEvent& msg)
   return true;
 }
 
-void MySqlOutput::Thread(MySqlOutput* _this)
+// Connects to the database, closing the previous connection (if any)
+bool MySqlOutput::connect()
+{
+  bool autoreconnect = true;
+  unsigned int timeout_seconds = 30;
+
+  if(connector) mysql_close(connector);
+  connector = mysql_init(nullptr);
+
+  // set MySQL options
+  mysql_options(connector, MYSQL_OPT_CONNECT_TIMEOUT, &timeout_seconds);
+  mysql_options(connector, MYSQL_OPT_RECONNECT, &autoreconnect); // Automaticly reconnect to MySQL server after a connection timeout
+  mysql_options(connector, MYSQL_INIT_COMMAND, "SET NAMES 'UTF8'");
+
+  // Connect to database
+  if(!mysql_real_connect(
+    connector,
+    opengalaxy().settings().mysql_server.c_str(),
+    opengalaxy().settings().mysql_user.c_str(),
+    opengalaxy().settings().mysql_password.c_str(),
+    opengalaxy().settings().mysql_database.c_str(),
+    0,
+    nullptr,
+    0
+  )){
+    opengalaxy().syslog().error("Output MySQL: %s", mysql_error(connector));
+    return false;
+  }
+
+  // Defeat a pre version 5.1.6 MySQL bug (where mysql_real_connect() resets the reconect option).
+  mysql_options(connector, MYSQL_OPT_RECONNECT, &autoreconnect);
+  return true;
+}
+
+// Writes the queued messages to the database,
+// runs (on one worker at a time) when notify() was called
+void MySqlOutput::run()
 {
-  using namespace std::chrono;
   try {
-    int loop_delay = 1;
-    std::unique_lock<std::mutex> lck(_this->m_request_mutex);
-
-    _this->opengalaxy().syslog().debug(
-      "Output MySQL: Server: '%s'",
-      _this->opengalaxy().settings().mysql_server.c_str()
-    );
-    _this->opengalaxy().syslog().debug(
-      "Output MySQL: User: '%s'",
-      _this->opengalaxy().settings().mysql_user.c_str()
-    );
-    /*
-    _this->opengalaxy().syslog().debug(
-      "Output MySQL: Password: '%s'",
-      _this->opengalaxy().settings().mysql_password.c_str()
-    );
-    */
-    _this->opengalaxy().syslog().debug(
-      "Output MySQL: Database: '%s'",
-      _this->opengalaxy().settings().mysql_database.c_str()
-    );
-
-    mysql_library_init(-1, nullptr, nullptr);
+    // (any worker of the pool may run this task)
     mysql_thread_init();
-    _this->connector = mysql_init(nullptr);
-
-    // set MySQL options
-    bool autoreconnect = true;
-    unsigned int timeout_seconds = 30;
-    mysql_options(_this->connector, MYSQL_OPT_CONNECT_TIMEOUT, &timeout_seconds);
-    mysql_options(_this->connector, MYSQL_OPT_RECONNECT, &autoreconnect); // Automaticly reconnect to MySQL server after a connection timeout
-    mysql_options(_this->connector, MYSQL_INIT_COMMAND, "SET NAMES 'UTF8'");
-
-    // Connect to database
-    if(!mysql_real_connect(
-      _this->connector,
-      _this->opengalaxy().settings().mysql_server.c_str(),
-      _this->opengalaxy().settings().mysql_user.c_str(),
-      _this->opengalaxy().settings().mysql_password.c_str(),
-      _this->opengalaxy().settings().mysql_database.c_str(),
-      0,
-      nullptr,
-      0
-    )){
-      _this->opengalaxy().syslog().error("Output MySQL: %s", mysql_error(_this->connector));
+
+    if(connector == nullptr){
+      opengalaxy().syslog().debug(
+        "Output MySQL: Server: '%s'",
+        opengalaxy().settings().mysql_server.c_str()
+      );
+      opengalaxy().syslog().debug(
+        "Output MySQL: User: '%s'",
+        opengalaxy().settings().mysql_user.c_str()
+      );
+      opengalaxy().syslog().debug(
+        "Output MySQL: Database: '%s'",
+        opengalaxy().settings().mysql_database.c_str()
+      );
+      if(connect()) opengalaxy().syslog().debug("Output MySQL: Successfully connected to database");
     }
-    else _this->opengalaxy().syslog().debug("Output MySQL: Successfully connected to database");
-
-    // Defeat a pre version 5.1.6 MySQL bug (where mysql_real_connect() resets the reconect option).
-    mysql_options(_this->connector, MYSQL_OPT_RECONNECT, &autoreconnect);
-
-    // Outer loop: test if it is time to exit
-    while(_this->opengalaxy().isQuit()==false){
-
-      // Inner loop: test if we were notified (or otherwise sleep untill we timeout) and do a loop iteration if we were/did
-      while(_this->m_cv_notified || _this->m_request_cv.wait_for(lck,seconds(loop_delay))==std::cv_status::timeout){
-
-        // reset our notification variable
-        _this->m_cv_notified = false;
-
-        // Test if we need to exit the thread.
-        if(_this->opengalaxy().isQuit()==true) break;
-
-        // If there is at least one message to output then;
-        while(_this->m_messages.size() > 0 && _this->opengalaxy().isQuit()==false){
-
-          // 'pop' a message from the array
-          _this->m_mutex.lock();
-          SiaEvent *msg = new SiaEvent(*_this->m_messages[0]);
-          _this->m_messages.remove(0);
-          _this->m_mutex.unlock();
-
-          // write the message to the database
-          if(_this->write_db(*msg) == false){
-            // failed to write to database, try again after reconnecting to the SQL server
-            mysql_thread_end();
-            mysql_library_end();
-            autoreconnect = true;
-            mysql_library_init( -1, nullptr, nullptr);
-            mysql_thread_init();
-            _this->connector = mysql_init(nullptr);
-            mysql_options(_this->connector, MYSQL_OPT_CONNECT_TIMEOUT, &timeout_seconds);
-            mysql_options(_this->connector, MYSQL_OPT_RECONNECT, &autoreconnect); // Automaticly reconnect to MySQL server after a connection timeout
-            mysql_options(_this->connector, MYSQL_INIT_COMMAND, "SET NAMES 'UTF8'");
-            if(!mysql_real_connect(
-              _this->connector,
-              _this->opengalaxy().settings().mysql_server.c_str(),
-              _this->opengalaxy().settings().mysql_user.c_str(),
-              _this->opengalaxy().settings().mysql_password.c_str(),
-              _this->opengalaxy().settings().mysql_database.c_str(),
-              0,
-              nullptr,
-              0
-            )){
-              _this->opengalaxy().syslog().error("Output MySQL: %s", mysql_error(_this->connector));
-            }
-            else {
-              mysql_options(_this->connector, MYSQL_OPT_RECONNECT, &autoreconnect);
-              _this->opengalaxy().syslog().error("Output MySQL: Successfully re-connected to database");
-            }
-            if(_this->write_db(*msg) == false)
-              _this->opengalaxy().syslog().error("Output MySQL: ERROR: MESSAGE LOST!: %s", mysql_error(_this->connector));
-          }
-
-          // and then throw it away
-          delete msg;
-
-          // Yield before processing the next message
-          std::this_thread::yield();
+
+    // If there is at least one message to output then;
+    while(m_messages.size() > 0 && opengalaxy().isQuit()==false){
+
+      // 'pop' a message from the array
+      m_mutex.lock();
+      SiaEvent *msg = new SiaEvent(*m_messages[0]);
+      m_messages.remove(0);
+      m_mutex.unlock();
+      if(m_stats) m_stats->queue_depth--;
+
+      // write the message to the database
+      if(write_db(*msg) == false){
+        // failed to write to database, try again after reconnecting to the SQL server
+        if(connect()){
+          opengalaxy().syslog().error("Output MySQL: Successfully re-connected to database");
+        }
+        if(write_db(*msg) == false){
+          opengalaxy().syslog().error("Output MySQL: ERROR: MESSAGE LOST!: %s", mysql_error(connector));
+          failed();
         }
-      } // ends inner loop
-    } // ends outer loop
+        else completed(*msg);
+      }
+      else completed(*msg);
 
-    mysql_close(_this->connector); // close connection to db
-    mysql_thread_end();
-    mysql_library_end(); // cleanup
+      // and then throw it away
+      delete msg;
+    }
 
-    _this->opengalaxy().syslog().debug("MySqlOutput::Thread exited normally");
+    mysql_thread_end();
   }
   catch(...){
+    mysql_thread_end();
     // pass the exception on to the main output thread
-    _this->opengalaxy().output().m_Plugin_exptr = std::current_exception();
-    _this->opengalaxy().exit();
+    opengalaxy().output().m_Plugin_exptr = std::current_exception();
+    opengalaxy().exit();
   }
 }
 
 void MySqlOutput::notify()
 {
-  m_cv_notified = true;
-  m_request_cv.notify_one();
+  m_task.schedule();
 }
 
 bool MySqlOutput::write(class SiaEvent& msg)
@@ -406,6 +374,7 @@ bool MySqlOutput::write(class SiaEvent& msg)
   m_mutex.lock();
   m_messages.append( new SiaEvent(msg) );
   m_mutex.unlock();
+  if(m_stats) m_stats->queue_depth++;
   notify();
   return true;
 }
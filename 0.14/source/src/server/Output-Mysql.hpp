@@ -41,17 +41,9 @@ namespace openGalaxy {
 
 class MySqlOutput : public virtual OutputPlugin {
 private:
-  // a worker thread
-  std::thread *m_thread;
-  static void Thread(class MySqlOutput*);
-
-  // mutex and condition variable used to wakeup the worker thread
-  std::mutex m_request_mutex;
-  std::condition_variable m_request_cv;
-
-  // Set to true when notify() is called, used to signal to the worker thread
-  // that it did not timeout while sleeping but that we woke it up with m_request_cv
-  volatile bool m_cv_notified = false;
+  // Writes the queued messages to the database (on the executor's worker pool)
+  Executor::Task m_task;
+  void run();
 
   // List of SiaEvents to write to the database
   class ObjectArray<SiaEvent*> m_messages;
@@ -59,12 +51,14 @@ private:
   // data mutex (protecting 'm_messages')
   std::mutex m_mutex;
 
-  // Notifies the worker thread to break the current
-  // delay loop and immediately start the next loop iteration
-  void notify(); 
+  // Schedules m_task
+  void notify();
+
+  // Our MySQL (library) instance, only used by m_task
+  MYSQL *connector = nullptr;
 
-  // Our MySQL (library) instance
-  MYSQL *connector;
+  // (Re)connects to the database
+  bool connect();
 
   // This function actually writes data to the database
   bool write_db(class SiaEvent& msg);
@@ -192,6 +192,11 @@ bool TextfileOutput::write(class SiaEvent& msg)
   text_encode(ss, msg);
   *ofs << ss.str() << std::endl << std::flush;
   if(lines++ > 32) lines = 0;
+  if(!ofs->good()){
+    failed();
+    return false;
+  }
+  completed(msg);
   return true;
 }
 
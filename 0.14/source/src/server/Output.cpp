@@ -55,7 +55,20 @@
 
 namespace openGalaxy {
 
+void OutputPlugin::completed(class SiaEvent& msg)
+{
+  if(m_stats && msg.tpReceived != std::chrono::steady_clock::time_point()){
+    m_stats->latency.record_since(msg.tpReceived);
+  }
+}
+
+void OutputPlugin::failed()
+{
+  if(m_stats) Stats::add(m_stats->failures);
+}
+
 bool NullOutput::write(class SiaEvent& msg) {
+  completed(msg);
   return true;
 }
 
@@ -71,7 +84,7 @@ const char *NullOutput::description()
 
 
 Output::Output(class openGalaxy& opengalaxy)
- : m_openGalaxy(opengalaxy)
+ : m_task(opengalaxy.executor(), [this]{ run(); }), m_openGalaxy(opengalaxy)
 {
 #ifdef HAVE_FILE_PLUGIN 
   if(m_openGalaxy.settings().plugin_use_file > 0){
@@ -98,7 +111,7 @@ Output::Output(class openGalaxy& opengalaxy)
     m_plugins.append( new NullOutput(m_openGalaxy) );
   }
 
-  // Log the active plugins
+  // Log the active plugins (and add their latency histograms)
   m_openGalaxy.syslog().info("Active output plugins:");
   for(int t=0; t<m_plugins.size(); t++){
     m_openGalaxy.syslog().info(
@@ -106,24 +119,20 @@ Output::Output(class openGalaxy& opengalaxy)
       m_plugins[t]->name(),
       m_plugins[t]->description()
     );
+    m_plugins[t]->m_stats = m_openGalaxy.stats().add_plugin(m_plugins[t]->name());
   }
-
-  m_thread = new std::thread(Output::Thread, this);
 }
 
 Output::~Output()
 {
-  delete m_thread;
 }
 
 void Output::notify()
 {
-  m_cv_notified = true;
-  m_request_cv.notify_one();
+  m_task.schedule();
 }
 
 void Output::join() {
-  m_thread->join();
   if(m_Plugin_exptr) std::rethrow_exception(m_Plugin_exptr);
 }
 
@@ -133,40 +142,39 @@ void Output::write(SiaEvent& msg)
   m_mutex.lock();
   m_messages.append( new SiaEvent(msg) );
   m_mutex.unlock();
+  m_openGalaxy.stats().output_queue_depth++;
   notify();
 }
 
-void Output::json_encode(std::stringstream& json, SiaEvent& msg)
+// Gets the date and time of a SIA message, or the local date and time
+// when the message does not have them
+void Output::date_time(SiaEvent& msg, char *date, char *time)
 {
-  // Get current date/time if we do not have date or time in the SIA message
-  time_t t;
   struct tm tm;
   memset( &tm, 0, sizeof(struct tm));
   if(msg.haveDate==0 || msg.haveTime==0) {
-    t = time(nullptr);
+    time_t t = ::time(nullptr);
     tm = *localtime(&t);
   }
 
-  char fmt_date[] = "%d-%d-%d";
-  char fmt_time[] = "%d:%d:%d";
-  char sia_date[16], sia_time[16];
-  const char *_date = nullptr, *_time = nullptr;
-
-  // set the date and time to the ones in the message if present or the local time if not
   if(msg.haveDate) {
-    _date = msg.date.get().c_str();
+    snprintf(date, DATE_TIME_SIZE, "%s", msg.date.get().c_str());
   }
   else {
-    snprintf(sia_date, 16, fmt_date, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
-    _date = sia_date;
+    snprintf(date, DATE_TIME_SIZE, "%d-%d-%d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
   }
   if(msg.haveTime) {
-    _time = msg.time.get().c_str();
+    snprintf(time, DATE_TIME_SIZE, "%s", msg.time.get().c_str());
   }
   else {
-    snprintf(sia_time, 16, fmt_time, tm.tm_hour, tm.tm_min, tm.tm_sec);
-    _date = sia_date;
+    snprintf(time, DATE_TIME_SIZE, "%d:%d:%d", tm.tm_hour, tm.tm_min, tm.tm_sec);
   }
+}
+
+void Output::json_encode(std::stringstream& json, SiaEvent& msg)
+{
+  char sia_date[DATE_TIME_SIZE], sia_time[DATE_TIME_SIZE];
+  date_time(msg, sia_date, sia_time);
 
   json << "{";
 
@@ -181,8 +189,8 @@ void Output::json_encode(std::stringstream& json, SiaEvent& msg)
   else
     json << "\"EventAddressNumber\": null,";
 
-  json << "\"Date\": \"" << _date << "\",";
-  json << "\"Time\": \"" << _time << "\",";
+  json << "\"Date\": \"" << sia_date << "\",";
+  json << "\"Time\": \"" << sia_time << "\",";
 
   if( msg.haveAscii == true )
     json << "\"ASCII\": \"" << msg.ascii.c_str() << "\",";
@@ -260,67 +268,103 @@ void Output::json_encode(std::stringstream& json, SiaEvent& msg)
   json << "}";
 }
 
-void Output::Thread(Output* output)
+// Encodes a SIA message as a frame for the openGalaxy-binary-protocol
+void Output::binary_encode(std::string& bin, SiaEvent& msg)
 {
-  using namespace std::chrono;
-  try {
-    int loop_delay = 1;
-    std::unique_lock<std::mutex> lck(output->m_request_mutex);
-
-    // The outer loop only exits if the openGalaxy object is being destroyed.
-    // The inner loop iterates once every 'loop_delay' seconds, 
-    // or sooner when NotifyWorkerThread() is called.
-
-    // Outer loop: test if it is time to exit
-    while(output->opengalaxy().isQuit()==false){
-
-      // Inner loop: test if we were notified (or otherwise sleep untill we timeout) and do a loop iteration if we were/did
-      while(output->m_cv_notified || output->m_request_cv.wait_for(lck,seconds(loop_delay))==std::cv_status::timeout){
-
-        // reset our notification variable
-        output->m_cv_notified = false;
-
-        // Test if we need to exit the thread.
-        if(output->opengalaxy().isQuit()==true) break;
+  char sia_date[DATE_TIME_SIZE], sia_time[DATE_TIME_SIZE];
+  date_time(msg, sia_date, sia_time);
 
-        // If there is at least one message to output then;
-        while(output->m_messages.size() > 0 && output->opengalaxy().isQuit()==false){
+  bin.clear();
+  bin += (char)static_cast<unsigned int>(Commander::json_reply_id::sia);
 
-          // 'pop' a message from the array
-          output->m_mutex.lock();
-          SiaEvent *msg = new SiaEvent(*output->m_messages[0]);
-          output->m_messages.remove(0);
-          output->m_mutex.unlock();
-
-          // Prepare the JSON formatted output to send through the websocket
-          std::stringstream ss;
-          output->json_encode(ss, *msg);
-          std::string json = ss.str();
-
-          // Send it to the websocket
-          output->opengalaxy().websocket().broadcast(json);
-
-          // Write it to all the plugins,
-          for(int nPlugin = 0; nPlugin < output->m_plugins.size(); nPlugin++){
-            if(output->opengalaxy().isQuit()==true) break;
-            output->m_plugins[nPlugin]->write(*msg);
-          }
-
-          // and then throw it away
-          delete msg;
+  Websocket::binary_put_uint(bin, BIN_FIELD_ACCOUNTID, msg.accountId);
+  Websocket::binary_put_string(bin, BIN_FIELD_EVENTCODE, msg.event->letter_code.data(), msg.event->letter_code.size());
+  Websocket::binary_put_string(bin, BIN_FIELD_EVENTNAME, msg.event->name.data(), msg.event->name.size());
+  Websocket::binary_put_string(bin, BIN_FIELD_EVENTDESC, msg.event->desc.data(), msg.event->desc.size());
+  Websocket::binary_put_string(bin, BIN_FIELD_EVENTADDRESSTYPE, msg.addressType.data(), msg.addressType.size());
+  if( msg.addressNumber > 0 )
+    Websocket::binary_put_uint(bin, BIN_FIELD_EVENTADDRESSNUMBER, msg.addressNumber);
+  Websocket::binary_put_string(bin, BIN_FIELD_DATE, sia_date, strlen(sia_date));
+  Websocket::binary_put_string(bin, BIN_FIELD_TIME, sia_time, strlen(sia_time));
+  if( msg.haveAscii == true )
+    Websocket::binary_put_string(bin, BIN_FIELD_ASCII, msg.ascii.data(), msg.ascii.size());
+  if( msg.haveSubscriberId == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_SUBSCRIBERID, msg.subscriberId);
+  if( msg.haveAreaId == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_AREAID, msg.areaId);
+  if( msg.havePeripheralId == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_PERIPHERALID, msg.peripheralId);
+  if( msg.haveAutomatedId == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_AUTOMATEDID, msg.automatedId);
+  if( msg.haveTelephoneId == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_TELEPHONEID, msg.telephoneId);
+  if( msg.haveLevel == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_LEVEL, msg.level);
+  if( msg.haveValue == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_VALUE, msg.value);
+  if( msg.havePath == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_PATH, msg.path);
+  if( msg.haveRouteGroup == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_ROUTEGROUP, msg.routeGroup);
+  if( msg.haveSubSubscriber == true )
+    Websocket::binary_put_uint(bin, BIN_FIELD_SUBSUBSCRIBER, msg.subSubscriber);
+
+  Websocket::binary_put_string(
+    bin,
+    BIN_FIELD_RAW,
+    (const char*)msg.raw.block.data,
+    msg.raw.block.header.block_length
+  );
+}
 
-          // Yield before processing the next message
-          std::this_thread::yield();
-        }
-      } // ends inner loop
-    } // ends outer loop
-    output->opengalaxy().syslog().debug("Output::Thread exited normally");
+// Outputs all queued messages
+// (runs on the executor's worker pool each time notify() was called)
+void Output::run()
+{
+  try {
+    // While there is at least one message to output
+    while(m_messages.size() > 0 && opengalaxy().isQuit()==false){
+
+      // 'pop' a message from the array
+      m_mutex.lock();
+      SiaEvent *msg = new SiaEvent(*m_messages[0]);
+      m_messages.remove(0);
+      m_mutex.unlock();
+      opengalaxy().stats().output_queue_depth--;
+      msg->tpDequeued = std::chrono::steady_clock::now();
+      opengalaxy().stats().record(Stats::stage::event_queue, msg->tpDequeued - msg->tpDecoded);
+
+      // Prepare the JSON formatted output to send through the websocket
+      std::stringstream ss;
+      json_encode(ss, *msg);
+      std::string json = ss.str();
+
+      // and the binary frame when any client uses the binary protocol
+      std::string bin;
+      if(opengalaxy().websocket().have_binary_clients()){
+        binary_encode(bin, *msg);
+      }
+
+      // Send it to the websocket
+      Subscription::Event event;
+      event.set(*msg);
+      opengalaxy().websocket().broadcast(json, bin, event, msg->tpReceived, msg->tpDequeued);
+
+      // Write it to all the plugins,
+      for(int nPlugin = 0; nPlugin < m_plugins.size(); nPlugin++){
+        if(opengalaxy().isQuit()==true) break;
+        m_plugins[nPlugin]->write(*msg);
+      }
+
+      // and then throw it away
+      delete msg;
+    }
   }
   catch(...){
-    output->opengalaxy().syslog().error("Output::Thread has thrown an exception!");
+    opengalaxy().syslog().error("Output: Outputting a message has thrown an exception!");
     // pass the exception on to the main() thread
-    output->opengalaxy().m_Output_exptr = std::current_exception();
-    output->opengalaxy().exit();
+    opengalaxy().m_Output_exptr = std::current_exception();
+    opengalaxy().exit();
   }
 }
 
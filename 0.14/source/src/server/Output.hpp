@@ -44,10 +44,18 @@ namespace openGalaxy {
 
 // All output plugins must inherit this base class
 class OutputPlugin {
+friend class Output;
 
 protected:
   class openGalaxy& m_openGalaxy;
 
+  // Latency, queue depth and failures of this plugin (set by class Output)
+  class PluginStats *m_stats = nullptr;
+
+  // Plugins call these when they are done with an event or failed to output it
+  void completed(class SiaEvent& msg);
+  void failed();
+
 public:
   OutputPlugin(class openGalaxy& opengalaxy) : m_openGalaxy(opengalaxy) {}
   virtual ~OutputPlugin() {}
@@ -74,21 +82,28 @@ public:
 
 
 class Output {
+friend class Bench; // src/bench/opengalaxy-bench.cpp
 private:
 
-  std::thread *m_thread;                      // the worker thread
-  std::mutex m_mutex;                         // data mutex (protecting variable 'transmit_list')
-  std::mutex m_request_mutex;                 // mutex and condition variable used to timeout and wakeup the worker thread
-  std::condition_variable m_request_cv;
-  volatile bool m_cv_notified = false;        // Set to true when NotifyWorkerThread() is called
+  Executor::Task m_task;                      // outputs the queued messages (on the executor's worker pool)
+  std::mutex m_mutex;                         // data mutex (protecting variable 'm_messages')
 
   class openGalaxy& m_openGalaxy;             // The openGalaxy object we are outputting messages for
   class ObjectArray<OutputPlugin*> m_plugins; // The list of registered output plugins
   class ObjectArray<SiaEvent*> m_messages;    // The list of messages to outpput
 
+  // Size of the buffers for date_time(), large enough for "%d-%d-%d" with
+  // three ints of the widest width
+  constexpr static const int DATE_TIME_SIZE = 36;
+
+  // Gets the date and time of a SIA message, or the local date and time
+  // when the message does not have them
+  static void date_time(SiaEvent& msg, char *date, char *time);
+
   void json_encode(std::stringstream& json, SiaEvent& msg);
+  void binary_encode(std::string& bin, SiaEvent& msg);
 
-  static void Thread(class Output*);
+  void run();
 
 public:
 
@@ -101,10 +116,10 @@ public:
   // Add a message to the que of messages to send to the output
   void write(SiaEvent& msg);
 
-  // Notifies the worker thread to break the current delay loop and immediately start the next loop iteration
+  // Schedules the task that outputs the queued messages
   void notify();
 
-  // joins the thread (used by openGalaxy::exit)
+  // Re-throws any exception from an output plugin's thread (used by openGalaxy::exit)
   void join();
 
   // Provide a method that refers to the top openGalaxy class
@@ -0,0 +1,520 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic.h"
+#include "opengalaxy.hpp"
+#include "PanelState.hpp"
+#include "Subscription.hpp"
+#include "SiaEvent.hpp"
+
+#include <new>
+
+namespace openGalaxy {
+
+PanelState::PanelState(class openGalaxy& opengalaxy)
+ : m_openGalaxy(opengalaxy)
+{
+  m_max_age = std::chrono::seconds(opengalaxy.settings().panel_state_max_age);
+
+  // (unset/normal/unset and all bits clear)
+  memset(&m_model, 0, sizeof(m_model));
+  m_armed = m_model.bytes(armed_at);
+  m_alarm = m_model.bytes(alarm_at);
+  m_ready = m_model.bytes(ready_at);
+  for(int q=0; q<zone_queries; q++) m_zones[q] = m_model.bytes(ZonesAt(static_cast<Galaxy::zones_query>(q)));
+  m_outputs = m_model.bytes(outputs_at);
+
+  // operator new does not align beyond alignof(std::max_align_t) before C++17
+  m_store_memory = new unsigned char[sizeof(Store) + alignof(Store)];
+  m_store = new(m_store_memory + (alignof(Store) - (uintptr_t)m_store_memory % alignof(Store))) Store;
+  m_store->sequence = 0;
+  m_store->version = 0;
+  for(int i=0; i<words; i++){
+    m_store->word[i] = 0;
+    m_store->changed[i] = 0;
+    m_store->confirmed[i] = 0;
+  }
+
+  stale(m_armed_stamp, areas);
+  stale(m_alarm_stamp, areas);
+  stale(m_ready_stamp, areas);
+  for(int q=0; q<zone_queries; q++) stale(m_zones_stamp[q], zone_bytes * 8);
+  stale(m_outputs_stamp, output_bytes * 8);
+}
+
+PanelState::~PanelState()
+{
+  m_store->~Store();
+  delete[] m_store_memory;
+}
+
+int PanelState::Snapshot::count(int at, int count) const
+{
+  int n = 0;
+  for(int i=at; i<at+count; i++) n += __builtin_popcountll(word[i]);
+  return n;
+}
+
+bool PanelState::Snapshot::changedSince(unsigned long long since, int at, int count) const
+{
+  for(int i=at; i<at+count; i++){
+    if(changed[i] > since) return true;
+  }
+  return false;
+}
+
+int PanelState::Snapshot::diff(const Snapshot& other, int at, int count, uint64_t *diff) const
+{
+  int n = 0;
+  for(int i=at; i<at+count; i++){
+    uint64_t x = word[i] ^ other.word[i];
+    if(diff) diff[i - at] = x;
+    n += __builtin_popcountll(x);
+  }
+  return n;
+}
+
+// Returns the oldest of 'count' stamps in steady_clock ticks,
+// or 0 when one of them is stale
+static long long oldest(const std::chrono::steady_clock::time_point *stamps, int count)
+{
+  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::time_point::max();
+  for(int i=0; i<count; i++){
+    if(stamps[i] == std::chrono::steady_clock::time_point::min()) return 0;
+    if(stamps[i] < t) t = stamps[i];
+  }
+  return t.time_since_epoch().count();
+}
+
+// Determines when the states in each word of the model were confirmed
+// (Must be called with m_mutex locked)
+void PanelState::Confirmed(long long confirmed[words])
+{
+  for(int q=0; q<zone_queries; q++){
+    for(int w=0; w<zone_words; w++){
+      int bits = (w < zone_words - 1) ? 64 : zone_bytes * 8 - w * 64;
+      confirmed[ZonesAt(static_cast<Galaxy::zones_query>(q)) + w] = oldest(&m_zones_stamp[q][w * 64], bits);
+    }
+  }
+  for(int w=0; w<output_words; w++) confirmed[outputs_at + w] = oldest(&m_outputs_stamp[w * 64], 64);
+  for(int w=0; w<area_words; w++){
+    confirmed[armed_at + w] = oldest(&m_armed_stamp[w * 8], 8);
+    confirmed[alarm_at + w] = oldest(&m_alarm_stamp[w * 8], 8);
+    confirmed[ready_at + w] = oldest(&m_ready_stamp[w * 8], 8);
+  }
+}
+
+// Copies the words of the model that changed (or were confirmed) to the
+// published store. Must be called with m_mutex locked (there is only one
+// writer).
+//
+// The sequence number is odd while the words are being written, readers
+// that see it change while copying the store simply copy it again.
+void PanelState::Publish()
+{
+  long long confirmed[words];
+  Confirmed(confirmed);
+
+  int i;
+  for(i=0; i<words; i++){
+    if(m_model.word[i] != m_store->word[i].load(std::memory_order_relaxed)) break;
+    if(confirmed[i] != m_store->confirmed[i].load(std::memory_order_relaxed)) break;
+  }
+  if(i == words) return; // nothing changed
+
+  // (the version only counts changes to the states themselves)
+  bool changed = false;
+  for(int j=i; j<words && changed == false; j++){
+    if(m_model.word[j] != m_store->word[j].load(std::memory_order_relaxed)) changed = true;
+  }
+
+  unsigned long long sequence = m_store->sequence.load(std::memory_order_relaxed);
+  m_store->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if(changed) m_model.version++;
+  for(; i<words; i++){
+    m_model.confirmed[i] = confirmed[i];
+    m_store->confirmed[i].store(confirmed[i], std::memory_order_relaxed);
+    if(m_model.word[i] == m_store->word[i].load(std::memory_order_relaxed)) continue;
+    m_model.changed[i] = m_model.version;
+    m_store->word[i].store(m_model.word[i], std::memory_order_relaxed);
+    m_store->changed[i].store(m_model.version, std::memory_order_relaxed);
+  }
+  m_store->version.store(m_model.version, std::memory_order_relaxed);
+
+  m_store->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void PanelState::Read(Snapshot& snapshot)
+{
+  while(1){
+    unsigned long long sequence = m_store->sequence.load(std::memory_order_acquire);
+    if(sequence & 1){
+      std::this_thread::yield();
+      continue;
+    }
+    snapshot.version = m_store->version.load(std::memory_order_relaxed);
+    for(int i=0; i<words; i++){
+      snapshot.word[i] = m_store->word[i].load(std::memory_order_relaxed);
+      snapshot.changed[i] = m_store->changed[i].load(std::memory_order_relaxed);
+      snapshot.confirmed[i] = m_store->confirmed[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(m_store->sequence.load(std::memory_order_relaxed) == sequence) break;
+  }
+}
+
+unsigned long long PanelState::Version()
+{
+  return m_store->version.load(std::memory_order_acquire);
+}
+
+// Returns true when the states in 'count' words starting at word 'at'
+// of a snapshot were all confirmed within the maximum age
+bool PanelState::fresh(const Snapshot& snapshot, int at, int count)
+{
+  if(m_max_age.count() == 0) return false;
+  long long now = std::chrono::steady_clock::now().time_since_epoch().count();
+  long long max_age = std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_max_age).count();
+  for(int i=at; i<at+count; i++){
+    if(snapshot.confirmed[i] == 0 || now - snapshot.confirmed[i] > max_age) return false;
+  }
+  return true;
+}
+
+void PanelState::stale(stamp_t *stamps, int count)
+{
+  for(int i=0; i<count; i++) stamps[i] = stamp_t::min();
+}
+
+// Returns the array index for an area, SIA messages without an area
+// (or area 0) are for area 1 when the panel is not in group mode.
+int PanelState::AreaIndex(int area)
+{
+  if(area <= 0) return 0;
+  if(area > areas) return -1;
+  return area - 1;
+}
+
+// Returns the bit number of a zone in a 65 byte zones state buffer
+// (see Galaxy::GalaxyZonesState) or -1 if it is not a zone number.
+int PanelState::ZoneBit(int zone)
+{
+  int nr = zone % 10;
+  if(nr < 1 || nr > 8) return -1;
+  if(zone >= 9011 && zone <= 9018) return nr - 1; // RIO 001 (dipswitch 8 on)
+  int line = zone / 1000;
+  int rio = (zone / 10) % 100;
+  if(line < 1 || line > 4 || rio > 15) return -1;
+  return ((((line - 1) * 16) + rio + 1) * 8) + nr - 1;
+}
+
+void PanelState::SetZoneBit(Galaxy::zones_query query, int bit, bool value, const stamp_t& now)
+{
+  int q = static_cast<int>(query);
+  if(value) m_zones[q][bit / 8] |= (1 << (bit % 8));
+  else m_zones[q][bit / 8] &= ~(1 << (bit % 8));
+  m_zones_stamp[q][bit] = now;
+}
+
+void PanelState::StaleZoneBit(Galaxy::zones_query query, int bit)
+{
+  m_zones_stamp[static_cast<int>(query)][bit] = stamp_t::min();
+}
+
+//
+// Applies a SIA message to the model.
+//
+// Area events follow the client's interpretation of these codes (see
+// src/client/areas.c), zone events are interpreted by the second letter
+// of the event code: xA = alarm, xB = bypassed, xU = unbypassed,
+// xT = trouble, xR/xH = restore and xJ = trouble restore.
+//
+void PanelState::Apply(SiaEvent& msg)
+{
+  Subscription::Event ev;
+  ev.set(msg);
+  if(ev.code[0] == '\0') return;
+
+  std::string code = ev.code;
+  stamp_t now = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if(ev.zone > 0){
+    int bit = ZoneBit(ev.zone);
+    if(bit < 0) return;
+    switch(code[1]){
+      case 'A': // alarm
+        SetZoneBit(Galaxy::zones_query::alarm, bit, true, now);
+        if(code[0] == 'T') SetZoneBit(Galaxy::zones_query::tamper, bit, true, now);
+        StaleZoneBit(Galaxy::zones_query::ready, bit);
+        StaleZoneBit(Galaxy::zones_query::open, bit);
+        StaleZoneBit(Galaxy::zones_query::rstate, bit);
+        break;
+      case 'B': // bypass
+        SetZoneBit(Galaxy::zones_query::omitted, bit, true, now);
+        break;
+      case 'U': // unbypass
+        SetZoneBit(Galaxy::zones_query::omitted, bit, false, now);
+        break;
+      case 'T': // trouble
+        SetZoneBit(Galaxy::zones_query::fault, bit, true, now);
+        StaleZoneBit(Galaxy::zones_query::ready, bit);
+        break;
+      case 'R': // restore, the alarm/tamper bits may be latched until the area is reset
+      case 'H':
+      case 'J':
+        for(int q=0; q<zone_queries; q++){
+          if(q == static_cast<int>(Galaxy::zones_query::omitted)) continue;
+          StaleZoneBit(static_cast<Galaxy::zones_query>(q), bit);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  int a = AreaIndex(ev.area);
+  if(a < 0){
+    Publish();
+    return;
+  }
+
+  if(code == "OP" || code == "OK" || code == "OG" || code == "OR"){ // opening
+    m_armed[a] = static_cast<unsigned char>(Galaxy::area_armed_state::unset);
+    m_armed_stamp[a] = now;
+    m_ready_stamp[a] = stamp_t::min(); // unset or ready to set?
+    m_alarm_stamp[a] = stamp_t::min(); // may need a reset now
+  }
+  else if(code == "CA" || code == "CL" || code == "CP"){ // closing
+    m_armed[a] = static_cast<unsigned char>(Galaxy::area_armed_state::set);
+    m_armed_stamp[a] = now;
+    m_ready[a] = static_cast<unsigned char>(Galaxy::area_ready_state::set);
+    m_ready_stamp[a] = now;
+  }
+  else if(code == "CG"){ // partial closing
+    m_armed[a] = static_cast<unsigned char>(Galaxy::area_armed_state::part_set);
+    m_armed_stamp[a] = now;
+    m_ready[a] = static_cast<unsigned char>(Galaxy::area_ready_state::part_set);
+    m_ready_stamp[a] = now;
+  }
+  else if(
+    code == "BA" || code == "DF" || code == "DT" || code == "FA" ||
+    code == "HA" || code == "MA" || code == "PA" || code == "JA" ||
+    code == "XQ" || // alarms
+    code == "AT" || code == "BT" || code == "FT" || code == "HT" ||
+    code == "LT" || code == "PT" || code == "TA" || code == "XT" ||
+    code == "YT"    // tamper/trouble
+  ){
+    m_alarm[a] = static_cast<unsigned char>(Galaxy::area_alarm_state::alarm);
+    m_alarm_stamp[a] = now;
+  }
+  else if(
+    code == "BC" || // cancel
+    code == "AR" || code == "BJ" || code == "FJ" || code == "HJ" ||
+    code == "LR" || code == "PJ" || code == "XR" || code == "YR" // restores
+  ){
+    m_alarm_stamp[a] = stamp_t::min(); // normal or reset required?
+  }
+
+  Publish();
+}
+
+// The Get functions below read the published snapshot, they never wait
+// for a thread that is updating the model.
+
+bool PanelState::GetAreaArmedState(unsigned int blknum, Galaxy::area_armed_state* state)
+{
+  if(blknum == 0 || blknum > areas) return false;
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, armed_at + (blknum - 1) / 8, 1) == false) return false;
+  *state = snapshot.armed(blknum);
+  return true;
+}
+
+bool PanelState::GetAllAreasArmedState(Galaxy::area_armed_state state[32])
+{
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, armed_at, area_words) == false) return false;
+  for(int i=0; i<areas; i++) state[i] = snapshot.armed(i + 1);
+  return true;
+}
+
+bool PanelState::GetAllAreasAlarmState(Galaxy::area_alarm_state state[32])
+{
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, alarm_at, area_words) == false) return false;
+  for(int i=0; i<areas; i++) state[i] = snapshot.alarm(i + 1);
+  return true;
+}
+
+bool PanelState::GetAllAreasReadyState(Galaxy::area_ready_state state[32])
+{
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, ready_at, area_words) == false) return false;
+  for(int i=0; i<areas; i++) state[i] = snapshot.ready(i + 1);
+  return true;
+}
+
+bool PanelState::ZoneIsOmit(unsigned int zone, Galaxy::zone_action* state)
+{
+  int bit = ZoneBit(zone);
+  if(bit < 0) return false;
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, ZonesAt(Galaxy::zones_query::omitted) + bit / 64, 1) == false) return false;
+  const unsigned char *omitted = snapshot.zones(Galaxy::zones_query::omitted);
+  *state = (omitted[bit / 8] & (1 << (bit % 8))) ? Galaxy::zone_action::omit : Galaxy::zone_action::unomit;
+  return true;
+}
+
+bool PanelState::GetAllZonesState(Galaxy::zones_query query, unsigned char zones_state[65])
+{
+  int q = static_cast<int>(query);
+  if(q < 0 || q >= zone_queries) return false;
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, ZonesAt(query), zone_words) == false) return false;
+  memcpy(zones_state, snapshot.zones(query), zone_bytes);
+  return true;
+}
+
+bool PanelState::GetAllOutputs(unsigned char outputs[32])
+{
+  Snapshot snapshot;
+  Read(snapshot);
+  if(fresh(snapshot, outputs_at, output_words) == false) return false;
+  memcpy(outputs, snapshot.outputs(), output_bytes);
+  return true;
+}
+
+void PanelState::UpdateAreaArmedState(unsigned int blknum, Galaxy::area_armed_state state)
+{
+  if(blknum == 0 || blknum > areas) return;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_armed[blknum - 1] = static_cast<unsigned char>(state);
+  m_armed_stamp[blknum - 1] = std::chrono::steady_clock::now();
+  Publish();
+}
+
+void PanelState::UpdateAllAreasArmedState(const Galaxy::area_armed_state state[32])
+{
+  stamp_t now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for(int i=0; i<areas; i++){
+    m_armed[i] = static_cast<unsigned char>(state[i]);
+    m_armed_stamp[i] = now;
+  }
+  Publish();
+}
+
+void PanelState::UpdateAllAreasAlarmState(const Galaxy::area_alarm_state state[32])
+{
+  stamp_t now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for(int i=0; i<areas; i++){
+    m_alarm[i] = static_cast<unsigned char>(state[i]);
+    m_alarm_stamp[i] = now;
+  }
+  Publish();
+}
+
+void PanelState::UpdateAllAreasReadyState(const Galaxy::area_ready_state state[32])
+{
+  stamp_t now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for(int i=0; i<areas; i++){
+    m_ready[i] = static_cast<unsigned char>(state[i]);
+    m_ready_stamp[i] = now;
+  }
+  Publish();
+}
+
+void PanelState::UpdateZoneIsOmit(unsigned int zone, Galaxy::zone_action state)
+{
+  int bit = ZoneBit(zone);
+  if(bit < 0) return;
+  stamp_t now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  SetZoneBit(Galaxy::zones_query::omitted, bit, state == Galaxy::zone_action::omit, now);
+  Publish();
+}
+
+void PanelState::UpdateAllZonesState(Galaxy::zones_query query, const unsigned char zones_state[65])
+{
+  int q = static_cast<int>(query);
+  if(q < 0 || q >= zone_queries) return;
+  stamp_t now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  memcpy(m_zones[q], zones_state, zone_bytes);
+  for(int i=0; i<zone_bytes * 8; i++) m_zones_stamp[q][i] = now;
+  Publish();
+}
+
+void PanelState::UpdateAllOutputs(const unsigned char outputs[32])
+{
+  stamp_t now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  memcpy(m_outputs, outputs, output_bytes);
+  for(int i=0; i<output_bytes * 8; i++) m_outputs_stamp[i] = now;
+  Publish();
+}
+
+void PanelState::InvalidateAreas()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stale(m_armed_stamp, areas);
+  stale(m_alarm_stamp, areas);
+  stale(m_ready_stamp, areas);
+  Publish();
+}
+
+void PanelState::InvalidateZones()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for(int q=0; q<zone_queries; q++) stale(m_zones_stamp[q], zone_bytes * 8);
+  Publish();
+}
+
+void PanelState::InvalidateOutputs()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stale(m_outputs_stamp, output_bytes * 8);
+  Publish();
+}
+
+} // ends namespace openGalaxy
+
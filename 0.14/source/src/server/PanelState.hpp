@@ -0,0 +1,212 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OPENGALAXY_SERVER_PANEL_STATE_HPP__
+#define __OPENGALAXY_SERVER_PANEL_STATE_HPP__
+
+#include "atomic.h"
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "Galaxy.hpp"
+
+namespace openGalaxy {
+
+class SiaEvent;
+
+// A model of the area, zone and output states of the panel.
+//
+// The model is updated incrementally with every SIA message received from
+// the panel (see Apply()) and reconciled with the actual panel state
+// whenever Galaxy decodes the reply to a state query.
+//
+// Every area state and every zone or output bit carries the time it was
+// last confirmed. A SIA message that only tells us that a state changed,
+// but not what it changed into, clears that time instead of guessing.
+// The Get functions only answer when every state they return was confirmed
+// within PANEL-STATE-MAX-AGE seconds and return false otherwise, leaving
+// it to the caller to query the panel.
+//
+// The states are published as a versioned Snapshot that any thread can
+// copy without taking a lock (see Read()), together with the oldest time
+// the states in each of its words were confirmed. The Get functions answer
+// from such a snapshot, so a single area (or zone) is only answered when
+// the other areas (or zones) in the same word are fresh as well.
+//
+class PanelState {
+public:
+
+  constexpr static int areas = 32;
+  constexpr static int zone_bytes = 65;  // see Galaxy::GalaxyZonesState
+  constexpr static int output_bytes = 32; // see Galaxy::GalaxyOutputs32
+  constexpr static int zone_queries = static_cast<int>(Galaxy::zones_query::fault) + 1;
+
+  constexpr static int zone_words = (zone_bytes + 7) / 8;
+  constexpr static int output_words = output_bytes / 8;
+  constexpr static int area_words = areas / 8;
+
+  // Offsets (in words) of the states in a Snapshot
+  constexpr static int zones_at = 0;
+  constexpr static int outputs_at = zones_at + zone_queries * zone_words;
+  constexpr static int armed_at = outputs_at + output_words;
+  constexpr static int alarm_at = armed_at + area_words;
+  constexpr static int ready_at = alarm_at + area_words;
+  constexpr static int words = ready_at + area_words;
+
+  static int ZonesAt(Galaxy::zones_query query){ return zones_at + static_cast<int>(query) * zone_words; }
+
+  // The states in the model packed into 64 bit words, so that they can be
+  // copied and compared a word at a time: a bit per zone for every
+  // zones_query (laid out as Galaxy::GalaxyZonesState), a bit per output
+  // (as Galaxy::GalaxyOutputs32) and a byte per area armed/alarm/ready state.
+  class Snapshot {
+  public:
+    unsigned long long version;        // incremented with every change to the states
+    uint64_t word[words];
+    unsigned long long changed[words]; // the version in which each word last changed
+    long long confirmed[words];        // when the states in each word were confirmed (the oldest one,
+                                       // in steady_clock ticks), 0 when one of them is not
+
+    unsigned char *bytes(int at){ return reinterpret_cast<unsigned char*>(&word[at]); }
+    const unsigned char *bytes(int at) const { return reinterpret_cast<const unsigned char*>(&word[at]); }
+
+    const unsigned char *zones(Galaxy::zones_query query) const { return bytes(ZonesAt(query)); }
+    const unsigned char *outputs() const { return bytes(outputs_at); }
+    Galaxy::area_armed_state armed(int area) const { return static_cast<Galaxy::area_armed_state>(bytes(armed_at)[area - 1]); }
+    Galaxy::area_alarm_state alarm(int area) const { return static_cast<Galaxy::area_alarm_state>(bytes(alarm_at)[area - 1]); }
+    Galaxy::area_ready_state ready(int area) const { return static_cast<Galaxy::area_ready_state>(bytes(ready_at)[area - 1]); }
+
+    // Returns the number of bits set in 'count' words starting at word 'at'
+    // (ie. count(ZonesAt(Galaxy::zones_query::alarm), zone_words) is the
+    // number of zones in alarm)
+    int count(int at, int count) const;
+
+    // Returns true when any of 'count' words starting at word 'at'
+    // changed after version 'since'
+    bool changedSince(unsigned long long since, int at, int count) const;
+
+    // Compares 'count' words starting at word 'at' with another snapshot,
+    // optionally stores the XOR of each word in 'diff' and returns the
+    // number of bits that differ
+    int diff(const Snapshot& other, int at, int count, uint64_t *diff = nullptr) const;
+  };
+
+private:
+
+  typedef std::chrono::steady_clock::time_point stamp_t;
+
+  class openGalaxy& m_openGalaxy;
+  std::mutex m_mutex;
+  std::chrono::seconds m_max_age;
+
+  // The model itself, only accessed with m_mutex locked
+  Snapshot m_model;
+  unsigned char *m_armed;  // (pointers into m_model)
+  unsigned char *m_alarm;
+  unsigned char *m_ready;
+  unsigned char *m_zones[zone_queries];
+  unsigned char *m_outputs;
+
+  // The published copy of the model, on a cache line of its own
+  struct alignas(64) Store {
+    std::atomic<unsigned long long> sequence; // odd while Publish() is writing
+    std::atomic<unsigned long long> version;
+    std::atomic<uint64_t> word[words];
+    std::atomic<unsigned long long> changed[words];
+    std::atomic<long long> confirmed[words];
+  };
+  unsigned char *m_store_memory;
+  Store *m_store;
+
+  stamp_t m_armed_stamp[areas];
+  stamp_t m_alarm_stamp[areas];
+  stamp_t m_ready_stamp[areas];
+
+  stamp_t m_zones_stamp[zone_queries][zone_bytes * 8];
+
+  stamp_t m_outputs_stamp[output_bytes * 8];
+
+  bool fresh(const Snapshot& snapshot, int at, int count);
+  void stale(stamp_t *stamps, int count);
+  void Confirmed(long long confirmed[words]);
+  void SetZoneBit(Galaxy::zones_query query, int bit, bool value, const stamp_t& now);
+  void StaleZoneBit(Galaxy::zones_query query, int bit);
+  void Publish();
+
+  static int AreaIndex(int area);
+  static int ZoneBit(int zone);
+
+public:
+
+  PanelState(class openGalaxy& opengalaxy);
+  ~PanelState();
+
+  // Applies a decoded SIA message to the model
+  void Apply(SiaEvent& msg);
+
+  // Copies the states without locking (seqlock), a snapshot is never
+  // torn by a concurrent update. Use the version of the snapshot and
+  // Snapshot::changedSince() or Snapshot::diff() to find what changed.
+  void Read(Snapshot& snapshot);
+  unsigned long long Version();
+
+  // Answer a state query from the model, these return false when
+  // the model can not answer it.
+  bool GetAreaArmedState       ( unsigned int blknum, Galaxy::area_armed_state* state );
+  bool GetAllAreasArmedState   ( Galaxy::area_armed_state state[32] );
+  bool GetAllAreasAlarmState   ( Galaxy::area_alarm_state state[32] );
+  bool GetAllAreasReadyState   ( Galaxy::area_ready_state state[32] );
+  bool ZoneIsOmit              ( unsigned int zone, Galaxy::zone_action* state );
+  bool GetAllZonesState        ( Galaxy::zones_query query, unsigned char zones_state[65] );
+  bool GetAllOutputs           ( unsigned char outputs[32] );
+
+  // Reconcile the model with a state reported by the panel
+  void UpdateAreaArmedState    ( unsigned int blknum, Galaxy::area_armed_state state );
+  void UpdateAllAreasArmedState( const Galaxy::area_armed_state state[32] );
+  void UpdateAllAreasAlarmState( const Galaxy::area_alarm_state state[32] );
+  void UpdateAllAreasReadyState( const Galaxy::area_ready_state state[32] );
+  void UpdateZoneIsOmit        ( unsigned int zone, Galaxy::zone_action state );
+  void UpdateAllZonesState     ( Galaxy::zones_query query, const unsigned char zones_state[65] );
+  void UpdateAllOutputs        ( const unsigned char outputs[32] );
+
+  // Forget what we know after an action that changes these states
+  void InvalidateAreas();
+  void InvalidateZones();
+  void InvalidateOutputs();
+
+  // Provide a method that refers to the top openGalaxy class
+  inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
+};
+
+} // ends namespace openGalaxy
+
+#endif
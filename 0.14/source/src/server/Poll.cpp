@@ -38,12 +38,16 @@
 #include "Syslog.hpp"
 #include "Settings.hpp"
 #include "Poll.hpp"
+#include "Subscription.hpp"
+#include "SiaEvent.hpp"
 
 #include "opengalaxy.hpp"
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <cstring>
+#include <cstdint>
 
 namespace openGalaxy {
 
@@ -51,83 +55,250 @@ void PollThread_Receiver_Callback(Websocket& websocket, char* s, int l);
 void PollThread_Commander_Callback(Commander&, session_id *session, void *user, char *out);
 
 Poll::Poll(openGalaxy& openGalaxy)
- : m_openGalaxy(openGalaxy)
+ : m_openGalaxy(openGalaxy), m_task(openGalaxy.executor(), [this]{ run(); })
 {
-  m_thread = new std::thread(Poll::Thread, this);
+  m_schedule[0] = { possible_items::areas,   "AREA 0 READY",  m_bufferAreas,   &m_haveAreas };
+  m_schedule[1] = { possible_items::zones,   "ZONES ALARM",   m_bufferZones,   &m_haveZones };
+  m_schedule[2] = { possible_items::outputs, "OUTPUT GETALL", m_bufferOutputs, &m_haveOutputs };
+  m_schedule[0].delta_name = "areaDelta";
+  m_schedule[1].delta_name = "zoneDelta";
+  m_schedule[2].delta_name = "outputDelta";
+  m_schedule[0].at = PanelState::ready_at;
+  m_schedule[0].words = PanelState::area_words;
+  m_schedule[0].size = PanelState::areas;
+  m_schedule[1].at = PanelState::ZonesAt(Galaxy::zones_query::alarm);
+  m_schedule[1].words = PanelState::zone_words;
+  m_schedule[1].size = PanelState::zone_bytes;
+  m_schedule[2].at = PanelState::outputs_at;
+  m_schedule[2].words = PanelState::output_words;
+  m_schedule[2].size = PanelState::output_bytes;
+  for(Schedule& s : m_schedule){
+    s.budget = 0;
+    s.interval = POLL_INTERVAL_MIN;
+    s.due = std::chrono::steady_clock::now();
+    s.version = 0;
+    s.polls = 0;
+  }
+  memset( &m_snapshot, 0, sizeof( m_snapshot ) );
+  m_ping_due = std::chrono::steady_clock::now();
+  m_activity = 0;
+  m_task.schedule();
 }
 
 Poll::~Poll()
 {
-  delete m_thread;
 }
 
-bool Poll::poll_once()
+Poll::Schedule* Poll::schedule(Poll::possible_items item)
+{
+  for(Schedule& s : m_schedule){
+    if(s.item == item) return &s;
+  }
+  return nullptr;
+}
+
+// Polls a single item
+void Poll::poll_item(Poll::Schedule& s)
+{
+  opengalaxy().syslog().debug("Poll: polling '%s' (interval %d seconds)", s.command, s.interval);
+  m_poll_busy = 1;
+  m_poll_started = std::chrono::steady_clock::now();
+  m_polling = s.item;
+  poll_userdata *user = new poll_userdata();
+  user->retv = 0;
+  opengalaxy().commander().execute(
+    &m_openGalaxy,
+    nullptr,
+    user,
+    s.command,
+    Poll::Commander_Callback
+  );
+}
+
+// Nothing to poll, test if the panel is online.
+void Poll::ping()
+{
+  m_poll_busy = 1;
+  m_poll_started = std::chrono::steady_clock::now();
+  m_polling = possible_items::nothing;
+  const char *msg = "EV*"; // flush all events for all modules
+  opengalaxy().receiver().send( SiaBlock::FunctionCode::extended, (char*)msg, strlen( msg ) + 1/*include the 0 byte*/, Poll::Receiver_Callback, Receiver::priority::poll );
+}
+
+// Formats the 'size' values in 'state' as a JSON array ("[1,0,...]")
+static void poll_format_state(const unsigned char *state, int size, char *buffer, size_t len)
+{
+  size_t pos = 0;
+  for(int i=0; i<size && pos < len; i++){
+    int l = snprintf( &buffer[pos], len - pos, "%c%u", ( i ) ? ',' : '[', state[i] );
+    if( l < 0 ) break;
+    pos += l;
+  }
+  if( pos + 2 <= len ) strcpy( &buffer[pos], "]" );
+}
+
+// Compares the 'size' values of an item at word 'at' in 'state' with the
+// values in 'last' and formats the index and new value of each changed
+// value into 'list' ("i,v,i,v...").
+// Returns the number of changed values.
+//
+// Snapshot::diff() compares the values 8 at a time, only the words that
+// differ are looked at byte by byte. When (almost) nothing changed this
+// costs a handful of XORs for the 65 values of the zone states.
+static int poll_diff_state(const PanelState::Snapshot& last, const PanelState::Snapshot& state, int at, int words, int size, char *list, size_t len)
 {
-  bool retv = true;
-
-  if( m_poll_items == possible_items::nothing ){
-    // Nothing to poll, test if the panel is online.
-    if( m_poll_on || m_poll_one_shot ){
-      m_poll_busy = 1;
-      const char *msg = "EV*"; // flush all events for all modules
-      opengalaxy().receiver().send( SiaBlock::FunctionCode::extended, (char*)msg, strlen( msg ) + 1/*include the 0 byte*/, Poll::Receiver_Callback );
+  uint64_t diff[PanelState::words];
+  int count = 0;
+  size_t pos = 0;
+  list[0] = '\0';
+  if( state.diff( last, at, words, diff ) == 0 ) return 0;
+  const unsigned char *a = last.bytes( at );
+  const unsigned char *b = state.bytes( at );
+  for(int w=0; w<words; w++){
+    if( diff[w] == 0 ) continue;
+    for(int j=w*8; j<w*8+8 && j<size; j++){
+      if( a[j] == b[j] ) continue;
+      int l = snprintf( &list[pos], len - pos, "%s%d,%u", ( count ) ? "," : "", j, b[j] );
+      if( l < 0 || (size_t)l >= len - pos ) return -1;
+      pos += l;
+      count++;
     }
   }
-  else{
-    if(opengalaxy().isQuit()==true) return false;
-    if( m_poll_items & possible_items::areas ){
-      // Poll areas alarm state
-      opengalaxy().syslog().debug("Poll: polling areas ready state...");
-      poll_userdata *user = new poll_userdata();
-      user->retv = 0;
-      user->item = possible_items::nothing;
-      opengalaxy().commander().execute(
-        &m_openGalaxy,
-        nullptr,
-        user,
-        (char*)"AREA 0 READY",
-        Poll::Commander_Callback
+  return count;
+}
+
+// Formats the full state of item 's' into 'buffer' using 'fmt'
+// (json_poll_state_fmt or json_poll_keyframe_fmt)
+void Poll::format_item(char *buffer, size_t size, const char *fmt, Poll::Schedule& s)
+{
+  snprintf(
+    buffer,
+    size,
+    fmt,
+    static_cast<unsigned int>(Commander::json_reply_id::poll_reply),
+    Commander::CommanderTypeDesc[static_cast<int>(Commander::json_reply_id::poll_reply)],
+    1, // online
+    ( s.item == Poll::possible_items::areas   ) ? 1 : 0, // have areas
+    ( s.item == Poll::possible_items::zones   ) ? 1 : 0, // have zones
+    ( s.item == Poll::possible_items::outputs ) ? 1 : 0, // have outputs
+    ( s.item == Poll::possible_items::areas   ) ? s.buffer : m_emptyArray, // area states
+    ( s.item == Poll::possible_items::zones   ) ? s.buffer : m_emptyArray, // zone states
+    ( s.item == Poll::possible_items::outputs ) ? s.buffer : m_emptyArray, // output states
+    s.version // json_poll_keyframe_fmt only
+  );
+}
+
+// Sends m_buffer to all listening clients
+// and removes the one-shot clients when 'last_one_shot' is true.
+void Poll::reply_all(bool last_one_shot)
+{
+  for(Poll::Client *client = m_client_list.first(); client; client = m_client_list.next(client)){
+    Poll::Client& c = *client;
+    if( c.on || c.one_shot ){
+      c.socket.callback(
+        m_openGalaxy,
+        &c.socket.session,
+        c.socket.user,
+        m_buffer
       );
     }
-    if(opengalaxy().isQuit()==true) return false;
-    if( m_poll_items & possible_items::zones ){
-      // poll zones
-      opengalaxy().syslog().debug("Poll: polling zones...");
-      poll_userdata *user = new poll_userdata();
-      user->retv = 0;
-      user->item = possible_items::nothing;
-      opengalaxy().commander().execute(
-        &m_openGalaxy,
-        nullptr,
-        user,
-        (char*)"ZONES ALARM",
-        Poll::Commander_Callback
-      );
+  }
+  if( last_one_shot ) remove_one_shots();
+}
+
+// Sends the result of polling item 's' to all listening clients.
+//
+// Clients that did not ask for delta replies always get the full state.
+// Clients that did get a keyframe when they do not have the state of the
+// item yet or when 'keyframe' is true, the changes (in m_deltaList) when
+// 'changed' is true and nothing at all otherwise.
+// Each reply is formatted only once, and only if some client needs it.
+void Poll::reply_item(Poll::Schedule& s, bool changed, bool keyframe)
+{
+  bool have_full = false, have_keyframe = false, have_delta = false;
+  for(Poll::Client *client = m_client_list.first(); client; client = m_client_list.next(client)){
+    Poll::Client& c = *client;
+    if( !c.on && !c.one_shot ) continue;
+    const char *reply;
+    if( c.delta == 0 ){
+      if( !have_full ) format_item( m_buffer, sizeof( m_buffer ), json_poll_state_fmt, s );
+      have_full = true;
+      reply = m_buffer;
     }
-    if(opengalaxy().isQuit()==true) return false;
-    if( m_poll_items & possible_items::outputs ){
-      // poll outputs
-      opengalaxy().syslog().debug("Poll: polling outputs..." );
-      poll_userdata *user = new poll_userdata();
-      user->retv = 0;
-      user->item = possible_items::nothing;
-      opengalaxy().commander().execute(
-        &m_openGalaxy,
-        nullptr,
-        user,
-        (char*)"OUTPUT GETALL",
-        Poll::Commander_Callback
-      );
+    else if( keyframe || c.one_shot || ( c.keyframes & s.item ) ){
+      if( !have_keyframe ) format_item( m_bufferKeyframe, sizeof( m_bufferKeyframe ), json_poll_keyframe_fmt, s );
+      have_keyframe = true;
+      c.keyframes &= ~(int)s.item;
+      reply = m_bufferKeyframe;
+    }
+    else if( changed ){
+      if( !have_delta ){
+        snprintf(
+          m_bufferDelta,
+          sizeof( m_bufferDelta ),
+          json_poll_delta_fmt,
+          static_cast<unsigned int>(Commander::json_reply_id::poll_reply),
+          Commander::CommanderTypeDesc[static_cast<int>(Commander::json_reply_id::poll_reply)],
+          s.version,
+          s.delta_name,
+          m_deltaList
+        );
+      }
+      have_delta = true;
+      reply = m_bufferDelta;
+    }
+    else {
+      continue;
     }
+    c.socket.callback(
+      m_openGalaxy,
+      &c.socket.session,
+      c.socket.user,
+      (char*)reply
+    );
   }
+}
 
-  return retv;
+// Removes the one-shot clients after the last item of a one-shot round
+void Poll::remove_one_shots()
+{
+  Poll::Client *c = m_client_list.first();
+  while( c ){
+    Poll::Client *next = m_client_list.next( c );
+    if( c->one_shot ){
+      session_id session = c->socket.session;
+      ClientRemove( session );
+    }
+    c = next;
+  }
+  m_poll_one_shot = 0;
+  m_one_shot_items = possible_items::nothing;
+}
+
+// Called by the receiver thread for every SIA message.
+//
+// Zone messages may change the zone and area (ready) states, openings and
+// closings the area and output states, alarms and restores everything.
+void Poll::activity(SiaEvent& msg)
+{
+  Subscription::Event ev;
+  ev.set(msg);
+  if(ev.code[0] == '\0') return;
+
+  int items = possible_items::nothing;
+  if(ev.zone > 0) items |= possible_items::zones | possible_items::areas;
+  if(ev.code[0] == 'O' || ev.code[0] == 'C') items |= possible_items::areas | possible_items::outputs;
+  if(ev.code[1] == 'A' || ev.code[1] == 'R') items |= possible_items::everything;
+
+  if(items != possible_items::nothing){
+    m_activity |= items;
+    notify();
+  }
 }
 
 void Poll::notify()
 {
-  m_cv_notified = true;
-  m_request_cv.notify_one();
+  m_task.schedule();
 }
 
 bool Poll::enable(_ws_info *socket)
@@ -143,6 +314,7 @@ bool Poll::enable(_ws_info *socket)
 
   c->on = 1;
   m_poll_on = 1;
+  m_interval_changed = 1; // the client's interval now counts
 
   m_mutex.unlock();
   notify();
@@ -250,7 +422,9 @@ bool Poll::oneShot(_ws_info *socket)
   if(c!=nullptr){
     // existing client, allready polling?
     if(c->on){
-      // yes, immediately wake the thread and do the next poll iteration
+      // yes, immediately wake the thread and poll all items
+      if(c->delta) c->keyframes = possible_items::everything;
+      m_poll_now = 1;
       m_mutex.unlock();
       notify();
       return true;
@@ -276,6 +450,30 @@ bool Poll::oneShot(_ws_info *socket)
   return true;
 }
 
+// Lets a client receive only the changes to the polled items.
+//
+// The client first gets the full state of each item (a keyframe), after
+// that only the items that changed and how, each with a 'stateVersion'
+// that increments by 1 for every change to an item. A client that missed
+// a version can send POLL DELTA again to get new keyframes.
+bool Poll::setDelta(_ws_info *socket)
+{
+  m_mutex.lock();
+  ClientAdd(socket);
+  Poll::Client *c = m_client_list.search(socket->session);
+  if(c==nullptr){
+    m_mutex.unlock();
+    return false;
+  }
+  c->delta = 1;
+  c->keyframes = possible_items::everything;
+  int wakeup = c->on;
+  if(wakeup) m_poll_now = 1; // send the keyframes now
+  m_mutex.unlock();
+  if(wakeup) notify();
+  return true;
+}
+
 // Adds a client to the list of clients that have requested to poll the panel
 void Poll::ClientAdd(Poll::_ws_info *socket)
 {
@@ -287,6 +485,8 @@ void Poll::ClientAdd(Poll::_ws_info *socket)
     c->interval = Poll::DEFAULT_POLL_INTERVAL_SECONDS;
     c->one_shot = 0;
     c->items = Poll::possible_items::nothing;
+    c->delta = 0;
+    c->keyframes = 0;
     m_client_list.append(c);
   }
 }
@@ -295,13 +495,10 @@ void Poll::ClientAdd(Poll::_ws_info *socket)
 bool Poll::ClientRemove(session_id& session)
 {
   bool retv = false;
-  for(int i=0; i<m_client_list.size(); i++){
-    Client *c = m_client_list[i];
-    if(c->socket.session == session){
-      m_client_list.remove(i);
-      retv = true;
-      break;
-    }
+  Client *c = m_client_list.search(session);
+  if(c != nullptr){
+    m_client_list.remove(c);
+    retv = true;
   }
   if(m_client_list.size() == 0){
     m_poll_on = 0; // no more clients, stop polling
@@ -310,64 +507,28 @@ bool Poll::ClientRemove(session_id& session)
   }
   m_items_changed = 1; // removing a client may change what items need to be polled...
   m_interval_changed = 1; // removing a client may change the polling interval
-  if(m_poll_busy > 0) m_poll_busy--;
   return retv;
 }
 
 
-// This callback is called by the commander thread with the results of each item that was polled
+// This callback is called by the commander thread with the result of the item that was polled
 void Poll::Commander_Callback(class openGalaxy& opengalaxy, session_id *session, void *user, char *out)
 {
+  using namespace std::chrono;
   Poll *poll = &opengalaxy.poll();
 
   poll->m_mutex.lock();
 
-  Poll::Client c(opengalaxy.m_options);
-  Poll::possible_items item = Poll::possible_items::nothing;
-
   // Get/Free the user data and determine if the command we tried to execute failed
+  bool online = false;
   Poll::poll_userdata *usr = (Poll::poll_userdata*)user;
   if(usr){
-    if(usr->retv == false){
-      // the command failed. this means the panel is offline.
-      poll->opengalaxy().syslog().debug("Poll: Panel is offline!");
-      delete usr;
-      poll->m_poll_busy = 0;
-      snprintf(
-        poll->m_buffer, sizeof( poll->m_buffer ),
-        poll->json_poll_state_fmt,
-        static_cast<unsigned int>(Commander::json_reply_id::poll_reply),
-        Commander::CommanderTypeDesc[static_cast<int>(Commander::json_reply_id::poll_reply)],
-        0, 0, 0, 0,
-        poll->m_emptyArray, poll->m_emptyArray, poll->m_emptyArray
-      );
-      goto notify;
-    }
-    item = usr->item;
+    online = usr->retv;
     delete usr;
   }
   else {
     poll->opengalaxy().syslog().debug("Poll: Missing userdata!");
   }
-  // The command was successfull.
-
-  // Copy the formatted output to a temporary buffer depending on the item returned
-  switch( item ){
-    case Poll::possible_items::areas:
-      strncpy( poll->m_bufferAreas, out, sizeof( poll->m_bufferAreas ) );
-      poll->m_haveAreas = true;
-      break;
-    case Poll::possible_items::zones:
-      strncpy( poll->m_bufferZones, out, sizeof( poll->m_bufferZones ) );
-      poll->m_haveZones = true;
-      break;
-    case Poll::possible_items::outputs:
-      strncpy( poll->m_bufferOutputs, out, sizeof( poll->m_bufferOutputs ) );
-      poll->m_haveOutputs = true;
-      break;
-    default:
-      break;
-  }
 
   // Are we waiting for a reply to a command?
   if( poll->m_poll_busy == 0 ){
@@ -378,55 +539,77 @@ void Poll::Commander_Callback(class openGalaxy& opengalaxy, session_id *session,
   }
   // Yes.
 
-  // one less item result to wait for until we can start a next polling loop.
-  for(int i=0; i<poll->m_client_list.size(); i++){
-    c = *poll->m_client_list[i];
-    if( ( c.on || c.one_shot ) && poll->m_poll_busy > 0 ) poll->m_poll_busy--;
-  }
-
-  // Did we get the result for all items?
-  if( poll->m_poll_busy == 0 ){
-    // Yes, compile and send the final result to all listening clients
+  Poll::Schedule *s = poll->schedule(poll->m_polling);
+  poll->opengalaxy().stats().histogram(Stats::stage::poll).record_since(poll->m_poll_started);
+  poll->m_poll_busy = 0;
+  poll->m_polling = Poll::possible_items::nothing;
+  steady_clock::time_point now = steady_clock::now();
 
+  if( online == false || s == nullptr ){
+    // the command failed. this means the panel is offline.
+    poll->opengalaxy().syslog().debug("Poll: Panel is offline!");
+    if( s ) s->due = now + seconds( ( s->budget > 0 ) ? s->budget : DEFAULT_POLL_INTERVAL_SECONDS );
     snprintf(
-      poll->m_buffer,
-      sizeof( poll->m_buffer ),
+      poll->m_buffer, sizeof( poll->m_buffer ),
       poll->json_poll_state_fmt,
       static_cast<unsigned int>(Commander::json_reply_id::poll_reply),
       Commander::CommanderTypeDesc[static_cast<int>(Commander::json_reply_id::poll_reply)],
-      1, // online
-      ( poll->m_haveAreas == true   ) ? 1 : 0, // have areas
-      ( poll->m_haveZones == true   ) ? 1 : 0, // have zones
-      ( poll->m_haveOutputs == true ) ? 1 : 0, // have outputs
-      ( poll->m_haveAreas == true   ) ? poll->m_bufferAreas   : poll->m_emptyArray, // area states
-      ( poll->m_haveZones == true   ) ? poll->m_bufferZones   : poll->m_emptyArray, // zone states
-      ( poll->m_haveOutputs == true ) ? poll->m_bufferOutputs : poll->m_emptyArray  // output states
+      0, 0, 0, 0,
+      poll->m_emptyArray, poll->m_emptyArray, poll->m_emptyArray
     );
+    poll->m_one_shot_items = Poll::possible_items::nothing;
+    // The state may change unseen while offline, start over with keyframes
+    for(Poll::Client *client = poll->m_client_list.first(); client; client = poll->m_client_list.next(client)){
+      Poll::Client& c = *client;
+      if( c.delta ) c.keyframes = Poll::possible_items::everything;
+    }
+    poll->reply_all( poll->m_poll_one_shot != 0 );
+  }
+  else {
+    // The command was successfull and the panel state model was updated
+    // with its result, compare the item with what the clients have now
+    PanelState::Snapshot snapshot;
+    opengalaxy.galaxy().state().Read( snapshot );
+    bool keyframe = ( *s->have == false );
+    int count = 0;
+    if( !keyframe ){
+      count = poll_diff_state( poll->m_snapshot, snapshot, s->at, s->words, s->size, poll->m_deltaList, sizeof( poll->m_deltaList ) );
+      if( count < 0 ) keyframe = true; // too many changes for a delta
+    }
+    bool changed = keyframe || ( count != 0 );
+    if( changed ){
+      memcpy( &poll->m_snapshot.word[s->at], &snapshot.word[s->at], s->words * sizeof( uint64_t ) );
+      s->version++;
+      poll_format_state( snapshot.bytes( s->at ), s->size, s->buffer, sizeof( poll->m_bufferAreas ) );
+    }
+    *s->have = true;
 
-notify:
-    poll->m_haveAreas = false; // reset
-    poll->m_haveZones = false;
-    poll->m_haveOutputs = false;
-
-    // Send the results to all listening clients
-    for(int i=0; i<poll->m_client_list.size(); i++){
-      c = *poll->m_client_list[i];
-      if( c.on || c.one_shot ){
-        c.socket.callback(
-          poll->m_openGalaxy,
-          &c.socket.session,
-          c.socket.user,
-          poll->m_buffer
-        );
-      }
-      // Remove any one-shot clients
-      if( c.one_shot ){
-        poll->ClientRemove( c.socket.session );
-        poll->m_poll_one_shot = 0;
-      }
+    // Send the full state to delta clients every now and then
+    if( ++s->polls >= POLL_KEYFRAME_INTERVAL ) keyframe = true;
+    if( keyframe ) s->polls = 0;
+
+    // adapt the interval for this item
+    if( changed ){
+      s->interval = POLL_INTERVAL_MIN;
+    }
+    else {
+      s->interval *= 2;
+    }
+    if( s->budget > 0 && s->interval > s->budget ) s->interval = s->budget;
+    s->due = now + seconds( s->interval );
+
+    // Send only the item that was polled, and to delta clients only if it changed
+    poll->reply_item( *s, changed, keyframe );
+    poll->m_one_shot_items = (Poll::possible_items)( poll->m_one_shot_items & ~(int)s->item );
+    if( poll->m_poll_one_shot && poll->m_one_shot_items == Poll::possible_items::nothing ){
+      poll->remove_one_shots();
     }
   }
+
   poll->m_mutex.unlock();
+
+  // Let the thread poll the next item that is due
+  poll->notify();
 }
 
 // called by Receiversend()
@@ -467,26 +650,15 @@ void Poll::Receiver_Callback(openGalaxy& opengalaxy, char* s, int l)
   );
 
   // Send the results to all listening clients
-  for(int i=0; i<poll.m_client_list.size(); i++){
-    Poll::Client& c = *poll.m_client_list[i];
-    if( c.on || c.one_shot ){
-      c.socket.callback(
-        poll.m_openGalaxy,
-        &c.socket.session,
-        c.socket.user,
-        poll.m_buffer
-      );
-    }
-    // Remove any one-shot clients
-    if( c.one_shot ){
-      poll.ClientRemove( c.socket.session );
-      poll.m_poll_one_shot = 0;
-    }
-  }
+  poll.reply_all( poll.m_poll_one_shot != 0 );
 
-  if( poll.m_poll_busy > 0 ) poll.m_poll_busy--;
+  if( poll.m_poll_busy ) opengalaxy.stats().histogram(Stats::stage::poll).record_since(poll.m_poll_started);
+  poll.m_poll_busy = 0;
 
   poll.m_mutex.unlock();
+
+  // Let the task decide when to ping again
+  poll.notify();
 }
 
 void Poll::pauze()
@@ -503,166 +675,150 @@ void Poll::resume()
 //  m_mutex.unlock();
 }
 
-void Poll::Thread(Poll* poll)
+//
+// An iteration of the polling loop.
+//
+// Instead of fetching every item at the shortest client interval this
+// task keeps a schedule for each item (see class Schedule) and polls
+// one item at a time: the one that is most overdue. The next item is not
+// polled until the result of the previous one was received, and not while
+// the commander is executing other commands, so that client commands are
+// never stuck behind a burst of poll commands.
+//
+// The task runs on the executor's worker pool when notify() is called or
+// when the timer it sets for itself (the time the next item is due) expires.
+//
+void Poll::run()
 {
   using namespace std::chrono;
   try {
-
-    Poll::possible_items items;
-    static int nr_of_items = 0;
-    int delayed = 0;
-
-    int loop_delay = 1;
-    std::unique_lock<std::mutex> lck(poll->m_request_mutex);
-
-    // The outer loop only exits if the openGalaxy object is being destroyed.
-    // The inner loop iterates once every 'loop_delay' seconds, 
-    // or sooner when Commander::NotifyWorkerThread() is called.
-
-    // Outer loop: test if it is time to exit
-    while(poll->opengalaxy().isQuit()==false){
-      // Inner loop: test if we were notified or if we need to sleep
-      while(poll->m_cv_notified || poll->m_request_cv.wait_for(lck,seconds(loop_delay))==std::cv_status::timeout){
-        // reset our notification variable
-        poll->m_cv_notified = false;
-        // Test if we need to exit the thread.
-        if(poll->opengalaxy().isQuit()==true) break;
-        // Lock the (data access) mutex
-        poll->m_mutex.lock();
-        //////////////////////////////////////////////////
-        //////////////////////////////////////////////////
-        //////////////////////////////////////////////////
-
-        // Has the previous loop received results for all the items it polled?
-        if( poll->m_poll_busy != 0 ){
-          // No, delay the next poll by 'delayed' seconds to prevent a buildup of unprocessed commands
-          delayed = 10;
-          poll->opengalaxy().syslog().error("Poll: Previous poll is still waiting for data, wait...");
-        }
-        else {
-          // Yes, we're clear to poll (again)
-
-          // Test if we need to exit the thread.
-          if(poll->opengalaxy().isQuit()==true) break;
-
-          if( poll->opengalaxy().commander().isBusy() == false ){
-            if( poll->opengalaxy().receiver().isTransmitting() == false ){
-              if( poll->opengalaxy().receiver().IsReceiving() == false ){
-
-                // determine what items to poll by combining flags from each client
-                if( poll->m_items_changed ){
-                  nr_of_items = 0;
-                  items = Poll::possible_items::nothing;
-
-                  if( poll->m_client_list.size() == 0 ){
-                    items = Poll::possible_items::nothing;
-                    nr_of_items = 0;
-                  }
-                  else {
-                    for(int i=0; i<poll->m_client_list.size(); i++){
-                      Poll::Client& c = *poll->m_client_list[i];
-                      if( c.items & Poll::possible_items::areas ){
-                        items |= Poll::possible_items::areas;
-                        nr_of_items++;
-                      }
-                      if( c.items & Poll::possible_items::zones ){
-                        items |= Poll::possible_items::zones;
-                        nr_of_items++;
-                      }
-                      if( c.items & Poll::possible_items::outputs ){
-                        items |= Poll::possible_items::outputs;
-                        nr_of_items++;
-                      }
-                    }
-                  }
-
-                  poll->m_poll_items = items;
-                  poll->m_items_changed = 0;
-                }
-
-//poll->opengalaxy().syslog().error("Poll: list=%d m_poll_on=%d m_poll_one_shot=%d",
-//poll->m_client_list.size(), poll->m_poll_on, poll->m_poll_one_shot);
-
-               // Poll the panel once if wanted
-                if(poll->m_client_list.size()){
-                  if( poll->m_poll_on || poll->m_poll_one_shot ){
-                    if(poll->m_is_pauzed == 0){
-//poll->opengalaxy().syslog().print("m_poll_on == %d", poll->m_poll_on);
-                      poll->m_poll_busy = nr_of_items; // reset the number of items (still) to get
-                      poll->poll_once(); // fetch the items, reset m_poll_busy to 0 and send a reply to all listening clients
-                    }
-                  }
-                }
-                else {
-                  poll->m_poll_on = 0;
-                  poll->m_poll_one_shot = 0;
-                }
-
-                // Use the client with the shortest interval as the new m_interval_seconds.
-                // Also check if we should continue to poll for any client
-                if( poll->m_interval_changed || poll->m_poll_one_shot || poll->m_poll_on ){
-                  int interval = poll->m_interval_seconds;
-                  int on = 0;
-                  // loop through the clients
-                  for(int i=0; i<poll->m_client_list.size(); i++){
-                    Poll::Client& c = *poll->m_client_list[i];
-                    // otherwise if this client has polling turned on, then check its interval value
-                    if( c.on ){
-                      if( c.interval < interval ) interval = c.interval;
-                      on = 1;
-                    }
-                  }
-
-                  // Set the new interval
-                  poll->m_interval_seconds = interval;
-                  // Reset the 'interval has changed' flag
-                  poll->m_interval_changed = 0;
-                  // Continue polling only if at least one client wants us to
-                  poll->m_poll_on = on;
-                }
-
-              }
-              else {
-                poll->opengalaxy().syslog().debug("Poll: Receiver is receiving, delaying this iteration!");
-                delayed = 10;
-              }
-            }
-            else {
-              poll->opengalaxy().syslog().debug("Poll: Receiver is transmitting, delaying this iteration!");
-              delayed = 10;
-            }
-          }
-          else {
-            poll->opengalaxy().syslog().debug("Poll: Commander is busy, delaying this iteration!");
-            delayed = 10;
+    long long delay_ms; // time until the next iteration (-1 = wait for notify())
+
+    if(opengalaxy().isQuit()==true) return;
+
+    // Lock the (data access) mutex
+    m_mutex.lock();
+
+    steady_clock::time_point now = steady_clock::now();
+
+    // determine what items to poll and the staleness budget for each
+    // item by combining the flags and intervals from each client
+    if( m_items_changed || m_interval_changed ){
+      Poll::possible_items items = Poll::possible_items::nothing;
+      int interval = Poll::DEFAULT_POLL_INTERVAL_SECONDS;
+      int on = 0;
+      for(Poll::Schedule& s : m_schedule){
+        int budget = 0;
+        for(Poll::Client *client = m_client_list.first(); client; client = m_client_list.next(client)){
+          Poll::Client& c = *client;
+          if( c.items & s.item ){
+            items |= s.item;
+            if( c.on && ( budget == 0 || c.interval < budget ) ) budget = c.interval;
           }
-
         }
-
-        // Decide for how long to sleep
-        if( poll->m_poll_on ){
-          if( delayed ){
-            loop_delay = delayed;
-          }
-          else {
-            loop_delay = poll->m_interval_seconds;
-          }
+        if( s.budget == 0 && budget > 0 ){
+          // A new item to poll, poll it now
+          s.interval = POLL_INTERVAL_MIN;
+          s.due = now;
         }
-        else {
-          // If no clients are listening, the timeout can be a very long time
-          loop_delay = Poll::POLL_INTERVAL_IDLE;
+        s.budget = budget;
+        if( s.interval > budget && budget > 0 ) s.interval = budget;
+      }
+      for(Poll::Client *client = m_client_list.first(); client; client = m_client_list.next(client)){
+        Poll::Client& c = *client;
+        if( c.on ){
+          if( on == 0 || c.interval < interval ) interval = c.interval;
+          on = 1;
         }
+      }
+      m_poll_items = items;
+      m_interval_seconds = interval;
+      m_poll_on = on;
+      m_items_changed = 0;
+      m_interval_changed = 0;
+    }
+    if( m_client_list.size() == 0 ){
+      m_poll_on = 0;
+      m_poll_one_shot = 0;
+    }
+
+    // Start a round of polls for one-shot clients
+    if( m_poll_one_shot && m_one_shot_items == Poll::possible_items::nothing ){
+      m_one_shot_items = m_poll_items;
+      for(Poll::Schedule& s : m_schedule){
+        if( s.item & m_poll_items ) s.due = now;
+      }
+      if( m_poll_items == Poll::possible_items::nothing ) m_ping_due = now;
+    }
+
+    // A client wants the state of all items right now
+    if( m_poll_now ){
+      for(Poll::Schedule& s : m_schedule) s.due = now;
+      m_ping_due = now;
+      m_poll_now = 0;
+    }
+
+    // Reschedule the items related to recent SIA activity
+    int activity = m_activity.exchange( 0 );
+    for(Poll::Schedule& s : m_schedule){
+      if( activity & s.item ){
+        s.interval = POLL_INTERVAL_MIN;
+        if( s.budget > 0 && s.interval > s.budget ) s.interval = s.budget;
+        if( s.due > now + seconds( POLL_ACTIVITY_DELAY ) ) s.due = now + seconds( POLL_ACTIVITY_DELAY );
+      }
+    }
+
+    // Find the item that is most overdue
+    Poll::Schedule *next = nullptr;
+    for(Poll::Schedule& s : m_schedule){
+      bool wanted = ( s.budget > 0 ) || ( m_one_shot_items & s.item );
+      if( wanted && ( next == nullptr || s.due < next->due ) ) next = &s;
+    }
+    bool want_ping = ( next == nullptr ) && ( m_poll_on || m_poll_one_shot );
+    steady_clock::time_point due = ( next ) ? next->due : m_ping_due;
+
+    if( m_poll_busy != 0 ){
+      // Still waiting for the result of the previous poll,
+      // Commander_Callback() or Receiver_Callback() wakes us when it arrives.
+      delay_ms = -1;
+    }
+    else if( next == nullptr && want_ping == false ){
+      // Nothing to poll, there is nothing to wake up for until
+      // a client (re)enables polling.
+      delay_ms = -1;
+    }
+    else if( due > now ){
+      // Sleep until the next item is due
+      long long ms = duration_cast<microseconds>( due - now ).count();
+      delay_ms = ( ms + 999 ) / 1000;
+    }
+    else if( m_is_pauzed || opengalaxy().commander().isBusy() ){
+      // Let the commander finish the commands of our clients first
+      opengalaxy().syslog().debug("Poll: Commander is busy, delaying this iteration!");
+      delay_ms = Poll::POLL_BUSY_RETRY * 1000;
+    }
+    else if( next ){
+      poll_item( *next );
+      // Provisional, Commander_Callback() sets the definitive due time
+      next->due = now + seconds( next->interval );
+      delay_ms = -1;
+    }
+    else {
+      ping();
+      m_ping_due = now + seconds( m_interval_seconds );
+      delay_ms = -1;
+    }
+
+    // unlock the (data access) mutex
+    m_mutex.unlock();
 
-        // unlock the (data access) mutex while we are sleeping
-        poll->m_mutex.unlock();
-      } // ends inner loop
-    } // ends outer loop
-    poll->opengalaxy().syslog().debug("Poll::Thread exited normally");
+    if( delay_ms < 0 ) m_task.cancel();
+    else m_task.schedule_after( delay_ms );
   }
   catch(...){
     // pass the exception on to the main() thread
-    poll->opengalaxy().m_Poll_exptr = std::current_exception();
-    poll->opengalaxy().exit();
+    opengalaxy().m_Poll_exptr = std::current_exception();
+    opengalaxy().exit();
   }
 }
 
@@ -35,10 +35,13 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 #include "Array.hpp"
 
 #include "opengalaxy.hpp"
+#include "PanelState.hpp"
 
 namespace openGalaxy {
 
@@ -56,7 +59,6 @@ public:
   // Poll userdata for each command send to the commander thread
   struct poll_userdata {
     bool retv;           // the return value of CommanderExecCmd(), false when the command failed, true when successfull
-    possible_items item; // the item returned by CommanderExecCmd() (poll_areas, poll_zones or poll_outputs)
   };
 
   // Instance data for each polling client
@@ -80,30 +82,36 @@ public:
 private:
 
   constexpr static const int DEFAULT_POLL_INTERVAL_SECONDS = 60;
-  constexpr static const int POLL_INTERVAL_IDLE = 180;
+  constexpr static const int POLL_INTERVAL_MIN = 2;     // fastest interval for an item that is changing
+  constexpr static const int POLL_ACTIVITY_DELAY = 1;   // delay between related SIA activity and the next poll
+  constexpr static const int POLL_BUSY_RETRY = 1;       // delay when the commander is busy with other commands
+  constexpr static const int POLL_KEYFRAME_INTERVAL = 20; // send the full state to delta clients every n polls of an item
 
   // Define a list of clients that have requested to poll the panel
-  class Client {
+  class Client : public IntrusiveList<Client>::Node {
   public:
     _ws_info socket;
     int on;
     int interval;
     int one_shot;
     possible_items items;
+    int delta;     // non-zero when the client wants only the changes (POLL DELTA)
+    int keyframes; // the items for which the client still needs the full state
     Client(class context_options& options) : socket(options) {}
     Client(Client& c) : socket(c.socket) {
       on = c.on;
       interval = c.interval;
       one_shot = c.one_shot;
       items = c.items;
+      delta = c.delta;
+      keyframes = c.keyframes;
     }
   };
 
-  class ClientList : public ObjectArray<Client*> {
+  class ClientList : public IntrusiveList<Client> {
   public:
     Client* search(session_id& session){
-      for(int i=0; i<ObjectArray<Client*>::size(); i++){
-        Client *c= ObjectArray<Client*>::operator[](i);
+      for(Client *c = first(); c; c = next(c)){
         if(c->socket.session == session){
           return c;
         }
@@ -112,13 +120,43 @@ private:
     }
   };
 
+  // Scheduling data for each item we can poll.
+  //
+  // Each item is polled on its own, at most once every 'interval' seconds.
+  // The interval is reset to POLL_INTERVAL_MIN whenever the state of the
+  // item changed or there was related SIA activity and doubles with every
+  // poll that did not see a change, up to the shortest interval of the
+  // clients that want the item (the staleness budget).
+  class Schedule {
+  public:
+    possible_items item;
+    const char *command;   // the commander command that polls the item
+    char *buffer;          // the last result
+    bool *have;            // true when 'buffer' holds a result
+    int budget;            // max. seconds between polls, 0 when no client polls the item
+    int interval;          // current poll interval in seconds
+    std::chrono::steady_clock::time_point due; // the time of the next poll
+    const char *delta_name; // name of the array with the changes in a delta reply
+    int at;                // the first word of the item in a PanelState::Snapshot
+    int words;             // the number of words of the item
+    int size;              // the number of values (bytes) of the item
+    unsigned int version;  // incremented each time 'state' changed
+    int polls;             // polls since the last keyframe
+  };
+  Schedule m_schedule[3];
+
+  // The states of the items as they were last send to the clients
+  PanelState::Snapshot m_snapshot;
+  Schedule* schedule(possible_items item);
+
+  // Items with related SIA activity since the last iteration of the thread,
+  // set by the receiver thread (without locking m_mutex).
+  std::atomic<int> m_activity;
+
   class openGalaxy& m_openGalaxy;
 
-  std::thread *m_thread;             // the worker thread for this receiver instance
+  Executor::Task m_task;             // an iteration of the polling loop (on the executor's worker pool)
   std::mutex m_mutex;                // data mutex
-  std::mutex m_request_mutex;        // mutex and condition variable used to timeout and wakeup the worker thread
-  std::condition_variable m_request_cv;
-  volatile bool m_cv_notified = false; // Set to true when Poll::NotifyWorkerThread() is called
 
 
   int m_interval_seconds = DEFAULT_POLL_INTERVAL_SECONDS;
@@ -127,7 +165,12 @@ private:
   int m_poll_on = 0;       // non-zero when we are actively polling
   int m_poll_one_shot = 0; // set to non-zero to poll once
 
-  int m_poll_busy = 0; // The number of items that (still) waiting to receive a result from the commander thread.
+  int m_poll_busy = 0; // Non-zero while waiting for the result of a poll
+  std::chrono::steady_clock::time_point m_poll_started; // when the current poll was started
+  possible_items m_polling = possible_items::nothing; // the item being polled
+  possible_items m_one_shot_items = possible_items::nothing; // items still to poll for one-shot clients
+  int m_poll_now = 0; // set to non-zero to poll all items at once
+  std::chrono::steady_clock::time_point m_ping_due; // next online test when there is nothing to poll
 
   int m_is_pauzed = 0;
 
@@ -150,8 +193,39 @@ private:
     "\"outputState\":%s"
     "}";
 
+  // The full state of an item for clients that use POLL DELTA
+  constexpr static const char *json_poll_keyframe_fmt =
+    "{"
+    "\"typeId\":%d,"
+    "\"typeDesc\":\"%s\","
+    "\"panelIsOnline\":%d,"
+    "\"haveAreaState\":%d,"
+    "\"haveZoneState\":%d,"
+    "\"haveOutputState\":%d,"
+    "\"areaState\":%s,"
+    "\"zoneState\":%s,"
+    "\"outputState\":%s,"
+    "\"stateVersion\":%u,"
+    "\"keyframe\":1"
+    "}";
+
+  // The changes to an item for clients that use POLL DELTA,
+  // an array of index/value pairs named after the item
+  constexpr static const char *json_poll_delta_fmt =
+    "{"
+    "\"typeId\":%d,"
+    "\"typeDesc\":\"%s\","
+    "\"panelIsOnline\":1,"
+    "\"stateVersion\":%u,"
+    "\"keyframe\":0,"
+    "\"%s\":[%s]"
+    "}";
+
   // buffers/data used by poll_callback() and cb_online()
   char m_buffer[1024];
+  char m_bufferKeyframe[1024];
+  char m_bufferDelta[1024];
+  char m_deltaList[512];
   const char *m_emptyArray = "[0]";
   char m_bufferAreas[1024];
   bool m_haveAreas = false;
@@ -160,10 +234,15 @@ private:
   char m_bufferOutputs[1024];
   bool m_haveOutputs = false;
 
-  static void Thread(class Poll *_this);
+  void run();
 
-  // This is the function that polls the galaxy panel.
-  bool poll_once();
+  // These are the functions that poll the galaxy panel.
+  void poll_item(Schedule& s);
+  void ping();
+  void reply_all(bool last_one_shot);
+  void reply_item(Schedule& s, bool changed, bool keyframe);
+  void format_item(char *buffer, size_t size, const char *fmt, Schedule& s);
+  void remove_one_shots();
 
   static void Commander_Callback(class openGalaxy&, session_id *session, void*, char*);
   static void Receiver_Callback(class openGalaxy&,char*,int);
@@ -175,12 +254,9 @@ public:
   Poll(openGalaxy& openGalaxy);
   ~Poll();
 
-  // Notifies the worker thread to end the current sleeping period and immediately starts the next mainloop iteration
+  // Schedules the next iteration of the polling loop right away
   void notify();
 
-  // joins the thread (used by openGalaxy::exit)
-  void join() { m_thread->join(); }
-
   bool enable(_ws_info *socket);
   bool disable(/*Websocket::*/session_id& session);
   bool setInterval(_ws_info *socket, int interval_in_seconds);
@@ -189,10 +265,15 @@ public:
   bool clearItems(_ws_info *socket, possible_items items);
   possible_items getItems();
   bool oneShot(_ws_info *socket);
+  bool setDelta(_ws_info *socket);
 
   void pauze();  // pauze polling the panel (while the receiver is executing a command)
   void resume(); // resume polling the panel
 
+  // Called by the receiver thread for every SIA message,
+  // (re)schedules a poll of the items related to it.
+  void activity(class SiaEvent& msg);
+
   // Provide a method that refers to the top openGalaxy class
   inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
 };
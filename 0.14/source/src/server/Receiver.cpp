@@ -39,18 +39,78 @@
 #include "Syslog.hpp"
 #include "Settings.hpp"
 #include "Receiver.hpp"
+#include "PanelState.hpp"
 
 namespace openGalaxy {
 
-Receiver::Receiver(openGalaxy& opengalaxy) : m_openGalaxy(opengalaxy)
+Receiver::Receiver(openGalaxy& opengalaxy)
+ : m_openGalaxy(opengalaxy), m_task(opengalaxy.executor(), [this]{ run(); }, true)
 {
-  // Create a new instance of the receiver thread
-  m_thread = new std::thread(Receiver::Thread, this);
+  hold_session = 0;
+  answer_timed_out = false;
+  session_timed_out = false;
+  m_answer_timer.set([this]{ answer_timed_out = true; notify(); });
+  m_session_timer.set([this]{ session_timed_out = true; notify(); });
+  retry_jitter.seed(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+  link.session_idle_ms = opengalaxy.settings().remote_session_idle_ms;
+  m_thread = nullptr;
+
+  // A context for the benchmarks does not use the serial port
+  if(opengalaxy.m_options.offline) return;
+
+  // Let the executor run the send/receive loop when there is data to read
+  // (or a command to send), or poll the serial port from a thread of our
+  // own when it can not be watched (on Windows, when replaying a capture)
+  m_fd = opengalaxy.serialport().fd();
+  if(m_fd >= 0 && opengalaxy.executor().watch(m_fd, [this](int events){ serial_event(events); })){
+    m_task.schedule();
+  }
+  else {
+    m_fd = -1;
+    m_thread = new std::thread(Receiver::Thread, this);
+  }
 }
 
 Receiver::~Receiver()
 {
-  delete m_thread;
+  if(m_thread){
+    if(m_thread->joinable()) m_thread->join();
+    delete m_thread;
+  }
+}
+
+void Receiver::notify()
+{
+  if(m_thread) m_request_cv.notify_one();
+  else m_task.schedule();
+}
+
+void Receiver::join()
+{
+  if(m_thread && m_thread->get_id() != std::this_thread::get_id()) m_thread->join();
+  if(m_fd >= 0) opengalaxy().executor().unwatch(m_fd);
+  opengalaxy().executor().disarm(m_answer_timer);
+  opengalaxy().executor().disarm(m_session_timer);
+
+  // Free any entries left in the transmit queues,
+  // failing the requests so nobody keeps waiting for them
+  m_mutex.lock();
+  m_stopped = true;
+  if(transmit_current != nullptr){
+    transmit_queue[static_cast<int>(transmit_current->prio)].push_front(transmit_current);
+    transmit_current = nullptr;
+  }
+  for(int p = 0; p < static_cast<int>(priority::count); p++){
+    while(transmit_queue[p].size()>0){
+      TransmitSiaBlock *block = transmit_queue[p].front();
+      transmit_queue[p].pop_front();
+      if(block->request) retire(block, nullptr, 0);
+      else delete block;
+    }
+  }
+  count_queued();
+  m_mutex.unlock();
+  complete_retired();
 }
 
 // Send any type of SIA block to the transmitter
@@ -59,7 +119,38 @@ Receiver::~Receiver()
 // data     = data to send (may include \0 bytes)
 // len      = length of data in bytes
 // callback = function to call with error status or data returned by the transmitter
-bool Receiver::send(SiaBlock::FunctionCode fc, char *data, int len, Receiver::transmit_callback callback)
+// prio     = the transmit queue to use
+// session  = id of the session requesting it (0 = none)
+bool Receiver::send(SiaBlock::FunctionCode fc, char *data, int len, Receiver::transmit_callback callback, Receiver::priority prio, unsigned long long session)
+{
+  if( data==nullptr ){
+    throw new std::runtime_error("Receiver::send(): data = null.");
+  }
+  if( callback==nullptr ){
+    throw new std::runtime_error("Receiver::send(): callback = null.");
+  }
+  if( len<0 ){
+    throw new std::runtime_error("Receiver::send(): len < 0.");
+  }
+  m_mutex.lock();
+  enqueue(new TransmitSiaBlock(fc, data, len, callback, prio, session), false);
+  m_mutex.unlock();
+  complete_retired();
+  opengalaxy().syslog().debug("Receiver: Command que append: %s (class %u)", filter_non_printable(data,len), static_cast<unsigned int>(prio));
+  notify();
+  return true;
+}
+
+// Send any type of SIA block to the transmitter on behalf of a request
+//
+// fc       = SIA function code
+// data     = data to send (may include \0 bytes)
+// len      = length of data in bytes
+// callback = function to call with the request id and error status or data returned by the transmitter
+// id       = request id to pass to the callback function
+// prio     = the transmit queue to use
+// session  = id of the session requesting it (0 = none)
+bool Receiver::send(SiaBlock::FunctionCode fc, char *data, int len, Receiver::request_callback callback, unsigned long id, Receiver::priority prio, unsigned long long session)
 {
   if( data==nullptr ){
     throw new std::runtime_error("Receiver::send(): data = null.");
@@ -71,9 +162,11 @@ bool Receiver::send(SiaBlock::FunctionCode fc, char *data, int len, Receiver::tr
     throw new std::runtime_error("Receiver::send(): len < 0.");
   }
   m_mutex.lock();
-  transmit_list.append(new TransmitSiaBlock(fc, data, len, callback));
+  enqueue(new TransmitSiaBlock(fc, data, len, callback, id, prio, session), false);
   m_mutex.unlock();
-  opengalaxy().syslog().debug("Receiver: Command que append: %s", filter_non_printable(data,len));
+  complete_retired();
+  opengalaxy().syslog().debug("Receiver: Command que append: %s (request %lu, class %u)", filter_non_printable(data,len), id, static_cast<unsigned int>(prio));
+  notify();
   return true;
 }
 
@@ -95,22 +188,257 @@ bool Receiver::sendFirst(SiaBlock::FunctionCode fc, char *data, int len, Receive
     throw new std::runtime_error("Receiver::sendFirst(): len < 0.");
   }
   m_mutex.lock();
-  transmit_list.prepend(new TransmitSiaBlock(fc, data, len, callback));
+  enqueue(new TransmitSiaBlock(fc, data, len, callback, priority::action, 0), true);
   m_mutex.unlock();
+  complete_retired();
   opengalaxy().syslog().debug("Receiver: Command que prepend: %s", filter_non_printable(data,len));
+  notify();
   return true;
 }
 
-// return true when transmit_list is not empty (ie. we are sending data)
+// Moves a queued request to a higher priority class (for when an identical
+// request was made with a higher priority) and forgets its session when it
+// is shared by another session (so cancel() will not drop it)
+void Receiver::share(unsigned long id, Receiver::priority prio, unsigned long long session)
+{
+  m_mutex.lock();
+  for(int p = 0; p < static_cast<int>(priority::count); p++){
+    for(auto it = transmit_queue[p].begin(); it != transmit_queue[p].end(); ++it){
+      TransmitSiaBlock *block = *it;
+      if(block->request == nullptr || block->id != id) continue;
+      if(block->session != session) block->session = 0;
+      if(static_cast<int>(prio) < p){
+        transmit_queue[p].erase(it);
+        block->prio = prio;
+        enqueue(block, false);
+      }
+      m_mutex.unlock();
+      complete_retired();
+      return;
+    }
+  }
+  // Not queued (anymore), it is being send or has been completed
+  m_mutex.unlock();
+}
+
+// Drops all blocks requested by a session that have not been send yet
+// (the block that is being send to the transmitter is left alone)
+void Receiver::cancel(unsigned long long session)
+{
+  if(session == 0) return;
+  int n = 0;
+  m_mutex.lock();
+  for(int p = 0; p < static_cast<int>(priority::count); p++){
+    auto it = transmit_queue[p].begin();
+    while(it != transmit_queue[p].end()){
+      TransmitSiaBlock *block = *it;
+      if(block->session == session){
+        it = transmit_queue[p].erase(it);
+        retire(block, nullptr, 3);
+        n++;
+      }
+      else ++it;
+    }
+  }
+  count_queued();
+  m_mutex.unlock();
+  complete_retired();
+  if(n) opengalaxy().syslog().debug("Receiver: Dropped %d queued command(s) for disconnected session", n);
+}
+
+// return true when the transmit queues are not empty (ie. we are sending data)
 bool Receiver::isTransmitting()
 {
   bool retv = false;
   m_mutex.lock();
-  if(transmit_list.size() > 0) retv = true;
+  if(transmit_current != nullptr) retv = true;
+  for(int p = 0; p < static_cast<int>(priority::count); p++){
+    if(transmit_queue[p].size() > 0) retv = true;
+  }
   m_mutex.unlock();
   return retv;
 }
 
+// Returns the maximum time (in milliseconds) a block may wait in a transmit queue
+int Receiver::deadline_ms(Receiver::priority p)
+{
+  switch(p){
+    case priority::action:
+      return 60000;
+    case priority::query:
+      return 30000;
+    default:
+      return 10000;
+  }
+}
+
+// Adds a block to its transmit queue.
+// Identical blocks queued for background polling are only send once.
+// (Must be called with m_mutex locked)
+void Receiver::enqueue(Receiver::TransmitSiaBlock *block, bool first)
+{
+  if(m_stopped){
+    // Exiting, nothing is send anymore
+    retire(block, nullptr, 3);
+    return;
+  }
+  std::deque<TransmitSiaBlock*>& queue = transmit_queue[static_cast<int>(block->prio)];
+  if(block->prio == priority::poll && block->request == nullptr){
+    for(auto it = queue.begin(); it != queue.end(); ++it){
+      if(
+        (*it)->request == nullptr &&
+        (*it)->callback == block->callback &&
+        (*it)->fc == block->fc &&
+        (*it)->len == block->len &&
+        memcmp((*it)->data, block->data, block->len) == 0
+      ){
+        delete block;
+        return;
+      }
+    }
+  }
+  if(first) queue.push_front(block);
+  else queue.push_back(block);
+  count_queued();
+}
+
+// Updates the transmit queue depth reported by /metrics
+// (Must be called with m_mutex locked)
+void Receiver::count_queued()
+{
+  int n = 0;
+  for(int p = 0; p < static_cast<int>(priority::count); p++) n += transmit_queue[p].size();
+  opengalaxy().stats().transmit_queue_depth.store(n, std::memory_order_relaxed);
+}
+
+// Takes the next block to send from the highest priority transmit queue,
+// dropping any blocks that have been waiting past their deadline.
+// (Must be called with m_mutex locked)
+Receiver::TransmitSiaBlock *Receiver::dequeue()
+{
+  using namespace std::chrono;
+  high_resolution_clock::time_point now = high_resolution_clock::now();
+  for(int p = 0; p < static_cast<int>(priority::count); p++){
+    while(transmit_queue[p].size() > 0){
+      TransmitSiaBlock *block = transmit_queue[p].front();
+      transmit_queue[p].pop_front();
+      long long waited = duration_cast<milliseconds>(now - block->queued).count();
+      if(waited >= deadline_ms(block->prio)){
+        opengalaxy().syslog().error("Receiver: Command waited %lld milliseconds to be send, dropping command!", waited);
+        Stats::add(opengalaxy().stats().transmit_failures);
+        retire(block, nullptr, 3);
+        continue;
+      }
+      if(block->prio != priority::poll){
+        opengalaxy().stats().record(Stats::stage::transmit_queue, now - block->queued);
+      }
+      count_queued();
+      return block;
+    }
+  }
+  count_queued();
+  return nullptr;
+}
+
+// Retires 'transmit_current' with the transmitters answer or error status
+// (its callback function is called by complete_retired()).
+// (Must be called with m_mutex locked)
+void Receiver::finish(char *buf, int len)
+{
+  if(transmit_current == nullptr) return;
+  if(buf == nullptr) Stats::add(opengalaxy().stats().transmit_failures);
+  else if(transmit_current->prio != priority::poll){
+    opengalaxy().stats().record(
+      Stats::stage::transmit_total,
+      std::chrono::high_resolution_clock::now() - transmit_current->queued
+    );
+  }
+  retire(transmit_current, buf, len);
+  transmit_current = nullptr;
+}
+
+// Takes a block out of the send/receive loop, keeping (a copy of) the
+// transmitters answer or error status for complete_retired().
+// (Must be called with m_mutex locked)
+void Receiver::retire(Receiver::TransmitSiaBlock *block, char *buf, int len)
+{
+  if(buf != nullptr){
+    block->answer = (char*)thread_safe_malloc(len + 1);
+    memcpy(block->answer, buf, len);
+    block->answer[len] = '\0';
+  }
+  block->answer_len = len;
+  m_retired.push_back(block);
+}
+
+// Passes the answer or error status of each retired block to its callback
+// function and frees it. (Must be called with m_mutex unlocked)
+void Receiver::complete_retired()
+{
+  std::vector<TransmitSiaBlock*> retired;
+  m_mutex.lock();
+  retired.swap(m_retired);
+  m_mutex.unlock();
+  for(TransmitSiaBlock *block : retired){
+    block->complete(m_openGalaxy, block->answer, block->answer_len);
+    delete block;
+  }
+}
+
+
+// Adds a round-trip time measurement to the estimate
+void Receiver::RoundTrip::sample(double rtt_ms)
+{
+  if(samples == 0){
+    srtt = rtt_ms;
+    rttvar = rtt_ms / 2;
+  }
+  else {
+    rttvar = 0.75 * rttvar + 0.25 * ((srtt > rtt_ms) ? srtt - rtt_ms : rtt_ms - srtt);
+    srtt = 0.875 * srtt + 0.125 * rtt_ms;
+  }
+  samples++;
+}
+
+// Returns the time to wait for the first answer to a block,
+// this is the fixed SIA timeout until a round-trip time was measured.
+int Receiver::RoundTrip::rto(int min_ms) const
+{
+  if(samples == 0) return SiaBlock::block_ack_timeout_ms;
+  int ms = (int)(srtt + 4 * rttvar);
+  if(ms < min_ms) ms = min_ms;
+  if(ms > SiaBlock::block_ack_timeout_ms) ms = SiaBlock::block_ack_timeout_ms;
+  return ms;
+}
+
+// Returns the time to wait for an answer before trying again.
+//
+// The timeout doubles with each consecutive timeout (backoff) and is
+// shortened by up to 1/8th at random when retrying, so that a retry does
+// not keep landing on the same point in the panel's own polling cycle.
+int Receiver::ack_timeout_ms(const RoundTrip& rtt, int backoff)
+{
+  int ms = rtt.rto(opengalaxy().settings().ack_timeout_min_ms);
+  for(int i = 0; i < backoff && ms < SiaBlock::block_ack_timeout_ms; i++) ms *= 2;
+  if(ms > SiaBlock::block_ack_timeout_ms) ms = SiaBlock::block_ack_timeout_ms;
+  if(backoff > 0){
+    std::uniform_int_distribution<int> jitter(0, ms / 8);
+    ms -= jitter(retry_jitter);
+  }
+  return ms;
+}
+
+Receiver::LinkEstimate Receiver::loginEstimate()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return { (int)rtt_login.srtt, (int)rtt_login.rttvar, rtt_login.rto(opengalaxy().settings().ack_timeout_min_ms), rtt_login.samples };
+}
+
+Receiver::LinkEstimate Receiver::commandEstimate()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return { (int)rtt_command.srtt, (int)rtt_command.rttvar, rtt_command.rto(opengalaxy().settings().ack_timeout_min_ms), rtt_command.samples };
+}
 
 // return true when we are receiving data
 bool Receiver::IsReceiving()
@@ -127,6 +455,7 @@ bool Receiver::IsReceiving()
 void Receiver::TriggerAcknoledge()
 {
   if(waiting == true){
+    tpResponse = std::chrono::high_resolution_clock::now();
     waiting = false;
     rejected = false;
     extended = false;
@@ -138,6 +467,7 @@ void Receiver::TriggerAcknoledge()
 void Receiver::TriggerReject()
 {
   if(waiting == true){
+    tpResponse = std::chrono::high_resolution_clock::now();
     waiting = false;
     rejected = true;
     extended = false;
@@ -149,6 +479,7 @@ void Receiver::TriggerReject()
 void Receiver::TriggerConfiguration()
 {
   if(waiting == true){
+    tpResponse = std::chrono::high_resolution_clock::now();
     waiting = false;
     rejected = false;
     extended = false;
@@ -160,6 +491,7 @@ void Receiver::TriggerConfiguration()
 void Receiver::TriggerControl(char *msg)
 {
   if(waiting == true){
+    tpResponse = std::chrono::high_resolution_clock::now();
     waiting = false;
     rejected = false;
     extended = false;
@@ -175,17 +507,50 @@ void Receiver::TriggerControl(char *msg)
 void Receiver::TriggerExtended(char *msg, size_t len )
 {
   if(waiting == true){
+    tpResponse = std::chrono::high_resolution_clock::now();
     waiting = false;
     rejected = false;
     extended = true;
     success = true;
     memset(receive_buffer, 0xFF, sizeof(receive_buffer));
     memcpy(receive_buffer, msg, (len > sizeof(receive_buffer)) ? sizeof(receive_buffer) : len);
-    receive_buffer_len = len;
+    receive_buffer_len = (len > sizeof(receive_buffer)) ? sizeof(receive_buffer) : len;
   }
   opengalaxy().syslog().debug("Receiver: Received from panel: X: %s", filter_non_printable(msg, len));
 }
 
+// Sends the current command (transmit_current) to the transmitter.
+// Must be called with m_mutex locked.
+//
+// Returns true when the command was send and a response is expected.
+bool Receiver::SendCommand()
+{
+  SiaBlock siablock;
+  siablock.block.function_code = transmit_current->fc;
+  siablock.block.header.block_length = transmit_current->len;
+  siablock.block.header.acknoledge_request = 1;
+  memcpy(
+    siablock.block.message,
+    transmit_current->data,
+    transmit_current->len
+  );
+  siablock.GenerateParity();
+
+  waiting = true;
+  rejected = true;
+  success = false;
+  extended = false;
+
+  opengalaxy().syslog().debug("Receiver: Sending command: %s", filter_non_printable((char*)siablock.block.message, siablock.block.header.block_length));
+  if(opengalaxy().sia().SendBlock(siablock)==false){
+    waiting = false;
+    opengalaxy().syslog().error("Receiver: Failed to send a command to the transmitter!");
+    finish(nullptr, 0);
+    return false;
+  }
+  return true;
+}
+
 // helper function that filters non-printable characters from a C string.
 // unprintable character are replaced with the '.' character.
 char *Receiver::filter_non_printable(char* str, int len)
@@ -241,240 +606,327 @@ static void pbuffer(const unsigned char *buf, int l)
 }
 */
 
-// the main() function for (all) the receiver thread(s)
-void Receiver::Thread(Receiver* receiver)
+// An iteration of the send/receive loop.
+//
+// Reads and decodes the data from the serial port. When the line is quiet
+// (nothing was read), checks for the answer to (or a timeout of) the last
+// block that was send, or starts sending the next command from the
+// transmit queues.
+//
+// Returns the time (in milliseconds) until the next iteration is needed,
+// or -1 when there is nothing to do until data arrives or a block is queued.
+int Receiver::step()
 {
   using namespace std::chrono;
-  try {
-
-    unsigned char buf[256];          // rs232 received data
-    bool wait_login = false;         // true when a login block has been send and we are waiting for a response (config or reject block)
-    bool wait_fc = false;            // true when a block has been send and we are waiting for a response
-    int retry = 0;                   // The number of times a command was retried
-
-    high_resolution_clock::time_point
-      tpStart, tpEnd,                // used to time how long it takes to do a single send/receive loop
-      tpTimeoutStart, tpTimeoutEnd;  // used to detect timeouts while sending data
-
-    int loop_delay_ms_default = 100; // (maximum) time in between consecutive send/receive loop iterations (milliseconds)
-    int loop_delay_ms_minimum = 50; // minimum time in between consecutive send/receive loop iterations (milliseconds)
-
-    // current time in between consecutive send/receive loop iterations (milliseconds)
-    int loop_delay_ms = loop_delay_ms_default;
+  unsigned char buf[256];            // rs232 received data
+  high_resolution_clock::time_point tpTimeoutEnd;
+
+  // Lock our (data access) mutex
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  // Read a maximum of 255 bytes from the serial port
+  // (when the executor watches the serial port, only when there is data,
+  //  otherwise this blocks for up to a second)
+  size_t l = 0;
+  if(m_fd < 0 || opengalaxy().serialport().pending()){
+    l = opengalaxy().serialport().read(buf, 255);
+    if(l > 255) l = 0; // (read error)
+  }
 
-    std::unique_lock<std::mutex> lck(receiver->m_request_mutex);
 
-    // Loop here until quitting time
-    while(receiver->opengalaxy().isQuit()==false){
-      // (When running on Windows (MSYS/MinGW) the previous while() also seems to fix a strange issue
-      // where m_request_cv is notified a lot of times by somebody other then us!?
-      // That in turn causes the program to break out of the next while loop)
-      //
-      // Start the main send/receive loop.
-      //
-      // This loop sleeps for 'loop_delay_ms' milliseconds before timing out and starting a new loop iteration.
-      // At the end of each loop, the time it took to execute (it) is calculated and subtracted from the
-      // 'loop_delay_ms_default' delay value. That new delay value is used to time the next loop iteration.
-      // This new delay shal not be smaller then 'loop_delay_ms_minimum'.
-      // While the thread is waiting for a response to a command that was send the 'loop_delay_ms_minimum' is used.
-      //
-      // A std::condition_variable (and associated std::mutex) is used to time the loop.
+  // Received at least 1 byte?
+  if(l > 0){
+    //pbuffer(buf, l);
+    // Yes, so decode the data.
+    SiaEvent *sia = opengalaxy().sia().Decode(buf, l);
+    // Complete SIA message decoded?
+    if ( sia != nullptr ){
+      opengalaxy().stats().record(Stats::stage::event_decode, sia->tpDecoded - sia->tpReceived);
+      std::string fc;
+      opengalaxy().syslog().info("Receiver: %s (0x%02X) %s %s", sia->raw.FunctionCodeToString(fc), sia->raw.block.function_code, sia->raw.block.message, sia->ascii.data());
+      // Yes, a complete message was received, send it to the output thread
+      opengalaxy().output().write(*sia);
+      // and update our model of the panel state
+      opengalaxy().galaxy().state().Apply(*sia);
+      // and poll the items that may have changed
+      opengalaxy().poll().activity(*sia);
+      // No more need to keep the message, free it's memory
+      delete sia; sia = nullptr;
+    }
+  }
+  else {
+    // No, we have not received any data...
+    //
+    // Are we currently blocking writes, or in the middle of receiving a message?
+    if((wait_write == false) && (opengalaxy().sia().sia_current_HaveAccountID == false)){
+      // Not blocking writes
       //
-      while(receiver->m_request_cv.wait_for(lck,milliseconds(loop_delay_ms))==std::cv_status::timeout){
-
-        // Begin timing this send/receive loop iteration
-        tpStart = high_resolution_clock::now();
-
-        // Test if we need to exit the thread.
-        if(receiver->opengalaxy().isQuit()==true) break;
-
-        // Lock our (data access) mutex
-        receiver->m_mutex.lock();
-
-        // Read a maximum of 255 bytes from the serial port
-        // (this function is non-blocking)
-        size_t l = receiver->opengalaxy().serialport().read(buf, 255);
-
-        // Received at least 1 byte?
-        if(l > 0){
-          //pbuffer(buf, l);
-          // Yes, so decode the data.
-          SiaEvent *sia = receiver->opengalaxy().sia().Decode(buf, l);
-          // Complete SIA message decoded?
-          if ( sia != nullptr ){
-            std::string fc;
-            receiver->opengalaxy().syslog().info("Receiver: %s (0x%02X) %s %s", sia->raw.FunctionCodeToString(fc), sia->raw.block.function_code, sia->raw.block.message, sia->ascii.data());
-            // Yes, a complete message was received, send it to the output thread
-            receiver->opengalaxy().output().write(*sia);
-            // No more need to keep the message, free it's memory
-            delete sia; sia = nullptr;
+      // Are we waiting for the response to a remote login block send earlier?
+      if(link.wait_login==true){
+        // Yes we are waiting for a configuration block, did we receive a configuration or reject block?
+        if(waiting==false){
+          opengalaxy().executor().disarm(m_answer_timer);
+          // Yes, measure the round-trip time unless the login was
+          // send more than once (the answer may be to any attempt)
+          if(link.login_backoff == 0){
+            duration<double,std::milli> rtt = tpResponse - link.tpTimeoutStart;
+            rtt_login.sample(rtt.count());
+            opengalaxy().stats().record(Stats::stage::transmit_login, rtt);
+            opengalaxy().syslog().debug("Receiver: Remote login answered in %d milliseconds (smoothed %d, variation %d)", (int)rtt.count(), (int)rtt_login.srtt, (int)rtt_login.rttvar);
+          }
+          link.login_backoff = 0;
+          // Accepted or reject?
+          link.wait_login = false;
+          if(rejected==true){
+            // Rejected, drop the current command after retry_max retries
+            opengalaxy().syslog().error("Receiver: Remote login attempt rejected, trying again... (%u)", link.retry);
+            Stats::add(opengalaxy().stats().transmit_rejects);
+            Stats::add(opengalaxy().stats().transmit_retries);
+            link.retry++;
+            if(link.retry>retry_max){
+              if(transmit_current != nullptr){
+                opengalaxy().syslog().error("Receiver: Remote login attempt rejected, droppping command!");
+                finish(nullptr,1);
+                link.command_backoff = 0;
+              }
+            }
+          }
+          else {
+            // Accepted, send the current command
+            link.wait_fc = SendCommand();
+            link.session_command = false;
+            // Start a new timer to calculate when waiting for
+            // the response to the block we just send times out.
+            link.retry = 0;
+            wait_answer(ack_timeout_ms(rtt_command, link.command_backoff));
           }
         }
         else {
-          // No, we have not received any data...
+          // No we did not receive a configuration/reject block but are waiting for one.
           //
-          // Are we currently blocking writes, or in the middle of receiving a message?
-          if((receiver->wait_write == false) && (receiver->opengalaxy().sia().sia_current_HaveAccountID == false)){
-            // Not blocking writes
-            //
-            // Are we waiting for the response to a remote login block send earlier?
-            if(wait_login==true){
-              // Yes we are waiting for a configuration block, did we receive a configuration or reject block?
-              if(receiver->waiting==false){
-                // Yes, accepted or reject?
-                wait_login = false;
-                if(receiver->rejected==true){
-                  // Rejected, remove the transmit_list entry after retry_max retries
-                  receiver->opengalaxy().syslog().error("Receiver: Remote login attempt rejected, trying again... (%u)", retry);
-                  retry++;
-                  if(retry>receiver->retry_max){
-                    if(receiver->transmit_list.size()>0){
-                      receiver->opengalaxy().syslog().error("Receiver: Remote login attempt rejected, droppping command!");
-                      receiver->transmit_list[0]->callback(receiver->m_openGalaxy,nullptr,1);
-                      receiver->transmit_list.remove(0);
-                    }
-                  }
-                }
-                else {
-                  // Accepted, send the topmost command in the transmit_list
-                  SiaBlock siablock;
-                  siablock.block.function_code = receiver->transmit_list[0]->fc;
-                  siablock.block.header.block_length = receiver->transmit_list[0]->len;
-                  siablock.block.header.acknoledge_request = 1;
-                  memcpy(
-                    siablock.block.message,
-                    receiver->transmit_list[0]->data,
-                    receiver->transmit_list[0]->len
-                  );
-                  siablock.GenerateParity();
-
-                  wait_fc = true;
-                  receiver->waiting = true;
-                  receiver->rejected = true;
-                  receiver->success = false;
-                  receiver->extended = false;
-
-                  receiver->opengalaxy().syslog().debug("Receiver: Sending command: %s", filter_non_printable((char*)siablock.block.message, siablock.block.header.block_length));
-                  if(receiver->opengalaxy().sia().SendBlock(siablock)==false){
-                    wait_fc = false;
-                    receiver->waiting = false;
-                    receiver->opengalaxy().syslog().error("Receiver: Failed to send a command to the transmitter!");
-                    receiver->transmit_list.remove(0);
-                  }
-                  // Start a new timer to calculate when waiting for
-                  // the response to the block we just send times out.
-                  retry = 0;
-                  tpTimeoutStart = high_resolution_clock::now();
-                }
-              }
-              else {
-                // No we did not receive a configuration/reject block but are waiting for one.
-                //
-                // Did we timeout while waiting for the configuration/reject block?
-                tpTimeoutEnd = high_resolution_clock::now();
-                duration<long long,std::milli> delta = duration_cast<duration<long long,std::milli>>(tpTimeoutEnd-tpTimeoutStart);
-                if((delta.count()<0)||(delta.count()>=SiaBlock::block_ack_timeout_ms)){
-                  // Yes
-                  retry++;
-                  if(retry>=receiver->retry_max){           
-                    receiver->opengalaxy().syslog().error("Receiver: Remote login timed out after %d milliseconds, dropping command... (%d)", delta.count(), retry);
-                    // Notify the callback function accociated with the command we send.
-                    if(receiver->transmit_list.size()>0){
-                      receiver->transmit_list[0]->callback(receiver->m_openGalaxy,nullptr,2);
-                      receiver->transmit_list.remove(0);
-                    }
-                    retry = 0;
-                  }
-                  else {
-                    receiver->opengalaxy().syslog().error("Receiver: Remote login timed out after %d milliseconds, trying again... (%u)", delta.count(), retry);
-                  }
-                  wait_login = false;
-                  receiver->waiting = false;
-                }
-                // No, we did not timeout while waiting for a configuartion/reject block but are still waiting...
-              }
+          // Did we timeout while waiting for the configuration/reject block?
+          if(answer_timed_out){
+            // Yes
+            tpTimeoutEnd = high_resolution_clock::now();
+            duration<long long,std::milli> delta = duration_cast<duration<long long,std::milli>>(tpTimeoutEnd-link.tpTimeoutStart);
+            link.retry++;
+            link.login_backoff++;
+            if(link.retry>=retry_max){           
+              opengalaxy().syslog().error("Receiver: Remote login timed out after %d milliseconds, dropping command... (%d)", delta.count(), link.retry);
+              // Notify the callback function accociated with the command we send.
+              finish(nullptr,2);
+              link.retry = 0;
+              link.command_backoff = 0;
             }
-            // No we are not blocking write (and have not received any data)
-            //
-            // Are we waiting for the response to a command (SIA block) we last send (ie. after the login was accepted)?
-            else if(wait_fc==true){
-              // Yes, did we receive a response (via one of the 'trigger' functions)?
-              if(receiver->waiting==false){
-                // Yes, success or failure?
-                if(receiver->success==true){
-                  // Success!
-                  // Pass the received data to the callback function accociated with the command we send.
-                  receiver->transmit_list[0]->callback(receiver->m_openGalaxy,(char*)receiver->receive_buffer,receiver->receive_buffer_len);
-                  receiver->receive_buffer_len = 0;
-                }
-                else {
-                  // Failure!
-                  receiver->opengalaxy().syslog().error("Receiver: Command execution failed!" );
-                  // Notify the callback function accociated with the command we send.
-                  receiver->transmit_list[0]->callback(receiver->m_openGalaxy,nullptr,0);
-                }
-                retry = 0;
-                receiver->transmit_list.remove(0);
-              }
-              else {
-                // No response to the (last send) command, did we timeout?
-                tpTimeoutEnd = high_resolution_clock::now();
-                duration<long long,std::milli> delta = duration_cast<duration<long long,std::milli>>(tpTimeoutEnd-tpTimeoutStart);
-                if((delta.count() < 0) || (delta.count() >= SiaBlock::block_ack_timeout_ms)){
-                  // Yes, do nothing and try (to login) again on the next loop..
-                  retry++;
-                  receiver->opengalaxy().syslog().debug("Receiver: Sending command timed out after %d milliseconds, trying again... (%u)", delta.count(),retry);
-                  receiver->waiting = false;
-                }
-                // No, wait some more
-              }
-              wait_fc = false; 
-            }
-            //
-            // We are not receiving data or waiting for anything,
-            //  start sending the next command in the list (if any)
-            //
-            else if(receiver->transmit_list.size() > 0){
-              receiver->opengalaxy().poll().pauze();
-              memset(receiver->receive_buffer, 0, sizeof(receiver->receive_buffer));
-              receiver->receive_buffer_len = 0;
-              receiver->waiting = true;
-              receiver->rejected = true;
-              receiver->success = false;
-              wait_login = true;
-              receiver->opengalaxy().sia().SendBlock_RemoteLogin();
-              tpTimeoutStart = high_resolution_clock::now();
+            else {
+              opengalaxy().syslog().error("Receiver: Remote login timed out after %d milliseconds, trying again... (%u)", delta.count(), link.retry);
+              Stats::add(opengalaxy().stats().transmit_retries);
             }
-            else receiver->opengalaxy().poll().resume();
+            link.wait_login = false;
+            waiting = false;
           }
+          // No, we did not timeout while waiting for a configuartion/reject block but are still waiting...
         }
-
-        // If we are waiting for a response then use the minimum delay value for loop_delay_ms
-        if(receiver->waiting==true){
-          loop_delay_ms = loop_delay_ms_minimum;
+      }
+      // No we are not blocking write (and have not received any data)
+      //
+      // Are we waiting for the response to a command (SIA block) we last send (ie. after the login was accepted)?
+      else if(link.wait_fc==true){
+        // Yes, did we receive a response (via one of the 'trigger' functions)?
+        if(waiting==false){
+          link.wait_fc = false;
+          opengalaxy().executor().disarm(m_answer_timer);
+          // Measure the round-trip time unless the command was send
+          // more than once (the answer may be to any attempt)
+          if(link.command_backoff == 0){
+            duration<double,std::milli> rtt = tpResponse - link.tpTimeoutStart;
+            rtt_command.sample(rtt.count());
+            opengalaxy().stats().record(Stats::stage::transmit_reply, rtt);
+            opengalaxy().syslog().debug("Receiver: Command answered in %d milliseconds (smoothed %d, variation %d)", (int)rtt.count(), (int)rtt_command.srtt, (int)rtt_command.rttvar);
+          }
+          link.command_backoff = 0;
+          // Yes, success or failure?
+          if(success==true){
+            // Success!
+            // Pass the received data to the callback function accociated with the command we send.
+            finish((char*)receive_buffer,receive_buffer_len);
+            receive_buffer_len = 0;
+            link.retry = 0;
+            // Keep the remote login open for the next queued command?
+            if(link.session_idle_ms > 0 || hold_session > 0){
+              keep_session();
+            }
+          }
+          else if(link.session_command==true){
+            // Rejected while reusing a remote login, the panel may have
+            // ended the session. Login again and resend the command.
+            opengalaxy().syslog().debug("Receiver: Command rejected on open remote session, logging in again...");
+            Stats::add(opengalaxy().stats().transmit_rejects);
+            Stats::add(opengalaxy().stats().transmit_retries);
+            link.session_open = false;
+          }
+          else {
+            // Failure!
+            opengalaxy().syslog().error("Receiver: Command execution failed!" );
+            Stats::add(opengalaxy().stats().transmit_rejects);
+            // Notify the callback function accociated with the command we send.
+            finish(nullptr,0);
+            link.retry = 0;
+            link.session_open = false;
+          }
         }
         else {
-          // Calculate how long it took to do this send/receive loop iteration
-          tpEnd = high_resolution_clock::now();
-          duration<long long,std::milli> time_span_ms = duration_cast<duration<long long,std::milli>>(tpEnd - tpStart);
-
-          // Prepare the (new) timeout for sleeping
-          if(time_span_ms.count() >= 0 && time_span_ms.count() < loop_delay_ms_default){
-            loop_delay_ms = loop_delay_ms_default - time_span_ms.count();
-            if(loop_delay_ms < loop_delay_ms_minimum) loop_delay_ms = loop_delay_ms_minimum;
+          // No response to the (last send) command, did we timeout?
+          if(answer_timed_out){
+            // Yes, do nothing and try (to login) again on the next loop..
+            tpTimeoutEnd = high_resolution_clock::now();
+            duration<long long,std::milli> delta = duration_cast<duration<long long,std::milli>>(tpTimeoutEnd-link.tpTimeoutStart);
+            Stats::add(opengalaxy().stats().transmit_retries);
+            link.retry++;
+            link.command_backoff++;
+            opengalaxy().syslog().debug("Receiver: Sending command timed out after %d milliseconds, trying again... (%u)", delta.count(),link.retry);
+            waiting = false;
+            link.wait_fc = false;
+            link.session_open = false;
           }
-          else loop_delay_ms = loop_delay_ms_minimum;
-        }    
+          // No, wait some more
+        }
+      }
+      //
+      // We are not receiving data or waiting for anything,
+      //  start sending the current command, or the next command
+      //  from the transmit queues (if any)
+      //
+      else if(
+        (transmit_current != nullptr) ||
+        ((transmit_current = dequeue()) != nullptr)
+      ){
+        opengalaxy().poll().pauze();
+        memset(receive_buffer, 0, sizeof(receive_buffer));
+        receive_buffer_len = 0;
+        // Is the remote login from the previous command still open?
+        if(link.session_open==true && hold_session == 0 && session_timed_out) link.session_open = false;
+        if(link.session_open==true){
+          // Yes, send the command without logging in again
+          link.wait_fc = SendCommand();
+          link.session_command = true;
+          wait_answer(ack_timeout_ms(rtt_command, link.command_backoff));
+        }
+        else {
+          waiting = true;
+          rejected = true;
+          success = false;
+          link.wait_login = true;
+          opengalaxy().sia().SendBlock_RemoteLogin();
+          wait_answer(ack_timeout_ms(rtt_login, link.login_backoff));
+        }
+      }
+      else {
+        // Nothing left to send, forget the remote login once it has been idle for too long
+        // (unless a transaction is holding it open)
+        if(link.session_open==true && hold_session == 0 && session_timed_out){
+          duration<long long,std::milli> idle = duration_cast<duration<long long,std::milli>>(high_resolution_clock::now()-link.tpSessionLast);
+          link.session_open = false;
+          opengalaxy().syslog().debug("Receiver: Remote session idle for %d milliseconds, closing it", idle.count());
+        }
+        opengalaxy().poll().resume();
+      }
+    }
+  }
 
-        // unlock the (data access) mutex while we are sleeping
-        receiver->m_mutex.unlock();
-      } // Ends send/receive loop iteration
+  // Determine when the next iteration is needed
+  if(l > 0){
+    // More data may follow, have a look again once the line is quiet
+    return loop_delay_ms_minimum;
+  }
+  if(link.wait_login || link.wait_fc){
+    // Waiting for an answer, m_answer_timer wakes us when it does not arrive in time
+    return -1;
+  }
+  bool queued = (transmit_current != nullptr);
+  for(int p = 0; p < static_cast<int>(priority::count); p++){
+    if(transmit_queue[p].size() > 0) queued = true;
+  }
+  if(queued || wait_write || opengalaxy().sia().sia_current_HaveAccountID){
+    // More to send, or in the middle of receiving a message
+    return loop_delay_ms_default;
+  }
+  // (m_session_timer wakes us to forget an idle remote login)
+  return -1;
+}
 
-    } // Ends while ! opengalaxy().isQuit()
+void Receiver::wait_answer(int timeout_ms)
+{
+  link.tpTimeoutStart = std::chrono::high_resolution_clock::now();
+  answer_timed_out = false;
+  opengalaxy().executor().arm(m_answer_timer, timeout_ms);
+}
 
-    // Free any entries left in transmit_list
-    while(receiver->transmit_list.size()>0) receiver->transmit_list.remove(0);
+void Receiver::keep_session()
+{
+  link.session_open = true;
+  link.tpSessionLast = std::chrono::high_resolution_clock::now();
+  // (with a session_idle_ms of 0 the login is only kept while it is held)
+  session_timed_out = (link.session_idle_ms <= 0);
+  if(session_timed_out) opengalaxy().executor().disarm(m_session_timer);
+  else opengalaxy().executor().arm(m_session_timer, link.session_idle_ms);
+}
 
+// Runs step() on the executor's I/O loop and sets the timer for the next iteration
+void Receiver::run()
+{
+  try {
+    if(opengalaxy().isQuit()==true) return;
+    int delay_ms = step();
+    complete_retired();
+    if(delay_ms < 0) m_task.cancel();
+    else m_task.schedule_after(delay_ms);
+  }
+  catch(...){
+    // pass the exception on to the main() thread
+    opengalaxy().m_Receiver_exptr = std::current_exception();
+    opengalaxy().exit();
+  }
+}
+
+// Called on the executor's I/O loop when the serial port can be read from
+void Receiver::serial_event(int events)
+{
+  if(events & Executor::hangup){
+    // (do not keep waking up for an unplugged USB adapter)
+    opengalaxy().syslog().error("Receiver: Lost the connection to the serial port!");
+    opengalaxy().executor().unwatch(m_fd);
+  }
+  m_task.schedule();
+}
+
+// The thread that runs the send/receive loop when the serial port can not
+// be watched by the executor.
+void Receiver::Thread(Receiver* receiver)
+{
+  using namespace std::chrono;
+  try {
+    int loop_delay_ms = loop_delay_ms_default;
+    std::unique_lock<std::mutex> lck(receiver->m_request_mutex);
+
+    // Loop here until quitting time
+    while(receiver->opengalaxy().isQuit()==false){
+      // Sleep until the next iteration, or until notify() is called
+      receiver->m_request_cv.wait_for(lck, milliseconds(loop_delay_ms));
+      if(receiver->opengalaxy().isQuit()==true) break;
+
+      high_resolution_clock::time_point tpStart = high_resolution_clock::now();
+      loop_delay_ms = receiver->step();
+      receiver->complete_retired();
+
+      // The serial port is not watched, so look at it at least every
+      // 'loop_delay_ms_default' milliseconds (minus the time the read took)
+      if(loop_delay_ms < 0 || loop_delay_ms > loop_delay_ms_default){
+        long long ms = duration_cast<milliseconds>(high_resolution_clock::now() - tpStart).count();
+        loop_delay_ms = (ms >= 0 && ms < loop_delay_ms_default) ? loop_delay_ms_default - ms : loop_delay_ms_minimum;
+        if(loop_delay_ms < loop_delay_ms_minimum) loop_delay_ms = loop_delay_ms_minimum;
+      }
+    }
     receiver->opengalaxy().syslog().debug("Receiver::Thread exited normally");
   }
   catch(...){
@@ -35,6 +35,11 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <random>
 
 #include "Array.hpp"
 #include "tmalloc.hpp"
@@ -51,60 +56,207 @@ public:
 
   // TransmitSiaBlock is used to store SIA data that will
   // be send data to the transmitter.
-  // Data is pushed into the array by member functions
-  // SendToTransmitter() and SendToTransmitterFirst() and
-  // pulled from the array by the send/receive loop in
-  // the worker thread.
+  // Data is pushed into one of the transmit queues by member functions
+  // send() and sendFirst() and pulled from the queues by the send/receive
+  // loop (see step()), highest priority class first.
+
+  // Priority classes for the transmit queues (highest priority first)
+  enum class priority : unsigned int {
+    action = 0, // operator commands that change the panel state (arm/disarm, omit, outputs)
+    query,      // operator commands that only read the panel state
+    poll,       // background polling
+    count
+  };
 
   // Description of a function to call with the transmitter's answer or error status
   //  - callback( object ref, receive_buffer, receive_buffer_len ) === success
   //  - callback( object ref, nullptr, 0 ) === command failed/rejected
   //  - callback( object ref, nullptr, 1 ) === login rejected
   //  - callback( object ref, nullptr, 2 ) === login timed out
+  //  - callback( object ref, nullptr, 3 ) === deadline expired or session disconnected before sending
   typedef void(*transmit_callback)(class openGalaxy&, char*, int);
 
+  // The same, but also passes back the request id given to send()
+  typedef void(*request_callback)(class openGalaxy&, unsigned long, char*, int);
+
 private:
   class TransmitSiaBlock {
   public:
+    // (allocated from the pools of thread_safe_malloc())
+    static void *operator new(size_t size) { return thread_safe_malloc(size); }
+    static void operator delete(void *p) { thread_safe_free(p); }
+
     SiaBlock::FunctionCode fc;  // Function code
     char *data;                 // Data payload
     int len;                    // Length of data member in bytes
     transmit_callback callback; // The function to call with the transmitters answer or error status
+    request_callback request;   // Or this function when the block was send on behalf of a request id
+    unsigned long id;           // The request id passed to 'request'
+    priority prio;              // The transmit queue this block is in
+    unsigned long long session; // The session that requested it (0 = none)
+    std::chrono::high_resolution_clock::time_point queued; // When it was queued
+    char *answer;               // The transmitters answer once it is retired (nullptr = error status)
+    int answer_len;             // Length of the answer in bytes (or the error status)
 
-    TransmitSiaBlock(SiaBlock::FunctionCode c, const char *data_ptr, size_t data_size, transmit_callback cb){
+    TransmitSiaBlock(SiaBlock::FunctionCode c, const char *data_ptr, size_t data_size, transmit_callback cb, priority p, unsigned long long s){
       fc = c;
       data = (char*)thread_safe_malloc(data_size);
       memcpy(data, data_ptr, data_size);
       len = data_size;
       callback = cb;
+      request = nullptr;
+      id = 0;
+      prio = p;
+      session = s;
+      queued = std::chrono::high_resolution_clock::now();
+      answer = nullptr;
+      answer_len = 0;
+    }
+    TransmitSiaBlock(SiaBlock::FunctionCode c, const char *data_ptr, size_t data_size, request_callback cb, unsigned long request_id, priority p, unsigned long long s){
+      fc = c;
+      data = (char*)thread_safe_malloc(data_size);
+      memcpy(data, data_ptr, data_size);
+      len = data_size;
+      callback = nullptr;
+      request = cb;
+      id = request_id;
+      prio = p;
+      session = s;
+      queued = std::chrono::high_resolution_clock::now();
+      answer = nullptr;
+      answer_len = 0;
     }
     ~TransmitSiaBlock() {
       if(data) thread_safe_free(data);
+      if(answer) thread_safe_free(answer);
+    }
+
+    // Calls the callback function with the transmitters answer or error status
+    void complete(class openGalaxy& opengalaxy, char *buf, int buf_len){
+      if(request) request(opengalaxy, id, buf, buf_len);
+      else callback(opengalaxy, buf, buf_len);
     }
   };
 
   // Maximum number of times to retry sending a SIA datablock
   constexpr static const int retry_max = SiaBlock::block_retries;
 
+  // Maximum time (in milliseconds) a block may wait in its transmit queue
+  // before it is dropped, an arming action that is minutes late does more
+  // harm than good and stale poll reads are of no use to anyone.
+  static int deadline_ms(priority p);
+
+  // Smoothed estimate of the time the transmitter takes to answer a block,
+  // kept the way TCP keeps its retransmission timer (RFC 6298).
+  class RoundTrip {
+  public:
+    double srtt = 0;                 // smoothed round-trip time (milliseconds)
+    double rttvar = 0;               // round-trip time variation (milliseconds)
+    unsigned long samples = 0;       // number of measurements taken
+    void sample(double rtt_ms);
+    // Time to wait for the first answer before retrying (milliseconds)
+    int rto(int min_ms) const;
+  };
+
+  // (maximum) time in between consecutive send/receive loop iterations while
+  // sending or receiving data (milliseconds)
+  constexpr static const int loop_delay_ms_default = 100;
+
+  // minimum time in between consecutive send/receive loop iterations (milliseconds)
+  constexpr static const int loop_delay_ms_minimum = 50;
+
+  // The state of the send/receive loop (only used by step())
+  struct Link {
+    bool wait_login = false;         // true when a login block has been send and we are waiting for a response (config or reject block)
+    bool wait_fc = false;            // true when a block has been send and we are waiting for a response
+    int retry = 0;                   // The number of times a command was retried
+    bool session_open = false;       // true while the panel still holds the remote login from the previous command
+    bool session_command = false;    // true when the command being waited on was send without logging in first
+
+    int login_backoff = 0;           // number of consecutive remote login timeouts
+    int command_backoff = 0;         // number of consecutive timeouts for the current command
+
+    // time (milliseconds) to keep a remote login open after the last command (0 = login for each command)
+    int session_idle_ms = 0;
+
+    std::chrono::high_resolution_clock::time_point
+      tpTimeoutStart,                // time the last block was send (to measure the round-trip time)
+      tpSessionLast;                 // time the last command on the open remote session was answered
+  };
+  Link link;
+
+  // Timers for the answer to the last block send and for the idle remote
+  // login, their callbacks set the flags below (on the executor's I/O loop)
+  // and wake up the send/receive loop.
+  Executor::Timer m_answer_timer;
+  Executor::Timer m_session_timer;
+  std::atomic<bool> answer_timed_out;
+  std::atomic<bool> session_timed_out;
+
   class openGalaxy& m_openGalaxy;    // our openGalaxy instance
-  std::thread *m_thread;             // the worker thread for this receiver instance
-  std::mutex m_mutex;                // data mutex (protecting variable 'transmit_list')
-  std::mutex m_request_mutex;        // mutex and condition variable used to timeout and wakeup the worker thread
+  Executor::Task m_task;             // runs step() on the executor's I/O loop
+  int m_fd = -1;                     // the serial port watched by the executor (-1 = m_thread polls it)
+  std::thread *m_thread;             // polls the serial port when the executor can not watch it
+  std::mutex m_mutex;                // data mutex (protecting the transmit queues and 'transmit_current')
+  std::mutex m_request_mutex;        // mutex and condition variable used to timeout and wakeup m_thread
   std::condition_variable m_request_cv;
+  bool m_stopped = false;            // set by join(), blocks are no longer send after that
 
   volatile bool wait_write = false;  // true while a SIA block is being received, used to block sending data to the reveiver
   volatile bool waiting = false;     // True while we are waiting for a response from the transmitter
   volatile bool rejected = false;    // True when the transmitter rejected the SIA block
   volatile bool success = false;     // True when the transmitter accepted the SIA block
   volatile bool extended = false;    // True when the transmitter returned an extended datablock (function code 'X')
+  std::atomic<int> hold_session;     // Non-zero while the remote login must be kept open (see holdSession())
 
-  ObjectArray<TransmitSiaBlock*> transmit_list; // A list of commands yet to be send to the transmitter
+  RoundTrip rtt_login;               // remote login block -> configuration/reject block
+  RoundTrip rtt_command;             // command block -> acknoledge/reject/control/extended block
+  std::chrono::high_resolution_clock::time_point tpResponse; // when the last answer was received (set by the Trigger*() functions)
+  std::minstd_rand retry_jitter;     // spreads out retries
+
+  // Time to wait for an answer (milliseconds) before the next attempt,
+  // doubled for each consecutive timeout (called with m_mutex locked)
+  int ack_timeout_ms(const RoundTrip& rtt, int backoff);
+
+  std::deque<TransmitSiaBlock*> transmit_queue[static_cast<int>(priority::count)]; // Commands yet to be send to the transmitter
+  TransmitSiaBlock *transmit_current = nullptr; // The command presently being send to the transmitter
+  std::vector<TransmitSiaBlock*> m_retired; // Blocks that still need their callback function called
   unsigned char receive_buffer[256]; // buffer with received SIA data
   int receive_buffer_len = 0;        // number of bytes presently stored in receive_buffer
 
   static char *filter_non_printable(char* str, int len);
+
+  // An iteration of the send/receive loop, returns the time (in
+  // milliseconds) until the next one or -1 to wait for data or a command
+  int step();
+
+  void run();
+  void serial_event(int events);
   static void Thread(class Receiver* receiver);
 
+  // Sends 'transmit_current' (called with m_mutex locked)
+  bool SendCommand();
+
+  // Starts the timer for the answer to the block that was just send
+  // (the time to wait is adapted to the measured round-trip time and backed
+  // off on timeouts) and for the idle remote login after a command was
+  // answered (called with m_mutex locked)
+  void wait_answer(int timeout_ms);
+  void keep_session();
+
+  // Transmit queue helpers (called with m_mutex locked)
+  void enqueue(TransmitSiaBlock *block, bool first);
+  TransmitSiaBlock *dequeue();
+  void finish(char *buf, int len);
+
+  // Takes a block out of the queues with the transmitters answer or error
+  // status (called with m_mutex locked). Its callback function is called
+  // by complete_retired() once m_mutex is unlocked, so that the callback
+  // may queue a follow-up block.
+  void retire(TransmitSiaBlock *block, char *buf, int len);
+  void complete_retired();
+  void count_queued();
+
 public:
 
   // constructor/destructor
@@ -114,8 +266,32 @@ public:
 
   // public member functions
 
-  bool send(SiaBlock::FunctionCode fc, char *data, int len, transmit_callback);
+  bool send(SiaBlock::FunctionCode fc, char *data, int len, transmit_callback, priority prio = priority::query, unsigned long long session = 0);
+  bool send(SiaBlock::FunctionCode fc, char *data, int len, request_callback, unsigned long id, priority prio = priority::query, unsigned long long session = 0);
   bool sendFirst(SiaBlock::FunctionCode fc, char *data, int len, transmit_callback);
+
+  // Moves a queued request to a higher priority class, and forgets the
+  // session that queued it when another session shares the request.
+  void share(unsigned long id, priority prio, unsigned long long session);
+
+  // Drops all queued (but not yet send) blocks requested by a session
+  void cancel(unsigned long long session);
+
+  // Keeps the remote login open between commands (regardless of
+  // REMOTE-SESSION-IDLE-MS) until releaseSession() is called,
+  // used to execute a series of commands as one transaction.
+  void holdSession() { hold_session++; }
+  void releaseSession() { hold_session--; notify(); }
+  // The measured round-trip times to the transmitter (milliseconds)
+  struct LinkEstimate {
+    int srtt;
+    int rttvar;
+    int rto;
+    unsigned long samples;
+  };
+  LinkEstimate loginEstimate();
+  LinkEstimate commandEstimate();
+
   bool isTransmitting();
   bool IsReceiving();
 
@@ -126,11 +302,12 @@ public:
   void TriggerControl(char *msg);
   void TriggerExtended(char *msg, size_t len);
 
-  // Notifies the worker thread to break the current delay loop and immediately start the next loop iteration
-  void notify() { m_request_cv.notify_one(); }
+  // Starts the next iteration of the send/receive loop right away
+  void notify();
 
-  // joins the thread (used by openGalaxy::exit)
-  void join() { m_thread->join(); }
+  // Waits for m_thread (if any) and fails the blocks that were not send
+  // (used by openGalaxy::exit after the executor's I/O loop was stopped)
+  void join();
 
   // Provide a method that refers to the top openGalaxy class
   inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
@@ -28,7 +28,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
- /* Compile with DEBUG_SERIAL defined to dump bytes to the screen... */
+ /* Compile with DEBUG_SERIAL defined to dump bytes to the log (at debug level)... */
 
 #include "atomic.h"
 
@@ -42,62 +42,21 @@
 #include <mutex>
 #include <condition_variable>
 #include <fcntl.h>
+#include <csignal>
+#include <cstring>
 
 #if __linux__
 #include <termios.h>
+#include <poll.h>
 #endif 
 
 namespace openGalaxy {
 
-#ifdef DEBUG_SERIAL
-// prints the content of a buffer
-static void pbuffer(const char *str, const unsigned char *buf, int l)
-{
-  int t, c=0;
-  unsigned char b16[16];
-  for( int t=0; t<l; t++) {
-    if(!c) printf("%s",str);
-    printf(  "%02X ", buf[t] );
-    b16[c++]=buf[t];
-    if( c==16 ){
-      printf(
-        "%c%c%c%c%c%c%c%c%c%c%c%c%c%c%c%c\n",
-        (b16[0]>31 && b16[0]<127) ? b16[0] : '.' ,
-        (b16[1]>31 && b16[1]<127) ? b16[1] : '.' ,
-        (b16[2]>31 && b16[2]<127) ? b16[2] : '.' ,
-        (b16[3]>31 && b16[3]<127) ? b16[3] : '.' ,
-        (b16[4]>31 && b16[4]<127) ? b16[4] : '.' ,
-        (b16[5]>31 && b16[5]<127) ? b16[5] : '.' ,
-        (b16[6]>31 && b16[6]<127) ? b16[6] : '.' ,
-        (b16[7]>31 && b16[7]<127) ? b16[7] : '.' ,
-        (b16[8]>31 && b16[8]<127) ? b16[8] : '.' ,
-        (b16[9]>31 && b16[9]<127) ? b16[9] : '.' ,
-        (b16[10]>31 && b16[10]<127) ? b16[10] : '.' ,
-        (b16[11]>31 && b16[11]<127) ? b16[11] : '.' ,
-        (b16[12]>31 && b16[12]<127) ? b16[12] : '.' ,
-        (b16[13]>31 && b16[13]<127) ? b16[13] : '.' ,
-        (b16[14]>31 && b16[14]<127) ? b16[14] : '.' ,
-        (b16[15]>31 && b16[15]<127) ? b16[15] : '.'
-      );
-      c=0;
-    }
-  }
-
-  if( c!=0 ){
-    for(  t=c; t<16;t++ ) printf(  "-- "  );
-    for( int t=0; t<c; t++ ){
-      printf("%c",(b16[t]>31 && b16[t]<127) ? b16[t] : '.' );
-    }
-    printf( "\n" );
-  }
-}
-#endif
-
 #if __linux__
 ///
 /// Opens the serial port
 ///
-bool SerialPort::open(void)
+bool SerialPort::tty_open(void)
 {
   if(m_bIsOpen==false){
     // open the tty for reading and writing, and it is not a console
@@ -142,7 +101,7 @@ bool SerialPort::open(void)
 ///
 /// Closes the serial port
 ///
-void SerialPort::close(void)
+void SerialPort::tty_close(void)
 {
   if(m_bIsOpen==true){
     tcsetattr(m_nTTY,TCSANOW,&m_oldtio);
@@ -159,13 +118,13 @@ void SerialPort::close(void)
 ///
 /// Returns the number of bytes read
 ///
-size_t SerialPort::read(void* buf,size_t count)
+size_t SerialPort::tty_read(void* buf,size_t count)
 {
   if(m_bIsOpen==true){
     size_t retv = ::read(m_nTTY,buf,count);
     if(retv) opengalaxy().syslog().debug("Serial: Read %d byte(s) from %s", retv, opengalaxy().settings().receiver_tty.c_str());
 #ifdef DEBUG_SERIAL
-    if(retv && opengalaxy().syslog().get_level()>=Syslog::Level::Debug) pbuffer("read: ",(const unsigned char*)buf, retv);
+    if(retv <= count) opengalaxy().syslog().dump(Syslog::Level::Debug, "Serial: read: ", buf, retv);
 #endif
     return retv;
   }
@@ -177,12 +136,12 @@ size_t SerialPort::read(void* buf,size_t count)
 ///
 /// Returns the number of bytes written
 ///
-size_t SerialPort::write(void* buf,size_t count)
+size_t SerialPort::tty_write(void* buf,size_t count)
 {
   if(m_bIsOpen==true){
     opengalaxy().syslog().debug("Serial: Write %d byte(s) to %s", count, opengalaxy().settings().receiver_tty.c_str());
 #ifdef DEBUG_SERIAL
-    if(count && opengalaxy().syslog().get_level()>=Syslog::Level::Debug) pbuffer("write: ",(const unsigned char*)buf, count);
+    opengalaxy().syslog().dump(Syslog::Level::Debug, "Serial: write: ", buf, count);
 #endif
     size_t retv = ::write(m_nTTY,buf,count);
     fsync(m_nTTY); // flush cache (ie write immediately)
@@ -247,7 +206,7 @@ size_t SerialPort::write(void* buf,size_t count)
 ///
 /// Opens the serial port
 ///
-bool SerialPort::open(void)
+bool SerialPort::tty_open(void)
 {
   static const char *baudfmt =
     "baud=%d "  // opengalaxy().settings().receiver_baudrate
@@ -348,7 +307,7 @@ bool SerialPort::open(void)
 ///
 /// Closes the serial port
 ///
-void SerialPort::close(void)
+void SerialPort::tty_close(void)
 {
   if( m_bIsOpen == true ){
     CloseHandle( m_nTTY );
@@ -364,14 +323,14 @@ void SerialPort::close(void)
 ///
 /// Returns the number of bytes read
 ///
-size_t SerialPort::read(void* buf,size_t count)
+size_t SerialPort::tty_read(void* buf,size_t count)
 {
   if( m_bIsOpen == true ){
     size_t retv = 0;
     ReadFile( m_nTTY, buf, count, (LPDWORD)((void *)&retv), nullptr);
     if(retv) opengalaxy().syslog().debug("Serial: Read %d byte(s) from %s", retv, opengalaxy().settings().receiver_tty.c_str());
 #ifdef DEBUG_SERIAL
-    if(retv && opengalaxy().syslog().get_level()>=Syslog::Level::Debug) pbuffer("read: ",(const unsigned char*)buf, retv);
+    if(retv <= count) opengalaxy().syslog().dump(Syslog::Level::Debug, "Serial: read: ", buf, retv);
 #endif
     return retv;
   }
@@ -383,13 +342,13 @@ size_t SerialPort::read(void* buf,size_t count)
 ///
 /// Returns the number of bytes written
 ///
-size_t SerialPort::write(void* buf,size_t count)
+size_t SerialPort::tty_write(void* buf,size_t count)
 {
   if( m_bIsOpen == true ){
     size_t retv = 0;
     opengalaxy().syslog().debug("Serial: Write %d byte(s) to %s", count, opengalaxy().settings().receiver_tty.c_str());
 #ifdef DEBUG_SERIAL
-    if(count && opengalaxy().syslog().get_level()>=Syslog::Level::Debug) pbuffer("write: ",(const unsigned char*)buf, count);
+    opengalaxy().syslog().dump(Syslog::Level::Debug, "Serial: write: ", buf, count);
 #endif
     WriteFile( m_nTTY, buf, count, (LPDWORD)((void *)&retv), NULL);
     return retv;
@@ -399,5 +358,267 @@ size_t SerialPort::write(void* buf,size_t count)
 
 #endif // ends IF _WIN32
 
+
+///
+/// Class openGalaxy::SerialTrace implementation
+///
+
+SerialTrace::~SerialTrace()
+{
+  if(m_file) fclose(m_file);
+}
+
+bool SerialTrace::create(const char *filename, int baudrate)
+{
+  m_file = fopen(filename, "wb");
+  if(m_file == nullptr) return false;
+  header_t h;
+  memcpy(h.magic, "OGSERIAL", sizeof h.magic);
+  h.version = 1;
+  h.baudrate = baudrate;
+  m_start = std::chrono::steady_clock::now();
+  return fwrite(&h, sizeof h, 1, m_file) == 1 && fflush(m_file) == 0;
+}
+
+bool SerialTrace::open(const char *filename)
+{
+  m_file = fopen(filename, "rb");
+  if(m_file == nullptr) return false;
+  header_t h;
+  if(
+    fread(&h, sizeof h, 1, m_file) != 1 ||
+    memcmp(h.magic, "OGSERIAL", sizeof h.magic) != 0 ||
+    h.version != 1
+  ){
+    fclose(m_file);
+    m_file = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void SerialTrace::record(uint8_t direction, const void *buf, size_t count)
+{
+  if(m_file == nullptr || count == 0) return;
+  record_t r;
+  memset(&r, 0, sizeof r);
+  r.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+  r.length = count;
+  r.direction = direction;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  fwrite(&r, sizeof r, 1, m_file);
+  fwrite(buf, 1, count, m_file);
+  fflush(m_file); // keep the capture complete should the program crash
+}
+
+bool SerialTrace::next(uint8_t& direction, uint64_t& time, std::vector<unsigned char>& data)
+{
+  if(m_file == nullptr) return false;
+  record_t r;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if(fread(&r, sizeof r, 1, m_file) != 1) return false;
+  data.resize(r.length);
+  if(r.length && fread(data.data(), 1, r.length, m_file) != r.length) return false;
+  direction = r.direction;
+  time = r.time;
+  return true;
+}
+
+///
+/// Class openGalaxy::SerialPort implementation (common to all platforms)
+///
+
+SerialPort::~SerialPort()
+{
+  SerialPort::close();
+  if(m_trace) delete m_trace;
+  if(m_replay) delete m_replay;
+}
+
+///
+/// Opens the serial port,
+/// or the capture file to replay when the --replay option was used.
+///
+bool SerialPort::open(void)
+{
+  context_options& options = opengalaxy().m_options;
+
+  // A context for the benchmarks has no serial port
+  if(options.offline) return false;
+
+  if(options.replay_file.size()){
+    if(m_replay == nullptr){
+      m_replay = new SerialTrace();
+      if(m_replay->open(options.replay_file.c_str()) == false){
+        opengalaxy().syslog().error("Serial: Could not open capture file: %s", options.replay_file.c_str());
+        delete m_replay;
+        m_replay = nullptr;
+        return false;
+      }
+      opengalaxy().syslog().info(
+        "Serial: Replaying %s %s.",
+        options.replay_file.c_str(),
+        options.replay_fast ? "as fast as possible" : "at the recorded speed"
+      );
+    }
+    m_bIsOpen = true;
+    return true;
+  }
+
+  if(tty_open() == false) return false;
+
+  if(options.trace_file.size() && m_trace == nullptr){
+    m_trace = new SerialTrace();
+    if(m_trace->create(options.trace_file.c_str(), opengalaxy().settings().receiver_baudrate) == false){
+      opengalaxy().syslog().error("Serial: Could not create capture file: %s", options.trace_file.c_str());
+      delete m_trace;
+      m_trace = nullptr;
+    }
+    else {
+      opengalaxy().syslog().info("Serial: Recording to %s", options.trace_file.c_str());
+    }
+  }
+  return true;
+}
+
+///
+/// Closes the serial port
+///
+void SerialPort::close(void)
+{
+  if(m_replay){
+    m_bIsOpen = false;
+    return;
+  }
+  tty_close();
+}
+
+///
+/// Returns the file descriptor of the open serial port for the executor
+/// to watch, or -1 when there is none (Windows, replaying a capture)
+///
+int SerialPort::fd(void)
+{
+#if __linux__
+  if(m_replay == nullptr && m_bIsOpen == true) return m_nTTY;
+#endif
+  return -1;
+}
+
+///
+/// Returns true when read() returns without blocking
+/// (or when that can not be told)
+///
+bool SerialPort::pending(void)
+{
+#if __linux__
+  if(m_replay == nullptr && m_bIsOpen == true){
+    struct pollfd pfd;
+    pfd.fd = m_nTTY;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return ::poll(&pfd, 1, 0) > 0;
+  }
+#endif
+  return true;
+}
+
+///
+/// Reads from open serial port (or the capture being replayed)
+///
+/// This function blocks for a maximum of 1 second
+///  while receiving a maximum of 'count' bytes.
+///
+/// Returns the number of bytes read
+///
+size_t SerialPort::read(void* buf, size_t count)
+{
+  if(m_replay) return replay_read(buf, count);
+  size_t retv = tty_read(buf, count);
+  if(m_trace && retv <= count) m_trace->record(SerialTrace::read, buf, retv);
+  return retv;
+}
+
+///
+/// Writes to open serial port
+/// (or discards the data when replaying a capture or benchmarking)
+///
+/// Returns the number of bytes written
+///
+size_t SerialPort::write(void* buf, size_t count)
+{
+  if(opengalaxy().m_options.offline) return count;
+  if(m_replay){
+    opengalaxy().syslog().debug("Serial: Replay: discarding %d byte(s)", count);
+    return count;
+  }
+  if(m_trace) m_trace->record(SerialTrace::write, buf, count);
+  return tty_write(buf, count);
+}
+
+///
+/// Returns the next chunk of data that was read from the serial port
+/// in the capture being replayed. Waits until it is due unless the
+/// --replay-fast option was used.
+///
+size_t SerialPort::replay_read(void* buf, size_t count)
+{
+  using namespace std::chrono;
+
+  if(m_bIsOpen == false) return 0;
+
+  // Get the next chunk that was read from the serial port
+  while(m_replay_pos == m_replay_data.size()){
+    uint8_t direction;
+    if(m_replay_done || m_replay->next(direction, m_replay_time, m_replay_data) == false){
+      if(m_replay_done == false){
+        m_replay_done = true;
+        duration<double,std::milli> ms = steady_clock::now() - m_replay_start;
+        opengalaxy().syslog().info(
+          "Serial: Replay finished, %llu byte(s) in %.1f ms (%.0f bytes/s).",
+          m_replay_bytes, ms.count(), (ms.count() > 0) ? m_replay_bytes * 1000.0 / ms.count() : 0.0
+        );
+#if __linux__
+        // Let the signal handler exit the program
+        ::kill(getpid(), SIGTERM);
+#endif
+      }
+      m_replay_data.clear();
+      m_replay_pos = 0;
+      std::this_thread::sleep_for(seconds(1));
+      return 0;
+    }
+    m_replay_pos = 0;
+    if(direction != SerialTrace::read) m_replay_data.clear();
+    else if(m_replay_started == false){
+      m_replay_started = true;
+      m_replay_base = m_replay_time;
+      m_replay_start = steady_clock::now();
+    }
+  }
+
+  // Wait until the chunk is due (for at most 1 second)
+  if(opengalaxy().m_options.replay_fast == 0 && m_replay_pos == 0){
+    steady_clock::time_point due = m_replay_start + microseconds(m_replay_time - m_replay_base);
+    steady_clock::time_point now = steady_clock::now();
+    if(due - now > seconds(1)){
+      std::this_thread::sleep_for(seconds(1));
+      return 0;
+    }
+    if(due > now) std::this_thread::sleep_until(due);
+  }
+
+  size_t n = m_replay_data.size() - m_replay_pos;
+  if(n > count) n = count;
+  memcpy(buf, &m_replay_data[m_replay_pos], n);
+  m_replay_pos += n;
+  m_replay_bytes += n;
+  opengalaxy().syslog().debug("Serial: Read %d byte(s) from %s", n, opengalaxy().m_options.replay_file.c_str());
+#ifdef DEBUG_SERIAL
+  opengalaxy().syslog().dump(Syslog::Level::Debug, "Serial: read: ", buf, n);
+#endif
+  return n;
+}
+
 } // ends namespace openGalaxy
 
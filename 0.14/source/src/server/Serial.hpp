@@ -40,11 +40,72 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
 
 #include "opengalaxy.hpp"
 
 namespace openGalaxy {
 
+//
+// A binary capture of the data that went over the serial port.
+//
+// The file starts with a header:
+//
+//   char magic[8]      "OGSERIAL"
+//   uint32_t version   1
+//   uint32_t baudrate  the baudrate of the serial port
+//
+// followed by a record for every chunk of data that was read or written:
+//
+//   uint64_t time      microseconds since the capture was started (monotonic)
+//   uint32_t length    the number of bytes that follow the record header
+//   uint8_t direction  SerialTrace::read or SerialTrace::write
+//   uint8_t reserved[3]
+//
+// All values are in host byte order.
+//
+class SerialTrace {
+public:
+  enum : uint8_t {
+    read = '<',  // the chunk was read from the serial port
+    write = '>'  // the chunk was written to the serial port
+  };
+
+  ~SerialTrace();
+
+  // Creates a new capture file to record()
+  bool create(const char *filename, int baudrate);
+
+  // Opens an existing capture file to read the records with next()
+  bool open(const char *filename);
+
+  // Appends a record
+  void record(uint8_t direction, const void *buf, size_t count);
+
+  // Reads the next record, returns false at the end of the file
+  bool next(uint8_t& direction, uint64_t& time, std::vector<unsigned char>& data);
+
+private:
+  struct header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t baudrate;
+  };
+  struct record_t {
+    uint64_t time;
+    uint32_t length;
+    uint8_t direction;
+    uint8_t reserved[3];
+  };
+
+  FILE *m_file = nullptr;
+  std::mutex m_mutex;
+  std::chrono::steady_clock::time_point m_start;
+};
+
 class SerialPort {
 private:
   class openGalaxy& m_openGalaxy;
@@ -55,14 +116,37 @@ private:
   int m_nTTY;
   struct termios m_oldtio, m_tio;
 #endif
+
+  // Records the data when the --trace option was used
+  SerialTrace *m_trace = nullptr;
+
+  // Replaces the serial port when the --replay option was used
+  SerialTrace *m_replay = nullptr;
+  std::vector<unsigned char> m_replay_data; // the current chunk
+  size_t m_replay_pos = 0;                  // the number of bytes read from the current chunk
+  uint64_t m_replay_time = 0;               // the time of the current chunk
+  uint64_t m_replay_base = 0;               // the time of the first chunk
+  std::chrono::steady_clock::time_point m_replay_start;
+  unsigned long long m_replay_bytes = 0;
+  bool m_replay_started = false;
+  bool m_replay_done = false;
+
+  bool tty_open(void);
+  void tty_close(void);
+  size_t tty_read(void* buf, size_t count);
+  size_t tty_write(void* buf, size_t count);
+  size_t replay_read(void* buf, size_t count);
+
 public:
   SerialPort(openGalaxy& opengalaxy) : m_openGalaxy(opengalaxy) { m_bIsOpen = false; open(); }
-  ~SerialPort() { SerialPort::close(); }
+  ~SerialPort();
   bool isOpen() { return m_bIsOpen; }
   bool open(void);
   void close(void);
   size_t read(void* buf, size_t count);
   size_t write(void* buf, size_t count);
+  int fd(void);
+  bool pending(void);
 
   // Provide a method that refers to the top openGalaxy class
   inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
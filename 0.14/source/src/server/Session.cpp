@@ -32,6 +32,7 @@
 #include "opengalaxy.hpp"
 #include "json.h"
 #include "credentials.h"
+#include <sys/stat.h>
 
 namespace openGalaxy {
 
@@ -55,12 +56,16 @@ Session::Session(class Websocket* websocket)
   websocket_connected = 0;
   websocket_wsi = nullptr;
   websocket_pss = nullptr;
+  m_context = nullptr;
+  m_unused_timer.set([this]{ unused_timeout(); });
+  m_logoff_timer.set([this]{ logoff_timeout(); });
 }
 
 
 // dtor
 Session::~Session()
 {
+  m_context = nullptr; // (do not restart the timers)
   logoff();
   if(auth) delete auth;
 }
@@ -179,19 +184,24 @@ int Session::start(
     strncpy((*s)->session.sha256str, sha256finger.c_str(), 2*SSL_SHA256LEN+1);
     strncpy(session.sha256str, sha256finger.c_str(), 2*SSL_SHA256LEN+1);
 
-    // Existing Credentials?
+    // (Re)load the Credentials, from the cache if we have parsed this
+    // certificate before.
+    if((*s)->auth) delete (*s)->auth;
+    (*s)->auth = ctxpss->websocket->credentials_cache.get(sha256finger.c_str());
     if(!(*s)->auth){
-      // No, create a new auth:
+      // Not cached, create a new auth:
       (*s)->auth = new Credentials(
         *(ctxpss->websocket),
         sha256finger.c_str()
       );
-    }
-
-    if((*s)->auth->parse_cert(x509) == false){
-      delete (*s)->auth;
-      (*s)->auth = nullptr;
-      n = 1;
+      if((*s)->auth->parse_cert(x509) == false){
+        delete (*s)->auth;
+        (*s)->auth = nullptr;
+        n = 1;
+      }
+      else {
+        ctxpss->websocket->credentials_cache.add(*(*s)->auth);
+      }
     }
   }
   else {
@@ -217,6 +227,11 @@ int Session::add(Session *s, struct lws_context* context)
     }
   }
   ctxpss->sessions.append(s);
+
+  // Start the timeouts
+  s->m_context = context;
+  s->set_used();
+  s->set_active();
   return 0;
 }
 
@@ -297,37 +312,6 @@ void Session::remove(
 }
 
 
-// static function:
-// Remove sessions that have a disconnected client or were
-// started but never used, called periodicly by Websocket::Thread()
-void Session::check_timeouts_and_remove_unused_sessions(struct lws_context* context)
-{
-  using namespace std::chrono;
-
-  Websocket::ContextUserData *ctxpss =
-    (Websocket::ContextUserData *) lws_context_user(context);
-
-  auto end_tp = high_resolution_clock::now();
-  auto end_seconds = time_point_cast<seconds>(end_tp);
-  auto end_value = duration_cast<seconds>(end_seconds.time_since_epoch());
-
-  for(int i = 0; i < ctxpss->sessions.size(); i++){ // loop over all (unconnected) sessions
-    if(ctxpss->sessions[i]->http_connected == 0 && ctxpss->sessions[i]->websocket_connected == 0) {
-      auto start_seconds = time_point_cast<seconds>(ctxpss->sessions[i]->timeout_tp);
-      auto start_value = duration_cast<seconds>(start_seconds.time_since_epoch());
-      auto delta = end_value - start_value;
-
-      if(delta.count() < 0 || delta.count() > Session::unused_timeout_seconds){
-        ctxpss->websocket->opengalaxy().syslog().debug(
-          "Session: Timeout, deleting session %llX", ctxpss->sessions[i]->session.id
-        );
-        ctxpss->sessions.remove(i); // Timed out: Delete the unused session.
-      }
-    }
-  }
-}
-
-
 int Session::login(const char *username, const char *password)
 {
   logged_on = 0;
@@ -338,6 +322,13 @@ int Session::login(const char *username, const char *password)
     if(auth->username().compare(username) == 0){
       if(auth->password().compare(password) == 0){
         logged_on = 1;
+        // Start the inactivity timeout if it already expired
+        if(m_context && !m_logoff_timer.armed()){
+          using namespace std::chrono;
+          long long ms = opengalaxy().settings().session_timeout_seconds * 1000LL -
+            duration_cast<milliseconds>(high_resolution_clock::now() - last_activity_tp).count();
+          opengalaxy().websocket().timers.arm(m_logoff_timer, ms);
+        }
       }
       else {
         opengalaxy().syslog().debug("Session: password does not match!");
@@ -360,7 +351,7 @@ int Session::authorized()
 void Session::logoff()
 {
   logged_on = 0;
-  timeout_tp = std::chrono::high_resolution_clock::now();
+  set_used();
 }
 
 
@@ -368,53 +359,80 @@ void Session::logoff()
 void Session::set_active()
 {
   last_activity_tp = std::chrono::high_resolution_clock::now();
+  if(m_context){
+    opengalaxy().websocket().timers.arm(
+      m_logoff_timer,
+      opengalaxy().settings().session_timeout_seconds * 1000LL
+    );
+  }
 }
 
 
-// static function:
-// logoff clients whoms activity timer has timed out.
-// called periodicly by Websocket::Thread()
-void Session::logoff_timed_out_clients(struct lws_context* context)
+// reset the unused session timeout
+void Session::set_used()
 {
-  using namespace std::chrono;
-  Websocket::ContextUserData *ctxpss =
-    (Websocket::ContextUserData *) lws_context_user(context);
+  timeout_tp = std::chrono::high_resolution_clock::now();
+  if(m_context){
+    opengalaxy().websocket().timers.arm(m_unused_timer, unused_timeout_seconds * 1000LL);
+  }
+}
 
-  auto end_tp = high_resolution_clock::now();
-  auto end_seconds = time_point_cast<seconds>(end_tp);
-  auto end_value = duration_cast<seconds>(end_seconds.time_since_epoch());
 
+// Starts the unused session timeout if it already expired while the
+// client was still connected
+void Session::closed()
+{
+  if(m_context && http_connected == 0 && websocket_connected == 0 && !m_unused_timer.armed()){
+    using namespace std::chrono;
+    long long ms = unused_timeout_seconds * 1000LL -
+      duration_cast<milliseconds>(high_resolution_clock::now() - timeout_tp).count();
+    opengalaxy().websocket().timers.arm(m_unused_timer, ms);
+  }
+}
+
+
+// Called by m_unused_timer:
+// Deletes the session when the client is no longer connected
+// (or was never connected at all)
+void Session::unused_timeout()
+{
+  if(http_connected != 0 || websocket_connected != 0) return; // (see closed())
+  Websocket::ContextUserData *ctxpss =
+    (Websocket::ContextUserData *) lws_context_user(m_context);
   for(int i = 0; i < ctxpss->sessions.size(); i++){
-    if(ctxpss->sessions[i]->authorized()){
-      auto start_seconds = time_point_cast<seconds>(ctxpss->sessions[i]->last_activity_tp);
-      auto start_value = duration_cast<seconds>(start_seconds.time_since_epoch());
-      auto delta = end_value - start_value;
-
-      if(
-        (delta.count() < 0) ||
-        (
-          delta.count() >=
-          ctxpss->websocket->opengalaxy().settings().session_timeout_seconds
-        )
-      ){
-        ctxpss->sessions[i]->logoff();
-        ctxpss->websocket->opengalaxy().syslog().debug(
-          "Session: Logging off %s due to %d seconds of inactivity",
-          ctxpss->sessions[i]->auth->fullname().c_str(),
-          ctxpss->websocket->opengalaxy().settings().session_timeout_seconds
-        );
-        // Timed out: Logoff the client
-        ctxpss->websocket->WriteAuthorizationRequiredMessage(
-          ctxpss,
-          ctxpss->sessions[i]->session.id,
-          ctxpss->sessions[i]->auth->fullname(),
-          &ctxpss->sessions[i]->session
-        );
-      }
+    if(ctxpss->sessions[i] == this){
+      opengalaxy().syslog().debug(
+        "Session: Timeout, deleting session %llX", session.id
+      );
+      ctxpss->sessions.remove(i); // (deletes this session)
+      break;
     }
   }
 }
 
+
+// Called by m_logoff_timer:
+// Logs off the client after session_timeout_seconds of inactivity
+void Session::logoff_timeout()
+{
+  if(!authorized() || opengalaxy().m_options.auto_logoff != 1) return;
+  Websocket::ContextUserData *ctxpss =
+    (Websocket::ContextUserData *) lws_context_user(m_context);
+  logoff();
+  opengalaxy().syslog().debug(
+    "Session: Logging off %s due to %d seconds of inactivity",
+    auth->fullname().c_str(),
+    opengalaxy().settings().session_timeout_seconds
+  );
+  // Timed out: Logoff the client
+  ctxpss->websocket->WriteAuthorizationRequiredMessage(
+    ctxpss,
+    session.id,
+    auth->fullname(),
+    &session
+  );
+}
+
 //
 // class Credentials implementation:
 //
@@ -963,5 +981,70 @@ bool Credentials::parse_cert(X509 *cert)
   return true;
 }
 
+
+//
+// class CredentialsCache implementation:
+//
+
+void CredentialsCache::watch(
+  const std::string& fn_crl,
+  const std::string& path_crl,
+  const std::string& path_users
+){
+  m_fn_crl = fn_crl;
+  m_path_crl = path_crl;
+  m_path_users = path_users;
+  m_credentials.erase();
+  m_mtime = 0;
+}
+
+
+// Returns the newest modification time of the watched files/directories
+// (a directory is modified when a file is added to or removed from it).
+time_t CredentialsCache::newest_mtime(void)
+{
+  const std::string *paths[] = { &m_fn_crl, &m_path_crl, &m_path_users };
+  time_t newest = 0;
+  struct stat st;
+  for(unsigned int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++){
+    if(paths[i]->size() == 0) continue;
+    if(stat(paths[i]->c_str(), &st) == 0 && st.st_mtime > newest){
+      newest = st.st_mtime;
+    }
+  }
+  return newest;
+}
+
+
+Credentials *CredentialsCache::get(const char *sha256)
+{
+  // Drop everything when the CRL or user certificates have changed
+  time_t mtime = newest_mtime();
+  if(mtime != m_mtime){
+    m_credentials.erase();
+    m_mtime = mtime;
+    return nullptr;
+  }
+
+  for(int i = 0; i < m_credentials.size(); i++){
+    if(m_credentials[i]->sha256().compare(sha256) == 0){
+      return new Credentials(*m_credentials[i]);
+    }
+  }
+  return nullptr;
+}
+
+
+void CredentialsCache::add(Credentials& credentials)
+{
+  for(int i = 0; i < m_credentials.size(); i++){
+    if(m_credentials[i]->sha256().compare(credentials.sha256()) == 0){
+      m_credentials.remove(i);
+      break;
+    }
+  }
+  m_credentials.append(new Credentials(credentials));
+}
+
 } // ends namespace openGalaxy
 
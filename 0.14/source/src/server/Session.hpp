@@ -34,6 +34,7 @@
 #include "atomic.h"
 #include "opengalaxy.hpp"
 #include "session_id.hpp"
+#include "Subscription.hpp"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN 1
@@ -113,6 +114,41 @@ public:
 };
 
 
+// Credentials that were parsed from a client certificate, kept by the
+// SHA-256 fingerprint of that certificate.
+// Parsing a certificate verifies and decrypts the embedded credentials,
+// the cache makes sure this is done only once for each certificate.
+// The cache is emptied when the CRL or the user certificates change.
+// (Only used by the websocket thread.)
+//
+class CredentialsCache {
+private:
+  ObjectArray<Credentials*> m_credentials;
+
+  // The files and directories that invalidate the cache when they change,
+  // and the newest modification time seen for them.
+  std::string m_fn_crl;
+  std::string m_path_crl;
+  std::string m_path_users;
+  time_t m_mtime;
+
+  time_t newest_mtime(void);
+
+public:
+  CredentialsCache() : m_mtime(0) {}
+
+  // Sets the files and directories to watch.
+  void watch(const std::string& fn_crl, const std::string& path_crl, const std::string& path_users);
+
+  // Returns a new copy of the cached credentials (to be deleted by the
+  // caller) or nullptr if the certificate was not cached.
+  Credentials *get(const char *sha256);
+
+  // Adds (a copy of) successfully parsed credentials to the cache.
+  void add(Credentials& credentials);
+};
+
+
 // Sessions are used to keep track of whether a user is still connected
 // or not. And when using SSL client certificates are used also
 // to keep track of wheter the user has been authenticated or not.
@@ -129,6 +165,17 @@ private:
   // Timepoint representing the last client activity on all protocols.
   std::chrono::high_resolution_clock::time_point last_activity_tp;
 
+  // The context of the session list (set by add())
+  struct lws_context *m_context;
+
+  // Timers on Websocket::timers that delete the session when it has not
+  // been used for unused_timeout_seconds, and log off the client after
+  // settings().session_timeout_seconds of inactivity.
+  TimingWheel::Timer m_unused_timer;
+  TimingWheel::Timer m_logoff_timer;
+  void unused_timeout();
+  void logoff_timeout();
+
 public:
   // The number of seconds after which a session expires if left unused,
   // ie. a connection attempt was made but never established.
@@ -143,7 +190,7 @@ public:
   // The name for our session id in an URI query string (must include the final '=').
   constexpr static const char *query_string = "session_id=";
 
-  // The timepoint to use for the calculation of the activity timeout
+  // The timepoint to use for the calculation of the unused session timeout
   std::chrono::high_resolution_clock::time_point timeout_tp;
 
   // http protocol only:
@@ -157,7 +204,7 @@ public:
   int session_was_started;
 
   // !0 when the client is connected to the protocol 
-  // used to delete unused sessions in check_timeouts_and_remove_unused_sessions()
+  // used to delete unused sessions in unused_timeout()
   int http_connected; // (only set whilst serving a file)
   int websocket_connected;
 
@@ -166,6 +213,13 @@ public:
   struct lws *websocket_wsi;
   struct per_session_data_opengalaxy_protocol *websocket_pss;
 
+  // The SIA messages this client wants to receive (see the SUBSCRIBE command)
+  Subscription subscription;
+
+  // Arguments of a RESUME command received before the client logged on
+  // (answered after a successful login, empty if none)
+  std::string resume_args;
+
   // !0 when the client has logged on successfully
   // (ie. http_passwd is validated against cert_san_othername.password)
   int logged_on;
@@ -176,6 +230,8 @@ public:
   int authorized(); // query the logon status
   void logoff();       // explicit logoff
   void set_active();   // reset auto logoff timeout
+  void set_used();     // reset the unused session timeout
+  void closed();       // called when a connection of the session was closed
 
   // default ctor: creates new session id and initializes timeout_tp
   Session(class Websocket* websocket);
@@ -204,15 +260,6 @@ public:
   // delete a session from the global list off sessions
   static void remove(session_id& session, struct lws_context* context);
 
-  // called periodicly from the service loop to remove unused
-  // sessions from the global list off sessions
-  static void check_timeouts_and_remove_unused_sessions(struct lws_context* context);
-
-  // Loops through the global session list and logout inactive
-  // clients after opengalaxy->settings->session_timeout_seconds
-  // called periodicly from Websocket::Thread
-  static void logoff_timed_out_clients(struct lws_context* context);
-
 };
 
 }
@@ -169,7 +169,13 @@ Settings::Settings(openGalaxy *opengalaxy) : m_openGalaxy(opengalaxy)
   m_openGalaxy->syslog().set_level(syslog_level);
 
   // Read settings from configuration file
-  read( configfile.c_str() );
+  // (a context for the benchmarks uses the defaults, without output plugins)
+  if(m_openGalaxy->m_options.offline){
+    plugin_use_file = plugin_use_email = plugin_use_mysql = 0;
+  }
+  else {
+    read( configfile.c_str() );
+  }
 }
 
 Settings::~Settings()
@@ -199,6 +205,10 @@ void Settings::clear( void )
 #endif
   receiver_baudrate = -1;
   sia_use_alt_control_blocks = -1;
+  remote_session_idle_ms = -1;
+  ack_timeout_min_ms = -1;
+  panel_state_max_age = -1;
+  macros.clear();
   syslog_level = Syslog::Level::Invalid;
   plugin_use_email = -1;
   plugin_use_mysql = -1;
@@ -210,6 +220,11 @@ void Settings::clear( void )
   iface = "";
   http_port = -1;
   https_port = -1;
+  websocket_deflate = -1;
+  websocket_deflate_window_bits = -1;
+  websocket_deflate_mem_level = -1;
+  websocket_coalesce_ms = -1;
+  websocket_replay_size = -1;
 }
 
 // Sets a default value for any 'empty' values
@@ -269,6 +284,9 @@ void Settings::defaults( void )
 
   // SIA
   if( sia_use_alt_control_blocks == -1 ) sia_use_alt_control_blocks = default_sia_use_alt_control_blocks;
+  if( remote_session_idle_ms == -1 ) remote_session_idle_ms = default_remote_session_idle_ms;
+  if( ack_timeout_min_ms == -1 ) ack_timeout_min_ms = default_ack_timeout_min_ms;
+  if( panel_state_max_age == -1 ) panel_state_max_age = default_panel_state_max_age;
 
   // global
   if( syslog_level == Syslog::Level::Invalid ) syslog_level = default_log_level;
@@ -288,6 +306,13 @@ void Settings::defaults( void )
 
   if( http_port == -1 ) http_port = default_http_port;
   if( https_port == -1 ) https_port = default_https_port;
+
+  // websocket compression and frame coalescing
+  if( websocket_deflate == -1 ) websocket_deflate = default_websocket_deflate;
+  if( websocket_deflate_window_bits == -1 ) websocket_deflate_window_bits = default_websocket_deflate_window_bits;
+  if( websocket_deflate_mem_level == -1 ) websocket_deflate_mem_level = default_websocket_deflate_mem_level;
+  if( websocket_coalesce_ms == -1 ) websocket_coalesce_ms = default_websocket_coalesce_ms;
+  if( websocket_replay_size == -1 ) websocket_replay_size = default_websocket_replay_size;
 }
 
 bool Settings::read(const char* filename)
@@ -520,6 +545,54 @@ bool Settings::read(const char* filename)
         thread_safe_free( tmp );
       }
 
+      else if( strcmp( name, "REMOTE-SESSION-IDLE-MS" ) == 0 ){
+        int ms = strtol( value, NULL, 10 );
+        if( ms >= 0 && ms <= 60000 ) remote_session_idle_ms = ms;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("REMOTE-SESSION-IDLE-MS must be in the range 0 to 60000!");
+        }
+      }
+
+      else if( strcmp( name, "ACK-TIMEOUT-MIN-MS" ) == 0 ){
+        int ms = strtol( value, NULL, 10 );
+        if( ms >= 50 && ms <= SiaBlock::block_ack_timeout_ms ) ack_timeout_min_ms = ms;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("ACK-TIMEOUT-MIN-MS must be in the range 50 to 2000!");
+        }
+      }
+
+      else if( strcmp( name, "PANEL-STATE-MAX-AGE" ) == 0 ){
+        int age = strtol( value, NULL, 10 );
+        if( age >= 0 && age <= 3600 ) panel_state_max_age = age;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("PANEL-STATE-MAX-AGE must be in the range 0 to 3600!");
+        }
+      }
+
+      else if( strcmp( name, "MACRO" ) == 0 ){
+        // MACRO = <name> : <command> [; <command> ...]
+        char *mname = strtok_r( value, ":", &saveptr );
+        char *cmds = strtok_r( NULL, "", &saveptr );
+        std::string n, c;
+        if( mname ) for( char *s = mname; *s; s++ ) if( *s != ' ' && *s != '\t' ) n += toupper( *s );
+        if( cmds ){
+          for( char *s = strtok_r( cmds, ";", &saveptr ); s; s = strtok_r( NULL, ";", &saveptr ) ){
+            while( *s == ' ' || *s == '\t' ) s++;
+            if( *s == '\0' ) continue;
+            if( c.size() ) c += '\n';
+            c += s;
+          }
+        }
+        if( n.size() && c.size() && macros.count( n ) == 0 ) macros[n] = c;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("MACRO must be a unique name followed by ':' and one or more commands separated by ';'!");
+        }
+      }
+
       else if( strcmp( name, "DIP8" ) == 0 ){
         char *tmp = thread_safe_strdup( strtok_r( value, "", &saveptr ) );
         galaxy_dip8 = is_yes_or_no( tmp );
@@ -556,6 +629,49 @@ bool Settings::read(const char* filename)
         https_port = strtol( value, NULL, 10 );
       }
 
+      else if( strcmp( name, "WEBSOCKET-DEFLATE" ) == 0 ){
+        char *tmp = thread_safe_strdup( strtok_r( value, "", &saveptr ) );
+        websocket_deflate = is_yes_or_no( tmp );
+        thread_safe_free( tmp );
+      }
+
+      else if( strcmp( name, "WEBSOCKET-DEFLATE-WINDOW-BITS" ) == 0 ){
+        int bits = strtol( value, NULL, 10 );
+        // zlib does not support raw deflate with a window of 8 bits
+        if( bits >= 9 && bits <= 15 ) websocket_deflate_window_bits = bits;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("WEBSOCKET-DEFLATE-WINDOW-BITS must be in the range 9 to 15!");
+        }
+      }
+
+      else if( strcmp( name, "WEBSOCKET-DEFLATE-MEM-LEVEL" ) == 0 ){
+        int level = strtol( value, NULL, 10 );
+        if( level >= 1 && level <= 9 ) websocket_deflate_mem_level = level;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("WEBSOCKET-DEFLATE-MEM-LEVEL must be in the range 1 to 9!");
+        }
+      }
+
+      else if( strcmp( name, "WEBSOCKET-COALESCE-MS" ) == 0 ){
+        int ms = strtol( value, NULL, 10 );
+        if( ms >= 0 && ms <= 1000 ) websocket_coalesce_ms = ms;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("WEBSOCKET-COALESCE-MS must be in the range 0 to 1000!");
+        }
+      }
+
+      else if( strcmp( name, "WEBSOCKET-REPLAY-SIZE" ) == 0 ){
+        int size = strtol( value, NULL, 10 );
+        if( size >= 0 && size <= 65536 ) websocket_replay_size = size;
+        else {
+          opengalaxy().syslog().error( "Error: Error on line %d in configuration file: %s", line_nr, filename );
+          throw new std::runtime_error("WEBSOCKET-REPLAY-SIZE must be in the range 0 to 65536!");
+        }
+      }
+
       else {
         opengalaxy().syslog().error( "Error: Syntax error on line %d in configuration file: %s", line_nr, filename );
         throw new std::runtime_error("Syntax error!");
@@ -34,6 +34,8 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <map>
+#include <string>
 #if __linux__
 #include <termios.h>
 #endif
@@ -86,6 +88,15 @@ private:
   // default configuration values for the SIA receiver
   int default_sia_use_alt_control_blocks = 0;
 
+  // default time (in ms) to keep a remote login open after the last command (0 = login for every command)
+  int default_remote_session_idle_ms = 0;
+
+  // default lower limit (in ms) for the adaptive acknoledge timeout
+  int default_ack_timeout_min_ms = 250;
+
+  // default time (in seconds) a state query may be answered from the panel state model (0 = always ask the panel)
+  int default_panel_state_max_age = 0;
+
   // default global configuration values
   Syslog::Level default_log_level = Syslog::Level::Info;
   int default_use_plugin_email = 0;
@@ -114,6 +125,17 @@ private:
   int default_https_port = 443;
 #endif
 
+  // default permessage-deflate settings for the websocket
+  int default_websocket_deflate = 1;
+  int default_websocket_deflate_window_bits = 15;
+  int default_websocket_deflate_mem_level = 8;
+
+  // default time (in ms) to collect SIA messages into a single websocket frame (0 = disabled)
+  int default_websocket_coalesce_ms = 0;
+
+  // default number of broadcasted SIA messages kept for reconnecting clients (0 = disabled)
+  int default_websocket_replay_size = 256;
+
 
   void defaults( void );
 
@@ -145,6 +167,10 @@ public:
   int plugin_use_file = -1;         // Use the Textfile plugin true/false
   int galaxy_dip8 = -1;
   int sia_use_alt_control_blocks = -1;
+  int remote_session_idle_ms = -1;  // Time to keep a remote login open for queued commands (0 = disabled)
+  int ack_timeout_min_ms = -1;      // Lower limit for the time to wait for the panel to answer a block
+  int panel_state_max_age = -1;     // Max. age of the panel state model for answering queries (0 = disabled)
+  std::map<std::string, std::string> macros; // Command macros by name (the commands are separated by newlines)
 
   int session_timeout_seconds = -1;   // the time after which a login times out after inactivity
   int blacklist_timeout_minutes = -1; // the time after which a blaclisted ip address is removed from the list
@@ -154,6 +180,12 @@ public:
   int http_port = -1; // The port to use in HTTP mode
   int https_port = -1; // The port to use in HTTPS mode
 
+  int websocket_deflate = -1;              // Negotiate permessage-deflate with clients true/false
+  int websocket_deflate_window_bits = -1;  // LZ77 window size (9..15) used to compress outgoing frames
+  int websocket_deflate_mem_level = -1;    // zlib memory level (1..9) used to compress outgoing frames
+  int websocket_coalesce_ms = -1;          // Time to collect SIA messages into a single JSON array frame (0 = disabled)
+  int websocket_replay_size = -1;          // Number of SIA messages kept for clients that RESUME (0 = disabled)
+
   // Variables that have hardcoded values under Linux but
   // that are stored in the registry under Windows
   //
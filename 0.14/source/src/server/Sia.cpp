@@ -322,6 +322,7 @@ bool SIA::DecodeBlock_AccountId()
   str.assign((char*)sia_current.raw.block.message, sia_current.raw.block.header.block_length);
   sia_current.accountId = std::stoi(str, nullptr, 10);
   sia_current_HaveAccountID = true;
+  sia_current.tpReceived = sia_block_received;
 //  opengalaxy().syslog().debug("SIA: Account ID: %u", sia_current.accountId);
   return true; 
 }
@@ -787,6 +788,8 @@ SiaEvent* SIA::Decode(unsigned char* data, size_t size)
   // Append the new bytes to the bytes allready in the buffer
   //
   if(data != nullptr){
+    sia_buffer_last_read = std::chrono::steady_clock::now();
+    if(sia_buffer_counter == 0) sia_buffer_received = sia_buffer_last_read;
     memcpy(&sia_buffer[sia_buffer_counter], data, size);
     sia_buffer_counter += size;
   }
@@ -834,6 +837,7 @@ opengalaxy().syslog().debug("SIA: left shifting data 1 place");
         // or wait for more data.
         opengalaxy().syslog().error("SIA: unknown function code (0x%02X)", raw.block.function_code);
         if(sia_buffer_counter > 0){
+          Stats::add(opengalaxy().stats().sia_resync_bytes);
           for(t=1; t<sia_buffer_counter; t++) sia_buffer[t-1] = sia_buffer[t]; // Shift all bytes to the left
           sia_buffer_counter--;
           return Decode(nullptr, 0);
@@ -868,6 +872,7 @@ opengalaxy().syslog().debug("SIA: left shifting data 1 place");
       //
 
       opengalaxy().syslog().error("SIA: discarding block, invalid column parity.");
+      Stats::add(opengalaxy().stats().sia_parity_errors);
       for(t=1; t<sia_buffer_counter; t++) sia_buffer[t-1] = sia_buffer[t]; // shift buffer to the left
       sia_buffer_counter--;
       opengalaxy().receiver().TriggerReject();
@@ -903,9 +908,12 @@ opengalaxy().syslog().debug("SIA: left shifting data 1 place");
     }
 
     // Left shift the remaining bytes in the buffer
+    // (the remaining bytes arrived no later than the last read)
+    sia_block_received = sia_buffer_received;
     sia_buffer_counter -= block_size;
     if(sia_buffer_counter > 0){
       for(t=0; t<sia_buffer_counter; t++) sia_buffer[t] = sia_buffer[block_size + t];
+      sia_buffer_received = sia_buffer_last_read;
     }
       
     // Sanity check, input buffer cannot be lesser them empty
@@ -1032,6 +1040,7 @@ opengalaxy().syslog().debug("SIA: left shifting data 1 place");
     //
     if(retv == false){
       opengalaxy().syslog().error("SIA: failed to decode data block, function code 0x%02X", sia_current.raw.block.function_code);
+      Stats::add(opengalaxy().stats().sia_decode_errors);
       if(sia_current.raw.block.header.acknoledge_request == 1){
         switch(sia_current.raw.block.function_code){
            case SiaBlock::FunctionCode::alt_reject:
@@ -1084,6 +1093,8 @@ opengalaxy().syslog().debug("SIA: left shifting data 1 place");
 
           // Restore the raw event data block
           memcpy(out->raw.block.data, remember_me.block.data, SiaBlock::block_max);
+          out->tpDecoded = std::chrono::steady_clock::now();
+          opengalaxy().stats().count_event((out->event) ? out->event->letter_code.c_str() : nullptr);
 
           // Reset sia_current, remember_me and sia_current_HaveAccountID
           sia_current.Erase();
@@ -1103,6 +1114,8 @@ opengalaxy().syslog().debug("SIA: left shifting data 1 place");
 
           // Restore the raw event data block
           memcpy(out->raw.block.data, remember_me.block.data, SiaBlock::block_max);
+          out->tpDecoded = std::chrono::steady_clock::now();
+          opengalaxy().stats().count_event((out->event) ? out->event->letter_code.c_str() : nullptr);
 
           // Reset sia_current, remember_me and sia_current_HaveAccountID
           sia_current.Erase();
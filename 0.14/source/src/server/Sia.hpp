@@ -61,6 +61,13 @@ private:
   // Used by SIA::Decode() to see how many bytes are left in the in-buffer,
   int sia_buffer_counter = 0;
 
+  // Used by SIA::Decode() to timestamp events:
+  // when the first byte in sia_buffer was read, when data was last read and
+  // when the first byte of the block that is being decoded was read.
+  std::chrono::steady_clock::time_point sia_buffer_received;
+  std::chrono::steady_clock::time_point sia_buffer_last_read;
+  std::chrono::steady_clock::time_point sia_block_received;
+
   // SIA level of the transmitter (value is autodetected by received configuration blocks)
   int sia_level = 2;
 
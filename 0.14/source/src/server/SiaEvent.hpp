@@ -35,6 +35,8 @@
 
 #include "Siablock.hpp"
 #include "opengalaxy.hpp"
+#include "tmalloc.hpp"
+#include <chrono>
 #include <iomanip>
 #include <sstream>
 
@@ -72,6 +74,10 @@ public:
 class SiaEvent {
 public:
 
+  // (allocated from the pools of thread_safe_malloc())
+  static void *operator new(size_t size) { return thread_safe_malloc(size); }
+  static void operator delete(void *p) { thread_safe_free(p); }
+
   class Date {
   friend class SiaEvent;
   private:
@@ -179,6 +185,11 @@ public:
   std::string ascii;
   bool haveAscii;
 
+  // Timestamps used to measure the latency of the event
+  std::chrono::steady_clock::time_point tpReceived; // the first byte of the event was read from the serial port
+  std::chrono::steady_clock::time_point tpDecoded;  // the event was decoded
+  std::chrono::steady_clock::time_point tpDequeued; // the event was taken from the output queue
+
   // clear all values so we start anew
   void Erase(){
     raw.Erase();
@@ -216,6 +227,7 @@ public:
     haveUnits = false;
     ascii.erase();
     haveAscii = false;
+    tpReceived = tpDecoded = tpDequeued = std::chrono::steady_clock::time_point();
   }
 
   // constructors
@@ -260,6 +272,9 @@ public:
     haveUnits = ev.haveUnits;
     ascii.assign(ev.ascii);
     haveAscii = ev.haveAscii;
+    tpReceived = ev.tpReceived;
+    tpDecoded = ev.tpDecoded;
+    tpDequeued = ev.tpDequeued;
   }
 };
 
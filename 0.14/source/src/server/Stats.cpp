@@ -0,0 +1,384 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic.h"
+#include "opengalaxy.hpp"
+#include "Stats.hpp"
+
+#include <cmath>
+
+namespace openGalaxy {
+
+constexpr int LatencyHistogram::sub_bits;
+constexpr int LatencyHistogram::sub_buckets;
+constexpr int LatencyHistogram::max_bits;
+constexpr unsigned long long LatencyHistogram::max_us;
+constexpr int LatencyHistogram::buckets;
+constexpr int Stats::event_classes;
+
+// Returns the bucket for a value
+int LatencyHistogram::index(unsigned long long us)
+{
+  if(us < 2 * sub_buckets) return (int)us;
+  int msb = 63 - __builtin_clzll(us);
+  int shift = msb - sub_bits;
+  return shift * sub_buckets + (int)(us >> shift);
+}
+
+// Returns the highest value that is counted in a bucket
+unsigned long long LatencyHistogram::highest(int index)
+{
+  if(index < 2 * sub_buckets) return index;
+  int shift = index / sub_buckets - 1;
+  unsigned long long low = (unsigned long long)(index % sub_buckets + sub_buckets) << shift;
+  return low + (1ULL << shift) - 1;
+}
+
+void LatencyHistogram::record(unsigned long long us)
+{
+  if(us > max_us) us = max_us;
+  m_counts[index(us)].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(us, std::memory_order_relaxed);
+  unsigned long long v = m_min.load(std::memory_order_relaxed);
+  while(us < v && !m_min.compare_exchange_weak(v, us, std::memory_order_relaxed));
+  v = m_max.load(std::memory_order_relaxed);
+  while(us > v && !m_max.compare_exchange_weak(v, us, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::summary(Summary& out) const
+{
+  // Take a copy of the buckets so the percentiles all come from the same
+  // set of samples (records made while copying may be partially included)
+  unsigned long long counts[buckets];
+  unsigned long long total = 0;
+  for(int i = 0; i < buckets; i++){
+    counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  out.count = total;
+  out.sum = m_sum.load(std::memory_order_relaxed);
+  if(total == 0){
+    out.sum = out.min = out.mean = out.p50 = out.p90 = out.p99 = out.p999 = out.max = 0;
+    return;
+  }
+  out.min = m_min.load(std::memory_order_relaxed);
+  out.max = m_max.load(std::memory_order_relaxed);
+  unsigned long long n = m_count.load(std::memory_order_relaxed);
+  out.mean = (n) ? out.sum / n : 0;
+
+  struct { double fraction; unsigned long long *value; } pct[] = {
+    { 0.5, &out.p50 }, { 0.9, &out.p90 }, { 0.99, &out.p99 }, { 0.999, &out.p999 }
+  };
+  unsigned long long seen = 0;
+  int p = 0, i = 0;
+  for(; i < buckets && p < 4; i++){
+    seen += counts[i];
+    while(p < 4 && seen > 0 && seen >= (unsigned long long)ceil(pct[p].fraction * total)){
+      *pct[p].value = highest(i);
+      p++;
+    }
+  }
+  for(; p < 4; p++) *pct[p].value = out.max;
+
+  // Never report a percentile beyond the largest value recorded
+  for(p = 0; p < 4; p++){
+    if(*pct[p].value > out.max) *pct[p].value = out.max;
+  }
+}
+
+void LatencyHistogram::reset()
+{
+  for(int i = 0; i < buckets; i++) m_counts[i].store(0, std::memory_order_relaxed);
+  m_count.store(0, std::memory_order_relaxed);
+  m_sum.store(0, std::memory_order_relaxed);
+  m_min.store(max_us, std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+
+Stats::Stats(class openGalaxy& opengalaxy)
+ : m_openGalaxy(opengalaxy)
+{
+  for(auto& c : sia_events) c.store(0);
+  sia_parity_errors.store(0);
+  sia_resync_bytes.store(0);
+  sia_decode_errors.store(0);
+  transmit_retries.store(0);
+  transmit_rejects.store(0);
+  transmit_failures.store(0);
+  transmit_queue_depth.store(0);
+  output_queue_depth.store(0);
+  broadcast_queue_depth.store(0);
+  broadcast_started.store(0);
+  m_since = std::chrono::steady_clock::now();
+}
+
+Stats::~Stats()
+{
+  for(auto p : m_plugins) delete p;
+}
+
+void Stats::count_event(const char *letter_code)
+{
+  int c = (letter_code) ? letter_code[0] : 0;
+  add(sia_events[(c >= 'A' && c <= 'Z') ? c - 'A' : event_classes - 1]);
+}
+
+PluginStats *Stats::add_plugin(const char *name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  PluginStats *p = new PluginStats(name);
+  m_plugins.push_back(p);
+  return p;
+}
+
+// Clears the latency histograms (the /metrics counters keep counting)
+void Stats::reset()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for(auto& h : m_stages) h.reset();
+  for(auto p : m_plugins) p->latency.reset();
+  m_since = std::chrono::steady_clock::now();
+}
+
+// Appends "name":[count,min,mean,p50,p90,p99,p99.9,max]
+void Stats::json_histogram(std::string& out, const char *name, const LatencyHistogram& h)
+{
+  LatencyHistogram::Summary s;
+  char buf[256];
+  h.summary(s);
+  snprintf(
+    buf, sizeof(buf), "\"%s\":[%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu]",
+    name, s.count, s.min, s.mean, s.p50, s.p90, s.p99, s.p999, s.max
+  );
+  out.append(buf);
+}
+
+void Stats::json(std::string& out)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  char buf[256];
+
+  snprintf(
+    buf, sizeof(buf),
+    "{\"unit\":\"us\",\"since\":%lld,"
+    "\"fields\":[\"count\",\"min\",\"mean\",\"p50\",\"p90\",\"p99\",\"p99.9\",\"max\"],",
+    (long long)std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now() - m_since
+    ).count()
+  );
+  out.append(buf);
+
+  out.append("\"event\":{");
+  json_histogram(out, "decode", histogram(stage::event_decode));
+  out.append(",");
+  json_histogram(out, "queue", histogram(stage::event_queue));
+  out.append(",");
+  json_histogram(out, "websocket", histogram(stage::event_websocket));
+  out.append(",");
+  json_histogram(out, "total", histogram(stage::event_total));
+  out.append("},\"plugin\":{");
+  for(size_t i = 0; i < m_plugins.size(); i++){
+    if(i) out.append(",");
+    json_histogram(out, m_plugins[i]->name.c_str(), m_plugins[i]->latency);
+  }
+  out.append("},\"command\":{");
+  json_histogram(out, "queue", histogram(stage::command_queue));
+  out.append(",");
+  json_histogram(out, "transmitQueue", histogram(stage::transmit_queue));
+  out.append(",");
+  json_histogram(out, "login", histogram(stage::transmit_login));
+  out.append(",");
+  json_histogram(out, "reply", histogram(stage::transmit_reply));
+  out.append(",");
+  json_histogram(out, "total", histogram(stage::transmit_total));
+  out.append("},");
+  json_histogram(out, "poll", histogram(stage::poll));
+  out.append(",");
+
+  // The current estimates used by the receiver to time out the panel (in milliseconds)
+  Receiver::LinkEstimate login = opengalaxy().receiver().loginEstimate();
+  Receiver::LinkEstimate command = opengalaxy().receiver().commandEstimate();
+  snprintf(
+    buf, sizeof(buf),
+    "\"link\":{\"unit\":\"ms\",\"login\":[%d,%d,%d,%lu],\"command\":[%d,%d,%d,%lu]}}",
+    login.srtt, login.rttvar, login.rto, login.samples,
+    command.srtt, command.rttvar, command.rto, command.samples
+  );
+  out.append(buf);
+}
+
+// Appends a latency histogram as a Prometheus summary (in seconds)
+void Stats::metrics_summary(std::string& out, const char *name, const char *labels, const LatencyHistogram& h)
+{
+  LatencyHistogram::Summary s;
+  char buf[512];
+  h.summary(s);
+  const char *sep = (labels[0]) ? "," : "";
+  snprintf(
+    buf, sizeof(buf),
+    "%s{%s%squantile=\"0.5\"} %.6f\n"
+    "%s{%s%squantile=\"0.9\"} %.6f\n"
+    "%s{%s%squantile=\"0.99\"} %.6f\n"
+    "%s{%s%squantile=\"0.999\"} %.6f\n"
+    "%s_sum{%s} %.6f\n"
+    "%s_count{%s} %llu\n",
+    name, labels, sep, s.p50 / 1e6,
+    name, labels, sep, s.p90 / 1e6,
+    name, labels, sep, s.p99 / 1e6,
+    name, labels, sep, s.p999 / 1e6,
+    name, labels, s.sum / 1e6,
+    name, labels, s.count
+  );
+  out.append(buf);
+}
+
+void Stats::metrics(std::string& out)
+{
+  // Names of the latency stages as used for the 'stage' label
+  static const char *stage_names[] = {
+    "event_decode", "event_queue", "event_websocket", "event_total",
+    "command_queue", "transmit_queue", "transmit_login", "transmit_reply",
+    "transmit_total", "poll"
+  };
+  static_assert(
+    sizeof(stage_names) / sizeof(stage_names[0]) == static_cast<int>(stage::count),
+    "Stats: a stage is missing in stage_names[]"
+  );
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  char buf[256];
+
+  out.append(
+    "# HELP opengalaxy_sia_events_total SIA events decoded, by the first letter of the event code.\n"
+    "# TYPE opengalaxy_sia_events_total counter\n"
+  );
+  for(int i = 0; i < event_classes; i++){
+    unsigned long n = sia_events[i].load(std::memory_order_relaxed);
+    if(n == 0) continue;
+    if(i < event_classes - 1) snprintf(buf, sizeof(buf), "opengalaxy_sia_events_total{class=\"%c\"} %lu\n", 'A' + i, n);
+    else snprintf(buf, sizeof(buf), "opengalaxy_sia_events_total{class=\"other\"} %lu\n", n);
+    out.append(buf);
+  }
+
+  struct { const char *name, *type, *help; unsigned long long value; } values[] = {
+    { "opengalaxy_sia_parity_errors_total", "counter",
+      "SIA blocks discarded because of a column parity error.", sia_parity_errors.load(std::memory_order_relaxed) },
+    { "opengalaxy_sia_resync_bytes_total", "counter",
+      "Bytes skipped looking for the start of a SIA block.", sia_resync_bytes.load(std::memory_order_relaxed) },
+    { "opengalaxy_sia_decode_errors_total", "counter",
+      "SIA blocks that could not be decoded.", sia_decode_errors.load(std::memory_order_relaxed) },
+    { "opengalaxy_transmit_queue_depth", "gauge",
+      "Blocks waiting to be send to the panel.", (unsigned long long)transmit_queue_depth.load(std::memory_order_relaxed) },
+    { "opengalaxy_transmit_retries_total", "counter",
+      "Blocks send to the panel again after a timeout or reject.", transmit_retries.load(std::memory_order_relaxed) },
+    { "opengalaxy_transmit_rejects_total", "counter",
+      "Remote logins and commands rejected by the panel.", transmit_rejects.load(std::memory_order_relaxed) },
+    { "opengalaxy_transmit_failures_total", "counter",
+      "Blocks dropped without an answer from the panel.", transmit_failures.load(std::memory_order_relaxed) },
+    { "opengalaxy_output_queue_depth", "gauge",
+      "SIA events waiting to be output.", (unsigned long long)output_queue_depth.load(std::memory_order_relaxed) },
+    { "opengalaxy_websocket_sessions", "gauge",
+      "Connected websocket clients.", (unsigned long long)opengalaxy().websocket().clients() },
+    { "opengalaxy_websocket_broadcast_queue_depth", "gauge",
+      "Messages waiting to be written to the websocket clients.", (unsigned long long)broadcast_queue_depth.load(std::memory_order_relaxed) },
+  };
+  for(auto& v : values){
+    snprintf(
+      buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n%s %llu\n",
+      v.name, v.help, v.name, v.type, v.name, v.value
+    );
+    out.append(buf);
+  }
+
+  // How long the websocket clients have been busy with the current message
+  long long started = broadcast_started.load(std::memory_order_relaxed);
+  double lag = 0;
+  if(started){
+    std::chrono::steady_clock::duration d =
+      std::chrono::steady_clock::now().time_since_epoch() -
+      std::chrono::steady_clock::duration(started);
+    lag = std::chrono::duration<double>(d).count();
+    if(lag < 0) lag = 0;
+  }
+  snprintf(
+    buf, sizeof(buf),
+    "# HELP opengalaxy_websocket_broadcast_lag_seconds Time the websocket clients have been writing the current message.\n"
+    "# TYPE opengalaxy_websocket_broadcast_lag_seconds gauge\n"
+    "opengalaxy_websocket_broadcast_lag_seconds %.6f\n",
+    lag
+  );
+  out.append(buf);
+
+  out.append(
+    "# HELP opengalaxy_output_plugin_queue_depth SIA events waiting to be handled by an output plugin.\n"
+    "# TYPE opengalaxy_output_plugin_queue_depth gauge\n"
+  );
+  for(auto p : m_plugins){
+    snprintf(
+      buf, sizeof(buf), "opengalaxy_output_plugin_queue_depth{plugin=\"%s\"} %d\n",
+      p->name.c_str(), p->queue_depth.load(std::memory_order_relaxed)
+    );
+    out.append(buf);
+  }
+  out.append(
+    "# HELP opengalaxy_output_plugin_failures_total SIA events an output plugin failed to output.\n"
+    "# TYPE opengalaxy_output_plugin_failures_total counter\n"
+  );
+  for(auto p : m_plugins){
+    snprintf(
+      buf, sizeof(buf), "opengalaxy_output_plugin_failures_total{plugin=\"%s\"} %lu\n",
+      p->name.c_str(), p->failures.load(std::memory_order_relaxed)
+    );
+    out.append(buf);
+  }
+
+  out.append(
+    "# HELP opengalaxy_latency_seconds Latency of the stages SIA events and commands pass through.\n"
+    "# TYPE opengalaxy_latency_seconds summary\n"
+  );
+  for(int i = 0; i < static_cast<int>(stage::count); i++){
+    snprintf(buf, sizeof(buf), "stage=\"%s\"", stage_names[i]);
+    metrics_summary(out, "opengalaxy_latency_seconds", buf, m_stages[i]);
+  }
+  out.append(
+    "# HELP opengalaxy_output_plugin_latency_seconds Time from reading a SIA event to an output plugin being done with it.\n"
+    "# TYPE opengalaxy_output_plugin_latency_seconds summary\n"
+  );
+  for(auto p : m_plugins){
+    snprintf(buf, sizeof(buf), "plugin=\"%s\"", p->name.c_str());
+    metrics_summary(out, "opengalaxy_output_plugin_latency_seconds", buf, p->latency);
+  }
+}
+
+} // ends namespace openGalaxy
+
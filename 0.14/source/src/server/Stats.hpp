@@ -0,0 +1,214 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __OPENGALAXY_SERVER_STATS_HPP__
+#define __OPENGALAXY_SERVER_STATS_HPP__
+
+#include "atomic.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opengalaxy.hpp"
+
+namespace openGalaxy {
+
+// A histogram of latencies (in microseconds) that any thread may add to
+// without locking.
+//
+// Values below 32 are counted exactly. Above that, each power of two is
+// split into 16 buckets, so a value reported from the histogram is at
+// most 1/16th larger than the measured one (like HdrHistogram does with
+// one significant digit). Values beyond max_us (about 19 hours) are
+// counted as max_us.
+class LatencyHistogram {
+public:
+  constexpr static int sub_bits = 4;
+  constexpr static int sub_buckets = 1 << sub_bits;
+  constexpr static int max_bits = 36;
+  constexpr static unsigned long long max_us = (1ULL << max_bits) - 1;
+  constexpr static int buckets = (max_bits - sub_bits + 1) * sub_buckets;
+
+  // The distribution of the recorded values (all in microseconds)
+  struct Summary {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long mean;
+    unsigned long long p50;
+    unsigned long long p90;
+    unsigned long long p99;
+    unsigned long long p999;
+    unsigned long long max;
+  };
+
+private:
+  std::atomic<unsigned long long> m_counts[buckets];
+  std::atomic<unsigned long long> m_count;
+  std::atomic<unsigned long long> m_sum;
+  std::atomic<unsigned long long> m_min;
+  std::atomic<unsigned long long> m_max;
+
+  static int index(unsigned long long us);
+  static unsigned long long highest(int index);
+
+public:
+  LatencyHistogram() { reset(); }
+
+  void record(unsigned long long us);
+
+  // Records a duration (negative durations are counted as 0)
+  template<class Rep, class Period> void record(std::chrono::duration<Rep, Period> d){
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    record((us > 0) ? (unsigned long long)us : 0);
+  }
+
+  // Records the time that has passed since 'from'
+  void record_since(std::chrono::steady_clock::time_point from){
+    record(std::chrono::steady_clock::now() - from);
+  }
+
+  void summary(Summary& out) const;
+  void reset();
+};
+
+
+// Statistics for a single output plugin
+class PluginStats {
+public:
+  std::string name;
+  LatencyHistogram latency;           // first byte of an event read -> plugin done with it
+  std::atomic<int> queue_depth;       // events waiting to be handled by the plugin
+  std::atomic<unsigned long> failures; // events the plugin failed to output
+
+  PluginStats(const char *n) : name(n), queue_depth(0), failures(0) {}
+};
+
+
+// Latency statistics for the path of a SIA event from the serial port to
+// the websocket clients and output plugins, and for the path of a command
+// from a client to the panel and back.
+//
+// Also holds the counters and gauges served by the /metrics endpoint.
+// These are plain atomics that are updated where things happen and are
+// only read by the HTTP server, so a scrape never locks out the threads
+// that receive events or talk to the panel.
+class Stats {
+public:
+
+  // The measured stages
+  enum class stage : unsigned int {
+    event_decode = 0, // first byte of an event read from the serial port -> event decoded
+    event_queue,      // event decoded -> taken from the output queue
+    event_websocket,  // taken from the output queue -> written to a websocket client (once per client)
+    event_total,      // first byte read -> written to a websocket client (alarm-to-screen)
+    command_queue,    // command received from a client -> executed by the commander
+    transmit_queue,   // block queued for the panel -> send to the panel
+    transmit_login,   // remote login send -> answered by the panel
+    transmit_reply,   // block send -> answered by the panel
+    transmit_total,   // block queued for the panel -> answer passed back
+    poll,             // poll started -> result passed to the polling clients
+    count
+  };
+
+  // Event code classes counted by count_event() ('A' to 'Z' and other)
+  constexpr static int event_classes = 27;
+
+  // Counters (only ever incremented)
+  std::atomic<unsigned long> sia_events[event_classes]; // decoded events per class of event code
+  std::atomic<unsigned long> sia_parity_errors;  // blocks discarded because of a column parity error
+  std::atomic<unsigned long> sia_resync_bytes;   // bytes skipped looking for the start of a block
+  std::atomic<unsigned long> sia_decode_errors;  // blocks that could not be decoded
+  std::atomic<unsigned long> transmit_retries;   // blocks send again after a timeout or reject
+  std::atomic<unsigned long> transmit_rejects;   // logins and commands rejected by the panel
+  std::atomic<unsigned long> transmit_failures;  // blocks that were dropped without an answer
+
+  // Gauges
+  std::atomic<int> transmit_queue_depth;         // blocks waiting to be send to the panel
+  std::atomic<int> output_queue_depth;           // events waiting to be output
+  std::atomic<int> broadcast_queue_depth;        // messages waiting to be written to websocket clients
+  std::atomic<long long> broadcast_started;      // steady_clock ticks when the message being written
+                                                 // to the websocket clients was scheduled (0 = idle)
+
+  // Increments a counter
+  static inline void add(std::atomic<unsigned long>& counter){
+    counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Counts a decoded event by the first letter of its event code
+  void count_event(const char *letter_code);
+
+private:
+  class openGalaxy& m_openGalaxy;
+
+  LatencyHistogram m_stages[static_cast<int>(stage::count)];
+
+  // Statistics for the output plugins
+  // (Plugins are only added at startup, m_mutex protects the list itself)
+  std::mutex m_mutex;
+  std::vector<PluginStats*> m_plugins;
+
+  // When the histograms were last reset
+  std::chrono::steady_clock::time_point m_since;
+
+  static void json_histogram(std::string& out, const char *name, const LatencyHistogram& h);
+  static void metrics_summary(std::string& out, const char *name, const char *labels, const LatencyHistogram& h);
+
+public:
+  Stats(class openGalaxy& opengalaxy);
+  ~Stats();
+
+  template<class Rep, class Period> void record(stage s, std::chrono::duration<Rep, Period> d){
+    m_stages[static_cast<int>(s)].record(d);
+  }
+
+  inline LatencyHistogram& histogram(stage s) { return m_stages[static_cast<int>(s)]; }
+
+  // Adds the statistics for an output plugin (called by class Output)
+  PluginStats *add_plugin(const char *name);
+
+  // Clears all histograms
+  void reset();
+
+  // Appends all statistics to 'out' as a JSON object
+  void json(std::string& out);
+
+  // Appends the counters, gauges and latencies to 'out'
+  // in the Prometheus text exposition format
+  void metrics(std::string& out);
+
+  // Provide a method that refers to the top openGalaxy class
+  inline class openGalaxy& opengalaxy(){ return m_openGalaxy; }
+};
+
+} // ends namespace openGalaxy
+
+#endif
@@ -0,0 +1,231 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic.h"
+#include "opengalaxy.hpp"
+#include "Subscription.hpp"
+
+#include <strings.h>
+
+namespace openGalaxy {
+
+void Subscription::Event::set(SiaEvent& msg)
+{
+  account = msg.accountId;
+  area = -1;
+  zone = -1;
+  code[0] = code[1] = code[2] = '\0';
+  if(msg.haveAreaId) area = msg.areaId;
+  if(msg.haveEvent && msg.event){
+    strncpy(code, msg.event->letter_code.c_str(), 2);
+    if(msg.addressNumber > 0){
+      if(msg.event->address_field == SiaEventCode::AddressField::zone){
+        zone = msg.addressNumber;
+      }
+      else if(area < 0 && msg.event->address_field == SiaEventCode::AddressField::area){
+        area = msg.addressNumber;
+      }
+    }
+  }
+}
+
+
+void Subscription::clear()
+{
+  m_all = true;
+  n_accounts = 0;
+  areas = 0;
+  n_zones = 0;
+  n_codes = 0;
+}
+
+
+bool Subscription::parse(const char *args, std::string& error)
+{
+  Subscription tmp;
+  char buf[256];
+  char *save1, *save2;
+
+  snprintf(buf, sizeof(buf), "%s", (args) ? args : "");
+
+  for(char *key = strtok_r(buf, " \t\r\n", &save1); key; key = strtok_r(nullptr, " \t\r\n", &save1)){
+
+    if(strcasecmp(key, "ALL") == 0){
+      tmp.clear();
+      continue;
+    }
+
+    // Every other keyword takes a comma separated list of values
+    char *list = strtok_r(nullptr, " \t\r\n", &save1);
+    if(!list){
+      error = "Missing value(s) for ";
+      error += key;
+      return false;
+    }
+
+    for(char *v = strtok_r(list, ",", &save2); v; v = strtok_r(nullptr, ",", &save2)){
+      if(strcasecmp(key, "ACCOUNT") == 0){
+        char *end;
+        long n = strtol(v, &end, 10);
+        if(*end || n < 0 || tmp.n_accounts >= max_accounts){
+          error = "Invalid or too many accounts";
+          return false;
+        }
+        tmp.accounts[tmp.n_accounts++] = n;
+      }
+      else if(strcasecmp(key, "AREA") == 0){
+        int n = Commander::isArea(v);
+        if(n < 1){
+          error = "Invalid area: ";
+          error += v;
+          return false;
+        }
+        tmp.areas |= 1UL << (n - 1);
+      }
+      else if(strcasecmp(key, "ZONE") == 0){
+        char *end;
+        long lo = strtol(v, &end, 10), hi = lo;
+        if(*end == '-') hi = strtol(end + 1, &end, 10);
+        if(*end || lo < 0 || hi < lo || tmp.n_zones >= max_zone_ranges){
+          error = "Invalid or too many zone ranges";
+          return false;
+        }
+        tmp.zones[tmp.n_zones][0] = lo;
+        tmp.zones[tmp.n_zones][1] = hi;
+        tmp.n_zones++;
+      }
+      else if(strcasecmp(key, "EVENT") == 0){
+        size_t len = strlen(v);
+        if(len < 1 || len > 2 || tmp.n_codes >= max_codes){
+          error = "Invalid or too many event codes";
+          return false;
+        }
+        tmp.codes[tmp.n_codes][0] = toupper(v[0]);
+        tmp.codes[tmp.n_codes][1] = (len > 1) ? toupper(v[1]) : '\0';
+        tmp.codes[tmp.n_codes][2] = '\0';
+        tmp.n_codes++;
+      }
+      else {
+        error = "Unknown keyword: ";
+        error += key;
+        return false;
+      }
+      tmp.m_all = false;
+    }
+  }
+
+  *this = tmp;
+  return true;
+}
+
+
+bool Subscription::match(const Event& ev) const
+{
+  if(m_all) return true;
+
+  if(n_accounts){
+    int i;
+    for(i = 0; i < n_accounts; i++) if(accounts[i] == ev.account) break;
+    if(i == n_accounts) return false;
+  }
+
+  if(areas){
+    if(ev.area < 1 || ev.area > 32) return false;
+    if(!(areas & (1UL << (ev.area - 1)))) return false;
+  }
+
+  if(n_zones){
+    int i;
+    if(ev.zone < 0) return false;
+    for(i = 0; i < n_zones; i++) if(ev.zone >= zones[i][0] && ev.zone <= zones[i][1]) break;
+    if(i == n_zones) return false;
+  }
+
+  if(n_codes){
+    int i;
+    for(i = 0; i < n_codes; i++){
+      if(codes[i][0] != ev.code[0]) continue;
+      if(codes[i][1] == '\0' || codes[i][1] == ev.code[1]) break;
+    }
+    if(i == n_codes) return false;
+  }
+
+  return true;
+}
+
+
+void Subscription::describe(std::string& out) const
+{
+  char buf[32];
+  out.clear();
+  if(m_all){
+    out = "ALL";
+    return;
+  }
+  if(n_accounts){
+    out += "ACCOUNT ";
+    for(int i = 0; i < n_accounts; i++){
+      snprintf(buf, sizeof(buf), (i) ? ",%d" : "%d", accounts[i]);
+      out += buf;
+    }
+  }
+  if(areas){
+    if(out.size()) out += ' ';
+    out += "AREA ";
+    bool first = true;
+    for(int i = 0; i < 32; i++){
+      if(!(areas & (1UL << i))) continue;
+      snprintf(buf, sizeof(buf), (first) ? "%d" : ",%d", i + 1);
+      out += buf;
+      first = false;
+    }
+  }
+  if(n_zones){
+    if(out.size()) out += ' ';
+    out += "ZONE ";
+    for(int i = 0; i < n_zones; i++){
+      if(i) out += ',';
+      if(zones[i][0] == zones[i][1]) snprintf(buf, sizeof(buf), "%d", zones[i][0]);
+      else snprintf(buf, sizeof(buf), "%d-%d", zones[i][0], zones[i][1]);
+      out += buf;
+    }
+  }
+  if(n_codes){
+    if(out.size()) out += ' ';
+    out += "EVENT ";
+    for(int i = 0; i < n_codes; i++){
+      if(i) out += ',';
+      out += codes[i];
+    }
+  }
+}
+
+} // ends namespace openGalaxy
+
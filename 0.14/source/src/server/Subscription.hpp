@@ -0,0 +1,97 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OPENGALAXY_SERVER_SUBSCRIPTION_HPP__
+#define __OPENGALAXY_SERVER_SUBSCRIPTION_HPP__
+
+#include "atomic.h"
+#include <string>
+
+namespace openGalaxy {
+
+class SiaEvent;
+
+// The SIA messages a websocket session wants to receive.
+//
+// A subscription selects messages by account, area, zone (ranges) and
+// event code (or event code class, ie. the first letter). Values within one
+// category are OR'ed, the categories themselves are AND'ed. An empty
+// category matches every message.
+//
+class Subscription {
+public:
+
+  constexpr static int max_accounts = 8;
+  constexpr static int max_zone_ranges = 16;
+  constexpr static int max_codes = 16;
+
+  // The fields of a SIA message that a subscription is matched against,
+  // extracted once for each message.
+  struct Event {
+    int account;   // account id
+    int area;      // area number (1-32), or -1 if the message has no area
+    int zone;      // zone number, or -1 if the message has no zone
+    char code[3];  // SIA event letter code
+    void set(SiaEvent& msg);
+  };
+
+private:
+  bool m_all;                 // true when subscribed to everything
+  int n_accounts;
+  int accounts[max_accounts];
+  unsigned long areas;        // bit n-1 is set for area n
+  int n_zones;
+  int zones[max_zone_ranges][2];
+  int n_codes;
+  char codes[max_codes][3];   // "X" matches a class, "XX" a single code
+
+public:
+  Subscription() { clear(); }
+
+  // Subscribe to everything
+  void clear();
+
+  // true if this subscription does not filter any messages
+  inline bool everything() const { return m_all; }
+
+  // Parses the arguments of the SUBSCRIBE command.
+  // Returns false (and leaves the subscription unchanged) on a syntax error.
+  bool parse(const char *args, std::string& error);
+
+  // Returns true if the message matches this subscription
+  bool match(const Event& ev) const;
+
+  // Describes this subscription in the syntax of the SUBSCRIBE command
+  void describe(std::string& out) const;
+};
+
+} // ends namespace openGalaxy
+
+#endif
@@ -39,6 +39,11 @@
 #include <mutex>
 #include <condition_variable>
 #include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cwchar>
 
 //#if HAVE_SYSLOG_H
 //#include <syslog.h>    // for syslog(), openlog(), closelog()
@@ -46,26 +51,427 @@
 
 namespace openGalaxy {
 
-Syslog::Syslog(){
+//
+// A single producer, single consumer ring buffer of records.
+//
+// Each record is stored as a 32 bit length followed by the record itself
+// and padded to a multiple of 8 bytes. A record never wraps around the end
+// of the buffer, instead a length of 'pad' tells the reader to continue at
+// the start of the buffer.
+//
+// Only the thread that owns the ring buffer writes to it, only the
+// background thread reads from it.
+//
+// Both the thread and the Syslog instance hold a reference to the ring
+// buffer. When the thread exits, the background thread moves the ring
+// buffer to the free list of the instance once it has been emptied. When
+// the instance goes first, the exiting thread deletes the ring buffer.
+//
+class Syslog::Ring {
+public:
+  static constexpr size_t size = 64 * 1024; // (a power of 2)
+  static constexpr uint32_t pad = 0xFFFFFFFF;
+
+  std::atomic<size_t> head; // written by the owner
+  std::atomic<size_t> tail; // written by the background thread
+  std::atomic<int> owners;  // the thread and/or the Syslog instance
+  unsigned char data[size];
+
+  Ring() : head(0), tail(0), owners(2) {}
+
+  // Drops a reference, returns true when it was the last one
+  bool release(){ return owners.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+  static size_t align(size_t n){ return (n + 7) & ~(size_t)7; }
+
+  size_t used(){ return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire); }
+
+  // Appends a record, returns false when it does not fit
+  bool push(const unsigned char* record, size_t len){
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t need = align(sizeof(uint32_t) + len);
+    size_t at = h & (size - 1);
+    size_t skip = (size - at < need) ? size - at : 0;
+    if(size - (h - t) < skip + need) return false;
+    if(skip){
+      uint32_t p = pad;
+      memcpy(&data[at], &p, sizeof p);
+      h += skip;
+      at = 0;
+    }
+    uint32_t l = len;
+    memcpy(&data[at], &l, sizeof l);
+    memcpy(&data[at + sizeof l], record, len);
+    head.store(h + need, std::memory_order_release);
+    return true;
+  }
+
+  // Returns the oldest record (or nullptr) without removing it
+  const unsigned char* front(size_t& len){
+    size_t t = tail.load(std::memory_order_relaxed);
+    for(;;){
+      if(t == head.load(std::memory_order_acquire)) return nullptr;
+      uint32_t l;
+      memcpy(&l, &data[t & (size - 1)], sizeof l);
+      if(l != pad){
+        len = l;
+        return &data[(t & (size - 1)) + sizeof l];
+      }
+      t += size - (t & (size - 1));
+      tail.store(t, std::memory_order_release);
+    }
+  }
+
+  // Removes the record returned by front()
+  void pop(size_t len){
+    tail.store(tail.load(std::memory_order_relaxed) + align(sizeof(uint32_t) + len), std::memory_order_release);
+  }
+};
+
+//
+// The header of each record in a ring buffer
+//
+struct record_t {
+  unsigned long long sequence;
+  int level;
+  int kind;
+};
+
+// The kinds of records
+enum record_kind : int {
+  record_text = 0, // a nul terminated string
+  record_format,   // a nul terminated format string followed by its arguments
+  record_dump      // a nul terminated prefix followed by the bytes to dump
+};
+
+// Tags for the arguments of a record_format record
+enum : unsigned char {
+  arg_int = 'I',    // 64 bit integer
+  arg_double = 'D', // double
+  arg_ldouble = 'L',// long double
+  arg_string = 'S', // nul terminated string
+  arg_null = 'N',   // null pointer for %s
+  arg_pointer = 'P',// void*
+  arg_text = 'T'    // already formatted text (nul terminated)
+};
+
+// The size of the largest record
+static constexpr size_t max_record = 8192;
+
+// How long the background thread waits for more messages after the first
+static constexpr int flush_delay_ms = 50;
+
+// Used to find the ring buffer of the calling thread
+static std::atomic<unsigned long> syslog_instances(0);
+static thread_local unsigned long tls_syslog_id = 0;
+
+// Releases the ring buffer of the calling thread when the thread exits
+struct thread_ring {
+  Syslog::Ring* ring = nullptr;
+  ~thread_ring(){
+    if(ring && ring->release()) delete ring;
+    ring = nullptr;
+    tls_syslog_id = 0;
+  }
+};
+static thread_local thread_ring tls_ring;
+
+//
+// A conversion specification in a format string
+//
+struct conversion_t {
+  const char* begin;  // points to the '%'
+  const char* end;    // points past the conversion character
+  int stars;          // the number of '*' for the width and precision
+  int precision;      // the precision, -1 when there is none or -2 for '*'
+  char length[3];     // the length modifier
+  char conversion;    // the conversion character
+};
+
+// Parses the conversion specification at p (which points to a '%')
+static bool parse_conversion(const char* p, conversion_t& c)
+{
+  c.begin = p++;
+  c.stars = 0;
+  c.precision = -1;
+  c.length[0] = c.length[1] = c.length[2] = '\0';
+  while(*p && strchr("-+ #0'", *p)) p++;
+  if(*p == '*'){ c.stars++; p++; }
+  else while(*p >= '0' && *p <= '9') p++;
+  if(*p == '.'){
+    p++;
+    c.precision = 0;
+    if(*p == '*'){ c.stars++; p++; c.precision = -2; }
+    else while(*p >= '0' && *p <= '9') c.precision = c.precision * 10 + (*p++ - '0');
+  }
+  int n = 0;
+  while(*p && strchr("hlLqjzt", *p) && n < 2) c.length[n++] = *p++;
+  if(*p == '\0') return false;
+  c.conversion = *p++;
+  c.end = p;
+  return true;
+}
+
+//
+// Appends the arguments for 'format' to a record_format record
+//
+class arg_writer {
+  unsigned char* m_p;
+  unsigned char* m_end;
+public:
+  bool full = false;
+  arg_writer(unsigned char* p, unsigned char* end) : m_p(p), m_end(end) {}
+  size_t used(unsigned char* start){ return m_p - start; }
+  template<typename T> void put(unsigned char tag, T v){
+    if(full || (size_t)(m_end - m_p) < 1 + sizeof v){ full = true; return; }
+    *m_p++ = tag;
+    memcpy(m_p, &v, sizeof v);
+    m_p += sizeof v;
+  }
+  void put_string(unsigned char tag, const char* s){ put_string(tag, s, strlen(s)); }
+  void put_string(unsigned char tag, const char* s, size_t n){
+    if(full || m_end - m_p < 2){ full = true; return; }
+    *m_p++ = tag;
+    if(n > (size_t)(m_end - m_p) - 1) n = m_end - m_p - 1;
+    memcpy(m_p, s, n);
+    m_p += n;
+    *m_p++ = '\0';
+  }
+};
+
+// Formats one conversion and appends it to 'out'
+template<typename T>
+static void emit(std::string& out, const std::string& spec, int stars, const int* star, T v)
+{
+  char buf[512];
+  int n;
+  switch(stars){
+    case 0:  n = snprintf(buf, sizeof buf, spec.c_str(), v); break;
+    case 1:  n = snprintf(buf, sizeof buf, spec.c_str(), star[0], v); break;
+    default: n = snprintf(buf, sizeof buf, spec.c_str(), star[0], star[1], v); break;
+  }
+  if(n < 0) return;
+  if((size_t)n < sizeof buf){
+    out.append(buf, n);
+    return;
+  }
+  std::string s(n + 1, '\0');
+  switch(stars){
+    case 0:  snprintf(&s[0], n + 1, spec.c_str(), v); break;
+    case 1:  snprintf(&s[0], n + 1, spec.c_str(), star[0], v); break;
+    default: snprintf(&s[0], n + 1, spec.c_str(), star[0], star[1], v); break;
+  }
+  out.append(s.c_str(), n);
+}
+
+static void capture_arguments(const char* format, va_list arguments, arg_writer& w)
+{
+  for(const char* p = format; *p && !w.full; p++){
+    if(*p != '%') continue;
+    if(p[1] == '%'){ p++; continue; }
+    conversion_t c;
+    if(!parse_conversion(p, c)) break;
+    p = c.end - 1;
+    int star[2] = { 0, 0 };
+    for(int i = 0; i < c.stars; i++){
+      star[i] = va_arg(arguments, int);
+      w.put<long long>(arg_int, star[i]);
+    }
+    const char* l = c.length;
+    switch(c.conversion){
+      case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+        if(!strcmp(l, "l") && c.conversion == 'c'){
+          // wide character: format it now
+          wint_t wc = va_arg(arguments, wint_t);
+          std::string text;
+          emit(text, std::string(c.begin, c.end), c.stars, star, wc);
+          w.put_string(arg_text, text.c_str());
+        }
+        else if(!strcmp(l, "l")) w.put<long long>(arg_int, va_arg(arguments, long));
+        else if(!strcmp(l, "ll") || !strcmp(l, "q")) w.put<long long>(arg_int, va_arg(arguments, long long));
+        else if(!strcmp(l, "z")) w.put<long long>(arg_int, va_arg(arguments, size_t));
+        else if(!strcmp(l, "j")) w.put<long long>(arg_int, va_arg(arguments, intmax_t));
+        else if(!strcmp(l, "t")) w.put<long long>(arg_int, va_arg(arguments, ptrdiff_t));
+        else w.put<long long>(arg_int, va_arg(arguments, int));
+        break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        if(!strcmp(l, "L")) w.put<long double>(arg_ldouble, va_arg(arguments, long double));
+        else w.put<double>(arg_double, va_arg(arguments, double));
+        break;
+      case 's':
+        if(!strcmp(l, "l")){
+          // wide string: format it now
+          const wchar_t* ws = va_arg(arguments, const wchar_t*);
+          std::string text;
+          if(ws) emit(text, std::string(c.begin, c.end), c.stars, star, ws);
+          w.put_string(arg_text, ws ? text.c_str() : "(null)");
+        }
+        else {
+          const char* s = va_arg(arguments, const char*);
+          // With a precision the string does not have to be nul terminated,
+          // do not read past it (a negative '*' precision is no precision)
+          int precision = (c.precision == -2) ? star[c.stars - 1] : c.precision;
+          if(s) w.put_string(arg_string, s, (precision >= 0) ? strnlen(s, precision) : strlen(s));
+          else w.put<char>(arg_null, 0);
+        }
+        break;
+      case 'p':
+        w.put<void*>(arg_pointer, va_arg(arguments, void*));
+        break;
+      case 'n':
+        (void)va_arg(arguments, void*); // not supported, ignored
+        break;
+      default:
+        return; // unknown conversion, stop here
+    }
+  }
+}
+
+//
+// Reads back the arguments of a record_format record
+//
+class arg_reader {
+  const unsigned char* m_p;
+  const unsigned char* m_end;
+public:
+  arg_reader(const unsigned char* p, const unsigned char* end) : m_p(p), m_end(end) {}
+  bool next(unsigned char tag){ return m_p < m_end && *m_p == tag; }
+  template<typename T> T get(){
+    T v;
+    memcpy(&v, m_p + 1, sizeof v);
+    m_p += 1 + sizeof v;
+    return v;
+  }
+  const char* get_string(){
+    const char* s = (const char*)m_p + 1;
+    m_p += 2 + strlen(s);
+    return s;
+  }
+};
+
+static void format_record(std::string& out, const char* format, arg_reader& r)
+{
+  const char* p = format;
+  while(*p){
+    const char* pct = strchr(p, '%');
+    if(pct == nullptr){
+      out.append(p);
+      return;
+    }
+    out.append(p, pct - p);
+    if(pct[1] == '%'){
+      out.push_back('%');
+      p = pct + 2;
+      continue;
+    }
+    conversion_t c;
+    if(!parse_conversion(pct, c)) return;
+    p = c.end;
+    int star[2] = { 0, 0 };
+    for(int i = 0; i < c.stars; i++){
+      if(!r.next(arg_int)) return;
+      star[i] = (int)r.get<long long>();
+    }
+    std::string spec(c.begin, c.end);
+    const char* l = c.length;
+    bool is_unsigned = strchr("ouxX", c.conversion) != nullptr;
+    if(c.conversion == 'n') continue;
+    if(r.next(arg_text)){
+      out.append(r.get_string());
+    }
+    else if(r.next(arg_int)){
+      long long v = r.get<long long>();
+      if(!strcmp(l, "l")){
+        if(is_unsigned) emit(out, spec, c.stars, star, (unsigned long)v);
+        else emit(out, spec, c.stars, star, (long)v);
+      }
+      else if(!strcmp(l, "ll") || !strcmp(l, "q")){
+        if(is_unsigned) emit(out, spec, c.stars, star, (unsigned long long)v);
+        else emit(out, spec, c.stars, star, v);
+      }
+      else if(!strcmp(l, "z")) emit(out, spec, c.stars, star, (size_t)v);
+      else if(!strcmp(l, "j")) emit(out, spec, c.stars, star, (intmax_t)v);
+      else if(!strcmp(l, "t")) emit(out, spec, c.stars, star, (ptrdiff_t)v);
+      else if(is_unsigned) emit(out, spec, c.stars, star, (unsigned int)v);
+      else emit(out, spec, c.stars, star, (int)v);
+    }
+    else if(r.next(arg_double)) emit(out, spec, c.stars, star, r.get<double>());
+    else if(r.next(arg_ldouble)) emit(out, spec, c.stars, star, r.get<long double>());
+    else if(r.next(arg_string)) emit(out, spec, c.stars, star, r.get_string());
+    else if(r.next(arg_null)){
+      r.get<char>();
+      emit(out, spec, c.stars, star, "(null)");
+    }
+    else if(r.next(arg_pointer)) emit(out, spec, c.stars, star, r.get<void*>());
+    else return; // truncated record
+  }
+}
+
+// Appends a hexdump of buf to 'out', each line preceded by 'line' and 'prefix'
+static void format_dump(std::string& out, const std::string& line, const char* prefix, const unsigned char* buf, size_t len)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  for(size_t at = 0; at < len; at += 16){
+    out.append(line);
+    out.append(prefix);
+    size_t n = (len - at < 16) ? len - at : 16;
+    for(size_t i = 0; i < 16; i++){
+      if(i < n){
+        out.push_back(hex[buf[at + i] >> 4]);
+        out.push_back(hex[buf[at + i] & 15]);
+        out.push_back(' ');
+      }
+      else out.append("-- ");
+    }
+    for(size_t i = 0; i < n; i++){
+      unsigned char b = buf[at + i];
+      out.push_back((b > 31 && b < 127) ? b : '.');
+    }
+    out.push_back('\n');
+  }
+}
+
+
+Syslog::Syslog() : m_sequence(0), m_dropped(0), m_pending(false)
+{
   set_level( Syslog::Level::Error ); // Set the default maximum log level
+  start();
 //#if HAVE_SYSLOG_H
 //  openlog( "openGalaxy", LOG_PERROR | LOG_PID, LOG_DAEMON );
 //#endif
 }
 
-Syslog::Syslog( Syslog::Level nLevel ){
+Syslog::Syslog( Syslog::Level nLevel ) : m_sequence(0), m_dropped(0), m_pending(false)
+{
   set_level( nLevel );
+  start();
 //#if HAVE_SYSLOG_H
 //  openlog( "openGalaxy", LOG_PERROR | LOG_PID, LOG_DAEMON );
 //#endif
 }
 
 Syslog::~Syslog(){
+  m_wait_mutex.lock();
+  m_quit = true;
+  m_wait_mutex.unlock();
+  m_cv.notify_one();
+  m_thread->join();
+  delete m_thread;
+  drain(); // anything logged while the thread was exiting
+  for(Ring* r : m_rings) if(r->release()) delete r;
+  for(Ring* r : m_free) delete r;
 //#if HAVE_SYSLOG_H
 //  closelog();
 //#endif
 }
 
+void Syslog::start()
+{
+  m_id = ++syslog_instances;
+  m_thread = new std::thread(Syslog::Thread, this);
+}
+
 void Syslog::set_level( Syslog::Level nLevel )
 {
   if( !(nLevel > Level::Always && nLevel < Level::Level_max) ){
@@ -74,97 +480,266 @@ void Syslog::set_level( Syslog::Level nLevel )
   m_nMaxLevel = nLevel;
 }
 
+// Returns the ring buffer of the calling thread
+Syslog::Ring* Syslog::ring()
+{
+  if(tls_syslog_id != m_id){
+    // release the ring buffer used with an earlier instance
+    if(tls_ring.ring && tls_ring.ring->release()) delete tls_ring.ring;
+    m_mutex.lock();
+    Ring *r;
+    if(m_free.size()){
+      r = m_free.back();
+      m_free.pop_back();
+      r->owners.store(2, std::memory_order_relaxed);
+    }
+    else {
+      r = new Ring();
+    }
+    m_rings.push_back(r);
+    m_mutex.unlock();
+    tls_ring.ring = r;
+    tls_syslog_id = m_id;
+  }
+  return tls_ring.ring;
+}
+
+void Syslog::enqueue( Syslog::Level nLevel, int kind, const unsigned char* record, size_t len )
+{
+  Ring *r = ring();
+  record_t *h = (record_t*)record;
+  h->sequence = m_sequence++;
+  h->level = (int)nLevel;
+  h->kind = kind;
+  bool urgent;
+  if(r->push(record, len) == false){
+    m_dropped++;
+    urgent = true;
+  }
+  // Do not wait for the flush delay of the background thread when the buffer fills up
+  else urgent = (r->used() > Ring::size / 2);
+
+  // Wake up the background thread for the first message after a drain()
+  // (the fence pairs with the one in Thread(), either it sees this message
+  //  or we see that m_pending was cleared)
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(m_pending.load(std::memory_order_relaxed) == false || urgent){
+    m_wait_mutex.lock();
+    m_pending.store(true, std::memory_order_relaxed);
+    if(urgent) m_urgent = true;
+    m_wait_mutex.unlock();
+    m_cv.notify_one();
+  }
+}
+
+void Syslog::enqueue( Syslog::Level nLevel, const char* format, va_list arguments )
+{
+  alignas(8) unsigned char record[max_record];
+  unsigned char *end = record + sizeof record;
+  unsigned char *p = record + sizeof(record_t);
+  size_t n = strlen(format);
+  if(n > max_record / 2) n = max_record / 2;
+  memcpy(p, format, n);
+  p[n] = '\0';
+  arg_writer w(p + n + 1, end);
+  capture_arguments(format, arguments, w);
+  enqueue(nLevel, record_format, record, w.used(record));
+}
 
 void Syslog::write( Syslog::Level nLevel, const char* str )
 {
   if( !(nLevel >= Level::Always && nLevel < Level::Level_max) ){
     throw new std::runtime_error("Syslog::write(): Level out of bounds.");
   }
+  if( nLevel > m_nMaxLevel ) return;
 
-  if( nLevel <= m_nMaxLevel ){
-    m_mutex.lock();
-//#if HAVE_SYSLOG_H
-//    int nType;
-//    switch( nLevel ){
-//      case Level::Error:
-//        nType = LOG_ERR;
-//        break;
-//      case Level::Info:
-//        nType = LOG_INFO;
-//        break;
-//      case Level::Debug:
-//      default:
-//        nType = LOG_DEBUG;
-//        break;
-//    }
-//    syslog( nType, str );
-//#else
-#ifndef _WIN32
-    std::cout << "openGalaxy";
-#ifdef HAVE_GETPID
-    std::cout << '[' << getpid() << ']';
-#endif
-    std::cout << ':' << ' ';
-#endif
-    std::cout << str << std::endl;
-//#endif
+  alignas(8) unsigned char record[max_record];
+  size_t n = strlen(str);
+  if(n > max_record - sizeof(record_t) - 1) n = max_record - sizeof(record_t) - 1;
+  memcpy(record + sizeof(record_t), str, n);
+  record[sizeof(record_t) + n] = '\0';
+  enqueue(nLevel, record_text, record, sizeof(record_t) + n + 1);
+}
 
-    m_mutex.unlock();
-  }
+void Syslog::dump( Syslog::Level nLevel, const char* prefix, const void* buf, size_t len )
+{
+  if( nLevel > m_nMaxLevel || len == 0 ) return;
+
+  alignas(8) unsigned char record[max_record];
+  unsigned char *p = record + sizeof(record_t);
+  size_t n = strlen(prefix);
+  if(n > 64) n = 64;
+  memcpy(p, prefix, n);
+  p[n++] = '\0';
+  if(len > max_record - sizeof(record_t) - n) len = max_record - sizeof(record_t) - n;
+  memcpy(p + n, buf, len);
+  enqueue(nLevel, record_dump, record, sizeof(record_t) + n + len);
 }
 
 void Syslog::message( Syslog::Level nLevel, const char* format, ... )
 {
-  char buffer[8192];
+  if( nLevel > m_nMaxLevel ) return;
   va_list arguments;
   va_start( arguments, format );
-  vsnprintf( buffer, sizeof buffer, format, arguments );
-  write( nLevel, (const char*)buffer );
+  enqueue( nLevel, format, arguments );
   va_end( arguments );
 }
 
 void Syslog::print( const char* format, ... )
 {
-  char buffer[8192];
   va_list arguments;
   va_start( arguments, format );
-  vsnprintf( buffer, sizeof buffer, format, arguments );
-  write( Level::Always, buffer );
+  enqueue( Level::Always, format, arguments );
   va_end( arguments );
 }
 
 void Syslog::error( const char* format, ... )
 {
   if( Level::Error > m_nMaxLevel ) return;
-  char buffer[8192];
   va_list arguments;
   va_start( arguments, format );
-  vsnprintf( buffer, sizeof buffer, format, arguments );
-  write( Level::Error, buffer );
+  enqueue( Level::Error, format, arguments );
   va_end( arguments );
 }
 
 void Syslog::info( const char* format, ... )
 {
   if( Level::Info > m_nMaxLevel ) return;
-  char buffer[8192];
   va_list arguments;
   va_start( arguments, format );
-  vsnprintf( buffer, sizeof buffer, format, arguments );
-  write( Level::Info, buffer );
+  enqueue( Level::Info, format, arguments );
   va_end( arguments );
 }
 
 void Syslog::debug( const char* format, ... )
 {
   if( Level::Debug > m_nMaxLevel ) return;
-  char buffer[8192];
   va_list arguments;
   va_start( arguments, format );
-  vsnprintf( buffer, sizeof buffer, format, arguments );
-  write( Level::Debug, buffer );
+  enqueue( Level::Debug, format, arguments );
   va_end( arguments );
 }
 
-} // ends namespace openGalaxy
+void Syslog::flush()
+{
+  drain();
+}
 
+//
+// Formats and writes all queued messages (in the order they were logged)
+//
+void Syslog::drain()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::string line; // the start of each line
+#ifndef _WIN32
+  line = "openGalaxy";
+#ifdef HAVE_GETPID
+  line += '[' + std::to_string(getpid()) + ']';
+#endif
+  line += ": ";
+#endif
+
+  std::string out;
+  size_t n = m_rings.size();
+  std::vector<const unsigned char*> rec(n);
+  std::vector<size_t> len(n);
+  std::vector<size_t> head(n); // do not chase a thread that keeps logging
+  for(size_t i = 0; i < n; i++){
+    head[i] = m_rings[i]->head.load(std::memory_order_acquire);
+    rec[i] = m_rings[i]->front(len[i]);
+  }
+
+  for(;;){
+    // take the oldest record from all ring buffers
+    size_t oldest = n;
+    for(size_t i = 0; i < n; i++){
+      if(rec[i] == nullptr) continue;
+      if(oldest == n || ((const record_t*)rec[i])->sequence < ((const record_t*)rec[oldest])->sequence) oldest = i;
+    }
+    if(oldest == n) break;
+
+    const record_t *h = (const record_t*)rec[oldest];
+    const unsigned char *data = rec[oldest] + sizeof(record_t);
+    const unsigned char *end = rec[oldest] + len[oldest];
+    switch(h->kind){
+      case record_text:
+        out.append(line);
+        out.append((const char*)data);
+        out.push_back('\n');
+        break;
+      case record_format: {
+        const char *format = (const char*)data;
+        arg_reader r((const unsigned char*)format + strlen(format) + 1, end);
+        out.append(line);
+        format_record(out, format, r);
+        out.push_back('\n');
+        break;
+      }
+      case record_dump: {
+        const char *prefix = (const char*)data;
+        const unsigned char *bytes = data + strlen(prefix) + 1;
+        format_dump(out, line, prefix, bytes, end - bytes);
+        break;
+      }
+    }
+
+    Ring *r = m_rings[oldest];
+    r->pop(len[oldest]);
+    if(r->tail.load(std::memory_order_relaxed) == head[oldest]) rec[oldest] = nullptr;
+    else rec[oldest] = r->front(len[oldest]);
+  }
+
+  // move the emptied ring buffers of threads that exited to the free list
+  for(size_t i = 0; i < m_rings.size(); ){
+    Ring *r = m_rings[i];
+    if(r->owners.load(std::memory_order_acquire) == 1 && r->used() == 0){
+      m_rings.erase(m_rings.begin() + i);
+      m_free.push_back(r);
+    }
+    else i++;
+  }
+
+  unsigned long long dropped = m_dropped.load();
+  if(dropped != m_dropped_reported){
+    out.append(line);
+    out.append("Syslog: " + std::to_string(dropped - m_dropped_reported) + " message(s) dropped");
+    out.push_back('\n');
+    m_dropped_reported = dropped;
+  }
+
+  if(out.size()){
+//#if HAVE_SYSLOG_H
+//    syslog( nType, str );
+//#else
+    std::cout.write(out.data(), out.size());
+    std::cout.flush();
+//#endif
+  }
+}
+
+//
+// The background thread that writes the log
+//
+void Syslog::Thread( Syslog* syslog )
+{
+  for(;;){
+    bool quit;
+    {
+      std::unique_lock<std::mutex> lock(syslog->m_wait_mutex);
+      // Sleep until a message is logged,
+      syslog->m_cv.wait(lock, [syslog]{ return syslog->m_pending.load() || syslog->m_quit; });
+      // then wait a little while for more to write them in a batch
+      syslog->m_cv.wait_for(lock, std::chrono::milliseconds(flush_delay_ms), [syslog]{ return syslog->m_urgent || syslog->m_quit; });
+      syslog->m_urgent = false;
+      syslog->m_pending.store(false, std::memory_order_relaxed);
+      quit = syslog->m_quit;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    syslog->drain();
+    if(quit) break;
+  }
+}
+
+} // ends namespace openGalaxy
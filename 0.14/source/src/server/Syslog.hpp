@@ -32,9 +32,24 @@
 
 #include "atomic.h"
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstdarg>
+#include <cstddef>
 
 namespace openGalaxy {
 
+// The log.
+//
+// Logging a message does not format or write it: the calling thread
+// copies the format string and its arguments into a ring buffer of its own
+// (without locking) and a background thread formats the messages of all
+// threads and writes them in batches, in the order they were logged.
+// When a thread logs faster than the messages can be written, the
+// messages that do not fit in its ring buffer are dropped and counted.
+//
 class Syslog {
 public:
   // Log 'level' used by class Syslog
@@ -69,9 +84,45 @@ public:
   void info( const char* format, ... );    // Send to log at SyslogInfo level
   void debug( const char* format, ... );   // Send to log at SyslogDebug level
 
+  // Writes a hexdump of 'len' bytes from 'buf' to the log,
+  // each line starts with 'prefix'
+  void dump( Syslog::Level nLevel, const char* prefix, const void* buf, size_t len );
+
+  // Blocks until all messages logged so far have been written
+  void flush();
+
+  // The number of messages that were dropped
+  unsigned long long dropped() { return m_dropped.load(); }
+
+  // The ring buffer of a thread (see Syslog.cpp)
+  class Ring;
+
 private:
+
   Syslog::Level m_nMaxLevel; // max 'level' that is logged
-  std::mutex m_mutex;
+  unsigned long m_id;        // tells the ring buffers of this instance from those of an earlier one
+
+  std::mutex m_mutex;        // protects m_rings, m_free and serializes writing the log
+  std::vector<Ring*> m_rings; // the ring buffer of each thread that logged a message
+  std::vector<Ring*> m_free;  // the ring buffers of threads that exited, for reuse
+  std::atomic<unsigned long long> m_sequence; // orders the messages of all threads
+  std::atomic<unsigned long long> m_dropped;
+  unsigned long long m_dropped_reported = 0;
+  std::thread *m_thread;
+
+  // Wakes up the background thread, it sleeps while nothing is logged
+  std::mutex m_wait_mutex;   // protects m_urgent and m_quit
+  std::condition_variable m_cv;
+  std::atomic<bool> m_pending; // a message was logged since the last drain()
+  bool m_urgent = false;     // a ring buffer is filling up, write it now
+  bool m_quit = false;
+
+  void start();
+  Ring* ring();
+  void enqueue( Syslog::Level nLevel, const char* format, va_list arguments );
+  void enqueue( Syslog::Level nLevel, int kind, const unsigned char* record, size_t len );
+  void drain();
+  static void Thread( Syslog* syslog );
 };
 
 } // ends namespace openGalaxy
@@ -0,0 +1,266 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic.h"
+#include "TimingWheel.hpp"
+
+#include <climits>
+
+namespace openGalaxy {
+
+constexpr int TimingWheel::bits;
+constexpr int TimingWheel::slots;
+constexpr int TimingWheel::wheels;
+
+TimingWheel::TimingWheel()
+ : m_epoch(std::chrono::steady_clock::now())
+{
+}
+
+TimingWheel::~TimingWheel()
+{
+  clear();
+}
+
+// Returns the current tick (milliseconds since m_epoch, rounded down)
+unsigned long long TimingWheel::tick()
+{
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now() - m_epoch).count();
+}
+
+void TimingWheel::arm(TimingWheel::Timer& timer, long long ms)
+{
+  using namespace std::chrono;
+  if(timer.m_wheel) timer.m_wheel->cancel(timer);
+  if(ms < 0) ms = 0;
+  long long us = duration_cast<microseconds>(steady_clock::now() - m_epoch).count();
+  // (nothing to move inwards when there are no timers, start counting from now)
+  if(m_count == 0) m_now = us / 1000;
+  // The due tick is rounded up so that a timer never expires early
+  timer.m_due = (us + ms * 1000 + 999) / 1000;
+  timer.m_wheel = this;
+  m_count++;
+  insert(timer);
+}
+
+void TimingWheel::cancel(TimingWheel::Timer& timer)
+{
+  if(timer.m_wheel == nullptr) return;
+  // (the bit in m_used is cleared by next_tick() once the slot is empty)
+  unlink(timer);
+  timer.m_wheel = nullptr;
+  m_count--;
+}
+
+void TimingWheel::clear()
+{
+  Link all;
+  splice(all, m_expired);
+  splice(all, m_collected);
+  for(int w = 0; w < wheels; w++){
+    for(int i = 0; i < slots; i++) splice(all, m_wheel[w][i]);
+    m_used[w] = 0;
+  }
+  while(all.next != &all){
+    Timer& timer = static_cast<Timer&>(*all.next);
+    unlink(timer);
+    timer.m_wheel = nullptr;
+  }
+  m_count = 0;
+}
+
+void TimingWheel::expire()
+{
+  Link expired;
+  advance(expired);
+  while(expired.next != &expired){
+    Timer& timer = static_cast<Timer&>(*expired.next);
+    unlink(timer);
+    timer.m_wheel = nullptr;
+    m_count--;
+    // (call a copy, the callback may destroy the timer)
+    callback fn = timer.m_fn;
+    if(fn) fn();
+  }
+}
+
+void TimingWheel::collect()
+{
+  Link list;
+  advance(list);
+  splice(m_collected, list);
+}
+
+bool TimingWheel::take(TimingWheel::callback& fn)
+{
+  while(m_collected.next != &m_collected){
+    Timer& timer = static_cast<Timer&>(*m_collected.next);
+    unlink(timer);
+    timer.m_wheel = nullptr;
+    m_count--;
+    if(timer.m_fn){
+      fn = timer.m_fn;
+      return true;
+    }
+  }
+  return false;
+}
+
+int TimingWheel::next_timeout_ms()
+{
+  using namespace std::chrono;
+  if(m_count == 0) return -1;
+  unsigned long long t = next_tick();
+  if(t == ULLONG_MAX) return -1;
+  long long us = duration_cast<microseconds>(steady_clock::now() - m_epoch).count();
+  if((long long)t * 1000 <= us) return 0;
+  long long ms = ((long long)t * 1000 - us + 999) / 1000;
+  return (ms > INT_MAX) ? INT_MAX : (int)ms;
+}
+
+// Puts an armed timer in the slot that matches its due tick
+void TimingWheel::insert(TimingWheel::Timer& timer)
+{
+  if(timer.m_due <= m_now){
+    link(m_expired, timer);
+    return;
+  }
+  for(int w = 0; w < wheels; w++){
+    unsigned long long slot = timer.m_due >> (w * bits);
+    unsigned long long current = m_now >> (w * bits);
+    if(slot - current >= (unsigned long long)slots){
+      if(w < wheels - 1) continue;
+      slot = current + slots - 1; // (beyond the outer wheel, wait in its last slot)
+    }
+    int i = slot & (slots - 1);
+    link(m_wheel[w][i], timer);
+    m_used[w] |= 1ULL << i;
+    return;
+  }
+}
+
+// Returns the next tick on which a timer expires or has to move inwards,
+// or ULLONG_MAX when there are no timers
+unsigned long long TimingWheel::next_tick()
+{
+  if(m_expired.next != &m_expired) return m_now;
+  unsigned long long next = ULLONG_MAX;
+  for(int w = 0; w < wheels; w++){
+    unsigned long long current = m_now >> (w * bits);
+    while(m_used[w]){
+      // the first slot with timers after the current one
+      int start = (current + 1) & (slots - 1);
+      unsigned long long used = (start == 0) ? m_used[w] : (m_used[w] >> start) | (m_used[w] << (slots - start));
+      int k = __builtin_ctzll(used);
+      int i = (start + k) & (slots - 1);
+      if(m_wheel[w][i].next == &m_wheel[w][i]){
+        m_used[w] &= ~(1ULL << i); // (its timers were cancelled)
+        continue;
+      }
+      unsigned long long t = (current + 1 + k) << (w * bits);
+      if(t < next) next = t;
+      break;
+    }
+  }
+  return next;
+}
+
+// Moves the timers that are due up to the current tick to 'expired'
+void TimingWheel::advance(TimingWheel::Link& expired)
+{
+  unsigned long long now = tick();
+  splice(expired, m_expired);
+  for(;;){
+    unsigned long long t = next_tick();
+    if(t > now){
+      if(now > m_now) m_now = now;
+      break;
+    }
+    m_now = t;
+    // Move the timers in the slots that start at this tick inwards
+    // (the outer wheels first, their timers may end up in the inner wheels)
+    for(int w = wheels - 1; w > 0; w--){
+      if(m_now & ((1ULL << (w * bits)) - 1)) continue;
+      int i = (m_now >> (w * bits)) & (slots - 1);
+      if((m_used[w] & (1ULL << i)) == 0) continue;
+      Link list;
+      splice(list, m_wheel[w][i]);
+      m_used[w] &= ~(1ULL << i);
+      while(list.next != &list){
+        Timer& timer = static_cast<Timer&>(*list.next);
+        unlink(timer);
+        insert(timer);
+      }
+    }
+    int i = m_now & (slots - 1);
+    if(m_used[0] & (1ULL << i)){
+      splice(m_expired, m_wheel[0][i]);
+      m_used[0] &= ~(1ULL << i);
+    }
+    splice(expired, m_expired);
+  }
+}
+
+// static function:
+// Appends a node to a list
+void TimingWheel::link(TimingWheel::Link& list, TimingWheel::Link& node)
+{
+  node.prev = list.prev;
+  node.next = &list;
+  list.prev->next = &node;
+  list.prev = &node;
+}
+
+// static function:
+// Removes a node from the list it is in
+void TimingWheel::unlink(TimingWheel::Link& node)
+{
+  node.prev->next = node.next;
+  node.next->prev = node.prev;
+  node.prev = node.next = &node;
+}
+
+// static function:
+// Moves all nodes of a list to the end of another list
+void TimingWheel::splice(TimingWheel::Link& to, TimingWheel::Link& from)
+{
+  if(from.next == &from) return;
+  Link *first = from.next;
+  Link *last = from.prev;
+  first->prev = to.prev;
+  to.prev->next = first;
+  last->next = &to;
+  to.prev = last;
+  from.next = from.prev = &from;
+}
+
+} // ends namespace openGalaxy
+
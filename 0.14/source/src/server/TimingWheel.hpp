@@ -0,0 +1,155 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OPENGALAXY_SERVER_TIMINGWHEEL_HPP__
+#define __OPENGALAXY_SERVER_TIMINGWHEEL_HPP__
+
+#include "atomic.h"
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace openGalaxy {
+
+//
+// A hierarchical timing wheel with a resolution of 1 millisecond.
+//
+// Timers are kept in (doubly linked) lists, one for each slot of a wheel.
+// The first wheel has a slot for each of the next 64 milliseconds, each
+// next wheel has slots that are 64 times as long (64 ms, 4 s and 4.4
+// minutes). When the time of a slot in one of the outer wheels comes,
+// its timers move inwards to the wheel that matches the time they have
+// left. Timers further away than the outer wheel reaches (4.6 hours)
+// simply wait in its last slot and move inwards from there.
+//
+// Arming and cancelling a timer takes the same (short) time no matter how
+// many timers there are, and the owner only needs to wake up when the next
+// timer expires (see next_timeout_ms()) and call expire().
+//
+// A TimingWheel is not thread safe, its owner must make sure that only one
+// thread at a time uses it (and the timers armed on it).
+//
+class TimingWheel {
+public:
+  typedef std::function<void()> callback;
+
+private:
+  // A node in the list of a slot
+  struct Link {
+    Link *prev;
+    Link *next;
+    Link() : prev(this), next(this) {}
+  };
+
+public:
+
+  //
+  // A timer that calls a callback function when it expires,
+  // it is cancelled when it is destroyed.
+  //
+  class Timer : private Link {
+  friend class TimingWheel;
+  public:
+    Timer(callback fn = nullptr) : m_fn(fn) {}
+    ~Timer(){ if(m_wheel) m_wheel->cancel(*this); }
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    // Sets the function to call when the timer expires
+    void set(callback fn){ m_fn = fn; }
+
+    // Returns true while the timer is armed
+    bool armed() const { return m_wheel != nullptr; }
+
+  private:
+    TimingWheel *m_wheel = nullptr; // the wheel the timer is armed on
+    unsigned long long m_due = 0;   // the tick the timer expires on
+    callback m_fn;
+  };
+
+  constexpr static int bits = 6;                // 64 slots per wheel
+  constexpr static int slots = 1 << bits;
+  constexpr static int wheels = 4;
+
+  TimingWheel();
+  ~TimingWheel();
+  TimingWheel(const TimingWheel&) = delete;
+  TimingWheel& operator=(const TimingWheel&) = delete;
+
+  // (Re)arms a timer to expire after 'ms' milliseconds
+  void arm(Timer& timer, long long ms);
+
+  // Disarms a timer (it does not matter if it is not armed)
+  void cancel(Timer& timer);
+
+  // Disarms all timers
+  void clear();
+
+  // Calls the callback of each timer that expired (the timer is disarmed
+  // first so the callback may arm it again, or destroy it)
+  void expire();
+
+  // The same, for owners that can not call the callbacks while they hold
+  // a lock: collect() sets the timers that expired aside and take() then
+  // disarms them one at a time and returns their callback in 'fn'
+  // (false when there are none left). A timer that is cancelled or armed
+  // again before it is taken is not returned.
+  void collect();
+  bool take(callback& fn);
+
+  // Returns the time (in milliseconds) until the next timer expires,
+  // 0 when one has expired or -1 when no timer is armed
+  int next_timeout_ms();
+
+  // The number of armed timers
+  int size() const { return m_count; }
+
+private:
+  std::chrono::steady_clock::time_point m_epoch; // tick 0
+  unsigned long long m_now = 0;                  // every tick up to here has been handled
+  Link m_wheel[wheels][slots];
+  unsigned long long m_used[wheels] = {};        // a bit for each slot with timers in it
+  Link m_expired;                                // timers that are due (on the next expire())
+  Link m_collected;                              // timers set aside by collect()
+  int m_count = 0;
+
+  unsigned long long tick();
+  void insert(Timer& timer);
+  unsigned long long next_tick();
+  void advance(Link& expired);
+
+  static void link(Link& list, Link& node);
+  static void unlink(Link& node);
+  static void splice(Link& to, Link& from);
+};
+
+} // ends namespace openGalaxy
+
+#endif
@@ -0,0 +1,284 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+ /* For libwebsockets API v1.7.5 */
+
+/*
+ * Encoders for the "openGalaxy-binary-protocol" websocket subprotocol,
+ * see binary.h for the layout of a binary frame.
+ */
+
+#include "atomic.h"
+#include "opengalaxy.hpp"
+
+namespace openGalaxy {
+
+// Maps the names used in the JSON formatted command replies to field id's
+struct binary_field_name_t {
+  const char *name;
+  int id;
+};
+
+static const struct binary_field_name_t binary_field_names[] = {
+  { "typeDesc",        BIN_FIELD_TYPEDESC },
+  { "success",         BIN_FIELD_SUCCESS },
+  { "command",         BIN_FIELD_COMMAND },
+  { "replyText",       BIN_FIELD_REPLYTEXT },
+  { "helpText",        BIN_FIELD_HELPTEXT },
+  { "areaState",       BIN_FIELD_AREASTATE },
+  { "zoneNumber",      BIN_FIELD_ZONENUMBER },
+  { "omitState",       BIN_FIELD_OMITSTATE },
+  { "zoneState",       BIN_FIELD_ZONESTATE },
+  { "outputState",     BIN_FIELD_OUTPUTSTATE },
+  { "panelIsOnline",   BIN_FIELD_PANELISONLINE },
+  { "haveAreaState",   BIN_FIELD_HAVEAREASTATE },
+  { "haveZoneState",   BIN_FIELD_HAVEZONESTATE },
+  { "haveOutputState", BIN_FIELD_HAVEOUTPUTSTATE },
+  { "stateVersion",    BIN_FIELD_STATEVERSION },
+  { "keyframe",        BIN_FIELD_KEYFRAME },
+  { "areaDelta",       BIN_FIELD_AREADELTA },
+  { "zoneDelta",       BIN_FIELD_ZONEDELTA },
+  { "outputDelta",     BIN_FIELD_OUTPUTDELTA },
+  { nullptr, 0 }
+};
+
+
+void Websocket::binary_put_byte(std::string& out, int id, unsigned int value)
+{
+  out += (char)BIN_TAG(BIN_KIND_BYTE, id);
+  out += (char)(value & 0xFF);
+}
+
+
+void Websocket::binary_put_uint(std::string& out, int id, unsigned int value)
+{
+  out += (char)BIN_TAG(BIN_KIND_UINT, id);
+  out += (char)(value & 0xFF);
+  out += (char)((value >> 8) & 0xFF);
+  out += (char)((value >> 16) & 0xFF);
+  out += (char)((value >> 24) & 0xFF);
+}
+
+
+void Websocket::binary_put_string(std::string& out, int id, const char *s, size_t len)
+{
+  if(len > 0xFFFF) len = 0xFFFF;
+  out += (char)BIN_TAG(BIN_KIND_STRING, id);
+  out += (char)(len & 0xFF);
+  out += (char)((len >> 8) & 0xFF);
+  out.append(s, len);
+}
+
+
+void Websocket::binary_put_array(std::string& out, int id, const unsigned char *a, size_t count)
+{
+  if(count > 0xFF) count = 0xFF;
+  out += (char)BIN_TAG(BIN_KIND_ARRAY, id);
+  out += (char)count;
+  out.append((const char*)a, count);
+}
+
+
+// Skips any whitespace in a JSON string
+static const char *binary_skip_ws(const char *p)
+{
+  while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+  return p;
+}
+
+
+// Reads a JSON string (p points to the opening quote) into out,
+// returns a pointer to the character after the closing quote or nullptr.
+static const char *binary_read_string(const char *p, std::string& out)
+{
+  out.clear();
+  if(*p++ != '"') return nullptr;
+  while(*p && *p != '"'){
+    if(*p == '\\'){
+      p++;
+      switch(*p){
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': {
+          // Re-encode the code point as UTF-8
+          if(!isxdigit(p[1]) || !isxdigit(p[2]) || !isxdigit(p[3]) || !isxdigit(p[4])) return nullptr;
+          char hex[5] = { p[1], p[2], p[3], p[4], '\0' };
+          unsigned int c = strtoul(hex, nullptr, 16);
+          if(c < 0x80){
+            out += (char)c;
+          }
+          else if(c < 0x800){
+            out += (char)(0xC0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3F));
+          }
+          else {
+            out += (char)(0xE0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+          }
+          p += 4;
+          break;
+        }
+        case '\0':
+          return nullptr;
+        default: // '"', '\\' and '/'
+          out += *p;
+          break;
+      }
+      p++;
+    }
+    else {
+      out += *p++;
+    }
+  }
+  if(*p != '"') return nullptr;
+  return p + 1;
+}
+
+
+// Converts a JSON formatted command reply (a single object with
+// numbers, strings and arrays of numbers) at 'p' into a binary frame
+// and moves 'p' past the end of the object.
+bool Websocket::binary_transcode_object(const char *&p, std::string& out)
+{
+  std::string name, text;
+  unsigned char values[256];
+  int typeId = -1;
+
+  out.clear();
+  p = binary_skip_ws(p);
+  if(*p++ != '{') return false;
+
+  while(1){
+    p = binary_skip_ws(p);
+    if(*p == '}') break;
+    if((p = binary_read_string(p, name)) == nullptr) return false;
+    p = binary_skip_ws(p);
+    if(*p++ != ':') return false;
+    p = binary_skip_ws(p);
+
+    // typeId must be the first item
+    if(typeId < 0){
+      if(name.compare("typeId") != 0) return false;
+      char *end;
+      typeId = strtoul(p, &end, 10);
+      if(end == p || typeId >= BIN_TYPE_BATCH) return false;
+      p = end;
+      out += (char)typeId;
+    }
+    else {
+      int id = 0;
+      for(int i = 0; binary_field_names[i].name; i++){
+        if(name.compare(binary_field_names[i].name) == 0){
+          id = binary_field_names[i].id;
+          break;
+        }
+      }
+      if(id == 0) return false;
+
+      if(*p == '"'){
+        if((p = binary_read_string(p, text)) == nullptr) return false;
+        // The description is implied by the typeId, except for the
+        // authorization required reply where it holds the session id.
+        if(
+          id != BIN_FIELD_TYPEDESC ||
+          typeId == static_cast<int>(Commander::json_reply_id::authorization_required)
+        ){
+          binary_put_string(out, id, text.data(), text.size());
+        }
+      }
+      else if(*p == '['){
+        size_t count = 0;
+        p = binary_skip_ws(p + 1);
+        while(*p != ']'){
+          char *end;
+          unsigned long v = strtoul(p, &end, 10);
+          if(end == p || count >= sizeof(values)) return false;
+          values[count++] = (v > 0xFF) ? 0xFF : v;
+          p = binary_skip_ws(end);
+          if(*p == ',') p = binary_skip_ws(p + 1);
+          else if(*p != ']') return false;
+        }
+        p++;
+        binary_put_array(out, id, values, count);
+      }
+      else if(strncmp(p, "null", 4) == 0){
+        p += 4;
+      }
+      else {
+        char *end;
+        unsigned long v = strtoul(p, &end, 10);
+        if(end == p) return false;
+        p = end;
+        if(v > 0xFF) binary_put_uint(out, id, v);
+        else binary_put_byte(out, id, v);
+      }
+    }
+
+    p = binary_skip_ws(p);
+    if(*p == ',') p++;
+    else if(*p != '}') return false;
+  }
+  p++;
+
+  return typeId >= 0;
+}
+
+
+// Converts a JSON formatted command reply into a binary frame,
+// or a JSON array of replies (to a batch of commands) into a batch frame.
+bool Websocket::binary_transcode(const char *json, std::string& out)
+{
+  const char *p = binary_skip_ws(json);
+  if(*p != '['){
+    return binary_transcode_object(p, out);
+  }
+
+  std::string frame;
+  out.clear();
+  out += (char)BIN_TYPE_BATCH;
+  p = binary_skip_ws(p + 1);
+  while(*p != ']'){
+    if(!binary_transcode_object(p, frame) || frame.size() > 0xFFFF) return false;
+    out += (char)(frame.size() & 0xFF);
+    out += (char)((frame.size() >> 8) & 0xFF);
+    out += frame;
+    p = binary_skip_ws(p);
+    if(*p == ',') p = binary_skip_ws(p + 1);
+    else if(*p != ']') return false;
+  }
+  return out.size() > 1;
+}
+
+} // ends namespace openGalaxy
+
@@ -130,6 +130,69 @@ static const char *get_http_mimetype(const char *file)
 }
 
 
+// Returns true for the URI's that are generated by the server (instead of
+// being served from www_root) for use by monitoring tools. These do not
+// need a (password) session, only the client certificate.
+static bool is_status_uri(const char *uri)
+{
+  return strcmp(uri, "/stats.json") == 0 || strcmp(uri, "/metrics") == 0;
+}
+
+
+// Returns true if the client may read the status URI's.
+// When client certificates are used they were verified by the SSL handshake,
+// otherwise only clients on the loopback interface are allowed.
+static bool status_uri_allowed(struct lws *wsi, context_options& options)
+{
+  if(options.no_ssl == 0 && options.no_client_certs == 0) return true;
+  char name[100], ip[50];
+  name[0] = ip[0] = '\0';
+  lws_get_peer_addresses(wsi, lws_get_socket_fd(wsi), name, sizeof name, ip, sizeof ip);
+  return
+    strncmp(ip, "127.", 4) == 0 ||
+    strncmp(ip, "::ffff:127.", 11) == 0 ||
+    strcmp(ip, "::1") == 0;
+}
+
+
+// Sends a generated (uncached) document as the reply to a HTTP GET request
+// Returns a negative value on error
+static int http_serve_generated(struct lws *wsi, const char *mimetype, const std::string& body)
+{
+  const char *cache_control = "no-cache, no-store, must-revalidate";
+  std::vector<unsigned char> buf(LWS_SEND_BUFFER_PRE_PADDING + 512 + body.size());
+  unsigned char *start = &buf[LWS_SEND_BUFFER_PRE_PADDING];
+  unsigned char *p = start;
+  unsigned char *end = &buf[0] + buf.size();
+
+  if(lws_add_http_header_status(wsi, HTTP_STATUS_OK, &p, end)) return -1;
+  if(lws_add_http_header_by_name(
+    wsi,
+    (const unsigned char *)"content-type:",
+    (const unsigned char *)mimetype,
+    strlen(mimetype),
+    &p,
+    end)
+  ) return -1;
+  if(lws_add_http_header_by_name(
+    wsi,
+    (const unsigned char *)"cache-control:",
+    (const unsigned char *)cache_control,
+    strlen(cache_control),
+    &p,
+    end)
+  ) return -1;
+  if(lws_add_http_header_content_length(wsi, body.size(), &p, end)) return -1;
+  if(lws_finalize_http_header(wsi, &p, end)) return -1;
+
+  // The body is small, send it together with the headers
+  if((size_t)(end - p) < body.size()) return -1;
+  memcpy(p, body.data(), body.size());
+  p += body.size();
+  return lws_write(wsi, start, p - start, LWS_WRITE_HTTP_HEADERS);
+}
+
+
 // static function:
 // libwebsockets callback for the openGalaxy::HTTP protocol
 int Websocket::http_protocol_callback(
@@ -188,11 +251,9 @@ int Websocket::http_protocol_callback(
           "SSL certificate, blacklisting IP address: %s",
           ctxpss->websocket->http_last_client_ip
         );
-        ctxpss->websocket->opengalaxy().websocket().blacklist.append(
-          new class BlacklistedIpAddress(
-            ctxpss->websocket->http_last_client_ip,
-            ctxpss->websocket->opengalaxy().settings().blacklist_timeout_minutes
-          )
+        ctxpss->websocket->opengalaxy().websocket().blacklist_add(
+          ctxpss->websocket->http_last_client_ip,
+          ctxpss->websocket->opengalaxy().settings().blacklist_timeout_minutes
         );
         ctxpss->websocket->opengalaxy().galaxy().GenerateWrongCodeAlarm_nb(
           Galaxy::sia_module::rs232,
@@ -276,6 +337,7 @@ int Websocket::http_protocol_callback(
       }
       if(s){
         s->http_connected = 0;
+        s->closed();
       }
 
       break;
@@ -299,7 +361,8 @@ int Websocket::http_protocol_callback(
       std::string http_referer;
       if(
         (ctxpss->websocket->opengalaxy().m_options.no_ssl == 0) &&
-        (ctxpss->websocket->opengalaxy().m_options.no_client_certs == 0)
+        (ctxpss->websocket->opengalaxy().m_options.no_client_certs == 0) &&
+        !is_status_uri((const char*)in)
       ){
         unsigned char *p;
         unsigned long long int s_id;
@@ -535,7 +598,7 @@ int Websocket::http_protocol_callback(
         }
 
         // Valid session, reset the 'unused session' timeout timer
-        s->timeout_tp = std::chrono::high_resolution_clock::now();
+        s->set_used();
 
         // Reset the activity timeout for this session
         s->set_active();
@@ -544,6 +607,26 @@ int Websocket::http_protocol_callback(
       // do not accept post data
       if(lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI)) return 1;
 
+      // Latency statistics and metrics for monitoring tools (see class Stats)
+      if(is_status_uri((const char*)in)){
+        if(!status_uri_allowed(wsi, ctxpss->websocket->opengalaxy().m_options)){
+          ctxpss->websocket->opengalaxy().syslog().error("Websocket: HTTP GET Request denied for '%s' (not a local client)", (char*)in);
+          lws_return_http_status(wsi, HTTP_STATUS_FORBIDDEN, "Not allowed!");
+          goto try_to_reuse;
+        }
+        std::string body;
+        if(strcmp((const char*)in, "/metrics") == 0){
+          ctxpss->websocket->opengalaxy().stats().metrics(body);
+          n = http_serve_generated(wsi, "text/plain; version=0.0.4", body);
+        }
+        else {
+          ctxpss->websocket->opengalaxy().stats().json(body);
+          n = http_serve_generated(wsi, "application/json", body);
+        }
+        if(n < 0) return -1;
+        goto try_to_reuse;
+      }
+
       // this server has no knowledge of directories
       // So only serve files that were explicitly approved by us
       for(m = 0, n = 1; ctxpss->websocket->valid_files_to_serve[m]; m++){
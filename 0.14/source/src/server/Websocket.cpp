@@ -35,6 +35,7 @@
 #include "credentials.h"
 #include "Certificates.hpp"
 #include <algorithm>
+#include <climits>
 #include <string>
 #include <sys/stat.h>
 #if __linux__
@@ -190,25 +191,82 @@ void utf8encode(const char *in, std::string& out)
 const struct lws_extension Websocket::exts[] = {
 	{
 		"permessage-deflate",
-		lws_extension_callback_pm_deflate,
+		Websocket::pm_deflate_callback,
 		"permessage-deflate"
 	},
 	{
 		"deflate-frame",
-		lws_extension_callback_pm_deflate,
+		Websocket::pm_deflate_callback,
 		"deflate_frame"
 	},
 	{ NULL, NULL, NULL /* terminator */ }
 };
 
 
+// static function:
+// Lets libwebsockets construct the extension, then applies the configured
+// window size and memory level (used to compress outgoing frames).
+int Websocket::pm_deflate_callback(
+  struct lws_context *context,
+  const struct lws_extension *ext,
+  struct lws *wsi,
+  enum lws_extension_callback_reasons reason,
+  void *user,
+  void *in,
+  size_t len
+){
+  static const char *server_window = "server_max_window_bits";
+
+  int n = lws_extension_callback_pm_deflate(context, ext, wsi, reason, user, in, len);
+  if(n != 0 || reason != LWS_EXT_CB_CONSTRUCT || !context || !user) return n;
+
+  ContextUserData *ctxpss = (ContextUserData *) lws_context_user(context);
+  if(!ctxpss || !ctxpss->websocket) return n;
+
+  // Never compress with a larger window then the client has offered to accept
+  int window_bits = ctxpss->websocket->opengalaxy().settings().websocket_deflate_window_bits;
+  char offer[256];
+  if(lws_hdr_copy(wsi, offer, sizeof(offer), WSI_TOKEN_EXTENSIONS) > 0){
+    const char *p = strstr(offer, server_window);
+    if(p && p[strlen(server_window)] == '='){
+      int bits = strtol(&p[strlen(server_window) + 1], nullptr, 10);
+      if(bits >= 9 && bits < window_bits) window_bits = bits;
+    }
+  }
+
+  // The extension's private data was allocated by LWS_EXT_CB_CONSTRUCT
+  void *priv = *((void **)user);
+  struct lws_ext_option_arg oa;
+  char value[16];
+
+  memset(&oa, 0, sizeof oa);
+  snprintf(value, sizeof value, "%d", window_bits);
+  oa.option_name = server_window;
+  oa.start = value;
+  oa.len = strlen(value);
+  lws_extension_callback_pm_deflate(context, ext, wsi, LWS_EXT_CB_NAMED_OPTION_SET, priv, &oa, 0);
+
+  memset(&oa, 0, sizeof oa);
+  snprintf(value, sizeof value, "%d", ctxpss->websocket->opengalaxy().settings().websocket_deflate_mem_level);
+  oa.option_name = "mem_level";
+  oa.start = value;
+  oa.len = strlen(value);
+  lws_extension_callback_pm_deflate(context, ext, wsi, LWS_EXT_CB_NAMED_OPTION_SET, priv, &oa, 0);
+
+  return n;
+}
+
+
 
 // class Websocket::BroadcastedMessagesArray dtor
 Websocket::BroadcastedMessagesArray::~BroadcastedMessagesArray()
 {
   for(int i = 0; i < Array<BroadcastedMessage*>::size(); i++){
-    thread_safe_free(Array<BroadcastedMessage*>::m_ptData[i]->data);
-    thread_safe_free(Array<BroadcastedMessage*>::m_ptData[i]);
+    thread_safe_free(Array<BroadcastedMessage*>::operator[](i)->data);
+    if(Array<BroadcastedMessage*>::operator[](i)->bin){
+      thread_safe_free(Array<BroadcastedMessage*>::operator[](i)->bin);
+    }
+    thread_safe_free(Array<BroadcastedMessage*>::operator[](i));
   }
 }
 
@@ -219,8 +277,11 @@ void Websocket::BroadcastedMessagesArray::remove(int nIndex)
   if( !(nIndex >= 0 && nIndex < Array<BroadcastedMessage*>::m_nLength) ){
     throw new std::runtime_error("Websocket::BroadcastedMessagesArray::remove: nIndex out of bounds.");
   }
-  thread_safe_free(Array<BroadcastedMessage*>::m_ptData[nIndex]->data);
-  thread_safe_free(Array<BroadcastedMessage*>::m_ptData[nIndex]);
+  thread_safe_free(Array<BroadcastedMessage*>::operator[](nIndex)->data);
+  if(Array<BroadcastedMessage*>::operator[](nIndex)->bin){
+    thread_safe_free(Array<BroadcastedMessage*>::operator[](nIndex)->bin);
+  }
+  thread_safe_free(Array<BroadcastedMessage*>::operator[](nIndex));
   Array<BroadcastedMessage*>::remove(nIndex);
 }
 
@@ -229,8 +290,8 @@ void Websocket::BroadcastedMessagesArray::remove(int nIndex)
 Websocket::CommandReplyMessagesArray::~CommandReplyMessagesArray()
 {
   for(int i = 0; i < Array<CommandReplyMessage*>::size(); i++){
-    thread_safe_free(Array<CommandReplyMessage*>::m_ptData[i]->reply);
-    thread_safe_free(Array<CommandReplyMessage*>::m_ptData[i]);
+    thread_safe_free(Array<CommandReplyMessage*>::operator[](i)->reply);
+    thread_safe_free(Array<CommandReplyMessage*>::operator[](i));
   }
 }
 
@@ -241,8 +302,8 @@ void Websocket::CommandReplyMessagesArray::remove(int nIndex)
   if( !(nIndex >= 0 && nIndex < Array<CommandReplyMessage*>::m_nLength) ){
     throw new std::runtime_error("Websocket::CommandReplyMessagesArray::remove: nIndex out of bounds.");
   }
-  thread_safe_free(Array<CommandReplyMessage*>::m_ptData[nIndex]->reply);
-  thread_safe_free(Array<CommandReplyMessage*>::m_ptData[nIndex]);
+  thread_safe_free(Array<CommandReplyMessage*>::operator[](nIndex)->reply);
+  thread_safe_free(Array<CommandReplyMessage*>::operator[](nIndex));
   Array<CommandReplyMessage*>::remove(nIndex);
 }
 
@@ -250,11 +311,15 @@ void Websocket::CommandReplyMessagesArray::remove(int nIndex)
 // class Websocket ctor
 Websocket::Websocket(openGalaxy *opengalaxy)
 {
-  restart_server = 0;
-
   // Set the backref. to our openGalaxy instance
   m_openGalaxy = opengalaxy;
 
+  restart_timer.set([this]{
+    m_openGalaxy->syslog().error("Info: Restarting server!\n\n");
+    m_openGalaxy->exit_status = openGalaxy::EXIT_STATUS_CERTS_UPDATED;
+    m_openGalaxy->exit();
+  });
+
   // Set the ref. to our Websocket instance in the context data passed
   // to libwebsockets
   ctx_user_data.websocket = this;
@@ -286,6 +351,7 @@ Websocket::Websocket(openGalaxy *opengalaxy)
   path_crl_cert.assign(buf);
   snprintf(buf, sizeof(buf), "%s/%s", ssldir, fmt_path_client_certs);
   path_user_certs.assign(buf);
+  credentials_cache.watch(fn_crl_cert, path_crl_cert, path_user_certs);
   snprintf(buf, sizeof(buf), "%s/%s", ssldir, fmt_credentials_key);
   fn_credentials_key.assign(buf);
   snprintf(buf, sizeof(buf), "%s/%s", ssldir, fmt_verify_key);
@@ -309,7 +375,23 @@ Websocket::Websocket(openGalaxy *opengalaxy)
   // Initially there a no clients and there is nothing to be send to them
   broadcast_do_send = 0;
   broadcast_nclients = 0;
-  broadcast_nclients_done = 0;
+  broadcast_nbinary = 0;
+  broadcast_nfiltered = 0;
+  broadcast_npending = 0;
+  broadcast_in_flight = false;
+  coalesce_count = 0;
+  coalesce_have_binary = false;
+  command_output_len = 0;
+
+  // Keep the last websocket_replay_size SIA messages for clients that RESUME.
+  // Sequence numbers start at the current time (in seconds) so that they
+  // keep increasing when the server restarts.
+  replay_size = m_openGalaxy->settings().websocket_replay_size;
+  replay_ring = (replay_size > 0) ? new ReplayedMessage[replay_size] : nullptr;
+  replay_count = 0;
+  replay_next = 0;
+  broadcast_seq = (unsigned long)time(nullptr) & 0xFFFFFFFFUL;
+  command_output_binary = false;
 
   // Create/start a new thread to handle this Websocket instance
   m_thread = new std::thread(Websocket::Thread, this);
@@ -319,8 +401,10 @@ Websocket::Websocket(openGalaxy *opengalaxy)
 // class Websocket dtor
 Websocket::~Websocket()
 {
+  wakeup();         // (openGalaxy::exit() was called)
   m_thread->join(); // wait for Thread() to finish
   delete m_thread;  // delete the instance
+  if(replay_ring) delete[] replay_ring;
 }
 
 
@@ -332,31 +416,24 @@ void Websocket::blacklist_dummy_callback(openGalaxy&,char*,int)
 }
 
 
-// checks the blacklist and removes any ip addresses that timed out.
-void Websocket::check_blacklist_timeouts(void)
+// Adds an IP address to the blacklist and arms the timer that removes it again
+void Websocket::blacklist_add(const char *ip, long long minutes)
 {
-  using namespace std::chrono;
-
-  auto end_tp = high_resolution_clock::now();
-  auto end_minutes = time_point_cast<minutes>(end_tp);
-  auto end_value = duration_cast<minutes>(end_minutes.time_since_epoch());
-
-  for(int i = 0; i < opengalaxy().websocket().blacklist.size(); i++){
-    auto start_minutes = time_point_cast<minutes>(opengalaxy().websocket().blacklist[i]->start);
-    auto start_value = duration_cast<minutes>(start_minutes.time_since_epoch());
-    auto delta = end_value - start_value;
-
-    if(
-      (delta.count() < 0) ||
-      (delta.count() > (opengalaxy().websocket().blacklist[i]->timeout_minutes))
-    ){
-      opengalaxy().syslog().debug(
-        "Websocket: Removing IP address from blacklist after timeout: %s",
-        opengalaxy().websocket().blacklist[i]->ip.c_str()
-      );
-      opengalaxy().websocket().blacklist.remove(i);
+  BlacklistedIpAddress *entry = new BlacklistedIpAddress(ip, minutes);
+  entry->timer.set([this, entry]{
+    for(int i = 0; i < blacklist.size(); i++){
+      if(blacklist[i] == entry){
+        opengalaxy().syslog().debug(
+          "Websocket: Removing IP address from blacklist after timeout: %s",
+          entry->ip.c_str()
+        );
+        blacklist.remove(i); // (deletes entry)
+        break;
+      }
     }
-  }
+  });
+  blacklist.append(entry);
+  timers.arm(entry->timer, minutes * 60 * 1000);
 }
 
 
@@ -366,7 +443,6 @@ void Websocket::Thread(Websocket *_this)
 {
   try {
     struct lws_context_creation_info context_info;
-    int do_server_restart = 0;
 
     // If SSL is used then register the OID openGalaxy uses to store user credentials
     // in the client certificates with openSSL and load the verify and decrytion keys needed
@@ -417,7 +493,12 @@ void Websocket::Thread(Websocket *_this)
         );
       }
       context_info.protocols = _this->protocols;
-      context_info.extensions = Websocket::exts;
+      if(_this->opengalaxy().settings().websocket_deflate){
+        context_info.extensions = Websocket::exts;
+      }
+      else {
+        context_info.extensions = nullptr;
+      }
       context_info.gid = -1;
       context_info.uid = -1;
       context_info.max_http_header_pool = 16;
@@ -493,21 +574,34 @@ void Websocket::Thread(Websocket *_this)
       if(_this->context == nullptr){
         throw new std::runtime_error("Could not create a websocket context, is the port allready used?");
       }
+      _this->m_wakeup_mutex.lock();
+      _this->m_wakeup_context = _this->context;
+      _this->m_wakeup_mutex.unlock();
 
 // create a vhost
 //lws_create_vhost(_this->context, &context_info, nullptr);
 
       // Enter the service loop
       int n = 0;
-      int timeout_count = 0;
       while(n >= 0 && _this->opengalaxy().isQuit() == false){
 
+        // Log off timed-out sessions, clean up unused sessions and update
+        // the list of blacklisted ip addresses (and restart if needed)
+        _this->timers.expire();
+
+        // Move any coalesced SIA messages that are due to the broadcast list
+        int service_timeout = _this->flush_coalesced(false);
+        int timer_timeout = _this->timers.next_timeout_ms();
+        if(timer_timeout >= 0 && (service_timeout < 0 || timer_timeout < service_timeout)) service_timeout = timer_timeout;
+        // Nothing is due, sleep until a client or wakeup() needs us
+        // (a negative timeout would not wait at all)
+        if(service_timeout < 0) service_timeout = INT_MAX;
+
         // If there are any SIA messages waiting, then send them to all clients
         if(_this->broadcast_do_send){
-          lws_callback_on_writable_all_protocol(
-            _this->context,
-            &_this->protocols[PROTOCOL_OPENGALAXY]
-          );
+          _this->m_broadcast_mutex.lock();
+          _this->schedule_broadcast(_this->context);
+          _this->m_broadcast_mutex.unlock();
         }
 
         // If there are any replies to commands a client has executed,
@@ -522,12 +616,28 @@ void Websocket::Thread(Websocket *_this)
             _this->context
           );
           if(s && s->websocket_connected){
-            strncpy(
-              (char*)_this->command_output_buffer,
-              _this->command_replies[0]->reply,
-              WS_BUFFER_SIZE - 1
-            );
-            _this->command_output_buffer[WS_BUFFER_SIZE - 1] = '\0';
+            // Convert the reply for clients using the binary protocol,
+            // send it as JSON if it could not be converted.
+            std::string bin;
+            if(
+              s->websocket_pss->binary &&
+              binary_transcode(_this->command_replies[0]->reply, bin) &&
+              bin.size() <= WS_BUFFER_SIZE
+            ){
+              memcpy(_this->command_output_buffer, bin.data(), bin.size());
+              _this->command_output_len = bin.size();
+              _this->command_output_binary = true;
+            }
+            else {
+              strncpy(
+                (char*)_this->command_output_buffer,
+                _this->command_replies[0]->reply,
+                WS_BUFFER_SIZE - 1
+              );
+              _this->command_output_buffer[WS_BUFFER_SIZE - 1] = '\0';
+              _this->command_output_len = strlen((char*)_this->command_output_buffer);
+              _this->command_output_binary = false;
+            }
             s->websocket_pss->send_data = true;
             lws_callback_on_writable(s->websocket_wsi);
           }
@@ -538,40 +648,30 @@ void Websocket::Thread(Websocket *_this)
             if(s) Session::remove(s->session, _this->context);
           }
           _this->command_replies.remove(0);
+          // (do not sleep while there are more replies to send)
+          if(_this->command_replies.size() > 0) service_timeout = 0;
           _this->m_command_mutex.unlock();
         }
 
-        if(timeout_count++ > 50 ){ // times 50 ms == 5 seconds
-          timeout_count = 0;
-          // Update the list of blacklisted ip addresses
-          _this->opengalaxy().websocket().check_blacklist_timeouts();
-          // logoff timed-out sessions
-          if(_this->opengalaxy().m_options.auto_logoff == 1){
-            Session::logoff_timed_out_clients(_this->context);
-          }
-          // cleanup unused sessions
-          Session::check_timeouts_and_remove_unused_sessions(_this->context);
-          // Do we need to restart?
-          if(do_server_restart) {
-            _this->opengalaxy().syslog().error("Info: Restarting server!\n\n");
-            _this->opengalaxy().exit_status = openGalaxy::EXIT_STATUS_CERTS_UPDATED;
-            _this->opengalaxy().exit();
-          }
-          if(_this->restart_server) {
-            do_server_restart = 1; // restart in 5 seconds
-            _this->restart_server = 0;
-          }
-        }
-
-        // Service libwebsockets (and throttle the service loop)
-        n = lws_service(_this->context, 100 /* ms */);
+        // Service libwebsockets
+        n = lws_service(_this->context, service_timeout /* ms */);
       }
 
+      _this->m_wakeup_mutex.lock();
+      _this->m_wakeup_context = nullptr;
+      _this->m_wakeup_mutex.unlock();
       lws_cancel_service(_this->context);
       lws_context_destroy(_this->context);
 
       // Cleanup any left over sessions
       _this->ctx_user_data.sessions.erase();
+
+      // Drop any coalesced messages, there is no one left to send them to
+      _this->m_broadcast_mutex.lock();
+      _this->coalesce_buffer.clear();
+      _this->coalesce_binary.clear();
+      _this->coalesce_count = 0;
+      _this->m_broadcast_mutex.unlock();
     }
 
     // Free the pkeys used to verify/decrypt the user credentials stored
@@ -594,30 +694,419 @@ void Websocket::Thread(Websocket *_this)
 }
 
 
+// Makes lws_service() return so the service loop sends what was queued
+// by another thread (a no-op while there is no context)
+void Websocket::wakeup()
+{
+  std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+  if(m_wakeup_context) lws_cancel_service(m_wakeup_context);
+}
+
+
+// Adds a message to the list of messages to broadcast and triggers
+// a libwebsockets write by setting broadcast_do_send
+// (m_broadcast_mutex must be locked by the caller)
+void Websocket::queue_broadcast(
+  const std::string& utf8,
+  const std::string& bin,
+  int audience,
+  const Subscription::Event *event,
+  struct lws *target,
+  std::chrono::steady_clock::time_point received,
+  std::chrono::steady_clock::time_point dequeued
+){
+  struct BroadcastedMessage *msg;
+  msg = (struct BroadcastedMessage*)thread_safe_malloc(
+    sizeof(struct BroadcastedMessage)
+  );
+  msg->len = utf8.size() + 1;
+  msg->data = (char*)thread_safe_malloc(msg->len);
+  memcpy(msg->data, utf8.c_str(), msg->len);
+  msg->bin = nullptr;
+  msg->bin_len = 0;
+  if(bin.size() > 0){
+    msg->bin_len = bin.size();
+    msg->bin = (unsigned char*)thread_safe_malloc(msg->bin_len);
+    memcpy(msg->bin, bin.data(), msg->bin_len);
+  }
+  msg->audience = audience;
+  if(event) msg->event = *event;
+  else memset(&msg->event, 0, sizeof(msg->event));
+  msg->target = target;
+  msg->received = received;
+  msg->dequeued = dequeued;
+  broadcast_msg.append(msg);
+  opengalaxy().stats().broadcast_queue_depth.store(broadcast_msg.size(), std::memory_order_relaxed);
+  broadcast_do_send = 1;
+}
+
+
+// Returns true if the session wants to receive the broadcasted message
+bool Websocket::wants_broadcast(Session *s, int audience, const Subscription::Event& event, struct lws *target)
+{
+  bool filtered = !s->subscription.everything();
+  switch(audience){
+    case AUDIENCE_SESSION:
+      return s->websocket_wsi == target;
+    case AUDIENCE_UNFILTERED:
+      return !filtered;
+    case AUDIENCE_FILTERED:
+      return filtered && s->subscription.match(event);
+    case AUDIENCE_ALL:
+    default:
+      return !filtered || s->subscription.match(event);
+  }
+}
+
+
+// Schedules a write callback for each session that wants the first message
+// in the broadcast list. Messages nobody wants are dropped.
+// (m_broadcast_mutex must be locked by the caller)
+void Websocket::schedule_broadcast(struct lws_context *context)
+{
+  while(!broadcast_in_flight && broadcast_msg.size() > 0){
+    struct BroadcastedMessage& msg = *broadcast_msg[0];
+    int n = 0;
+    for(int i = 0; i < ctx_user_data.sessions.size(); i++){
+      Session *s = ctx_user_data.sessions[i];
+      if(!s->websocket_connected || !s->websocket_wsi || !s->websocket_pss) continue;
+      if(!wants_broadcast(s, msg.audience, msg.event, msg.target)) continue;
+      s->websocket_pss->broadcast_pending = true;
+      lws_callback_on_writable(s->websocket_wsi);
+      n++;
+    }
+    if(n > 0){
+      broadcast_npending = n;
+      broadcast_in_flight = true;
+      opengalaxy().stats().broadcast_started.store(
+        std::chrono::steady_clock::now().time_since_epoch().count(),
+        std::memory_order_relaxed
+      );
+    }
+    else {
+      broadcast_msg.remove(0);
+    }
+  }
+  opengalaxy().stats().broadcast_queue_depth.store(broadcast_msg.size(), std::memory_order_relaxed);
+  broadcast_do_send = 0;
+}
+
+
+// Removes the first message from the broadcast list once it was send to
+// every session it was scheduled for, then schedules the next message.
+// (m_broadcast_mutex must be locked by the caller)
+void Websocket::broadcast_written(struct lws_context *context)
+{
+  if(broadcast_npending > 0 && --broadcast_npending == 0){
+    if(broadcast_msg.size() > 0) broadcast_msg.remove(0);
+    broadcast_in_flight = false;
+    opengalaxy().stats().broadcast_started.store(0, std::memory_order_relaxed);
+    schedule_broadcast(context);
+  }
+}
+
+
+// Recounts the sessions that have a subscription other then ALL
+void Websocket::count_filtered_sessions()
+{
+  int n = 0;
+  for(int i = 0; i < ctx_user_data.sessions.size(); i++){
+    Session *s = ctx_user_data.sessions[i];
+    if(s->websocket_connected && !s->subscription.everything()) n++;
+  }
+  broadcast_nfiltered = n;
+}
+
+
+// Formats a standard (typeId 1) reply for a command handled by the websocket
+static void format_reply(std::string& out, bool success, const char *command, const std::string& text)
+{
+  // text may quote the client's input, escape it for JSON
+  std::string escaped;
+  for(size_t i = 0; i < text.size(); i++){
+    if(text[i] == '"' || text[i] == '\\') escaped += '\\';
+    if((unsigned char)text[i] >= ' ') escaped += text[i];
+  }
+
+  char reply[
+    strlen(Commander::json_command_error_fmt) +
+    strlen(Commander::CommanderTypeDesc[static_cast<int>(Commander::json_reply_id::standard)]) +
+    strlen(command) + escaped.size() + 32
+  ];
+  snprintf(reply, sizeof(reply), Commander::json_command_error_fmt,
+    static_cast<unsigned int>(Commander::json_reply_id::standard),
+    Commander::CommanderTypeDesc[static_cast<int>(Commander::json_reply_id::standard)],
+    (success) ? 1 : 0,
+    command,
+    escaped.c_str()
+  );
+  out = reply;
+}
+
+
+// Handles the SUBSCRIBE command:
+//  SUBSCRIBE                   reports the current subscription
+//  SUBSCRIBE ALL               receive every SIA message (the default)
+//  SUBSCRIBE [ACCOUNT n[,n]] [AREA a[,a]] [ZONE z[-z][,z]] [EVENT XX[,X]]
+void Websocket::subscribe(Session *s, const char *args)
+{
+  std::string error, text;
+  bool success = true;
+
+  while(*args == ' ' || *args == '\t') args++;
+  if(*args){
+    success = s->subscription.parse(args, error);
+    count_filtered_sessions();
+  }
+  if(success) s->subscription.describe(text);
+  else text = error;
+
+  std::string reply;
+  format_reply(reply, success, "SUBSCRIBE", text);
+  write(opengalaxy(), &s->session, nullptr, (char*)reply.c_str());
+}
+
+
+// Adds a broadcasted SIA message to the ring of recent messages
+// (m_broadcast_mutex must be locked by the caller)
+void Websocket::replay_add(unsigned long seq, const std::string& utf8, const std::string& bin, const Subscription::Event& event)
+{
+  if(replay_size <= 0) return;
+  ReplayedMessage& r = replay_ring[replay_next];
+  r.seq = seq;
+  r.utf8 = utf8;
+  r.bin = bin;
+  r.event = event;
+  replay_next = (replay_next + 1) % replay_size;
+  if(replay_count < replay_size) replay_count++;
+}
+
+
+// Handles the RESUME command:
+//  RESUME <seq>   resend the SIA messages broadcasted after message <seq>
+//
+// The messages (that match the subscription of the session) are send in as
+// few frames as possible, followed by a standard reply that reports if any
+// messages were lost. Everything is queued on the broadcast list so that
+// the client receives it before any newer SIA message.
+void Websocket::resume(Session *s, const char *args)
+{
+  std::string text;
+  bool success = true;
+  char *end;
+
+  while(isspace(*args)) args++;
+  unsigned long from = strtoul(args, &end, 10);
+  while(isspace(*end)) end++;
+  if(!*args || *end){
+    std::string reply;
+    format_reply(reply, false, "RESUME", "Expected a sequence number");
+    write(opengalaxy(), &s->session, nullptr, (char*)reply.c_str());
+    return;
+  }
+
+  bool binary = s->websocket_pss && s->websocket_pss->binary;
+  m_broadcast_mutex.lock();
+
+  // The oldest message we still have
+  unsigned long oldest = broadcast_seq + 1;
+  int first = (replay_next - replay_count + replay_size) % ((replay_size > 0) ? replay_size : 1);
+  if(replay_count > 0) oldest = replay_ring[first].seq;
+
+  if(replay_size <= 0){
+    success = false;
+    text = "Disabled by WEBSOCKET-REPLAY-SIZE";
+  }
+  else if(from > broadcast_seq){
+    // The client knows of messages we never send, resend all we have
+    success = false;
+    text = "Unknown sequence number, resending all remembered messages";
+    from = 0;
+  }
+  else if(from + 1 < oldest){
+    success = false;
+    text = "Lost " + std::to_string(oldest - from - 1) + " message(s)";
+  }
+
+  // Collect the messages the client missed
+  std::string frame, bin;
+  int nframe = 0, nbin = 0, count = 0;
+  bool use_bin = binary;
+  for(int i = 0; i < replay_count; i++){
+    ReplayedMessage& r = replay_ring[(first + i) % replay_size];
+    if(r.seq <= from) continue;
+    if(!s->subscription.everything() && !s->subscription.match(r.event)) continue;
+    if(r.bin.size() == 0) use_bin = false;
+  }
+  for(int i = 0; i < replay_count; i++){
+    ReplayedMessage& r = replay_ring[(first + i) % replay_size];
+    if(r.seq <= from) continue;
+    if(!s->subscription.everything() && !s->subscription.match(r.event)) continue;
+    count++;
+    if(use_bin){
+      // Send what we have when this message does not fit in the same frame
+      if(nbin > 0 && bin.size() + r.bin.size() + 2 >= WS_BUFFER_SIZE){
+        queue_broadcast(std::string(), (nbin == 1) ? bin.substr(3) : bin, AUDIENCE_SESSION, nullptr, s->websocket_wsi);
+        bin.clear();
+        nbin = 0;
+      }
+      if(nbin++ == 0) bin += (char)BIN_TYPE_BATCH;
+      bin += (char)(r.bin.size() & 0xFF);
+      bin += (char)((r.bin.size() >> 8) & 0xFF);
+      bin += r.bin;
+    }
+    else {
+      if(nframe > 0 && frame.size() + r.utf8.size() + 3 >= WS_BUFFER_SIZE){
+        queue_broadcast((nframe == 1) ? frame : "[" + frame + "]", std::string(), AUDIENCE_SESSION, nullptr, s->websocket_wsi);
+        frame.clear();
+        nframe = 0;
+      }
+      if(nframe++ > 0) frame += ',';
+      frame += r.utf8;
+    }
+  }
+  if(nbin > 0){
+    queue_broadcast(std::string(), (nbin == 1) ? bin.substr(3) : bin, AUDIENCE_SESSION, nullptr, s->websocket_wsi);
+  }
+  if(nframe > 0){
+    queue_broadcast((nframe == 1) ? frame : "[" + frame + "]", std::string(), AUDIENCE_SESSION, nullptr, s->websocket_wsi);
+  }
+
+  // Followed by the reply
+  if(success) text = "Resent " + std::to_string(count) + " message(s)";
+  std::string reply, reply_bin;
+  format_reply(reply, success, "RESUME", text);
+  if(binary) binary_transcode(reply.c_str(), reply_bin);
+  queue_broadcast(reply, reply_bin, AUDIENCE_SESSION, nullptr, s->websocket_wsi);
+
+  m_broadcast_mutex.unlock();
+}
+
+
+// Moves the coalesced SIA messages to the broadcast list.
+// A single message is send as is, multiple messages are send as a JSON array
+// (and as a batch frame to clients using the binary protocol).
+int Websocket::flush_coalesced(bool force)
+{
+  using namespace std::chrono;
+  int retv = -1;
+  m_broadcast_mutex.lock();
+  if(coalesce_count > 0){
+    int elapsed = duration_cast<milliseconds>(steady_clock::now() - coalesce_start).count();
+    if(force || elapsed >= opengalaxy().settings().websocket_coalesce_ms){
+      std::string bin;
+      if(coalesce_have_binary){
+        if(coalesce_count == 1){
+          bin.assign(coalesce_binary, 2, std::string::npos); // strip the length
+        }
+        else {
+          bin += (char)BIN_TYPE_BATCH;
+          bin += coalesce_binary;
+        }
+      }
+      if(coalesce_count == 1){
+        queue_broadcast(coalesce_buffer, bin, AUDIENCE_UNFILTERED, nullptr, nullptr, coalesce_received, coalesce_dequeued);
+      }
+      else {
+        std::string frame;
+        frame.reserve(coalesce_buffer.size() + 2);
+        frame += '[';
+        frame += coalesce_buffer;
+        frame += ']';
+        queue_broadcast(frame, bin, AUDIENCE_UNFILTERED, nullptr, nullptr, coalesce_received, coalesce_dequeued);
+      }
+      coalesce_buffer.clear();
+      coalesce_binary.clear();
+      coalesce_count = 0;
+    }
+    else {
+      retv = opengalaxy().settings().websocket_coalesce_ms - elapsed;
+    }
+  }
+  m_broadcast_mutex.unlock();
+  return retv;
+}
+
+
 // Broadcast a SIA message to all clients
 // in: SIA message (as JSON object)
-void Websocket::broadcast(std::string& in)
-{
+// bin: SIA message (as binary frame, may be empty if there are no binary clients)
+// event: the fields used to match the message against each session's subscription
+// received/dequeued: when the SIA message was read from the serial port and taken from the output queue
+void Websocket::broadcast(
+  std::string& in,
+  const std::string& bin,
+  const Subscription::Event& event,
+  std::chrono::steady_clock::time_point received,
+  std::chrono::steady_clock::time_point dequeued
+){
   char buf[in.size() + strlen(json_sia_message_fmt) + 32]; // make sure buf is large enough
-  sprintf(buf, json_sia_message_fmt, in.c_str());
   m_broadcast_mutex.lock();
+
+  // Number the message
+  unsigned long seq = broadcast_seq = (broadcast_seq + 1) & 0xFFFFFFFFUL;
+  sprintf(buf, json_sia_message_fmt, seq, in.c_str());
+
+  // Encode the string (JSON data) as UTF-8
+  std::string utf8;
+  utf8encode(buf, utf8);
+
+  // Add the sequence number to the binary frame
+  std::string frame;
+  if(bin.size() > 0){
+    frame.reserve(bin.size() + 5);
+    frame = bin;
+    frame += (char)BIN_TAG(BIN_KIND_UINT, BIN_FIELD_SEQ);
+    for(int i = 0; i < 32; i += 8) frame += (char)((seq >> i) & 0xFF);
+  }
+
+  // Remember it for clients that reconnect
+  replay_add(seq, utf8, frame, event);
+
   if(broadcast_nclients){
-    // Encode the string (JSON data) as UTF-8
-    std::string utf8;
-    utf8encode(buf, utf8);
-    // Add it to the array of messages to te broadcast and trigger
-    // a libwebsockets write by setting broadcast_do_send
-    struct BroadcastedMessage *msg;
-    msg = (struct BroadcastedMessage*)thread_safe_malloc(
-      sizeof(struct BroadcastedMessage)
-    );
-    msg->len = utf8.size() + 1;
-    msg->data = (char*)thread_safe_malloc(msg->len);
-    memcpy(msg->data, utf8.data() , msg->len);
-    broadcast_msg.append(msg);
-    broadcast_do_send = 1;
+    if(opengalaxy().settings().websocket_coalesce_ms > 0){
+      // Send what we have when this message does not fit in the same frame
+      if(
+        coalesce_count > 0 && (
+          coalesce_buffer.size() + utf8.size() + 3 >= WS_BUFFER_SIZE ||
+          coalesce_binary.size() + frame.size() + 3 >= WS_BUFFER_SIZE
+        )
+      ){
+        m_broadcast_mutex.unlock();
+        flush_coalesced(true);
+        m_broadcast_mutex.lock();
+      }
+      // Collect the message untill the coalesce time has passed
+      if(coalesce_count++ == 0){
+        coalesce_start = std::chrono::steady_clock::now();
+        coalesce_received = received;
+        coalesce_dequeued = dequeued;
+        coalesce_have_binary = true;
+      }
+      else {
+        coalesce_buffer += ',';
+      }
+      coalesce_buffer += utf8;
+      // Each binary frame is prefixed by its length
+      if(frame.size() == 0) coalesce_have_binary = false;
+      if(coalesce_have_binary){
+        coalesce_binary += (char)(frame.size() & 0xFF);
+        coalesce_binary += (char)((frame.size() >> 8) & 0xFF);
+        coalesce_binary += frame;
+      }
+      // Sessions with a subscription get each message on its own
+      if(broadcast_nfiltered > 0){
+        queue_broadcast(utf8, frame, AUDIENCE_FILTERED, &event, nullptr, received, dequeued);
+      }
+    }
+    else {
+      queue_broadcast(utf8, frame, AUDIENCE_ALL, &event, nullptr, received, dequeued);
+    }
   }
   m_broadcast_mutex.unlock(); 
+
+  // (also when the message is coalesced, the loop has to time the flush)
+  wakeup();
 }
 
 
@@ -646,6 +1135,7 @@ void Websocket::write(
   opengalaxy.websocket().m_command_mutex.lock();
   opengalaxy.websocket().command_replies.append(l);
   opengalaxy.websocket().m_command_mutex.unlock();
+  opengalaxy.websocket().wakeup();
 }
 
 
@@ -821,7 +1311,13 @@ int Websocket::opengalaxy_protocol_callback(
       }
 
       pss->send_data = false; // initially there are no command replies to send
+      pss->broadcast_pending = false;
       ctxpss->websocket->broadcast_nclients++; // increment the number of connected clients
+      ctxpss->websocket->count_filtered_sessions(); // a session keeps its subscription when it reconnects
+
+      // Is the client using the binary protocol?
+      pss->binary = (strcmp(lws_get_protocol(wsi)->name, BIN_PROTOCOL_NAME) == 0);
+      if(pss->binary) ctxpss->websocket->broadcast_nbinary++;
       return 0;
     }
 
@@ -836,15 +1332,28 @@ int Websocket::opengalaxy_protocol_callback(
         s = Session::get(wsi, context);
       }
       if(s){
-        // Log out of the session when the websocket is closed
-        // and stop polling
-        if(ctxpss) ctxpss->websocket->opengalaxy().poll().disable(s->session);
+        // Log out of the session when the websocket is closed,
+        // stop polling and drop any commands it still has queued
+        if(ctxpss){
+          ctxpss->websocket->opengalaxy().poll().disable(s->session);
+          ctxpss->websocket->opengalaxy().commander().cancel(s->session);
+          ctxpss->websocket->opengalaxy().receiver().cancel(s->session.id);
+        }
         s->logoff();
         s->websocket_connected = 0;
       }
       if(ctxpss){
         // decrement the number of clients
         ctxpss->websocket->broadcast_nclients--;
+        if(pss && pss->binary) ctxpss->websocket->broadcast_nbinary--;
+        // Do not wait for this client to receive the current SIA message
+        if(pss && pss->broadcast_pending){
+          pss->broadcast_pending = false;
+          ctxpss->websocket->m_broadcast_mutex.lock();
+          ctxpss->websocket->broadcast_written(context);
+          ctxpss->websocket->m_broadcast_mutex.unlock();
+        }
+        ctxpss->websocket->count_filtered_sessions();
       }
       break;
     }
@@ -856,65 +1365,65 @@ int Websocket::opengalaxy_protocol_callback(
 
       // Broadcast SIA message(s)?
       //
-      // Output a single messages from the list to all clients.
-      // The last client removes the list entry.
-      // Schedule another write if the list is not yet empty.
+      // Output the first message from the list to this client.
+      // The last client it was scheduled for removes the list entry
+      // and schedules the next message.
       if(
+        pss &&
         ctxpss &&
-        ctxpss->websocket->broadcast_do_send &&
+        pss->broadcast_pending &&
         !ctxpss->websocket->opengalaxy().isQuit()
       ){
+        pss->broadcast_pending = false;
         // yes, get the first message and
         ctxpss->websocket->m_broadcast_mutex.lock(); 
         if(ctxpss->websocket->broadcast_msg.size() > 0){
           struct BroadcastedMessage& msg = *ctxpss->websocket->broadcast_msg[0];
-          // copy it to the write buffer and
-          if(msg.len > WS_BUFFER_SIZE) msg.len = WS_BUFFER_SIZE;
-          memcpy(ctxpss->websocket->sia_output_buffer, msg.data, msg.len);
-          // send it to this client
-          n = lws_write(
-            wsi,
-            ctxpss->websocket->sia_output_buffer,
-            msg.len,
-            LWS_WRITE_TEXT
-          );
-          if(n < 0){ // (sanity check, test for write error)
-            ctxpss->websocket->opengalaxy().syslog().error(
-              "WebSocket: ERROR %d writing to socket",
-              n
+          if(pss->binary && msg.bin){
+            // copy the binary frame to the write buffer and
+            if(msg.bin_len > WS_BUFFER_SIZE) msg.bin_len = WS_BUFFER_SIZE;
+            memcpy(ctxpss->websocket->sia_output_buffer, msg.bin, msg.bin_len);
+            // send it to this client
+            n = lws_write(
+              wsi,
+              ctxpss->websocket->sia_output_buffer,
+              msg.bin_len,
+              LWS_WRITE_BINARY
             );
-            ctxpss->websocket->m_broadcast_mutex.unlock(); 
-            n = -1; // (fatal, close connection)
-            break;
           }
-        }
-        // increment the 'number of clients done' counter
-        ctxpss->websocket->broadcast_nclients_done++;
-        // Did we send this message to all clients?
-        if(
-          ctxpss->websocket->broadcast_nclients_done >=
-          ctxpss->websocket->broadcast_nclients
-        ){
-          // Yes, reset the counter and signal that we are done and
-          ctxpss->websocket->broadcast_nclients_done = 0;
-          ctxpss->websocket->broadcast_do_send = 0;
-          // delete the current message from the fifo list
-          //(sanity check first, test for null message)
-          if(ctxpss->websocket->broadcast_msg.size() > 0){
-            ctxpss->websocket->broadcast_msg.remove(0);
-            // Another message to send?
-            if(ctxpss->websocket->broadcast_msg.size() > 0){
-              // Yes, signal we need to send a message
-              ctxpss->websocket->broadcast_do_send = 1;
-              // And trigger a write callback for all clients
-              lws_callback_on_writable_all_protocol(
-                context,
-                lws_get_protocol(wsi)
-              );
-            }
+          else {
+            // copy it to the write buffer and
+            if(msg.len > WS_BUFFER_SIZE) msg.len = WS_BUFFER_SIZE;
+            memcpy(ctxpss->websocket->sia_output_buffer, msg.data, msg.len);
+            // send it to this client
+            n = lws_write(
+              wsi,
+              ctxpss->websocket->sia_output_buffer,
+              msg.len,
+              LWS_WRITE_TEXT
+            );
+          }
+          // Measure how long the SIA message took to reach this client
+          if(n >= 0 && msg.dequeued != std::chrono::steady_clock::time_point()){
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            Stats& stats = ctxpss->websocket->opengalaxy().stats();
+            stats.record(Stats::stage::event_websocket, now - msg.dequeued);
+            stats.record(Stats::stage::event_total, now - msg.received);
           }
         }
+        // this client is done with the message
+        ctxpss->websocket->broadcast_written(context);
         ctxpss->websocket->m_broadcast_mutex.unlock(); 
+        if(n < 0){ // (sanity check, test for write error)
+          ctxpss->websocket->opengalaxy().syslog().error(
+            "WebSocket: ERROR %d writing to socket",
+            n
+          );
+          n = -1; // (fatal, close connection)
+          break;
+        }
+        // A command reply may be waiting as well
+        if(pss->send_data) lws_callback_on_writable(wsi);
       }
 
       // Command reply to send?
@@ -926,12 +1435,12 @@ int Websocket::opengalaxy_protocol_callback(
       ){
 
         // Send the message to the client
-        n = strlen((char*)ctxpss->websocket->command_output_buffer);
+        n = ctxpss->websocket->command_output_len;
         m = lws_write(
           wsi,
           ctxpss->websocket->command_output_buffer,
           n,
-          LWS_WRITE_TEXT
+          (ctxpss->websocket->command_output_binary) ? LWS_WRITE_BINARY : LWS_WRITE_TEXT
         );
         if(m < n){
           ctxpss->websocket->opengalaxy().syslog().error(
@@ -992,9 +1501,9 @@ int Websocket::opengalaxy_protocol_callback(
               if(in_stream.str().find((const char*)"CERTS") == 0){
                 // Yes, so try to save them
                 n = save_certificates(&in_stream.str().c_str()[5], ctxpss->websocket->opengalaxy());
-                // success, retstart the server by signaling the service loop
-                // that will call openGalaxy::exit() in about 5 seconds
-                ctxpss->websocket->restart_server = 1;
+                // success, retstart the server by calling
+                // openGalaxy::exit() in 5 seconds
+                ctxpss->websocket->timers.arm(ctxpss->websocket->restart_timer, 5000);
                 char buffer[256];
                 snprintf(buffer, 256, Commander::json_standard_reply_fmt,
                   static_cast<unsigned int>(Commander::json_reply_id::standard),
@@ -1005,6 +1514,20 @@ int Websocket::opengalaxy_protocol_callback(
                 ctxpss->websocket->write(ctxpss->websocket->opengalaxy(), &s->session, NULL, buffer);
                 n = 0;
               }
+              // Is it a subscription for a subset of the SIA messages?
+              else if(
+                strncasecmp(in_stream.str().c_str(), "SUBSCRIBE", 9) == 0 &&
+                (in_stream.str().c_str()[9] == '\0' || isspace(in_stream.str().c_str()[9]))
+              ){
+                ctxpss->websocket->subscribe(s, &in_stream.str().c_str()[9]);
+              }
+              // Does the client want the SIA messages it missed?
+              else if(
+                strncasecmp(in_stream.str().c_str(), "RESUME", 6) == 0 &&
+                (in_stream.str().c_str()[6] == '\0' || isspace(in_stream.str().c_str()[6]))
+              ){
+                ctxpss->websocket->resume(s, &in_stream.str().c_str()[6]);
+              }
               else {
                 // No its a normal command, add the it to the list of commands
                 ctxpss->websocket->opengalaxy().commander().execute(
@@ -1025,6 +1548,16 @@ int Websocket::opengalaxy_protocol_callback(
           else {
             // no not authorized
 
+            // A reconnecting client may ask to RESUME before it logs on,
+            // remember it untill the login succeeds.
+            if(
+              len >= 6 && strncasecmp((const char*)in, "RESUME", 6) == 0 &&
+              (len == 6 || isspace(((const char*)in)[6]))
+            ){
+              s->resume_args.assign(&((const char*)in)[6], len - 6);
+              break;
+            }
+
             // Extract username/password (and session id) from the received data
             char *pwd;
             char *sid = strtok_r((char*)in, "\n", &pwd);
@@ -1073,6 +1606,12 @@ int Websocket::opengalaxy_protocol_callback(
 
             // Also let the client know with a reply message
             WriteAuthorizationAcceptedMessage(ctxpss, &pss->session);
+
+            // and send the SIA messages it missed
+            if(s->resume_args.size() > 0){
+              ctxpss->websocket->resume(s, s->resume_args.c_str());
+              s->resume_args.clear();
+            }
             break;
           }
         }
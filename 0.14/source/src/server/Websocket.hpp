@@ -51,6 +51,8 @@
 #include "session_id.hpp"
 #include "Session.hpp"
 #include "context_options.hpp"
+#include "binary.h"
+#include "Subscription.hpp"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN 1
@@ -96,6 +98,8 @@ struct per_session_data_http_protocol {
 struct per_session_data_opengalaxy_protocol {
   session_id session;
   bool send_data; // true when there is a command reply to send
+  bool binary;    // true when the client uses the openGalaxy-binary-protocol
+  bool broadcast_pending; // true while a broadcasted message waits to be written
 };
 
 
@@ -104,6 +108,10 @@ class Websocket {
 public:
   constexpr static int WS_BUFFER_SIZE = 4096;
 
+  // Timers for the session and blacklist timeouts
+  // (only used by the websocket thread, it outlives the sessions)
+  TimingWheel timers;
+
   // Make good use of libwebsockets's context user-data facility.
   // (Use it to keep track of this Websocket instance and all of its sessions)
   class ContextUserData {
@@ -119,13 +127,14 @@ private:
 
   // Used to format a decoded SIA message (itself a JSON object) as a 'command reply' JSON object.
   constexpr static const char* json_sia_message_fmt =
-    "{\"typeId\":0,\"typeDesc\":\"SIA Message\",\"sia\":%s}";
+    "{\"typeId\":0,\"typeDesc\":\"SIA Message\",\"seq\":%lu,\"sia\":%s}";
 
 
   // Count of all protocols
   enum {
     PROTOCOL_HTTP = 0,
     PROTOCOL_OPENGALAXY,
+    PROTOCOL_BINARY,
     PROTOCOL_COUNT
   };
 
@@ -135,10 +144,37 @@ private:
   // Supported extentions
   static const struct lws_extension exts[];
 
+  // Wraps lws_extension_callback_pm_deflate() to apply the configured
+  // window size and memory level to each new compressed connection.
+  static int pm_deflate_callback(
+    struct lws_context *context,
+    const struct lws_extension *ext,
+    struct lws *wsi,
+    enum lws_extension_callback_reasons reason,
+    void *user,
+    void *in,
+    size_t len
+  );
+
   // List of SIA messages to be 'broadcasted' to all clients
   struct BroadcastedMessage { // <- allocated by tmalloc() !
     char *data; // <- allocated by tmalloc() !
     size_t len;
+    unsigned char *bin; // <- allocated by tmalloc() ! (nullptr if not encoded)
+    size_t bin_len;
+    int audience;             // the sessions this message is meant for
+    Subscription::Event event; // matched against each session's subscription
+    struct lws *target;       // the only client to send to (AUDIENCE_SESSION)
+    std::chrono::steady_clock::time_point received; // when the (first) SIA event was read from the serial port
+    std::chrono::steady_clock::time_point dequeued; // and taken from the output queue (both 0 if not a SIA event)
+  };
+
+  // Values for BroadcastedMessage::audience
+  enum {
+    AUDIENCE_ALL = 0,    // every session with a matching subscription
+    AUDIENCE_UNFILTERED, // only sessions subscribed to everything (coalesced frames)
+    AUDIENCE_FILTERED,   // only sessions with a matching (non ALL) subscription
+    AUDIENCE_SESSION     // only the client in BroadcastedMessage::target (RESUME)
   };
   class BroadcastedMessagesArray : public Array<BroadcastedMessage*> {
   public:
@@ -163,6 +199,7 @@ private:
     std::string ip;
     long long timeout_minutes;
     std::chrono::high_resolution_clock::time_point start;
+    TimingWheel::Timer timer; // removes the address from the blacklist
 
     BlacklistedIpAddress(const char* ip_address, unsigned long minutes)
       : ip(ip_address), timeout_minutes(minutes) {
@@ -176,11 +213,89 @@ private:
   // Context of our libwebsocket 'instance'
   struct lws_context *context;
 
+  // Wakes up the service loop from another thread (when there is
+  // something to send), m_wakeup_mutex protects m_wakeup_context
+  std::mutex m_wakeup_mutex;
+  struct lws_context *m_wakeup_context = nullptr;
+  void wakeup();
+
   // List of messages to send to all websocket clients
   BroadcastedMessagesArray broadcast_msg;
   // A mutex to protect the list.
   std::mutex m_broadcast_mutex;
 
+  // SIA messages collected while coalescing (comma separated JSON objects),
+  // the number of messages and the time the first message was added.
+  // (Also protected by m_broadcast_mutex)
+  std::string coalesce_buffer;
+  int coalesce_count;
+  std::chrono::steady_clock::time_point coalesce_start;
+  std::chrono::steady_clock::time_point coalesce_received; // timestamps of the first message
+  std::chrono::steady_clock::time_point coalesce_dequeued;
+
+  // The same messages as length prefixed binary frames, valid only while
+  // coalesce_have_binary is true (ie. every message was binary encoded).
+  std::string coalesce_binary;
+  bool coalesce_have_binary;
+
+  // Ring of the most recently broadcasted SIA messages, kept so that a
+  // client can RESUME after reconnecting (also protected by m_broadcast_mutex)
+  struct ReplayedMessage {
+    unsigned long seq;          // sequence number of the message
+    std::string utf8;           // the JSON object
+    std::string bin;            // the binary frame (empty if not encoded)
+    Subscription::Event event;  // for matching against the subscription
+  };
+  ReplayedMessage *replay_ring;
+  int replay_size;  // number of entries in replay_ring (0 = disabled)
+  int replay_count; // number of valid entries
+  int replay_next;  // the entry to (over)write next
+
+  // Sequence number of the last broadcasted SIA message
+  unsigned long broadcast_seq;
+
+  // Adds a message to the ring (m_broadcast_mutex must be locked)
+  void replay_add(unsigned long seq, const std::string& utf8, const std::string& bin, const Subscription::Event& event);
+
+  // Adds a message to the broadcast list (m_broadcast_mutex must be locked)
+  // bin may be empty if there are no clients using the binary protocol.
+  // target is only used for AUDIENCE_SESSION.
+  // received and dequeued are the timestamps of a SIA event (see class SiaEvent).
+  void queue_broadcast(
+    const std::string& utf8,
+    const std::string& bin,
+    int audience,
+    const Subscription::Event *event,
+    struct lws *target,
+    std::chrono::steady_clock::time_point received = std::chrono::steady_clock::time_point(),
+    std::chrono::steady_clock::time_point dequeued = std::chrono::steady_clock::time_point()
+  );
+
+  // Returns true if the session wants to receive a message for this audience
+  static bool wants_broadcast(Session *s, int audience, const Subscription::Event& event, struct lws *target);
+
+  // Schedules a write callback for each session that wants the first message
+  // in the broadcast list (m_broadcast_mutex must be locked)
+  void schedule_broadcast(struct lws_context *context);
+
+  // Called after the first message in the broadcast list was written to
+  // (or dropped for) a session (m_broadcast_mutex must be locked)
+  void broadcast_written(struct lws_context *context);
+
+  // Recounts the sessions that have a subscription other then ALL
+  void count_filtered_sessions();
+
+  // Handles the SUBSCRIBE command for a session
+  void subscribe(Session *s, const char *args);
+
+  // Handles the RESUME command for a session
+  void resume(Session *s, const char *args);
+
+  // Moves the coalesced messages to the broadcast list when the coalesce
+  // time has passed (or immediately if force is true).
+  // Returns the number of ms left before the next flush, or -1 when idle.
+  int flush_coalesced(bool force);
+
   // List of status messages added by the commander thread in response to
   // each command, to be sent to their 'owning' session.
   CommandReplyMessagesArray command_replies;
@@ -191,8 +306,8 @@ private:
   // to authenticate a client connection.
   class ObjectArray<BlacklistedIpAddress*> blacklist;
 
-  // Called periodicly to remove IP addresses from the blacklist after an amount of time has passed.
-  void check_blacklist_timeouts(void);
+  // Adds an IP address to the blacklist, it is removed again when 'minutes' minutes have passed.
+  void blacklist_add(const char *ip, long long minutes);
 
   // An empty callback function (used when executing a 'CODE-ALARM' command in
   // response to a client certificate that failed authentication).
@@ -205,12 +320,19 @@ private:
   // Count of connected clients
   volatile int broadcast_nclients;
 
-  // Counter that keeps track of how many clients the current
-  // SIA message has been send to.
-  volatile int broadcast_nclients_done;
+  // Count of connected clients using the openGalaxy-binary-protocol
+  volatile int broadcast_nbinary;
 
-  // set to 1 after certs were downloaded, restarts after 5..10 seconds
-  int restart_server;
+  // Count of connected clients with a subscription other then ALL
+  volatile int broadcast_nfiltered;
+
+  // Number of sessions the current SIA message still has to be send to,
+  // and true while the first message in the list is being send.
+  volatile int broadcast_npending;
+  volatile bool broadcast_in_flight;
+
+  // armed after certs were downloaded, restarts the server after 5 seconds
+  TimingWheel::Timer restart_timer;
 
   //
   // Buffers used by the callback for the HTTP protocol:
@@ -238,6 +360,8 @@ private:
   ];
   unsigned char* command_output_buffer =
     &_command_output_buffer[LWS_SEND_BUFFER_PRE_PADDING];
+  size_t command_output_len;   // number of bytes in command_output_buffer
+  bool command_output_binary;  // true if command_output_buffer is a binary frame
   unsigned char* sia_output_buffer =
     &_sia_output_buffer[LWS_SEND_BUFFER_PRE_PADDING];
 
@@ -273,7 +397,7 @@ private:
   static int opengalaxy_protocol_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
 
   // List of supported protocols and their callbacks
-  struct lws_protocols protocols[3] = {
+  struct lws_protocols protocols[4] = {
     // first protocol must always be HTTP handler
     {
       "openGalaxy-http-protocol",
@@ -287,6 +411,12 @@ private:
       sizeof(struct per_session_data_opengalaxy_protocol),
       WS_BUFFER_SIZE,
     },
+    {
+      BIN_PROTOCOL_NAME,
+      opengalaxy_protocol_callback,
+      sizeof(struct per_session_data_opengalaxy_protocol),
+      WS_BUFFER_SIZE,
+    },
     { nullptr, nullptr, 0, 0 } // terminator
   };
 
@@ -309,6 +439,9 @@ public:
   // The RSA private key used to decrypt user credentials.
   EVP_PKEY *credentials_key;
 
+  // Credentials parsed from client certificates (used by Session::start)
+  CredentialsCache credentials_cache;
+
   // Complete path to the www root directory
   std::string path_www_root;
 
@@ -428,7 +561,35 @@ public:
   ~Websocket();
 
   // Broadcast a SIA message to all clients
-  void broadcast(std::string&);
+  // (JSON object and the binary frame for openGalaxy-binary-protocol clients)
+  // received and dequeued are the timestamps of the SIA event, used to
+  // measure the latency to each client.
+  void broadcast(
+    std::string& json,
+    const std::string& bin,
+    const Subscription::Event& event,
+    std::chrono::steady_clock::time_point received,
+    std::chrono::steady_clock::time_point dequeued
+  );
+
+  // Returns true if any client uses the openGalaxy-binary-protocol
+  inline bool have_binary_clients(){ return broadcast_nbinary > 0; }
+
+  // Returns the number of connected websocket clients
+  inline int clients(){ return broadcast_nclients; }
+
+  // Encoders for the openGalaxy-binary-protocol (see binary.h)
+  // implemented in Websocket-Binary.cpp
+  static void binary_put_byte(std::string& out, int id, unsigned int value);
+  static void binary_put_uint(std::string& out, int id, unsigned int value);
+  static void binary_put_string(std::string& out, int id, const char *s, size_t len);
+  static void binary_put_array(std::string& out, int id, const unsigned char *a, size_t count);
+
+  // Converts a JSON formatted command reply into a binary frame,
+  // or a JSON array of replies into a batch frame.
+  // Returns false if the reply could not be converted.
+  static bool binary_transcode(const char *json, std::string& out);
+  static bool binary_transcode_object(const char *&p, std::string& out);
 
 };
 
@@ -32,6 +32,7 @@
 #define __OPENGALAXY_CONTEXT_OPTIONS_HPP__
 
 #include "atomic.h"
+#include <string>
 
 namespace openGalaxy {
 
@@ -43,6 +44,10 @@ public:
   int no_ssl;           // Set to 1 to disable SSL.
   int no_password;      // Set to 1 to disable the use of a username/password (when using client certificates).
   int auto_logoff;      // Set to 1 to enable automatic logoff after a timeout.
+  std::string trace_file;  // Record the data send/received over the serial port to this file.
+  std::string replay_file; // Replay the data from this file instead of using the serial port.
+  int replay_fast;      // Set to 1 to replay as fast as possible instead of at the recorded speed.
+  int offline;          // Set to 1 to create a context without worker threads, websocket server and serial port (used by src/bench).
 
   // default ctor
   context_options(){
@@ -50,6 +55,8 @@ public:
     auto_logoff = 1;
     no_client_certs = 0;
     no_ssl = 0;
+    replay_fast = 0;
+    offline = 0;
   }
 
   // copy ctor
@@ -58,6 +65,10 @@ public:
     auto_logoff = s.auto_logoff;
     no_client_certs = s.no_client_certs;
     no_ssl = s.no_ssl;
+    trace_file = s.trace_file;
+    replay_file = s.replay_file;
+    replay_fast = s.replay_fast;
+    offline = s.offline;
   }
 
   // = operator
@@ -66,6 +77,10 @@ public:
     auto_logoff = s.auto_logoff;
     no_client_certs = s.no_client_certs;
     no_ssl = s.no_ssl;
+    trace_file = s.trace_file;
+    replay_file = s.replay_file;
+    replay_fast = s.replay_fast;
+    offline = s.offline;
     return *this;
   }
   context_options& operator=(context_options* s){
@@ -62,6 +62,9 @@ static struct option cmd_line_options[] = {
     { "disable-ssl",            no_argument,       nullptr, 'd' },
     { "disable-password",       no_argument,       nullptr, 'p' },
     { "disable-auto-logoff",    no_argument,       nullptr, 'a' },
+    { "trace",                  required_argument, nullptr, 't' },
+    { "replay",                 required_argument, nullptr, 'r' },
+    { "replay-fast",            no_argument,       nullptr, 'f' },
     { NULL, 0, 0, 0 }
   };
 
@@ -69,7 +72,7 @@ static const char* synopsis =
   "\n"
   "Synopsis: opengalaxy [-h] [-l] "
   "[-v] "
-  "[-n] [-d] [-a]"
+  "[-n] [-d] [-a] [-t file] [-r file [-f]]"
   "\n"
   "\n"
   " -h or --help\t\t\tPrints this help text and exit.\n"
@@ -81,6 +84,12 @@ static const char* synopsis =
   "\t\t\t\tand password to log on (implies -a).\n"
   " -a or --disable-auto-logoff\tDisable automaticly logging off clients\n"
   "\t\t\t\twhen they have been inactive for a while.\n"
+  " -t or --trace <file>\t\tRecord all data send and received over the\n"
+  "\t\t\t\tserial port to a capture file.\n"
+  " -r or --replay <file>\t\tReplay a capture file instead of using the\n"
+  "\t\t\t\tserial port, then exit.\n"
+  " -f or --replay-fast\t\tReplay as fast as possible instead of at the\n"
+  "\t\t\t\trecorded speed.\n"
   "\n";
 
 static const char* licence =
@@ -141,6 +150,7 @@ openGalaxy::openGalaxy(context_options& options)
   m_Commander_exptr = nullptr;
   m_Output_exptr = nullptr;
   m_Poll_exptr = nullptr;
+  m_Executor_exptr = nullptr;
 
   // Initialize the mutex for the exit() and isQuit() member functions
   m_lock = new std::unique_lock<std::mutex>(m_lock_mutex);
@@ -197,10 +207,22 @@ openGalaxy::openGalaxy(context_options& options)
   if(m_Settings->galaxy_dip8)
     syslog().info("Galaxy dipswitch 8 position configured as 'ON'.");
 
+  m_Stats = new Stats(*this);
+  m_Executor = new Executor(*this);
   m_Galaxy = new Galaxy(*this);
   m_SIA = new SIA(*this);
   m_Output = new Output(*this);
 
+  // A context for the benchmarks (src/bench) stops here: SIA::Decode() needs
+  // a serial port and receiver to talk to, but nothing is opened or started
+  // (and the executor never runs the tasks that are scheduled).
+  if(m_options.offline){
+    m_Serial = new SerialPort(*this);
+    m_Receiver = new Receiver(*this);
+    m_mutex.unlock();
+    return;
+  }
+
   // Open the serial port
   // (this blocks for a while on windows if the port does not exist)
   syslog().info(
@@ -220,6 +242,9 @@ openGalaxy::openGalaxy(context_options& options)
   m_Poll = new Poll(*this);
   m_Websocket = new Websocket(this);
 
+  // Start running the tasks scheduled above
+  m_Executor->start();
+
   m_mutex.unlock();
 }
 
@@ -227,6 +252,8 @@ openGalaxy::openGalaxy(context_options& options)
 openGalaxy::~openGalaxy()
 {
   if(!isQuit()) exit();
+  // (wait for the thread that called exit(), if it was one of the executor's)
+  if(m_Executor) m_Executor->join();
   if(m_Poll) delete m_Poll;
   if(m_Commander) delete m_Commander;
   if(m_Receiver) delete m_Receiver;
@@ -235,6 +262,8 @@ openGalaxy::~openGalaxy()
   if(m_SIA) delete m_SIA;
   if(m_Galaxy) delete m_Galaxy;
   if(m_Serial) delete m_Serial;
+  if(m_Executor) delete m_Executor;
+  if(m_Stats) delete m_Stats;
   if(m_Settings) delete m_Settings;
   if(m_Syslog) delete m_Syslog;
 }
@@ -249,33 +278,32 @@ void openGalaxy::exit()
   m_quit = true;
   m_mutex.unlock();
 
-  // Notify the worker threads and wait until they exit
-  try {
-    poll().notify();
-    poll().join();
-  }
-  catch(...) {
-    m_Poll_exptr = std::current_exception();
+  // A context for the benchmarks has no worker threads to wait for
+  if(m_options.offline){
+    m_lock_cv.notify_one();
+    return;
   }
 
+  // Stop the I/O loop (it runs the receiver) and fail any commands still
+  // waiting to be send, so no task keeps waiting for the panel
   try {
-    receiver().notify();
+    executor().stop_loop();
     receiver().join();
   }
   catch(...) {
     m_Receiver_exptr = std::current_exception();
   }
 
+  // Stop the worker pool (this waits for the tasks that are running, the
+  // output plugins included)
   try {
-    commander().notify();
-    commander().join();
+    executor().stop();
   }
   catch(...) {
-    m_Commander_exptr = std::current_exception();
+    m_Executor_exptr = std::current_exception();
   }
 
   try {
-    output().notify();
     output().join();
   }
   catch(...) {
@@ -306,6 +334,9 @@ void openGalaxy::rethrow_thread_exceptions()
 
   // re-throw any exception from the poll thread
   if(m_Poll_exptr) std::rethrow_exception(m_Poll_exptr);
+
+  // re-throw any exception from the executor's threads
+  if(m_Executor_exptr) std::rethrow_exception(m_Executor_exptr);
 }
 
 
@@ -333,7 +364,7 @@ bool context_options::parse_command_line(int argc, char *argv[])
   bool quit = false;
 
   while( n >= 0 ){
-    n = getopt_long( argc, argv, "hlnvdpa"
+    n = getopt_long( argc, argv, "hlnvdpat:r:f"
       , cmd_line_options, &opt_index
     );
     if( n < 0 ) continue;
@@ -367,6 +398,15 @@ bool context_options::parse_command_line(int argc, char *argv[])
       case 'a':
         auto_logoff = 0;
         break;
+      case 't':
+        trace_file = optarg;
+        break;
+      case 'r':
+        replay_file = optarg;
+        break;
+      case 'f':
+        replay_fast = 1;
+        break;
       default:
         quit = true;
         break;
@@ -381,6 +421,14 @@ bool context_options::parse_command_line(int argc, char *argv[])
     quit = true;
   }
 
+  if( trace_file.size() && replay_file.size() ){
+    std::cout <<
+      "Error: "
+      "--trace and --replay cannot work together!\n" <<
+      std::endl;
+    quit = true;
+  }
+
   return quit;
 }
 
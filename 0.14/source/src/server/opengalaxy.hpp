@@ -68,6 +68,7 @@
 
 #include "Syslog.hpp"
 #include "Settings.hpp"
+#include "Executor.hpp"
 #include "Serial.hpp"
 #include "Sia.hpp"
 #include "Receiver.hpp"
@@ -76,6 +77,7 @@
 #include "Output.hpp"
 #include "Poll.hpp"
 #include "Galaxy.hpp"
+#include "Stats.hpp"
 #include "context_options.hpp"
 
 namespace openGalaxy {
@@ -100,7 +102,11 @@ private:
   class Syslog *m_Syslog = nullptr;
   class Settings *m_Settings = nullptr;
 
-  // These classes have worker threads
+  // Runs the work of the Receiver, Commander, Output and Poll classes
+  class Executor *m_Executor = nullptr;
+
+  // These classes do their work on the Executor
+  // (except Websocket, libwebsockets runs its own service loop)
   class Receiver *m_Receiver = nullptr;
   class Websocket *m_Websocket = nullptr;
   class Commander *m_Commander = nullptr;
@@ -111,6 +117,7 @@ private:
   class Galaxy *m_Galaxy = nullptr;
   class SerialPort *m_Serial = nullptr;
   class SIA *m_SIA = nullptr;
+  class Stats *m_Stats = nullptr;
 
   // re-throws exceptions caught in the worker threads
   void rethrow_thread_exceptions();
@@ -144,6 +151,7 @@ public:
 
   inline class Syslog&     syslog()     { return *m_Syslog; }
   inline class Settings&   settings()   { return *m_Settings; }
+  inline class Executor&   executor()   { return *m_Executor; }
   inline class Receiver&   receiver()   { return *m_Receiver; }
   inline class Websocket&  websocket()  { return *m_Websocket; }
   inline class Commander&  commander()  { return *m_Commander; }
@@ -152,6 +160,7 @@ public:
   inline class Galaxy&     galaxy()     { return *m_Galaxy; }
   inline class SerialPort& serialport() { return *m_Serial; }
   inline class SIA&        sia()        { return *m_SIA; }
+  inline class Stats&      stats()      { return *m_Stats; }
 
   // worker threads store any thrown exception here
   std::exception_ptr m_Receiver_exptr;
@@ -159,6 +168,7 @@ public:
   std::exception_ptr m_Commander_exptr;
   std::exception_ptr m_Output_exptr;
   std::exception_ptr m_Poll_exptr;
+  std::exception_ptr m_Executor_exptr;
 
 }; // ends class openGalaxy
 
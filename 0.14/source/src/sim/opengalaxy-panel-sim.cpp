@@ -0,0 +1,732 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// opengalaxy-panel-sim - Emulates a Galaxy panel on a pseudo terminal
+//
+// Opens a pseudo terminal and answers the SIA blocks that openGalaxy sends
+// to it the way a Galaxy panel (with a RS232 module) would: remote logins,
+// area, zone and output commands and their control/extended replies. It can
+// also send storms of SIA events and inject errors (bad parity, dropped
+// and rejected blocks) to test how the receiver copes with them.
+//
+// Point RECEIVER-TTY in galaxy.conf at the name of the pseudo terminal
+// (or at the symbolic link given with --link) and start openGalaxy.
+// A summary of the traffic is printed when the simulator exits (Ctrl-C).
+//
+
+#include "atomic.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <string>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <getopt.h>
+
+#include "Siablock.hpp"
+
+namespace openGalaxy {
+
+// Options from the command line
+class sim_options {
+public:
+  std::string link;           // create a symbolic link to the pseudo terminal
+  std::string remote_code = "543210"; // the remote code that logs in
+  unsigned int account = 1234;// the SIA account number of the panel
+  int baudrate = 9600;        // the (simulated) speed of the serial line
+  int reply_delay_ms = 20;    // the time the panel takes to process a command
+  int session_timeout_s = 30; // a remote login ends after this idle time
+  int storm = 0;              // the number of events in an event storm
+  int rate = 5;               // events per second during a storm
+  int storm_every_s = 0;      // repeat the storm after this many seconds (0 = once)
+  int storm_delay_s = 5;      // start the first storm after this many seconds
+  int block_gap_ms = 50;      // the time between the blocks of an event
+  int parity_errors = 0;      // % of the blocks send with a bad parity
+  int drops = 0;              // % of the commands that are not answered
+  int rejects = 0;            // % of the commands that are rejected
+  unsigned int seed = 1;      // seed for the error injection
+};
+
+class PanelSim {
+public:
+  PanelSim(sim_options& options);
+  ~PanelSim();
+
+  bool open();
+  void run(volatile sig_atomic_t& quit);
+  void report();
+
+private:
+  typedef SiaBlock::FunctionCode FunctionCode;
+  typedef std::chrono::steady_clock clock;
+
+  // The time a SIA transmitter waits for an acknoledge
+  static constexpr int ack_timeout_ms = 2500;
+
+  sim_options& m_options;
+  int m_master = -1;
+  int m_slave = -1;
+  std::string m_name;
+  std::minstd_rand m_random;
+
+  // The model of the panel
+  char m_armed[32];           // '0' unset, '1' set, '2' part set
+  char m_alarm[32];           // '0' normal, '1' alarm, '2' reset required
+  char m_ready[32];           // '0' unset, '1' set, '2' part set, '3' ready to set
+  std::map<unsigned int,int> m_omitted;
+  unsigned char m_outputs[32];// per RIO: bits 7-4 are present, 3-0 are on
+
+  // Remote login
+  bool m_logged_in = false;
+  clock::time_point m_session_last;
+
+  // Received bytes that do not yet form a complete block
+  std::string m_rx;
+
+  // The blocks of the events waiting to be send, and the state of the one at the front
+  struct event_block {
+    FunctionCode fc;
+    std::string message;
+    int event;                // the sequence number of the event
+  };
+  std::deque<event_block> m_tx;
+  bool m_tx_waiting = false;  // the front block was send, waiting for the acknoledge
+  int m_tx_retry = 0;
+  clock::time_point m_tx_sent;
+  clock::time_point m_tx_next;
+
+  // Event storms
+  int m_storm_left = 0;
+  int m_event_count = 0;
+  clock::time_point m_storm_next;
+  clock::time_point m_event_next;
+
+  // Statistics
+  struct {
+    unsigned long logins = 0;
+    unsigned long login_failures = 0;
+    unsigned long commands = 0;
+    unsigned long replies = 0;
+    unsigned long acknoledged = 0;
+    unsigned long rejected = 0;
+    unsigned long unknown = 0;
+    unsigned long bad_parity_received = 0;
+    unsigned long bad_parity_send = 0;
+    unsigned long dropped = 0;
+    unsigned long events = 0;
+    unsigned long event_blocks = 0;
+    unsigned long event_retries = 0;
+    unsigned long event_failures = 0;
+    unsigned long acks = 0;
+    double ack_ms_total = 0;
+    double ack_ms_max = 0;
+    unsigned long bytes_in = 0;
+    unsigned long bytes_out = 0;
+  } m_stats;
+
+  bool inject(int percent);
+  void send(FunctionCode fc, const std::string& message, bool ack_request);
+  void receive();
+  void handle(unsigned char header, FunctionCode fc, const std::string& message);
+  bool command(FunctionCode fc, const std::string& cmd, std::string& reply);
+  void queue_event();
+  void transmit();
+  int timeout_ms();
+};
+
+constexpr int PanelSim::ack_timeout_ms;
+
+PanelSim::PanelSim(sim_options& options) : m_options(options), m_random(options.seed)
+{
+  memset(m_armed, '0', sizeof m_armed);
+  memset(m_alarm, '0', sizeof m_alarm);
+  memset(m_ready, '3', sizeof m_ready);
+  for(int i = 0; i < 32; i++) m_outputs[i] = 0xF0;
+  m_storm_left = 0;
+  m_storm_next = clock::now() + std::chrono::seconds(options.storm_delay_s);
+  m_tx_next = clock::now();
+}
+
+PanelSim::~PanelSim()
+{
+  if(m_options.link.size()) unlink(m_options.link.c_str());
+  if(m_slave >= 0) ::close(m_slave);
+  if(m_master >= 0) ::close(m_master);
+}
+
+// Opens the pseudo terminal
+bool PanelSim::open()
+{
+  m_master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0){
+    perror("Could not open a pseudo terminal");
+    return false;
+  }
+  m_name = ptsname(m_master);
+
+  // Keep the slave side open ourselves, otherwise reading the master fails
+  // (with EIO) whenever openGalaxy has not opened the port.
+  m_slave = ::open(m_name.c_str(), O_RDWR | O_NOCTTY);
+  if(m_slave < 0){
+    perror("Could not open the slave side of the pseudo terminal");
+    return false;
+  }
+  struct termios tio;
+  tcgetattr(m_slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(m_slave, TCSANOW, &tio);
+
+  if(m_options.link.size()){
+    unlink(m_options.link.c_str());
+    if(symlink(m_name.c_str(), m_options.link.c_str()) != 0){
+      perror("Could not create the symbolic link");
+      return false;
+    }
+  }
+
+  printf("Galaxy panel simulator on %s", m_name.c_str());
+  if(m_options.link.size()) printf(" (%s)", m_options.link.c_str());
+  printf("\n");
+  return true;
+}
+
+// Returns true 'percent' % of the time
+bool PanelSim::inject(int percent)
+{
+  if(percent <= 0) return false;
+  return (int)(m_random() % 100) < percent;
+}
+
+// Sends a SIA block and waits for the time it takes to send it at the set baudrate
+void PanelSim::send(FunctionCode fc, const std::string& message, bool ack_request)
+{
+  SiaBlock sia;
+  size_t len = (message.size() > SiaBlock::datablock_max) ? SiaBlock::datablock_max : message.size();
+  sia.block.header.block_length = len;
+  sia.block.header.acknoledge_request = ack_request ? 1 : 0;
+  sia.block.function_code = fc;
+  memcpy(sia.block.message, message.data(), len);
+  sia.GenerateParity();
+  if(inject(m_options.parity_errors)){
+    sia.block.parity ^= 0x5A;
+    m_stats.bad_parity_send++;
+  }
+
+  unsigned char buf[SiaBlock::block_max];
+  size_t n = 0;
+  buf[n++] = sia.block.header.data;
+  buf[n++] = (unsigned char)sia.block.function_code;
+  memcpy(&buf[n], sia.block.message, len);
+  n += len;
+  buf[n++] = sia.block.parity;
+
+  for(size_t done = 0; done < n; ){
+    ssize_t w = ::write(m_master, buf + done, n - done);
+    if(w <= 0) break;
+    done += w;
+  }
+  m_stats.bytes_out += n;
+
+  // 10 bits per byte (8N1)
+  std::this_thread::sleep_for(std::chrono::microseconds(n * 10 * 1000000LL / m_options.baudrate));
+}
+
+// Reads from the pseudo terminal and handles every complete block
+void PanelSim::receive()
+{
+  unsigned char buf[256];
+  ssize_t n = ::read(m_master, buf, sizeof buf);
+  if(n <= 0) return;
+  m_stats.bytes_in += n;
+  m_rx.append((char*)buf, n);
+
+  while(m_rx.size() >= (size_t)SiaBlock::block_overhead){
+    size_t size = (m_rx[0] & SiaBlock::blockheader_length_mask) + SiaBlock::block_overhead;
+    if(m_rx.size() < size) break;
+
+    unsigned char parity = 0xFF;
+    for(size_t i = 0; i < size - 1; i++) parity ^= (unsigned char)m_rx[i];
+    if(parity != (unsigned char)m_rx[size - 1]){
+      // Resynchronize one byte at a time, like the receiver does
+      m_stats.bad_parity_received++;
+      m_rx.erase(0, 1);
+      send(FunctionCode::reject, "", false);
+      continue;
+    }
+
+    handle((unsigned char)m_rx[0], (FunctionCode)m_rx[1], m_rx.substr(2, size - SiaBlock::block_overhead));
+    m_rx.erase(0, size);
+  }
+}
+
+// Handles a block received from openGalaxy
+void PanelSim::handle(unsigned char header, FunctionCode fc, const std::string& message)
+{
+  clock::time_point now = clock::now();
+
+  switch(fc){
+
+    case FunctionCode::acknoledge:
+    case FunctionCode::alt_acknoledge:
+      if(m_tx_waiting){
+        std::chrono::duration<double,std::milli> ms = now - m_tx_sent;
+        m_stats.acks++;
+        m_stats.ack_ms_total += ms.count();
+        if(ms.count() > m_stats.ack_ms_max) m_stats.ack_ms_max = ms.count();
+        m_tx.pop_front();
+        m_tx_waiting = false;
+        m_tx_retry = 0;
+        m_tx_next = now + std::chrono::milliseconds(m_options.block_gap_ms);
+      }
+      return;
+
+    case FunctionCode::reject:
+    case FunctionCode::alt_reject:
+      if(m_tx_waiting){
+        // send it again
+        m_tx_waiting = false;
+        m_tx_retry++;
+        m_stats.event_retries++;
+        m_tx_next = now + std::chrono::milliseconds(m_options.block_gap_ms);
+      }
+      return;
+
+    case FunctionCode::remote_login:
+      if(inject(m_options.drops)){
+        m_stats.dropped++;
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(m_options.reply_delay_ms));
+      if(message == m_options.remote_code){
+        m_stats.logins++;
+        m_logged_in = true;
+        m_session_last = now;
+        send(FunctionCode::configuration, "AL4", false);
+      }
+      else {
+        m_stats.login_failures++;
+        m_logged_in = false;
+        send(FunctionCode::reject, "", false);
+      }
+      return;
+
+    case FunctionCode::control:
+    case FunctionCode::extended: {
+      m_stats.commands++;
+      if(inject(m_options.drops)){
+        m_stats.dropped++;
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(m_options.reply_delay_ms));
+      if(
+        m_logged_in == false ||
+        now - m_session_last > std::chrono::seconds(m_options.session_timeout_s) ||
+        inject(m_options.rejects)
+      ){
+        m_logged_in = false;
+        m_stats.rejected++;
+        send(FunctionCode::reject, "", false);
+        return;
+      }
+      m_session_last = now;
+      std::string reply;
+      if(command(fc, message, reply) == false){
+        m_stats.unknown++;
+        m_stats.rejected++;
+        send(FunctionCode::reject, "", false);
+      }
+      else if(reply.size()){
+        m_stats.replies++;
+        send(fc, reply, false);
+      }
+      else {
+        m_stats.acknoledged++;
+        send(FunctionCode::acknoledge, "", false);
+      }
+      return;
+    }
+
+    default:
+      if(header & SiaBlock::blockheader_flag_ack_request) send(FunctionCode::acknoledge, "", false);
+      return;
+  }
+}
+
+// Executes a command, 'reply' is left empty when the answer is an acknoledge
+// Returns false for unknown commands
+bool PanelSim::command(FunctionCode fc, const std::string& cmd, std::string& reply)
+{
+  const char *s = cmd.c_str();
+  const char *star = strchr(s, '*');
+  char buf[64];
+
+  if(fc == FunctionCode::control){
+
+    // Areas
+    if(strncmp(s, "SA", 2) == 0){
+      if(cmd == "SA"){
+        reply = "SA*" + std::string(m_armed, 32);
+      }
+      else if(cmd == "SA91"){
+        reply = "SA91*" + std::string(m_alarm, 32);
+      }
+      else if(cmd == "SA92"){
+        reply = "SA92*" + std::string(m_ready, 32);
+      }
+      else if(star == nullptr){
+        int area = atoi(s + 2);
+        if(area < 1 || area > 32) return false;
+        snprintf(buf, sizeof buf, "SA%d*%c", area, m_armed[area - 1]);
+        reply = buf;
+      }
+      else {
+        int area = (star == s + 2) ? 0 : atoi(s + 2);
+        int action = atoi(star + 1);
+        if(area < 0 || area > 32 || action < 0 || action > 5) return false;
+        for(int i = (area ? area - 1 : 0); i < (area ? area : 32); i++){
+          switch(action){
+            case 0: m_armed[i] = '0'; m_ready[i] = '3'; break;           // unset
+            case 1: case 5: m_armed[i] = '1'; m_ready[i] = '1'; break;   // (force) set
+            case 2: m_armed[i] = '2'; m_ready[i] = '2'; break;           // part set
+            case 3: m_alarm[i] = '0'; break;                             // reset
+            default: break;                                              // abort set
+          }
+        }
+      }
+      return true;
+    }
+
+    // Zone omit state
+    if(strncmp(s, "SB", 2) == 0){
+      unsigned int zone = atoi(s + 2);
+      if(star == nullptr){
+        snprintf(buf, sizeof buf, "SB%04u*%d", zone, m_omitted[zone]);
+        reply = buf;
+      }
+      else m_omitted[zone] = atoi(star + 1);
+      return true;
+    }
+
+    // Outputs
+    if(strncmp(s, "OR", 2) == 0){
+      if(cmd == "OR1000"){
+        reply = "OR1000*" + std::string((const char*)m_outputs, 32);
+      }
+      else if(cmd.compare(0, 7, "OR1000*") == 0 || cmd.compare(0, 7, "OR1001*") == 0){
+        // One byte per RIO, the high nibble selects the outputs to change
+        size_t base = (cmd[5] == '1') ? 16 : 0;
+        for(size_t i = 7; i < cmd.size() && base + i - 7 < 32; i++){
+          unsigned char c = cmd[i];
+          unsigned char mask = c >> 4;
+          unsigned char &o = m_outputs[base + i - 7];
+          o = 0xF0 | ((o & ~mask) & 0x0F) | (c & mask);
+        }
+      }
+      else if(star == nullptr) return false;
+      else {
+        // by type (and area): switch all outputs
+        bool on = atoi(star + 1) != 0;
+        for(int i = 0; i < 32; i++) m_outputs[i] = on ? 0xFF : 0xF0;
+      }
+      return true;
+    }
+
+    return false;
+  }
+
+  // Extended blocks
+
+  if(strncmp(s, "ZS", 2) == 0){
+    if(star){
+      return true; // zone programming
+    }
+    // All zones: ZS1, ZS2 (ready state) or ZSx01, ZSx02
+    if(cmd == "ZS1" || (cmd.size() == 5 && cmd.compare(3, 2, "01") == 0)){
+      reply = cmd + "*" + std::string(35, '\0');
+      return true;
+    }
+    if(cmd == "ZS2" || (cmd.size() == 5 && cmd.compare(3, 2, "02") == 0)){
+      reply = cmd + "*" + std::string(33, '\0');
+      return true;
+    }
+    // A single zone (closed)
+    snprintf(buf, sizeof buf, "ZS%04u*1", (unsigned int)atoi(s + 2));
+    reply = buf;
+    return true;
+  }
+
+  if(strncmp(s, "EV", 2) == 0){
+    if(star == nullptr) reply = "EV0*0"; // no events waiting to be send
+    return true;
+  }
+
+  return false;
+}
+
+// Queues the blocks of the next event of a storm
+void PanelSim::queue_event()
+{
+  static const struct {
+    const char *code;
+    const char *ascii;
+    bool zone;
+  } events[] = {
+    { "BA", "+Intruder", true },
+    { "BR", "-Intruder", true },
+    { "CL", "+Closing", false },
+    { "OP", "-Opening", false },
+    { "TA", "+Tamper", true },
+    { "TR", "-Tamper", true }
+  };
+
+  int n = m_event_count++;
+  int e = n % (sizeof(events) / sizeof(events[0]));
+  int area = 1 + (n / 2) % 32;
+  unsigned int zone = 1001 + (n % 8) + 10 * ((n / 8) % 16);
+
+  time_t t = time(nullptr);
+  struct tm tm;
+  localtime_r(&t, &tm);
+
+  char account[16], event[64], ascii[64];
+  snprintf(account, sizeof account, "%04u", m_options.account);
+  if(events[e].zone){
+    snprintf(event, sizeof event, "ti%02d:%02d/ri%d/%s%u", tm.tm_hour, tm.tm_min, area, events[e].code, zone);
+    snprintf(ascii, sizeof ascii, "%s zone %u", events[e].ascii, zone);
+  }
+  else {
+    snprintf(event, sizeof event, "ti%02d:%02d/id%03d/ri%d/%s%d", tm.tm_hour, tm.tm_min, 1 + n % 99, area, events[e].code, area);
+    snprintf(ascii, sizeof ascii, "%s area %d", events[e].ascii, area);
+  }
+
+  // Keep the model in step with the events
+  if(strcmp(events[e].code, "BA") == 0) m_alarm[area - 1] = '1';
+  else if(strcmp(events[e].code, "CL") == 0) m_armed[area - 1] = '1';
+  else if(strcmp(events[e].code, "OP") == 0){ m_armed[area - 1] = '0'; m_alarm[area - 1] = '0'; }
+
+  m_tx.push_back({ FunctionCode::account_id, account, n });
+  m_tx.push_back({ FunctionCode::new_event, event, n });
+  m_tx.push_back({ FunctionCode::ascii, ascii, n });
+  m_stats.events++;
+}
+
+// Sends the next event block when it is due, or again when it was not acknoledged in time
+void PanelSim::transmit()
+{
+  clock::time_point now = clock::now();
+
+  // Start a new storm?
+  if(m_options.storm > 0 && m_storm_left == 0 && now >= m_storm_next){
+    m_storm_left = m_options.storm;
+    m_event_next = now;
+    if(m_options.storm_every_s > 0) m_storm_next = now + std::chrono::seconds(m_options.storm_every_s);
+    else m_storm_next = clock::time_point::max();
+    printf("Sending a storm of %d events\n", m_options.storm);
+  }
+  if(m_storm_left > 0 && now >= m_event_next){
+    queue_event();
+    m_storm_left--;
+    m_event_next += std::chrono::microseconds(1000000 / (m_options.rate > 0 ? m_options.rate : 1));
+  }
+
+  if(m_tx.empty()) return;
+
+  if(m_tx_waiting){
+    if(now - m_tx_sent < std::chrono::milliseconds(ack_timeout_ms)) return;
+    m_tx_waiting = false;
+    m_stats.event_retries++;
+    if(++m_tx_retry >= SiaBlock::block_retries){
+      // give up on the rest of this event
+      int event = m_tx.front().event;
+      while(m_tx.size() && m_tx.front().event == event) m_tx.pop_front();
+      m_stats.event_failures++;
+      m_tx_retry = 0;
+      return;
+    }
+  }
+  else if(now < m_tx_next) return;
+
+  event_block& b = m_tx.front();
+  send(b.fc, b.message, true);
+  m_stats.event_blocks++;
+  m_tx_waiting = true;
+  m_tx_sent = clock::now();
+}
+
+// Returns how long run() may wait for data before transmit() has work to do
+int PanelSim::timeout_ms()
+{
+  clock::time_point now = clock::now();
+  clock::time_point next = now + std::chrono::milliseconds(100);
+  if(m_options.storm > 0 && m_storm_left == 0 && m_storm_next < next) next = m_storm_next;
+  if(m_storm_left > 0 && m_event_next < next) next = m_event_next;
+  if(m_tx.size()){
+    clock::time_point due = m_tx_waiting ? m_tx_sent + std::chrono::milliseconds(ack_timeout_ms) : m_tx_next;
+    if(due < next) next = due;
+  }
+  long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count();
+  return (ms < 0) ? 0 : (int)ms;
+}
+
+void PanelSim::run(volatile sig_atomic_t& quit)
+{
+  while(!quit){
+    struct pollfd pfd;
+    pfd.fd = m_master;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int n = poll(&pfd, 1, timeout_ms());
+    if(n > 0 && (pfd.revents & POLLIN)) receive();
+    transmit();
+  }
+}
+
+void PanelSim::report()
+{
+  printf("\n");
+  printf("Bytes received/send     : %lu/%lu\n", m_stats.bytes_in, m_stats.bytes_out);
+  printf("Remote logins           : %lu (%lu with a wrong code)\n", m_stats.logins, m_stats.login_failures);
+  printf("Commands                : %lu\n", m_stats.commands);
+  printf(" answered with data     : %lu\n", m_stats.replies);
+  printf(" acknoledged            : %lu\n", m_stats.acknoledged);
+  printf(" rejected               : %lu (%lu unknown)\n", m_stats.rejected, m_stats.unknown);
+  printf(" dropped (injected)     : %lu\n", m_stats.dropped);
+  printf("Blocks with bad parity  : %lu received, %lu send (injected)\n", m_stats.bad_parity_received, m_stats.bad_parity_send);
+  printf("Events                  : %lu (%lu blocks, %lu retries, %lu failed)\n", m_stats.events, m_stats.event_blocks, m_stats.event_retries, m_stats.event_failures);
+  if(m_stats.acks > 0){
+    printf("Event block acknoledge  : %.1f ms average, %.1f ms max\n", m_stats.ack_ms_total / m_stats.acks, m_stats.ack_ms_max);
+  }
+}
+
+} // ends namespace openGalaxy
+
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int)
+{
+  quit = 1;
+}
+
+static struct option cmd_line_options[] = {
+  { "help",            no_argument,       nullptr, 'h' },
+  { "link",            required_argument, nullptr, 'l' },
+  { "code",            required_argument, nullptr, 'c' },
+  { "account",         required_argument, nullptr, 'a' },
+  { "baudrate",        required_argument, nullptr, 'b' },
+  { "reply-delay",     required_argument, nullptr, 'd' },
+  { "session-timeout", required_argument, nullptr, 't' },
+  { "storm",           required_argument, nullptr, 's' },
+  { "rate",            required_argument, nullptr, 'r' },
+  { "storm-every",     required_argument, nullptr, 'e' },
+  { "storm-delay",     required_argument, nullptr, 'w' },
+  { "block-gap",       required_argument, nullptr, 'g' },
+  { "parity-errors",   required_argument, nullptr, 'P' },
+  { "drop",            required_argument, nullptr, 'D' },
+  { "reject",          required_argument, nullptr, 'R' },
+  { "seed",            required_argument, nullptr, 'S' },
+  { NULL, 0, 0, 0 }
+};
+
+static const char* synopsis =
+  "\n"
+  "Synopsis: opengalaxy-panel-sim [options]\n"
+  "\n"
+  " -h or --help\t\t\tPrints this help text and exit.\n"
+  " -l or --link <path>\t\tCreate a symbolic link to the pseudo terminal.\n"
+  " -c or --code <code>\t\tThe remote code (default 543210).\n"
+  " -a or --account <nr>\t\tThe SIA account number (default 1234).\n"
+  " -b or --baudrate <baud>\tThe simulated line speed (default 9600).\n"
+  " -d or --reply-delay <ms>\tTime to process a command (default 20).\n"
+  " -t or --session-timeout <s>\tEnd an idle remote login (default 30).\n"
+  " -s or --storm <n>\t\tSend storms of n events (default 0).\n"
+  " -r or --rate <n>\t\tEvents per second during a storm (default 5).\n"
+  " -e or --storm-every <s>\tRepeat the storm every s seconds (default once).\n"
+  " -w or --storm-delay <s>\tWait before the first storm (default 5).\n"
+  " -g or --block-gap <ms>\t\tTime between the blocks of an event (default 50).\n"
+  " -P or --parity-errors <%>\tSend % of the blocks with a bad parity.\n"
+  " -D or --drop <%>\t\tDo not answer % of the commands.\n"
+  " -R or --reject <%>\t\tReject % of the commands.\n"
+  " -S or --seed <n>\t\tSeed for the error injection (default 1).\n"
+  "\n";
+
+int main(int argc, char *argv[])
+{
+  using namespace openGalaxy;
+
+  sim_options options;
+  int n, opt_index;
+  while((n = getopt_long(argc, argv, "hl:c:a:b:d:t:s:r:e:w:g:P:D:R:S:", cmd_line_options, &opt_index)) >= 0){
+    switch(n){
+      case 'l': options.link = optarg; break;
+      case 'c': options.remote_code = optarg; break;
+      case 'a': options.account = strtoul(optarg, nullptr, 10); break;
+      case 'b': options.baudrate = atoi(optarg); break;
+      case 'd': options.reply_delay_ms = atoi(optarg); break;
+      case 't': options.session_timeout_s = atoi(optarg); break;
+      case 's': options.storm = atoi(optarg); break;
+      case 'r': options.rate = atoi(optarg); break;
+      case 'e': options.storm_every_s = atoi(optarg); break;
+      case 'w': options.storm_delay_s = atoi(optarg); break;
+      case 'g': options.block_gap_ms = atoi(optarg); break;
+      case 'P': options.parity_errors = atoi(optarg); break;
+      case 'D': options.drops = atoi(optarg); break;
+      case 'R': options.rejects = atoi(optarg); break;
+      case 'S': options.seed = strtoul(optarg, nullptr, 10); break;
+      default:
+        printf("%s", synopsis);
+        return (n == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if(options.baudrate < 300) options.baudrate = 300;
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  PanelSim sim(options);
+  if(sim.open() == false) return EXIT_FAILURE;
+  sim.run(quit);
+  sim.report();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+/* This file is part of openGalaxy.
+ *
+ * opengalaxy - a SIA receiver for Galaxy security control panels.
+ * Copyright (C) 2015 - 2016 Alexander Bruines <alexander.bruines@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * as published by the Free Software Foundation, or (at your option)
+ * any later version.
+ *
+ * In addition, as a special exception, the author of this program
+ * gives permission to link the code of its release with the OpenSSL
+ * project's "OpenSSL" library (or with modified versions of it that
+ * use the same license as the "OpenSSL" library), and distribute the
+ * linked executables. You must obey the GNU General Public License
+ * in all respects for all of the code used other than "OpenSSL".
+ * If you modify this file, you may extend this exception to your
+ * version of the file, but you are not obligated to do so.
+ * If you do not wish to do so, delete this exception statement
+ * from your version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// syslog-test - Checks how class Syslog captures the arguments of a message
+//
+// Syslog copies the arguments of a message into the ring buffer of the
+// calling thread and formats them on the log thread. This checks that the
+// formatted text matches what snprintf() makes of the same format and that
+// a string with a precision ("%.4s" or "%.*s") is not read past that
+// precision, it does not have to be nul terminated. The unterminated
+// string is placed at the end of a page that is followed by an inaccessible
+// page, so reading past it crashes the test.
+//
+// Built and run by 'make check'.
+//
+
+#include "atomic.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Syslog.hpp"
+
+using namespace openGalaxy;
+
+static int failures = 0;
+
+static void check( bool ok, const char *what )
+{
+  if( !ok ){
+    fprintf( stderr, "FAILED: %s\n", what );
+    failures++;
+  }
+}
+
+int main()
+{
+  // Put "ABCDEFGH" (without a nul) at the end of a page followed by a
+  // page that can not be read
+  long page = sysconf( _SC_PAGESIZE );
+  char *map = (char*)mmap( nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( map == MAP_FAILED || mprotect( map + page, page, PROT_NONE ) != 0 ){
+    perror( "syslog-test" );
+    return EXIT_FAILURE;
+  }
+  char *text = map + page - 8;
+  memcpy( text, "ABCDEFGH", 8 );
+
+  // Syslog writes to std::cout
+  std::ostringstream out;
+  std::streambuf *cout_buf = std::cout.rdbuf( out.rdbuf() );
+  {
+    Syslog log( Syslog::Level::Debug );
+    log.print( "1[%.*s]", 4, text );
+    log.print( "2[%.8s]", text );
+    log.print( "3[%-6.*s]", 3, text + 5 );
+    log.print( "4[%*.*s]", 6, 2, text );
+    log.print( "5[%.*s]", -1, "negative" );
+    log.print( "6[%.20s]", "short" );
+    log.print( "7[%s|%d]", "plain", 42 );
+    log.flush();
+  }
+  std::cout.rdbuf( cout_buf );
+
+  std::string s = out.str();
+  check( s.find( "1[ABCD]" ) != std::string::npos, "%.*s with an unterminated string" );
+  check( s.find( "2[ABCDEFGH]" ) != std::string::npos, "%.8s with an unterminated string" );
+  check( s.find( "3[FGH   ]" ) != std::string::npos, "%-6.*s with an unterminated string" );
+  check( s.find( "4[    AB]" ) != std::string::npos, "%*.*s with an unterminated string" );
+  check( s.find( "5[negative]" ) != std::string::npos, "%.*s with a negative precision" );
+  check( s.find( "6[short]" ) != std::string::npos, "%.20s with a shorter string" );
+  check( s.find( "7[plain|42]" ) != std::string::npos, "%s and %d" );
+
+  munmap( map, 2 * page );
+  if( failures ){
+    fprintf( stderr, "%s", s.c_str() );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
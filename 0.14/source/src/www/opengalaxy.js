@@ -33,6 +33,7 @@
 
 var socket_commander = null; // Websocket
 var session_id = 0;          // Our session ID
+var sia_last_seq = 0;        // Sequence number of the last SIA message received
 
 var Pending_alarms_empty_string = ''; // String used for empty table fields
 var Pending_alarms_x_filler = 0;      // width to make the Pending-Alarms-Dialog-??_x_filler classes (dynamicly initialised)
@@ -129,6 +130,18 @@ function send( cmd ) {
  }
 }
 
+/////////////////////////////////////////////////////////////////////
+// Adds a received SIA message to the table, unless it was already //
+// received before a RESUME after reconnecting                     //
+/////////////////////////////////////////////////////////////////////
+function sia_receive( result ){
+  if( result.seq ) {
+    if( result.seq <= sia_last_seq ) return;
+    sia_last_seq = result.seq;
+  }
+  table_prepend( result.sia );
+}
+
 ///////////////////////////////////////////////////////////////////
 // This function adds a SIA message to the table of SIA messages //
 ///////////////////////////////////////////////////////////////////
@@ -1078,6 +1091,9 @@ function SocketCommander_OnOpen()
   $( "#ws_url_status" ).css( "color", "green" );
   // Set command status to 'idle'
   SocketStatus_SetCommandStatus( "Idle", "ui-state-active", "green", 0 );
+  // Ask for the SIA messages we missed while we were disconnected
+  // (the server waits for us to login before answering)
+  if( sia_last_seq ) socket_commander.send( 'RESUME ' + sia_last_seq );
 } 
 
 //////////////////////////////////////////////////////////////
@@ -1105,10 +1121,18 @@ function SocketCommander_OnMessage(msg)
   $( "#json" ).html( msg.data );
   var result = jQuery.parseJSON( $( "#json" ).html() );
 
+  // SIA messages may arrive coalesced into a single array
+  if( $.isArray( result ) ) {
+    for( var i = 0; i < result.length; i++ ) {
+      if( result[i].typeId == JSON_SIA_MESSAGE ) sia_receive( result[i] );
+    }
+    return;
+  }
+
   switch( result.typeId ) {
 
     case JSON_SIA_MESSAGE:
-      table_prepend( result.sia );
+      sia_receive( result );
       break;
 
     case JSON_HELP_REPLY: